@@ -0,0 +1,359 @@
+#include "Config.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#include "common/String.h"
+#include "common/Platform.h"
+#include "common/tpt-rand.h"
+#include "json/json.h"
+
+#include "client/GameSave.h"
+#include "graphics/Graphics.h"
+#include "graphics/Renderer.h"
+#include "simulation/ElementGraphics.h"
+#include "simulation/Simulation.h"
+#include "simulation/Air.h"
+#include "simulation/Gravity.h"
+#include "simulation/HeatField.h"
+
+using BenchClock = std::chrono::steady_clock;
+
+static uint64_t Nanoseconds(BenchClock::duration duration)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+}
+
+static double Milliseconds(uint64_t nanoseconds)
+{
+	return nanoseconds / 1e6;
+}
+
+static bool ReadFile(ByteString filename, std::vector<char> &storage)
+{
+	std::ifstream fileStream(filename.c_str(), std::ios::binary);
+	if (!fileStream.is_open())
+		return false;
+	storage.assign(std::istreambuf_iterator<char>(fileStream), std::istreambuf_iterator<char>());
+	return true;
+}
+
+// FNV-1a over every live particle, so runs with the same seed can be compared for determinism
+static uint64_t ParticleChecksum(const Simulation *sim)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	auto mix = [&hash](const void *data, size_t size) {
+		auto *bytes = reinterpret_cast<const unsigned char *>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+	};
+	for (int i = 0; i <= sim->parts_lastActiveIndex; i++)
+	{
+		if (sim->parts[i].type)
+		{
+			mix(&i, sizeof(i));
+			mix(&sim->parts[i], sizeof(Particle));
+		}
+	}
+	return hash;
+}
+
+// FNV-1a over the pixels drawn by the renderer
+static uint64_t FrameChecksum(const Renderer *ren)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	auto *bytes = reinterpret_cast<const unsigned char *>(ren->vid);
+	for (size_t i = 0; i < size_t(WINDOWW * WINDOWH) * sizeof(pixel); i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static void Usage(const char *argv0)
+{
+	std::cerr << "Usage: " << argv0 << " [-t ticks] [-s seed] [-p] [-i] [-z] [-a] [-f] [-g] [-d] [-r frames] <save, stamp or directory>..." << std::endl;
+	std::cerr << "  -p  update particles on several threads (checksums differ from the serial update)" << std::endl;
+	std::cerr << "  -i  keep pmap up to date incrementally instead of rebuilding it every tick (checksums differ too)" << std::endl;
+	std::cerr << "  -z  let static areas sleep (checksums differ too)" << std::endl;
+	std::cerr << "  -a  update air and the heat field on one thread without SIMD (checksums are the same, except in" << std::endl;
+	std::cerr << "      release builds, where fast math lets the compiler reorder the scalar code)" << std::endl;
+	std::cerr << "  -f  conduct heat with the heat field in every save, as if fast heat was enabled in it (checksums differ)" << std::endl;
+	std::cerr << "  -g  solve Newtonian gravity on the main thread, so that the gravity phase includes the solver" << std::endl;
+	std::cerr << "      and results with it enabled are reproducible" << std::endl;
+	std::cerr << "  -d  only add the field of changed cells when few cells change mass (checksums with -g differ)" << std::endl;
+	std::cerr << "  -r  render each save this many times once it has been simulated, with the default render modes," << std::endl;
+	std::cerr << "      fire and gravity lensing" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	int ticks = 1000;
+	unsigned int seed = 0;
+	bool parallel = false;
+	bool incrementalPmap = false;
+	bool sleepingCells = false;
+	bool scalarAir = false;
+	bool fastHeat = false;
+	bool synchronousGravity = false;
+	bool sparseGravity = false;
+	int renderFrames = 0;
+	std::vector<ByteString> inputFilenames;
+	for (int i = 1; i < argc; i++)
+	{
+		ByteString arg = argv[i];
+		if ((arg == "-t" || arg == "-s" || arg == "-r") && i + 1 < argc)
+		{
+			auto value = strtoul(argv[++i], nullptr, 10);
+			if (arg == "-t")
+				ticks = int(value);
+			else if (arg == "-r")
+				renderFrames = int(value);
+			else
+				seed = (unsigned int)value;
+		}
+		else if (arg == "-p")
+		{
+			parallel = true;
+		}
+		else if (arg == "-i")
+		{
+			incrementalPmap = true;
+		}
+		else if (arg == "-z")
+		{
+			sleepingCells = true;
+		}
+		else if (arg == "-a")
+		{
+			scalarAir = true;
+		}
+		else if (arg == "-f")
+		{
+			fastHeat = true;
+		}
+		else if (arg == "-g")
+		{
+			synchronousGravity = true;
+		}
+		else if (arg == "-d")
+		{
+			sparseGravity = true;
+		}
+		else if (arg.size() && arg[0] == '-')
+		{
+			Usage(argv[0]);
+			return 1;
+		}
+		else if (Platform::DirectoryExists(arg))
+		{
+			for (auto &name : Platform::DirectorySearch(arg, "", { ".cps", ".stm" }))
+			{
+				inputFilenames.push_back(arg + PATH_SEP + name);
+			}
+		}
+		else
+		{
+			inputFilenames.push_back(arg);
+		}
+	}
+	if (!inputFilenames.size() || ticks <= 0)
+	{
+		Usage(argv[0]);
+		return 1;
+	}
+
+	Simulation *sim = new Simulation();
+	sim->parallelUpdate = parallel;
+	sim->incrementalPmap = incrementalPmap;
+	sim->sleepingCells = sleepingCells;
+	sim->air->scalarUpdate = scalarAir;
+	if (scalarAir)
+		sim->GetHeatField().scalarUpdate = true;
+	sim->grav->synchronous = synchronousGravity;
+	sim->grav->sparseUpdates = sparseGravity;
+	Renderer *ren = nullptr;
+	if (renderFrames > 0)
+	{
+		// Same render modes as a new GameModel
+		ren = new Renderer(new Graphics(), sim);
+		ren->SetRenderMode({ RENDER_FIRE, RENDER_EFFE, RENDER_BASC });
+		ren->SetDisplayMode({});
+		ren->SetColourMode(0);
+	}
+	SimulationPhaseTimes totalPhaseTimes;
+	uint64_t totalParticleLoop = 0, totalTick = 0, totalParticleTicks = 0;
+	int totalTicks = 0;
+
+	Json::Value results(Json::arrayValue);
+	for (auto &inputFilename : inputFilenames)
+	{
+		Json::Value result;
+		result["file"] = inputFilename;
+
+		std::vector<char> inputFile;
+		GameSave *gameSave = nullptr;
+		try
+		{
+			if (!ReadFile(inputFilename, inputFile))
+				throw ParseException(ParseException::InternalError, "Cannot read file");
+			gameSave = new GameSave(inputFile);
+		}
+		catch (ParseException &e)
+		{
+			result["error"] = e.what();
+			results.append(result);
+			continue;
+		}
+
+		// Same option handling as GameModel::SetSave, so the save runs the way it would in the game
+		sim->gravityMode = gameSave->gravityMode;
+		sim->customGravityX = gameSave->customGravityX;
+		sim->customGravityY = gameSave->customGravityY;
+		sim->air->airMode = gameSave->airMode;
+		sim->air->ambientAirTemp = gameSave->ambientAirTemp;
+		sim->edgeMode = gameSave->edgeMode;
+		sim->legacy_enable = gameSave->legacyEnable;
+		sim->water_equal_test = gameSave->waterEEnabled;
+		sim->aheat_enable = gameSave->aheatEnable;
+		sim->fastHeat = gameSave->fastHeat || fastHeat;
+		if (gameSave->gravityEnable)
+			sim->grav->start_grav_async();
+		else
+			sim->grav->stop_grav_async();
+		sim->clear_sim();
+		RNG::Ref().seed(seed);
+		random_gen.seed(seed);
+		if (ren)
+			ren->rng.seed(seed);
+		if (sim->Load(gameSave, true))
+		{
+			result["error"] = "Cannot load save";
+			results.append(result);
+			delete gameSave;
+			continue;
+		}
+		delete gameSave;
+
+		SimulationPhaseTimes phaseTimes;
+		sim->phaseTimes = &phaseTimes;
+		sim->sys_pause = 0;
+		uint64_t particleLoop = 0, particleTicks = 0;
+		auto start = BenchClock::now();
+		for (int tick = 0; tick < ticks; tick++)
+		{
+			sim->BeforeSim();
+			auto particleLoopStart = BenchClock::now();
+			sim->UpdateParticles(0, NPART);
+			particleLoop += Nanoseconds(BenchClock::now() - particleLoopStart);
+			sim->AfterSim();
+			particleTicks += sim->NUM_PARTS;
+		}
+		uint64_t tickTotal = Nanoseconds(BenchClock::now() - start);
+		sim->phaseTimes = nullptr;
+
+		result["ticks"] = ticks;
+		result["particles"] = sim->NUM_PARTS;
+		// Unless -g is given, the Newtonian gravity solver runs on its own thread and results with it enabled are not reproducible
+		result["newtonian_gravity"] = sim->grav->IsEnabled();
+		result["ticks_per_second"] = ticks / (tickTotal / 1e9);
+		result["ns_per_particle"] = particleTicks ? double(particleLoop) / particleTicks : 0.0;
+		result["checksum"] = ByteString::Build(Format::Hex(), ParticleChecksum(sim));
+		Json::Value phases;
+		phases["air"] = Milliseconds(phaseTimes.air);
+		phases["gravity"] = Milliseconds(phaseTimes.gravity);
+		phases["recalc_free_particles"] = Milliseconds(phaseTimes.recalcFreeParticles);
+		phases["gol"] = Milliseconds(phaseTimes.gol);
+		phases["heat"] = Milliseconds(phaseTimes.heat);
+		phases["particle_loop"] = Milliseconds(particleLoop);
+		phases["total"] = Milliseconds(tickTotal);
+		result["phases_ms"] = phases;
+
+		if (ren)
+		{
+			// Particles and fire are drawn the way RenderBegin draws them, the gravity lensing
+			// of DISPLAY_WARP then adds the result to a cleared screen
+			uint64_t renderParts = 0, renderFire = 0, gravityLensing = 0;
+			for (int frame = 0; frame < renderFrames; frame++)
+			{
+				ren->clearScreen(1.0f);
+				auto partsStart = BenchClock::now();
+				ren->render_parts();
+				auto fireStart = BenchClock::now();
+				ren->render_fire();
+				auto fireEnd = BenchClock::now();
+				std::copy(ren->vid, ren->vid + WINDOWW * WINDOWH, ren->warpVid);
+				ren->clearScreen(1.0f);
+				auto lensingStart = BenchClock::now();
+				ren->render_gravlensing(ren->warpVid);
+				gravityLensing += Nanoseconds(BenchClock::now() - lensingStart);
+				renderParts += Nanoseconds(fireStart - partsStart);
+				renderFire += Nanoseconds(fireEnd - fireStart);
+			}
+			Json::Value render;
+			render["frames"] = renderFrames;
+			render["checksum"] = ByteString::Build(Format::Hex(), FrameChecksum(ren));
+			Json::Value renderPhases;
+			renderPhases["render_parts"] = Milliseconds(renderParts);
+			renderPhases["render_fire"] = Milliseconds(renderFire);
+			renderPhases["gravity_lensing"] = Milliseconds(gravityLensing);
+			render["phases_ms"] = renderPhases;
+			result["render"] = render;
+		}
+		results.append(result);
+
+		totalPhaseTimes.air += phaseTimes.air;
+		totalPhaseTimes.gravity += phaseTimes.gravity;
+		totalPhaseTimes.recalcFreeParticles += phaseTimes.recalcFreeParticles;
+		totalPhaseTimes.gol += phaseTimes.gol;
+		totalPhaseTimes.heat += phaseTimes.heat;
+		totalParticleLoop += particleLoop;
+		totalTick += tickTotal;
+		totalParticleTicks += particleTicks;
+		totalTicks += ticks;
+	}
+	sim->grav->stop_grav_async();
+
+	Json::Value root;
+	root["seed"] = seed;
+	root["parallel"] = parallel;
+	root["incremental_pmap"] = incrementalPmap;
+	root["sleeping_cells"] = sleepingCells;
+	root["scalar_air"] = scalarAir;
+	root["fast_heat"] = fastHeat;
+	root["synchronous_gravity"] = synchronousGravity;
+	root["sparse_gravity"] = sparseGravity;
+	root["render_frames"] = renderFrames;
+	root["saves"] = results;
+	Json::Value total;
+	total["ticks"] = totalTicks;
+	total["ticks_per_second"] = totalTick ? totalTicks / (totalTick / 1e9) : 0.0;
+	total["ns_per_particle"] = totalParticleTicks ? double(totalParticleLoop) / totalParticleTicks : 0.0;
+	Json::Value phases;
+	phases["air"] = Milliseconds(totalPhaseTimes.air);
+	phases["gravity"] = Milliseconds(totalPhaseTimes.gravity);
+	phases["recalc_free_particles"] = Milliseconds(totalPhaseTimes.recalcFreeParticles);
+	phases["gol"] = Milliseconds(totalPhaseTimes.gol);
+	phases["heat"] = Milliseconds(totalPhaseTimes.heat);
+	phases["particle_loop"] = Milliseconds(totalParticleLoop);
+	phases["total"] = Milliseconds(totalTick);
+	total["phases_ms"] = phases;
+	root["total"] = total;
+	std::cout << root << std::endl;
+
+	if (ren)
+	{
+		Graphics *g = ren->g;
+		delete ren;
+		delete g;
+	}
+	delete sim;
+	return 0;
+}
@@ -53,6 +53,7 @@
 #include "gui/dialogues/ErrorMessage.h"
 #include "gui/interface/Engine.h"
 #include "gui/interface/Keys.h"
+#include "simulation/SimulationThread.h"
 
 #define INCLUDE_SYSWM
 #include "SDLCompat.h"
@@ -575,6 +576,8 @@ void EngineProcess()
 	int drawingTimer = 0;
 	int frameStart = 0;
 
+	// If the simulation runs on a thread of its own, it is only let in while drawing and waiting for the next frame
+	auto &simThread = SimulationThread::Ref();
 	while(engine->Running())
 	{
 		int oldFrameStart = frameStart;
@@ -582,20 +585,29 @@ void EngineProcess()
 		drawingTimer += frameStart - oldFrameStart;
 
 		if(engine->Broken()) { engine->UnBreak(); break; }
+		simThread.Lock();
 		event.type = 0;
 		while (SDL_PollEvent(&event))
 		{
 			EventProcess(event);
 			event.type = 0; //Clear last event
 		}
-		if(engine->Broken()) { engine->UnBreak(); break; }
+		if(engine->Broken()) { simThread.Unlock(); engine->UnBreak(); break; }
 
 		engine->Tick();
 
 		int drawcap = ui::Engine::Ref().GetDrawingFrequencyLimit();
-		if (!drawcap || drawingTimer > 1000.f/drawcap)
+		bool draw = !drawcap || drawingTimer > 1000.f/drawcap;
+		bool drawLocked = draw && simThread.DrawNeedsLock();
+		if (draw)
+			simThread.TakeSnapshot();
+		if (!drawLocked)
+			simThread.Unlock();
+		if (draw)
 		{
 			engine->Draw();
+			if (drawLocked)
+				simThread.Unlock();
 			drawingTimer = 0;
 
 			if (scale != engine->Scale || fullscreen != engine->Fullscreen ||
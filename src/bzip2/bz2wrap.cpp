@@ -2,6 +2,9 @@
 
 #include "bzlib.h"
 
+#include "common/ThreadPool.h"
+
+#include <cstdint>
 #include <memory>
 #include <functional>
 #include <vector>
@@ -104,3 +107,176 @@ BZ2WDecompressResult BZ2WDecompress(std::vector<char> &dest, const char *srcData
 	dest.resize(stream.total_out_lo32);
 	return BZ2WDecompressOk;
 }
+
+namespace
+{
+	constexpr uint64_t blockMagic = 0x314159265359ULL;
+	constexpr uint64_t endMagic = 0x177245385090ULL;
+	constexpr uint64_t magicMask = 0xFFFFFFFFFFFFULL;
+
+	// The 64 bits starting at byte pos, most significant first, with zeroes past the end
+	uint64_t Read64(const unsigned char *data, size_t size, size_t pos)
+	{
+		uint64_t value = 0;
+		for (size_t i = pos; i < pos + 8; i++)
+		{
+			value = (value << 8) | (i < size ? data[i] : 0U);
+		}
+		return value;
+	}
+
+	uint32_t Read32AtBit(const unsigned char *data, size_t size, uint64_t bit)
+	{
+		return uint32_t(Read64(data, size, size_t(bit >> 3)) >> (32 - (bit & 7)));
+	}
+
+	void PutBits(std::vector<char> &out, uint64_t &bitCount, uint64_t value, int bits)
+	{
+		for (int i = bits - 1; i >= 0; i--)
+		{
+			if (!(bitCount & 7))
+			{
+				out.push_back(0);
+			}
+			if ((value >> i) & 1)
+			{
+				out.back() |= char(0x80 >> (bitCount & 7));
+			}
+			bitCount++;
+		}
+	}
+
+	// Turns the block of a stream in bits [begin, end) into a stream of its own: the header of the original
+	// stream, the block, then an end of stream marker with the block's CRC as the combined CRC
+	void SingleBlockStream(std::vector<char> &out, const unsigned char *data, size_t size, uint64_t begin, uint64_t end)
+	{
+		out.assign(data, data + 4);
+		uint64_t bits = end - begin;
+		size_t first = size_t(begin >> 3);
+		int shift = int(begin & 7);
+		size_t bytes = size_t((bits + 7) >> 3);
+		out.resize(4 + bytes);
+		for (size_t i = 0; i < bytes; i++)
+		{
+			unsigned int high = data[first + i];
+			unsigned int low = first + i + 1 < size ? data[first + i + 1] : 0U;
+			out[4 + i] = char(((high << shift) | (low >> (8 - shift))) & 0xFFU);
+		}
+		if (bits & 7)
+		{
+			out.back() &= char(0xFF00U >> (bits & 7));
+		}
+		uint64_t bitCount = 32 + bits;
+		PutBits(out, bitCount, endMagic, 48);
+		PutBits(out, bitCount, Read32AtBit(data, size, begin + 48), 32);
+	}
+
+	// Bit positions of the block headers of the stream, followed by that of the end of stream marker. Empty
+	// if it does not look like a bzip2 stream. Compressed data can contain either magic number by chance, such
+	// false finds make decompressing a block fail.
+	std::vector<uint64_t> FindBlocks(const unsigned char *data, size_t size)
+	{
+		std::vector<uint64_t> boundaries;
+		if (size < 4 || data[0] != 'B' || data[1] != 'Z' || data[2] != 'h' || data[3] < '1' || data[3] > '9')
+		{
+			return boundaries;
+		}
+		// Which alignments of either magic number the second and third bytes of it would match, bits 0 to 7
+		// for the block header, 8 to 15 for the end of stream marker; most pairs of bytes match neither
+		static const auto candidates = []() {
+			std::vector<uint16_t> table(512, 0);
+			for (int shift = 0; shift < 8; shift++)
+			{
+				table[(blockMagic >> (32 + shift)) & 0xFF] |= uint16_t(1 << shift);
+				table[(endMagic >> (32 + shift)) & 0xFF] |= uint16_t(0x100 << shift);
+				table[256 + ((blockMagic >> (24 + shift)) & 0xFF)] |= uint16_t(1 << shift);
+				table[256 + ((endMagic >> (24 + shift)) & 0xFF)] |= uint16_t(0x100 << shift);
+			}
+			return table;
+		}();
+		for (size_t next = 5; next + 1 < size; next++)
+		{
+			auto match = candidates[data[next]] & candidates[256 + data[next + 1]];
+			if (!match)
+			{
+				continue;
+			}
+			size_t pos = next - 1;
+			uint64_t window = Read64(data, size, pos);
+			for (int shift = 0; shift < 8; shift++)
+			{
+				uint64_t bit = uint64_t(pos) * 8 + shift;
+				// Both are followed by a CRC
+				if (bit + 80 > uint64_t(size) * 8)
+				{
+					break;
+				}
+				uint64_t found = (window >> (16 - shift)) & magicMask;
+				if ((match & (1 << shift)) && found == blockMagic)
+				{
+					boundaries.push_back(bit);
+				}
+				if ((match & (0x100 << shift)) && found == endMagic)
+				{
+					boundaries.push_back(bit);
+					return boundaries;
+				}
+			}
+		}
+		return std::vector<uint64_t>();
+	}
+}
+
+BZ2WDecompressResult BZ2WDecompressParallel(std::vector<char> &dest, const char *srcData, size_t srcSize, size_t maxSize)
+{
+	if (ThreadPool::Ref().ThreadCount() < 2)
+	{
+		return BZ2WDecompress(dest, srcData, srcSize, maxSize);
+	}
+	auto *data = reinterpret_cast<const unsigned char *>(srcData);
+	auto boundaries = FindBlocks(data, srcSize);
+	int blockCount = int(boundaries.size()) - 1;
+	if (blockCount < 2 || boundaries[0] != 32)
+	{
+		return BZ2WDecompress(dest, srcData, srcSize, maxSize);
+	}
+	uint32_t combinedCRC = 0;
+	for (int i = 0; i < blockCount; i++)
+	{
+		combinedCRC = ((combinedCRC << 1) | (combinedCRC >> 31)) ^ Read32AtBit(data, srcSize, boundaries[i] + 48);
+	}
+	if (combinedCRC != Read32AtBit(data, srcSize, boundaries[blockCount] + 48))
+	{
+		return BZ2WDecompress(dest, srcData, srcSize, maxSize);
+	}
+
+	std::vector<std::vector<char>> blocks(blockCount);
+	std::vector<BZ2WDecompressResult> results(blockCount);
+	ThreadPool::Ref().ParallelFor(blockCount, [&](int i) {
+		std::vector<char> stream;
+		SingleBlockStream(stream, data, srcSize, boundaries[i], boundaries[i + 1]);
+		results[i] = BZ2WDecompress(blocks[i], stream.data(), stream.size(), maxSize);
+	});
+	size_t totalSize = 0;
+	for (int i = 0; i < blockCount; i++)
+	{
+		if (results[i] != BZ2WDecompressOk)
+		{
+			// Most likely a magic number that happened to turn up in compressed data, let the whole stream
+			// be decompressed in one go to tell
+			return BZ2WDecompress(dest, srcData, srcSize, maxSize);
+		}
+		totalSize += blocks[i].size();
+	}
+	if (maxSize && totalSize > maxSize)
+	{
+		return BZ2WDecompressLimit;
+	}
+	dest.resize(totalSize);
+	auto *out = dest.data();
+	for (auto &block : blocks)
+	{
+		out = std::copy(block.begin(), block.end(), out);
+	}
+	return BZ2WDecompressOk;
+}
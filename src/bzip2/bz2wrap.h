@@ -21,3 +21,7 @@ enum BZ2WDecompressResult
 	BZ2WDecompressEof,
 };
 BZ2WDecompressResult BZ2WDecompress(std::vector<char> &dest, const char *srcData, size_t srcSize, size_t maxSize = 0);
+// Same as BZ2WDecompress, but decompresses the blocks of the stream on the threads of ThreadPool, which pays off
+// for streams of more than one block, i.e. of more than 900 kB of uncompressed data. Streams it cannot split are
+// decompressed in one go.
+BZ2WDecompressResult BZ2WDecompressParallel(std::vector<char> &dest, const char *srcData, size_t srcSize, size_t maxSize = 0);
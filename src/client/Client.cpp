@@ -619,7 +619,7 @@ ByteString Client::AddStamp(GameSave * saveData)
 	saveData->authors = stampInfo;
 
 	unsigned int gameDataLength;
-	char * gameData = saveData->Serialise(gameDataLength);
+	char * gameData = saveData->Serialise(gameDataLength, GameSave::CompressionZlib);
 	if (gameData == NULL)
 		return "";
 
@@ -7,6 +7,9 @@
 #include <set>
 #include <cmath>
 
+#include <zlib.h>
+
+#include "bzip2/bz2wrap.h"
 #include "bzip2/bzlib.h"
 #include "Config.h"
 #include "Format.h"
@@ -24,6 +27,7 @@ GameSave::GameSave(const GameSave & save):
 	legacyEnable(save.legacyEnable),
 	gravityEnable(save.gravityEnable),
 	aheatEnable(save.aheatEnable),
+	fastHeat(save.fastHeat),
 	paused(save.paused),
 	gravityMode(save.gravityMode),
 	customGravityX(save.customGravityX),
@@ -125,6 +129,7 @@ void GameSave::InitVars()
 	legacyEnable = false;
 	gravityEnable = false;
 	aheatEnable = false;
+	fastHeat = false;
 	paused = false;
 	gravityMode = 0;
 	customGravityX = 0.0f;
@@ -141,6 +146,12 @@ bool GameSave::Collapsed()
 	return !expanded;
 }
 
+const std::vector<char> *GameSave::GetOriginalData() const
+{
+	// Only a collapsed save is sure to still be what it was read from
+	return hasOriginalData && !expanded ? &originalData : nullptr;
+}
+
 void GameSave::Expand()
 {
 	if(hasOriginalData && !expanded)
@@ -171,7 +182,8 @@ void GameSave::read(char * data, int dataSize)
 		}
 		else if(data[0] == 'O' && data[1] == 'P' && data[2] == 'S')
 		{
-			if (data[3] != '1')
+			// OPS1 is compressed with bzip2, OPS2 with zlib
+			if (data[3] != '1' && data[3] != '2')
 				throw ParseException(ParseException::WrongVersion, "Save format from newer version");
 			readOPS(data, dataSize);
 		}
@@ -216,10 +228,10 @@ void GameSave::setSize(int newWidth, int newHeight)
 	ambientHeat = Allocate2DArray<float>(blockWidth, blockHeight, 0.0f);
 }
 
-std::vector<char> GameSave::Serialise()
+std::vector<char> GameSave::Serialise(Compression compression)
 {
 	unsigned int dataSize;
-	char * data = Serialise(dataSize);
+	char * data = Serialise(dataSize, compression);
 	if (data == NULL)
 		return std::vector<char>();
 	std::vector<char> dataVect(data, data+dataSize);
@@ -227,11 +239,11 @@ std::vector<char> GameSave::Serialise()
 	return dataVect;
 }
 
-char * GameSave::Serialise(unsigned int & dataSize)
+char * GameSave::Serialise(unsigned int & dataSize, Compression compression)
 {
 	try
 	{
-		return serialiseOPS(dataSize);
+		return serialiseOPS(dataSize, compression);
 	}
 	catch (BuildException & e)
 	{
@@ -560,7 +572,7 @@ void GameSave::CheckBsonFieldFloat(bson_iterator iter, const char *field, float
 
 void GameSave::readOPS(char * data, int dataLength)
 {
-	unsigned char *inputData = (unsigned char*)data, *bsonData = NULL, *partsData = NULL, *partsPosData = NULL, *fanData = NULL, *wallData = NULL, *soapLinkData = NULL;
+	unsigned char *inputData = (unsigned char*)data, *partsData = NULL, *partsPosData = NULL, *fanData = NULL, *wallData = NULL, *soapLinkData = NULL;
 	unsigned char *pressData = NULL, *vxData = NULL, *vyData = NULL, *ambientData = NULL;
 	unsigned int inputDataLen = dataLength, bsonDataLen = 0, partsDataLen, partsPosDataLen, fanDataLen, wallDataLen, soapLinkDataLen;
 	unsigned int pressDataLen, vxDataLen, vyDataLen, ambientDataLen;
@@ -574,7 +586,8 @@ void GameSave::readOPS(char * data, int dataLength)
 	bson b;
 	b.data = NULL;
 	bson_iterator iter;
-	auto bson_deleter = [](bson * b) { bson_destroy(b); };
+	// The document is owned by bsonData, bson_destroy must not free it
+	auto bson_deleter = [](bson * b) { b->data = NULL; bson_destroy(b); };
 	// Use unique_ptr with a custom deleter to ensure that bson_destroy is called even when an exception is thrown
 	std::unique_ptr<bson, decltype(bson_deleter)> b_ptr(&b, bson_deleter);
 
@@ -620,22 +633,36 @@ void GameSave::readOPS(char * data, int dataLength)
 	if (toAlloc > 209715200 || !toAlloc)
 		throw ParseException(ParseException::InvalidDimensions, "Save data too large, refusing");
 
-	bsonData = (unsigned char*)malloc(toAlloc);
-	if (!bsonData)
-		throw ParseException(ParseException::InternalError, "Unable to allocate memory");
+	std::vector<char> bsonData;
+	bsonData.reserve(toAlloc);
+	if (inputData[3] == '2')
+	{
+		bsonData.resize(bsonDataLen);
+		uLongf zlibDataLen = bsonDataLen;
+		int zlibret;
+		if ((zlibret = uncompress((Bytef*)bsonData.data(), &zlibDataLen, (Bytef*)(inputData+12), inputDataLen-12)) != Z_OK)
+		{
+			throw ParseException(ParseException::Corrupt, String::Build("Unable to decompress (zlib ret ", zlibret, ")"));
+		}
+		bsonData.resize(zlibDataLen);
+	}
+	else
+	{
+		// Large saves span several bzip2 blocks, which are decompressed in parallel
+		BZ2WDecompressResult bz2ret;
+		if ((bz2ret = BZ2WDecompressParallel(bsonData, (char*)(inputData+12), inputDataLen-12, bsonDataLen)) != BZ2WDecompressOk)
+		{
+			throw ParseException(ParseException::Corrupt, String::Build("Unable to decompress (ret ", int(bz2ret), ")"));
+		}
+	}
+	bsonDataLen = bsonData.size();
 
 	//Make sure bsonData is null terminated, since all string functions need null terminated strings
 	//(bson_iterator_key returns a pointer into bsonData, which is then used with strcmp)
-	bsonData[bsonDataLen] = 0;
-
-	int bz2ret;
-	if ((bz2ret = BZ2_bzBuffToBuffDecompress((char*)bsonData, &bsonDataLen, (char*)(inputData+12), inputDataLen-12, 0, 0)) != BZ_OK)
-	{
-		throw ParseException(ParseException::Corrupt, String::Build("Unable to decompress (ret ", bz2ret, ")"));
-	}
+	bsonData.push_back(0);
 
 	set_bson_err_handler([](const char* err) { throw ParseException(ParseException::Corrupt, "BSON error when parsing save: " + ByteString(err).FromUtf8()); });
-	bson_init_data_size(&b, (char*)bsonData, bsonDataLen);
+	bson_init_data_size(&b, bsonData.data(), bsonDataLen);
 	bson_iterator_init(&iter, &b);
 
 	std::vector<sign> tempSigns;
@@ -654,6 +681,7 @@ void GameSave::readOPS(char * data, int dataLength)
 		CheckBsonFieldBool(iter, "legacyEnable", &legacyEnable);
 		CheckBsonFieldBool(iter, "gravityEnable", &gravityEnable);
 		CheckBsonFieldBool(iter, "aheat_enable", &aheatEnable);
+		CheckBsonFieldBool(iter, "fastHeat", &fastHeat);
 		CheckBsonFieldBool(iter, "waterEEnabled", &waterEEnabled);
 		CheckBsonFieldBool(iter, "paused", &paused);
 		CheckBsonFieldInt(iter, "gravityMode", &gravityMode);
@@ -2053,7 +2081,7 @@ void GameSave::readPSv(char * saveDataChar, int dataLength)
 	minimumMinorVersion = minor;\
 }
 
-char * GameSave::serialiseOPS(unsigned int & dataLength)
+char * GameSave::serialiseOPS(unsigned int & dataLength, Compression compression)
 {
 	int blockX, blockY, blockW, blockH, fullX, fullY, fullW, fullH;
 	int x, y, i;
@@ -2588,6 +2616,9 @@ char * GameSave::serialiseOPS(unsigned int & dataLength)
 	bson_append_bool(&b, "legacyEnable", legacyEnable);
 	bson_append_bool(&b, "gravityEnable", gravityEnable);
 	bson_append_bool(&b, "aheat_enable", aheatEnable);
+	// Older versions ignore it and run the save with the original heat conduction
+	if (fastHeat)
+		bson_append_bool(&b, "fastHeat", fastHeat);
 	bson_append_bool(&b, "paused", paused);
 	bson_append_int(&b, "gravityMode", gravityMode);
 	bson_append_int(&b, "airMode", airMode);
@@ -2694,14 +2725,15 @@ char * GameSave::serialiseOPS(unsigned int & dataLength)
 
 	unsigned char *finalData = (unsigned char*)bson_data(&b);
 	unsigned int finalDataLen = bson_size(&b);
-	auto outputData = std::unique_ptr<unsigned char[]>(new unsigned char[finalDataLen*2+12]);
+	unsigned int outputCapacity = std::max(finalDataLen*2, (unsigned int)compressBound(finalDataLen));
+	auto outputData = std::unique_ptr<unsigned char[]>(new unsigned char[outputCapacity+12]);
 	if (!outputData)
-		throw BuildException(String::Build("Save error, out of memory (finalData): ", finalDataLen*2+12));
+		throw BuildException(String::Build("Save error, out of memory (finalData): ", outputCapacity+12));
 
 	outputData[0] = 'O';
 	outputData[1] = 'P';
 	outputData[2] = 'S';
-	outputData[3] = '1';
+	outputData[3] = compression == CompressionZlib ? '2' : '1';
 	outputData[4] = SAVE_VERSION;
 	outputData[5] = CELL;
 	outputData[6] = blockW;
@@ -2711,10 +2743,24 @@ char * GameSave::serialiseOPS(unsigned int & dataLength)
 	outputData[10] = finalDataLen >> 16;
 	outputData[11] = finalDataLen >> 24;
 
-	unsigned int compressedSize = finalDataLen*2, bz2ret;
-	if ((bz2ret = BZ2_bzBuffToBuffCompress((char*)(outputData.get()+12), &compressedSize, (char*)finalData, bson_size(&b), 9, 0, 0)) != BZ_OK)
+	unsigned int compressedSize = outputCapacity;
+	if (compression == CompressionZlib)
+	{
+		uLongf zlibSize = outputCapacity;
+		int zlibret;
+		if ((zlibret = compress2((Bytef*)(outputData.get()+12), &zlibSize, (Bytef*)finalData, bson_size(&b), Z_BEST_SPEED)) != Z_OK)
+		{
+			throw BuildException(String::Build("Save error, could not compress (zlib ret ", zlibret, ")"));
+		}
+		compressedSize = zlibSize;
+	}
+	else
 	{
-		throw BuildException(String::Build("Save error, could not compress (ret ", bz2ret, ")"));
+		unsigned int bz2ret;
+		if ((bz2ret = BZ2_bzBuffToBuffCompress((char*)(outputData.get()+12), &compressedSize, (char*)finalData, bson_size(&b), 9, 0, 0)) != BZ_OK)
+		{
+			throw BuildException(String::Build("Save error, could not compress (ret ", bz2ret, ")"));
+		}
 	}
 
 #ifdef DEBUG
@@ -93,6 +93,7 @@ public:
 	bool legacyEnable;
 	bool gravityEnable;
 	bool aheatEnable;
+	bool fastHeat;
 	bool paused;
 	int gravityMode;
 	float customGravityX;
@@ -114,14 +115,22 @@ public:
 
 	int pmapbits;
 
+	// How Serialise compresses the save. Only bzip2 saves are taken by the server and by versions before this
+	// one, zlib ones take a small fraction of the time to compress and decompress but are a few times larger
+	enum Compression
+	{
+		CompressionBzip2,
+		CompressionZlib,
+	};
+
 	GameSave();
 	GameSave(const GameSave & save);
 	GameSave(int width, int height);
 	GameSave(std::vector<char> data);
 	~GameSave();
 	void setSize(int width, int height);
-	char * Serialise(unsigned int & dataSize);
-	std::vector<char> Serialise();
+	char * Serialise(unsigned int & dataSize, Compression compression = CompressionBzip2);
+	std::vector<char> Serialise(Compression compression = CompressionBzip2);
 	vector2d Translate(vector2d translate);
 	void Transform(matrix2d transform, vector2d translate);
 	void Transform(matrix2d transform, vector2d translate, vector2d translateReal, int newWidth, int newHeight);
@@ -129,6 +138,8 @@ public:
 	void Expand();
 	void Collapse();
 	bool Collapsed();
+	// The data the save was read from, or nullptr if there is none or the save may have changed since
+	const std::vector<char> *GetOriginalData() const;
 
 	static bool TypeInCtype(int type, int ctype);
 	static bool TypeInTmp(int type);
@@ -158,7 +169,7 @@ private:
 	void read(char * data, int dataSize);
 	void readOPS(char * data, int dataLength);
 	void readPSv(char * data, int dataLength);
-	char * serialiseOPS(unsigned int & dataSize);
+	char * serialiseOPS(unsigned int & dataSize, Compression compression);
 	void ConvertJsonToBson(bson *b, Json::Value j, int depth = 0);
 	void ConvertBsonToJson(bson_iterator *b, Json::Value *j, int depth = 0);
 };
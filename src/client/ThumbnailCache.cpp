@@ -0,0 +1,170 @@
+#include "ThumbnailCache.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#include "Format.h"
+#include "MD5.h"
+#include "common/Platform.h"
+#include "graphics/Graphics.h"
+
+namespace
+{
+	// Enough for a few thousand stamp and save thumbnails
+	constexpr long long THUMBNAIL_CACHE_SIZE = 128LL << 20;
+
+	ByteString CacheFilename(ByteString key)
+	{
+		return ByteString::Build(THUMBNAIL_CACHE_DIR, PATH_SEP, key, ".pti");
+	}
+}
+
+ByteString ThumbnailCache::Key(const std::vector<char> &data, ByteString options)
+{
+	md5_context md5;
+	md5_init(&md5);
+	md5_update(&md5, reinterpret_cast<const unsigned char *>(options.data()), options.size());
+	md5_update(&md5, reinterpret_cast<const unsigned char *>(data.data()), data.size());
+	unsigned char hash[16];
+	md5_final(hash, &md5);
+	ByteString key;
+	for (int i = 0; i < 16; i++)
+	{
+		key += format::hex[hash[i] >> 4];
+		key += format::hex[hash[i] & 0x0F];
+	}
+	return key;
+}
+
+// Scans the directory without holding cacheMutex, so that a Store from another thread doesn't have to wait for it
+void ThumbnailCache::LoadIndex()
+{
+	{
+		std::lock_guard<std::mutex> g(cacheMutex);
+		if (indexLoaded)
+			return;
+	}
+	struct File
+	{
+		ByteString key;
+		long long size, modifiedTime;
+	};
+	std::vector<File> files;
+	for (auto &name : Platform::DirectorySearch(THUMBNAIL_CACHE_DIR, "", { ".pti" }))
+	{
+		File file;
+		file.key = name.SubstrFromEnd(4);
+		if (Platform::FileSizeAndTime(CacheFilename(file.key), file.size, file.modifiedTime))
+		{
+			files.push_back(file);
+		}
+	}
+	// When a thumbnail was last used is not kept anywhere, so order them by when they were written
+	std::sort(files.begin(), files.end(), [](const File &a, const File &b) {
+		return a.modifiedTime > b.modifiedTime;
+	});
+
+	std::lock_guard<std::mutex> g(cacheMutex);
+	if (indexLoaded)
+		return;
+	indexLoaded = true;
+	for (auto &file : files)
+	{
+		// Stored while the directory was being scanned, that entry is more recent
+		if (index.find(file.key) != index.end())
+			continue;
+		entries.push_back(Entry{ file.key, file.size });
+		index[file.key] = std::prev(entries.end());
+		totalSize += file.size;
+	}
+	Evict();
+}
+
+void ThumbnailCache::Evict()
+{
+	while (totalSize > THUMBNAIL_CACHE_SIZE && entries.size() > 1)
+	{
+		auto &entry = entries.back();
+		Platform::RemoveFile(CacheFilename(entry.key));
+		totalSize -= entry.size;
+		index.erase(entry.key);
+		entries.pop_back();
+	}
+}
+
+void ThumbnailCache::RemoveEntry(std::map<ByteString, std::list<Entry>::iterator>::iterator it)
+{
+	totalSize -= it->second->size;
+	entries.erase(it->second);
+	index.erase(it);
+}
+
+// Files are only read and written without holding cacheMutex. A thumbnail is taken out of the index while it is
+// being written, so that Load never reads one that is only partly there.
+std::unique_ptr<VideoBuffer> ThumbnailCache::Load(ByteString key)
+{
+	LoadIndex();
+	{
+		std::lock_guard<std::mutex> g(cacheMutex);
+		if (index.find(key) == index.end())
+			return nullptr;
+	}
+
+	std::vector<char> data;
+	std::ifstream file(CacheFilename(key).c_str(), std::ios::binary);
+	if (file.is_open())
+		data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	file.close();
+	std::unique_ptr<VideoBuffer> thumbnail;
+	if (data.size())
+		thumbnail = std::unique_ptr<VideoBuffer>(format::PTIToVideoBuffer(data));
+
+	std::lock_guard<std::mutex> g(cacheMutex);
+	auto it = index.find(key);
+	if (!thumbnail)
+	{
+		// Gone or damaged, render or download it again; if it is not in the index any more, it has been evicted
+		// or is being written again, and is not this thread's to remove
+		if (it != index.end())
+		{
+			Platform::RemoveFile(CacheFilename(key));
+			RemoveEntry(it);
+		}
+		return nullptr;
+	}
+	if (it != index.end())
+		entries.splice(entries.begin(), entries, it->second);
+	return thumbnail;
+}
+
+void ThumbnailCache::Store(ByteString key, const VideoBuffer &thumbnail)
+{
+	auto data = format::VideoBufferToPTI(thumbnail);
+	if (!data.size())
+		return;
+
+	LoadIndex();
+	{
+		std::lock_guard<std::mutex> g(cacheMutex);
+		auto it = index.find(key);
+		if (it != index.end())
+			RemoveEntry(it);
+	}
+
+	if (!Platform::DirectoryExists(THUMBNAIL_CACHE_DIR))
+		Platform::MakeDirectory(THUMBNAIL_CACHE_DIR);
+	std::ofstream file(CacheFilename(key).c_str(), std::ios::binary);
+	if (!file.write(&data[0], data.size()))
+		return;
+	file.close();
+
+	std::lock_guard<std::mutex> g(cacheMutex);
+	auto it = index.find(key);
+	if (it != index.end())
+		RemoveEntry(it);
+	entries.push_front(Entry{ key, (long long)data.size() });
+	index[key] = entries.begin();
+	totalSize += data.size();
+	Evict();
+}
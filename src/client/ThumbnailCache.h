@@ -0,0 +1,46 @@
+#ifndef THUMBNAILCACHE_H_
+#define THUMBNAILCACHE_H_
+#include "Config.h"
+
+#include "common/Singleton.h"
+#include "common/String.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class VideoBuffer;
+
+// Thumbnails kept as PTI files in THUMBNAIL_CACHE_DIR, named after a hash of whatever they were made from, so
+// that a save that has not changed is not rendered or downloaded again. Once the files add up to more than a
+// set size, the ones used least recently are deleted. Safe to use from any thread, but Load and Store read and
+// write files, the first call also goes through the whole directory, so keep them off the UI thread.
+class ThumbnailCache : public Singleton<ThumbnailCache>
+{
+	struct Entry
+	{
+		ByteString key;
+		long long size;
+	};
+	// Most recently used first
+	std::list<Entry> entries;
+	std::map<ByteString, std::list<Entry>::iterator> index;
+	long long totalSize = 0;
+	bool indexLoaded = false;
+	std::mutex cacheMutex;
+
+	void LoadIndex();
+	void Evict();
+	void RemoveEntry(std::map<ByteString, std::list<Entry>::iterator>::iterator it);
+
+public:
+	// Key for a thumbnail made from data with the given options, such as the size and render settings
+	static ByteString Key(const std::vector<char> &data, ByteString options);
+
+	std::unique_ptr<VideoBuffer> Load(ByteString key);
+	void Store(ByteString key, const VideoBuffer &thumbnail);
+};
+
+#endif /* THUMBNAILCACHE_H_ */
@@ -1,10 +1,111 @@
 #include "ThumbnailRendererTask.h"
 
 #include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
 
+#include "common/Singleton.h"
 #include "graphics/Graphics.h"
 #include "simulation/SaveRenderer.h"
 #include "client/GameSave.h"
+#include "client/ThumbnailCache.h"
+
+class ThumbnailRendererQueue : public Singleton<ThumbnailRendererQueue>
+{
+	struct ComparePriority
+	{
+		bool operator()(const ThumbnailRendererTask *a, const ThumbnailRendererTask *b) const
+		{
+			if (a->priority != b->priority)
+				return a->priority > b->priority;
+			return a->queueOrder < b->queueOrder;
+		}
+	};
+	std::set<ThumbnailRendererTask *, ComparePriority> queue;
+	// Tasks that have never been queued have an order of 0, so they never compare equal to a queued one
+	uint64_t nextOrder = 1;
+	bool stopping = false;
+	std::vector<std::thread> workers;
+	std::mutex queueMutex;
+	std::condition_variable taskAvailable;
+
+	void WorkerMain()
+	{
+		std::unique_lock<std::mutex> l(queueMutex);
+		while (true)
+		{
+			taskAvailable.wait(l, [this]() { return stopping || !queue.empty(); });
+			if (stopping)
+				break;
+			auto *task = *queue.begin();
+			queue.erase(queue.begin());
+			l.unlock();
+			// May delete the task if it has been abandoned in the meantime
+			task->doWork_wrapper();
+			l.lock();
+		}
+	}
+
+public:
+	ThumbnailRendererQueue()
+	{
+		// Any more workers would only wait for a free slot in SaveRenderer
+		int workerCount = SaveRenderer::Ref().SlotCount();
+		for (int i = 0; i < workerCount; i++)
+		{
+			workers.emplace_back([this]() { WorkerMain(); });
+		}
+	}
+
+	~ThumbnailRendererQueue()
+	{
+		{
+			std::lock_guard<std::mutex> g(queueMutex);
+			stopping = true;
+		}
+		taskAvailable.notify_all();
+		for (auto &worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	void Push(ThumbnailRendererTask *task)
+	{
+		{
+			std::lock_guard<std::mutex> g(queueMutex);
+			task->queueOrder = nextOrder++;
+			queue.insert(task);
+		}
+		taskAvailable.notify_one();
+	}
+
+	// Returns false if the task is not in the queue, that is, if a worker has already picked it up
+	bool Remove(ThumbnailRendererTask *task)
+	{
+		std::lock_guard<std::mutex> g(queueMutex);
+		return queue.erase(task) > 0;
+	}
+
+	void SetPriority(ThumbnailRendererTask *task, int priority)
+	{
+		std::lock_guard<std::mutex> g(queueMutex);
+		if (task->priority == priority)
+			return;
+		auto it = queue.find(task);
+		if (it == queue.end())
+		{
+			task->priority = priority;
+			return;
+		}
+		queue.erase(it);
+		task->priority = priority;
+		queue.insert(task);
+	}
+};
 
 ThumbnailRendererTask::ThumbnailRendererTask(GameSave *save, int width, int height, bool autoRescale, bool decorations, bool fire) :
 	Save(new GameSave(*save)),
@@ -16,12 +117,57 @@ ThumbnailRendererTask::ThumbnailRendererTask(GameSave *save, int width, int heig
 {
 }
 
+ThumbnailRendererTask::ThumbnailRendererTask(ByteString cacheKey) :
+	CacheKey(cacheKey),
+	Width(0),
+	Height(0),
+	Decorations(false),
+	Fire(false),
+	AutoRescale(false)
+{
+}
+
+ThumbnailRendererTask::ThumbnailRendererTask(ByteString cacheKey, const VideoBuffer &thumbnail) :
+	CacheKey(cacheKey),
+	toStore(new VideoBuffer(thumbnail)),
+	Width(0),
+	Height(0),
+	Decorations(false),
+	Fire(false),
+	AutoRescale(false)
+{
+}
+
 ThumbnailRendererTask::~ThumbnailRendererTask()
 {
 }
 
 bool ThumbnailRendererTask::doWork()
 {
+	if (!Save)
+	{
+		if (toStore)
+			ThumbnailCache::Ref().Store(CacheKey, *toStore);
+		else
+			thumbnail = ThumbnailCache::Ref().Load(CacheKey);
+		return true;
+	}
+
+	ByteString cacheKey;
+	if (auto *saveData = Save->GetOriginalData())
+	{
+		// The version is part of the key as saves may render differently in another one
+		auto options = ByteString::Build(SAVE_VERSION, ".", MINOR_VERSION, ".", BUILD_NUM, " ", Width, "x", Height, AutoRescale ? "r" : "", Decorations ? "d" : "", Fire ? "f" : "");
+		cacheKey = ThumbnailCache::Key(*saveData, options);
+		thumbnail = ThumbnailCache::Ref().Load(cacheKey);
+		if (thumbnail)
+		{
+			Width = thumbnail->Width;
+			Height = thumbnail->Height;
+			return true;
+		}
+	}
+
 	thumbnail = std::unique_ptr<VideoBuffer>(SaveRenderer::Ref().Render(Save.get(), Decorations, Fire));
 	if (thumbnail)
 	{
@@ -49,6 +195,8 @@ bool ThumbnailRendererTask::doWork()
 		{
 			thumbnail->Resize(Width, Height, true);
 		}
+		if (cacheKey.size())
+			ThumbnailCache::Ref().Store(cacheKey, *thumbnail);
 		return true;
 	}
 	else
@@ -57,6 +205,27 @@ bool ThumbnailRendererTask::doWork()
 	}
 }
 
+void ThumbnailRendererTask::Start()
+{
+	before();
+	ThumbnailRendererQueue::Ref().Push(this);
+}
+
+void ThumbnailRendererTask::Abandon()
+{
+	if (!toStore && ThumbnailRendererQueue::Ref().Remove(this))
+	{
+		delete this;
+		return;
+	}
+	AbandonableTask::Abandon();
+}
+
+void ThumbnailRendererTask::SetPriority(int newPriority)
+{
+	ThumbnailRendererQueue::Ref().SetPriority(this, newPriority);
+}
+
 std::unique_ptr<VideoBuffer> ThumbnailRendererTask::Finish()
 {
 	auto ptr = std::move(thumbnail);
@@ -2,25 +2,47 @@
 #define THUMBNAILRENDERER_H
 
 #include "tasks/AbandonableTask.h"
+#include "common/String.h"
 
+#include <cstdint>
 #include <memory>
 
 class GameSave;
 class VideoBuffer;
+class ThumbnailRendererQueue;
+// Started tasks wait in a queue shared by a few worker threads, as many as SaveRenderer can render
+// on at once, instead of each getting a thread of its own. Thumbnails that are not rendered here, such
+// as downloaded ones, can go through the same queue to be looked up in or put in ThumbnailCache.
 class ThumbnailRendererTask : public AbandonableTask
 {
 	std::unique_ptr<GameSave> Save;
+	ByteString CacheKey;
+	std::unique_ptr<VideoBuffer> toStore;
 	int Width, Height;
 	bool Decorations;
 	bool Fire;
 	bool AutoRescale;
 	std::unique_ptr<VideoBuffer> thumbnail;
+	int priority = 0;
+	uint64_t queueOrder = 0;
+
+	friend class ThumbnailRendererQueue;
 
 public:
 	ThumbnailRendererTask(GameSave *save, int width, int height, bool autoRescale = false, bool decorations = true, bool fire = true);
+	// Only looks the thumbnail up in ThumbnailCache, Finish returns null if it is not there
+	ThumbnailRendererTask(ByteString cacheKey);
+	// Only puts thumbnail in ThumbnailCache, Finish returns null
+	ThumbnailRendererTask(ByteString cacheKey, const VideoBuffer &thumbnail);
 	virtual ~ThumbnailRendererTask();
 
 	virtual bool doWork() override;
+	void Start() override;
+	// A task abandoned before a worker has picked it up is taken out of the queue and never rendered, unless
+	// it is there to store a thumbnail
+	void Abandon() override;
+	// Tasks with a higher priority are started first, tasks with the same one in the order they were started in
+	void SetPriority(int newPriority);
 	std::unique_ptr<VideoBuffer> Finish();
 };
 
@@ -277,6 +277,23 @@ bool DirectoryExists(ByteString directory)
 	}
 }
 
+bool FileSizeAndTime(ByteString filename, long long &size, long long &modifiedTime)
+{
+#ifdef WIN
+	struct _stat s;
+	if (_stat(filename.c_str(), &s) == 0)
+#else
+	struct stat s;
+	if (stat(filename.c_str(), &s) == 0)
+#endif
+	{
+		size = s.st_size;
+		modifiedTime = s.st_mtime;
+		return true;
+	}
+	return false;
+}
+
 bool RemoveFile(ByteString filename)
 {
 	return std::remove(filename.c_str()) == 0;
@@ -24,6 +24,10 @@ namespace Platform
 	bool Stat(ByteString filename);
 	bool FileExists(ByteString filename);
 	bool DirectoryExists(ByteString directory);
+	/**
+	 * @return true on success, modifiedTime is in seconds since the epoch
+	 */
+	bool FileSizeAndTime(ByteString filename, long long &size, long long &modifiedTime);
 	/**
 	 * @return true on success
 	 */
@@ -0,0 +1,82 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool() :
+	jobNext(0)
+{
+	int threadCount = int(std::thread::hardware_concurrency());
+	for (int i = 1; i < threadCount; i++)
+	{
+		workers.emplace_back([this]() { WorkerMain(); });
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> g(poolMutex);
+		stopping = true;
+	}
+	workAvailable.notify_all();
+	for (auto &worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::WorkerMain()
+{
+	unsigned int seenGeneration = 0;
+	std::unique_lock<std::mutex> l(poolMutex);
+	while (true)
+	{
+		workAvailable.wait(l, [this, seenGeneration]() { return stopping || jobGeneration != seenGeneration; });
+		if (stopping)
+			break;
+		seenGeneration = jobGeneration;
+		auto *func = job;
+		auto count = jobCount;
+		l.unlock();
+		RunJob(*func, count);
+		l.lock();
+		busyWorkers--;
+		if (!busyWorkers)
+			workDone.notify_one();
+	}
+}
+
+void ThreadPool::RunJob(const std::function<void (int)> &func, int count)
+{
+	int index;
+	while ((index = jobNext.fetch_add(1)) < count)
+	{
+		func(index);
+	}
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void (int)> &func)
+{
+	if (count <= 0)
+		return;
+	std::unique_lock<std::mutex> call(callMutex, std::try_to_lock);
+	if (count == 1 || !workers.size() || !call.owns_lock())
+	{
+		for (int i = 0; i < count; i++)
+		{
+			func(i);
+		}
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> g(poolMutex);
+		job = &func;
+		jobCount = count;
+		jobNext = 0;
+		jobGeneration++;
+		busyWorkers = int(workers.size());
+	}
+	workAvailable.notify_all();
+	RunJob(func, count);
+	std::unique_lock<std::mutex> l(poolMutex);
+	workDone.wait(l, [this]() { return !busyWorkers; });
+	job = nullptr;
+}
@@ -0,0 +1,52 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#include "Config.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Singleton.h"
+
+// A set of worker threads, one less than the number of hardware threads, that
+// run the iterations of a loop concurrently. Meant for short bursts of work
+// issued from the main thread, e.g. once per simulation tick. If the simulation
+// runs on a thread of its own, loops issued while the workers are busy with the
+// other thread's are run on the calling thread alone.
+class ThreadPool : public Singleton<ThreadPool>
+{
+	std::vector<std::thread> workers;
+	std::mutex poolMutex;
+	std::mutex callMutex;
+	std::condition_variable workAvailable;
+	std::condition_variable workDone;
+	const std::function<void (int)> *job = nullptr;
+	int jobCount = 0;
+	std::atomic<int> jobNext;
+	unsigned int jobGeneration = 0;
+	int busyWorkers = 0;
+	bool stopping = false;
+
+	void WorkerMain();
+	void RunJob(const std::function<void (int)> &func, int count);
+
+public:
+	ThreadPool();
+	~ThreadPool();
+
+	// Number of threads that take part in ParallelFor, including the calling thread
+	int ThreadCount() const
+	{
+		return int(workers.size()) + 1;
+	}
+
+	// Calls func(index) for every index in [0, count), in no particular order,
+	// and returns once all calls have returned. The calling thread takes part too.
+	// Not reentrant: func must not call ParallelFor.
+	void ParallelFor(int count, const std::function<void (int)> &func);
+};
+
+#endif // THREADPOOL_H
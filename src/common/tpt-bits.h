@@ -0,0 +1,44 @@
+#pragma once
+#include "Config.h"
+
+#include <cstdint>
+#ifdef _MSC_VER
+# include <intrin.h>
+#endif
+
+// Index of the lowest set bit of a, which must not be 0
+inline int CountTrailingZeros(uint64_t a)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+	unsigned long i;
+	_BitScanForward64(&i, a);
+	return int(i);
+#elif defined(_MSC_VER)
+	// 32-bit MSVC only has the 32-bit bit scans
+	unsigned long i;
+	if (_BitScanForward(&i, uint32_t(a)))
+		return int(i);
+	_BitScanForward(&i, uint32_t(a >> 32));
+	return 32 + int(i);
+#else
+	return __builtin_ctzll(a);
+#endif
+}
+
+// Number of bits above the highest set bit of a, which must not be 0
+inline int CountLeadingZeros(uint64_t a)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+	unsigned long i;
+	_BitScanReverse64(&i, a);
+	return 63 - int(i);
+#elif defined(_MSC_VER)
+	unsigned long i;
+	if (_BitScanReverse(&i, uint32_t(a >> 32)))
+		return 31 - int(i);
+	_BitScanReverse(&i, uint32_t(a));
+	return 63 - int(i);
+#else
+	return __builtin_clzll(a);
+#endif
+}
@@ -1,4 +1,5 @@
 #include "tpt-rand.h"
+#include "tpt-thread-local.h"
 #include <cstdlib>
 #include <ctime>
 
@@ -9,6 +10,15 @@ static inline uint64_t rotl(const uint64_t x, int k)
 	return (x << k) | (x >> (64 - k));
 }
 
+// splitmix64, used to spread seeds over the whole state
+static inline uint64_t mix(uint64_t &x)
+{
+	uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
 uint64_t RNG::next()
 {
 	const uint64_t s0 = s[0];
@@ -62,4 +72,33 @@ void RNG::seed(unsigned int sd)
 	s[1] = sd;
 }
 
+void RNG::seed(uint64_t base, uint64_t stream)
+{
+	uint64_t x = base ^ (stream * 0xD1B54A32D192ED03ULL);
+	s[0] = mix(x);
+	s[1] = mix(x);
+}
+
+static THREAD_LOCAL(RNG *, threadGenerator);
+
+std::atomic<int> RNG::threadGenerators{ 0 };
+
+RNG &RNG::ThreadRef()
+{
+	RNG *&rng = threadGenerator;
+	return rng ? *rng : Singleton<RNG>::Ref();
+}
+
+void RNG::SetThreadGenerator(RNG *rng)
+{
+	if (rng == &Singleton<RNG>::Ref())
+		rng = nullptr;
+	RNG *&current = threadGenerator;
+	if (!current && rng)
+		threadGenerators++;
+	else if (current && !rng)
+		threadGenerators--;
+	current = rng;
+}
+
 RNG random_gen;
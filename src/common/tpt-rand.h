@@ -2,6 +2,7 @@
 #define TPT_RAND_
 #include "Config.h"
 
+#include <atomic>
 #include <stdint.h>
 #include "Singleton.h"
 
@@ -10,6 +11,10 @@ class RNG : public Singleton<RNG>
 private:
 	uint64_t s[2];
 	uint64_t next();
+
+	// How many threads have a generator installed with SetThreadGenerator
+	static std::atomic<int> threadGenerators;
+	static RNG &ThreadRef();
 public:
 	unsigned int operator()();
 	unsigned int gen();
@@ -19,6 +24,19 @@ public:
 
 	RNG();
 	void seed(unsigned int sd);
+	// Seeds one of many independent streams derived from base, e.g. one per particle index for a given tick
+	void seed(uint64_t base, uint64_t stream);
+
+	// The generator installed on the calling thread with SetThreadGenerator, or the shared one. The thread's
+	// generator is only looked up while some thread has one, so the serial update and the UI don't pay for it
+	static RNG &Ref()
+	{
+		if (threadGenerators.load(std::memory_order_relaxed))
+			return ThreadRef();
+		return Singleton<RNG>::Ref();
+	}
+	// Makes Ref() return rng on the calling thread, or the shared generator again if rng is null
+	static void SetThreadGenerator(RNG *rng);
 };
 
 extern RNG random_gen;
@@ -218,7 +218,7 @@ void *Graphics::ptif_pack(pixel *src, int w, int h, int *result_size){
 	result[6] = h;
 	result[7] = h>>8;
 
-	i -= 8;
+	i = datalen;
 
 	if(BZ2_bzBuffToBuffCompress((char *)(result+8), (unsigned *)&i, (char *)data, datalen, 9, 0, 0) != 0){
 		free(data);
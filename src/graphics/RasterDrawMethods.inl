@@ -1,6 +1,11 @@
 #include <cmath>
 #include "FontReader.h"
 
+// Lets the including class leave out pixels inside its buffer, see Renderer::render_parts
+#ifndef PIXELMETHODS_CLIPPED
+#define PIXELMETHODS_CLIPPED(x, y) false
+#endif
+
 int PIXELMETHODS_CLASS::drawtext_outline(int x, int y, String s, int r, int g, int b, int a)
 {
 	drawtext(x-1, y-1, s, 0, 0, 0, 120);
@@ -104,7 +109,7 @@ int PIXELMETHODS_CLASS::addchar(int x, int y, String::value_type c, int r, int g
 TPT_INLINE void PIXELMETHODS_CLASS::xor_pixel(int x, int y)
 {
 	int c;
-	if (x<0 || y<0 || x>=XRES || y>=YRES)
+	if (x<0 || y<0 || x>=XRES || y>=YRES || PIXELMETHODS_CLIPPED(x, y))
 		return;
 	c = vid[y*(VIDXRES)+x];
 	c = PIXB(c) + 3*PIXG(c) + 2*PIXR(c);
@@ -117,7 +122,7 @@ TPT_INLINE void PIXELMETHODS_CLASS::xor_pixel(int x, int y)
 void PIXELMETHODS_CLASS::blendpixel(int x, int y, int r, int g, int b, int a)
 {
 	pixel t;
-	if (x<0 || y<0 || x>=VIDXRES || y>=VIDYRES)
+	if (x<0 || y<0 || x>=VIDXRES || y>=VIDYRES || PIXELMETHODS_CLIPPED(x, y))
 		return;
 	if (a!=255)
 	{
@@ -132,7 +137,7 @@ void PIXELMETHODS_CLASS::blendpixel(int x, int y, int r, int g, int b, int a)
 void PIXELMETHODS_CLASS::addpixel(int x, int y, int r, int g, int b, int a)
 {
 	pixel t;
-	if (x<0 || y<0 || x>=VIDXRES || y>=VIDYRES)
+	if (x<0 || y<0 || x>=VIDXRES || y>=VIDYRES || PIXELMETHODS_CLIPPED(x, y))
 		return;
 	t = vid[y*(VIDXRES)+x];
 	r = (a*r + 255*PIXR(t)) >> 8;
@@ -34,5 +34,6 @@ void Graphics::Finalise()
 #undef VIDYRES
 #undef VIDXRES
 #undef PIXELMETHODS_CLASS
+#undef PIXELMETHODS_CLIPPED
 
 #endif
@@ -1,16 +1,20 @@
 #include "Renderer.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <iomanip>
 #include <vector>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include "Config.h"
 #include "Misc.h"
 
 #include "common/tpt-rand.h"
 #include "common/tpt-compat.h"
+#include "common/tpt-thread-local.h"
+#include "common/ThreadPool.h"
 
 #include "gui/game/RenderPreset.h"
 
@@ -30,6 +34,10 @@
 #include "Shaders.h"
 #endif
 
+#ifdef X86_SSE2
+#include <emmintrin.h>
+#endif
+
 #ifndef OGLI
 #define VIDXRES WINDOWW
 #define VIDYRES WINDOWH
@@ -38,6 +46,287 @@
 #define VIDYRES YRES
 #endif
 
+namespace
+{
+	// Size of the squares of vid that render_parts draws on separate threads, a multiple of CELL so
+	// that every fire cell is in one of them
+	constexpr int RENDER_TILE_SIZE = 64;
+
+	// Number of Graphics results kept for elements with GraphicsCacheFields
+	constexpr int RENDER_GCACHE_SIZE = 4096;
+
+	struct RenderTile
+	{
+		int x1, y1, x2, y2;
+
+		bool Contains(int x, int y) const
+		{
+			return x >= x1 && y >= y1 && x < x2 && y < y2;
+		}
+	};
+
+	// Tile the current thread is drawing, pixels outside of it are not drawn
+	THREAD_LOCAL(const RenderTile *, currentTile);
+
+	// Modes the compositor in render_parts draws with the same code as the OpenGL renderer,
+	// rather than with a loop of their own
+	constexpr int RENDER_EFFECT_MODES = PMODE_FLARE | PMODE_LFLARE | EFFECT_GRAVIN | EFFECT_GRAVOUT | EFFECT_DBGLINES;
+	constexpr int RENDER_LINE_MODES = EFFECT_LINES | PSPEC_STICKMAN;
+
+	// blendpixel and addpixel for pixels already known to be in vid and in the tile being drawn
+	inline void BlendPixel(pixel &p, int r, int g, int b, int a)
+	{
+		if (a!=255)
+		{
+			r = (a*r + (255-a)*PIXR(p)) >> 8;
+			g = (a*g + (255-a)*PIXG(p)) >> 8;
+			b = (a*b + (255-a)*PIXB(p)) >> 8;
+		}
+		p = PIXRGB(r,g,b);
+	}
+
+	inline void AddPixel(pixel &p, int r, int g, int b, int a)
+	{
+		r = (a*r + 255*PIXR(p)) >> 8;
+		g = (a*g + 255*PIXG(p)) >> 8;
+		b = (a*b + 255*PIXB(p)) >> 8;
+		p = PIXRGB(std::min(r, 255), std::min(g, 255), std::min(b, 255));
+	}
+
+	// Pixels drawn around a particle by PMODE_BLOB, PMODE_GLOW and PMODE_BLUR, in the order they
+	// are drawn in. weight is the alpha for blob and blur, and which of its three alphas glow uses.
+	struct StampPixel
+	{
+		int dx, dy, weight;
+		int offset;
+
+		StampPixel(int dx, int dy, int weight) : dx(dx), dy(dy), weight(weight), offset(dy*(VIDXRES)+dx)
+		{
+		}
+	};
+
+	const std::vector<StampPixel> &BlobStamp()
+	{
+		static const std::vector<StampPixel> stamp = {
+			{ 1, 0, 223 }, { -1, 0, 223 }, { 0, 1, 223 }, { 0, -1, 223 },
+			{ 1, -1, 112 }, { -1, -1, 112 }, { 1, 1, 112 }, { -1, 1, 112 },
+		};
+		return stamp;
+	}
+
+	const std::vector<StampPixel> &GlowStamp()
+	{
+		static const std::vector<StampPixel> stamp = []() {
+			std::vector<StampPixel> stamp = {
+				{ 0, 0, 0 }, { 1, 0, 1 }, { -1, 0, 1 }, { 0, 1, 1 }, { 0, -1, 1 },
+			};
+			for (int x = 1; x < 6; x++)
+			{
+				stamp.push_back({ 0, -x, 2 });
+				stamp.push_back({ 0, x, 2 });
+				stamp.push_back({ -x, 0, 2 });
+				stamp.push_back({ x, 0, 2 });
+				for (int y = 1; y < 6; y++)
+				{
+					if (x + y > 7)
+						continue;
+					stamp.push_back({ x, -y, 2 });
+					stamp.push_back({ -x, y, 2 });
+					stamp.push_back({ x, y, 2 });
+					stamp.push_back({ -x, -y, 2 });
+				}
+			}
+			return stamp;
+		}();
+		return stamp;
+	}
+
+	const std::vector<StampPixel> &BlurStamp()
+	{
+		static const std::vector<StampPixel> stamp = []() {
+			std::vector<StampPixel> stamp;
+			for (int x = -3; x < 4; x++)
+			{
+				for (int y = -3; y < 4; y++)
+				{
+					if (abs(x)+abs(y) <2 && !(abs(x)==2||abs(y)==2))
+						stamp.push_back({ x, y, 30 });
+					if (abs(x)+abs(y) <=3 && abs(x)+abs(y))
+						stamp.push_back({ x, y, 20 });
+					if (abs(x)+abs(y) == 2)
+						stamp.push_back({ x, y, 10 });
+				}
+			}
+			return stamp;
+		}();
+		return stamp;
+	}
+
+	// How far render_gravlensing moves each colour channel of the pixels of a cell, from sim->gravx and gravy
+	struct LensCell
+	{
+		float rx, ry, gx, gy, bx, by;
+		// No gravity in the cell, every pixel only has itself added to it
+		bool still;
+	};
+
+	// Adds the red, green and blue channels of source, each displaced by the cell the pixel is in, to a row of vid
+	void LensRow(const LensCell *cells, const pixel *src, pixel *dst, int ny)
+	{
+		int nx = 0;
+#if defined(X86_SSE2) && PIXELSIZE == 4 && CELL % 4 == 0
+		// Four pixels at a time, all in the same cell
+		const __m128i rgbMask = _mm_set1_epi32(PIXRGB(255, 255, 255));
+		const __m128i opaque = _mm_set1_epi32(PIXRGB(0, 0, 0));
+		const __m128i minusOne = _mm_set1_epi32(-1);
+		const __m128i xLimit = _mm_set1_epi32(XRES);
+		const __m128i yLimit = _mm_set1_epi32(YRES);
+		// Used with _mm_madd_epi16 on x | y << 16 to get y*(VIDXRES)+x
+		const __m128i rowStride = _mm_set1_epi32(((VIDXRES) << 16) | 1);
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+		const __m128 y = _mm_set1_ps(float(ny));
+		auto inRange = [minusOne](__m128i v, __m128i limit) {
+			return _mm_and_si128(_mm_cmpgt_epi32(v, minusOne), _mm_cmplt_epi32(v, limit));
+		};
+		auto offsets = [rowStride](__m128i x, __m128i y) {
+			return _mm_madd_epi16(_mm_or_si128(x, _mm_slli_epi32(y, 16)), rowStride);
+		};
+		for (; nx < XRES; nx += 4)
+		{
+			auto &cell = cells[nx/CELL];
+			__m128i *out = reinterpret_cast<__m128i *>(&dst[ny*(VIDXRES)+nx]);
+			__m128i dstPixels = _mm_loadu_si128(out);
+			__m128i srcPixels, valid;
+			if (cell.still)
+			{
+				srcPixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&src[ny*(VIDXRES)+nx]));
+				valid = minusOne;
+			}
+			else
+			{
+				__m128 x = _mm_add_ps(_mm_set1_ps(float(nx)), lanes);
+				__m128i rx = _mm_cvttps_epi32(_mm_add_ps(_mm_sub_ps(x, _mm_set1_ps(cell.rx)), half));
+				__m128i ry = _mm_cvttps_epi32(_mm_add_ps(_mm_sub_ps(y, _mm_set1_ps(cell.ry)), half));
+				__m128i gx = _mm_cvttps_epi32(_mm_add_ps(_mm_sub_ps(x, _mm_set1_ps(cell.gx)), half));
+				__m128i gy = _mm_cvttps_epi32(_mm_add_ps(_mm_sub_ps(y, _mm_set1_ps(cell.gy)), half));
+				__m128i bx = _mm_cvttps_epi32(_mm_add_ps(_mm_sub_ps(x, _mm_set1_ps(cell.bx)), half));
+				__m128i by = _mm_cvttps_epi32(_mm_add_ps(_mm_sub_ps(y, _mm_set1_ps(cell.by)), half));
+				valid = _mm_and_si128(_mm_and_si128(inRange(rx, xLimit), inRange(ry, yLimit)),
+				                      _mm_and_si128(_mm_and_si128(inRange(gx, xLimit), inRange(gy, yLimit)),
+				                                    _mm_and_si128(inRange(bx, xLimit), inRange(by, yLimit))));
+				alignas(16) int rOffset[4], gOffset[4], bOffset[4], validLane[4];
+				alignas(16) pixel gathered[4];
+				_mm_store_si128(reinterpret_cast<__m128i *>(rOffset), offsets(rx, ry));
+				_mm_store_si128(reinterpret_cast<__m128i *>(gOffset), offsets(gx, gy));
+				_mm_store_si128(reinterpret_cast<__m128i *>(bOffset), offsets(bx, by));
+				_mm_store_si128(reinterpret_cast<__m128i *>(validLane), valid);
+				for (int lane = 0; lane < 4; lane++)
+				{
+					gathered[lane] = validLane[lane] ? ((src[rOffset[lane]] & PIXRGB(255, 0, 0)) | (src[gOffset[lane]] & PIXRGB(0, 255, 0)) | (src[bOffset[lane]] & PIXRGB(0, 0, 255))) : 0;
+				}
+				srcPixels = _mm_load_si128(reinterpret_cast<const __m128i *>(gathered));
+			}
+			// Saturating adds are the same as adding channels and clamping them to 255
+			__m128i sum = _mm_or_si128(_mm_and_si128(_mm_adds_epu8(dstPixels, _mm_and_si128(srcPixels, rgbMask)), rgbMask), opaque);
+			_mm_storeu_si128(out, _mm_or_si128(_mm_and_si128(valid, sum), _mm_andnot_si128(valid, dstPixels)));
+		}
+#endif
+		for (; nx < XRES; nx++)
+		{
+			auto &cell = cells[nx/CELL];
+			int rx = (int)(nx-cell.rx+0.5f);
+			int ry = (int)(ny-cell.ry+0.5f);
+			int gx = (int)(nx-cell.gx+0.5f);
+			int gy = (int)(ny-cell.gy+0.5f);
+			int bx = (int)(nx-cell.bx+0.5f);
+			int by = (int)(ny-cell.by+0.5f);
+			if(rx >= 0 && rx < XRES && ry >= 0 && ry < YRES && gx >= 0 && gx < XRES && gy >= 0 && gy < YRES && bx >= 0 && bx < XRES && by >= 0 && by < YRES)
+			{
+				pixel t = dst[ny*(VIDXRES)+nx];
+				int r = PIXR(src[ry*(VIDXRES)+rx]) + PIXR(t);
+				int g = PIXG(src[gy*(VIDXRES)+gx]) + PIXG(t);
+				int b = PIXB(src[by*(VIDXRES)+bx]) + PIXB(t);
+				if (r>255)
+					r = 255;
+				if (g>255)
+					g = 255;
+				if (b>255)
+					b = 255;
+				dst[ny*(VIDXRES)+nx] = PIXRGB(r,g,b);
+			}
+		}
+	}
+
+	// Blurs a row of fire cells across, out[channel][x] is the glow at x of the cells in the row, before it is spread down
+	void FireAcross(const unsigned char *fireR, const unsigned char *fireG, const unsigned char *fireB, const float *kernel, float out[3][XRES])
+	{
+		const unsigned char *channels[3] = { fireR, fireG, fireB };
+		for (int ch=0; ch<3; ch++)
+		{
+			auto *fire = channels[ch];
+			for (int i=0; i<XRES/CELL; i++)
+			{
+				float left = i > 0 ? fire[i-1] : 0;
+				float centre = fire[i];
+				float right = i < XRES/CELL-1 ? fire[i+1] : 0;
+				for (int ox=0; ox<CELL; ox++)
+					out[ch][i*CELL+ox] = kernel[ox+2*CELL]*left + kernel[ox+CELL]*centre + kernel[ox]*right;
+			}
+		}
+	}
+
+	// Spreads the rows of FireAcross of the cells above, in and below a row of pixels down into it with the given
+	// weights, and adds the result to dst with saturation
+	void FireDown(const float across[3][3][XRES], const float *weights, pixel *dst)
+	{
+		int x = 0;
+#if defined(X86_SSE2) && PIXRGB(1, 2, 3) == 0x010203 && XRES % 4 == 0
+		const __m128 w0 = _mm_set1_ps(weights[0]);
+		const __m128 w1 = _mm_set1_ps(weights[1]);
+		const __m128 w2 = _mm_set1_ps(weights[2]);
+		const __m128i channelMax = _mm_set1_epi32(255);
+		auto channel = [&](int ch, int x) {
+			__m128 sum = _mm_mul_ps(w0, _mm_load_ps(&across[0][ch][x]));
+			sum = _mm_add_ps(sum, _mm_mul_ps(w1, _mm_load_ps(&across[1][ch][x])));
+			sum = _mm_add_ps(sum, _mm_mul_ps(w2, _mm_load_ps(&across[2][ch][x])));
+			__m128i value = _mm_cvttps_epi32(sum);
+			__m128i over = _mm_cmpgt_epi32(value, channelMax);
+			return _mm_or_si128(_mm_and_si128(over, channelMax), _mm_andnot_si128(over, value));
+		};
+		for (; x < XRES; x += 4)
+		{
+			__m128i glow = _mm_or_si128(_mm_slli_epi32(channel(0, x), 16), _mm_or_si128(_mm_slli_epi32(channel(1, x), 8), channel(2, x)));
+			__m128i *out = reinterpret_cast<__m128i *>(&dst[x]);
+			_mm_storeu_si128(out, _mm_adds_epu8(_mm_loadu_si128(out), glow));
+		}
+#endif
+		for (; x < XRES; x++)
+		{
+			int c[3];
+			for (int ch=0; ch<3; ch++)
+				c[ch] = int(weights[0]*across[0][ch][x] + weights[1]*across[1][ch][x] + weights[2]*across[2][ch][x]);
+			pixel t = dst[x];
+			dst[x] = PIXRGB(std::min(int(PIXR(t))+c[0], 255), std::min(int(PIXG(t))+c[1], 255), std::min(int(PIXB(t))+c[2], 255));
+		}
+	}
+
+	// Number of pixels the rays of PMODE_SPARK and PMODE_FLARE reach, for a given start intensity and falloff
+	int RayLength(float gradv, float falloff)
+	{
+		int length = 0;
+		while (gradv>0.5)
+		{
+			gradv = gradv/falloff;
+			length++;
+		}
+		// Rounding of the intensity may differ from when the ray is drawn
+		return length + 1;
+	}
+}
+
+#define PIXELMETHODS_CLIPPED(x, y) (currentTile && !currentTile->Contains(x, y))
+
 
 void Renderer::RenderBegin()
 {
@@ -1032,40 +1321,27 @@ void Renderer::DrawSigns()
 void Renderer::render_gravlensing(pixel * source)
 {
 #ifndef OGLR
-	int nx, ny, rx, ry, gx, gy, bx, by, co;
-	int r, g, b;
-	pixel t;
 	pixel *src = source;
 	pixel *dst = vid;
 	if (!dst)
 		return;
-	for(nx = 0; nx < XRES; nx++)
-	{
-		for(ny = 0; ny < YRES; ny++)
-		{
-			co = (ny/CELL)*(XRES/CELL)+(nx/CELL);
-			rx = (int)(nx-sim->gravx[co]*0.75f+0.5f);
-			ry = (int)(ny-sim->gravy[co]*0.75f+0.5f);
-			gx = (int)(nx-sim->gravx[co]*0.875f+0.5f);
-			gy = (int)(ny-sim->gravy[co]*0.875f+0.5f);
-			bx = (int)(nx-sim->gravx[co]+0.5f);
-			by = (int)(ny-sim->gravy[co]+0.5f);
-			if(rx >= 0 && rx < XRES && ry >= 0 && ry < YRES && gx >= 0 && gx < XRES && gy >= 0 && gy < YRES && bx >= 0 && bx < XRES && by >= 0 && by < YRES)
-			{
-				t = dst[ny*(VIDXRES)+nx];
-				r = PIXR(src[ry*(VIDXRES)+rx]) + PIXR(t);
-				g = PIXG(src[gy*(VIDXRES)+gx]) + PIXG(t);
-				b = PIXB(src[by*(VIDXRES)+bx]) + PIXB(t);
-				if (r>255)
-					r = 255;
-				if (g>255)
-					g = 255;
-				if (b>255)
-					b = 255;
-				dst[ny*(VIDXRES)+nx] = PIXRGB(r,g,b);
-			}
+	// Rows of cells go to separate threads, the displacement of each cell is worked out once
+	ThreadPool::Ref().ParallelFor(YRES/CELL, [this, src, dst](int cy) {
+		LensCell cells[XRES/CELL];
+		for (int cx = 0; cx < XRES/CELL; cx++)
+		{
+			int co = cy*(XRES/CELL)+cx;
+			cells[cx].rx = sim->gravx[co]*0.75f;
+			cells[cx].ry = sim->gravy[co]*0.75f;
+			cells[cx].gx = sim->gravx[co]*0.875f;
+			cells[cx].gy = sim->gravy[co]*0.875f;
+			cells[cx].bx = sim->gravx[co];
+			cells[cx].by = sim->gravy[co];
+			cells[cx].still = sim->gravx[co] == 0 && sim->gravy[co] == 0;
 		}
-	}
+		for (int ny = cy*CELL; ny < (cy+1)*CELL; ny++)
+			LensRow(cells, src, dst, ny);
+	});
 #endif
 }
 
@@ -1074,69 +1350,96 @@ void Renderer::render_fire()
 #ifndef OGLR
 	if(!(render_mode & FIREMODE))
 		return;
-	int i,j,x,y,r,g,b,a;
-	for (j=0; j<YRES/CELL; j++)
-		for (i=0; i<XRES/CELL; i++)
-		{
-			r = fire_r[j][i];
-			g = fire_g[j][i];
-			b = fire_b[j][i];
-			if (r || g || b)
-				for (y=-CELL; y<2*CELL; y++)
-					for (x=-CELL; x<2*CELL; x++)
-					{
-						a = fire_alpha[y+CELL][x+CELL];
-						if (findingElement)
-							a /= 2;
-						addpixel(i*CELL+x, j*CELL+y, r, g, b, a);
-					}
-			r *= 8;
-			g *= 8;
-			b *= 8;
-			for (y=-1; y<2; y++)
-				for (x=-1; x<2; x++)
-					if ((x || y) && i+x>=0 && j+y>=0 && i+x<XRES/CELL && j+y<YRES/CELL)
-					{
-						r += fire_r[j+y][i+x];
-						g += fire_g[j+y][i+x];
-						b += fire_b[j+y][i+x];
-					}
-			r /= 16;
-			g /= 16;
-			b /= 16;
-			fire_r[j][i] = r>4 ? r-4 : 0;
-			fire_g[j][i] = g>4 ? g-4 : 0;
-			fire_b[j][i] = b>4 ? b-4 : 0;
+	// Rows of cells with fire in them or next to them, only these have any glow drawn
+	bool glowRows[YRES/CELL] = {};
+	for (int j=0; j<YRES/CELL; j++)
+		for (int i=0; i<XRES/CELL; i++)
+			if (fire_r[j][i] || fire_g[j][i] || fire_b[j][i])
+			{
+				for (int y=std::max(j-1, 0); y<std::min(j+2, YRES/CELL); y++)
+					glowRows[y] = true;
+				break;
+			}
+	float strength = findingElement ? 0.5f : 1.0f;
+	ThreadPool::Ref().ParallelFor(YRES/CELL, [this, &glowRows, strength](int j) {
+		if (!glowRows[j])
+			return;
+		// The glow of a cell is fire_kernel[x]*fire_kernel[y], so it is blurred across the row of cells
+		// above, the row and the row below first, then down into the pixels of the row
+		alignas(16) float across[3][3][XRES];
+		for (int row=0; row<3; row++)
+		{
+			int cellRow = j+row-1;
+			if (cellRow >= 0 && cellRow < YRES/CELL)
+				FireAcross(fire_r[cellRow], fire_g[cellRow], fire_b[cellRow], fire_kernel, across[row]);
+			else
+				std::fill(&across[row][0][0], &across[row][0][0]+3*XRES, 0.0f);
 		}
+		for (int y=0; y<CELL; y++)
+		{
+			float weights[3] = {
+				fire_kernel[y+2*CELL]*strength,
+				fire_kernel[y+CELL]*strength,
+				fire_kernel[y]*strength,
+			};
+			FireDown(across, weights, &vid[(j*CELL+y)*(VIDXRES)]);
+		}
+	});
+
+	// Every cell then fades into the ones around it, each one 8/16 itself and 1/16 of every neighbour. The sum
+	// of the 3x3 cells around each one is worked out across and then down, from the values the glow used.
+	for (auto *fire : { fire_r, fire_g, fire_b })
+	{
+		unsigned short rowSums[3][XRES/CELL];
+		auto sumRow = [fire](int j, unsigned short *sums) {
+			for (int i=0; i<XRES/CELL; i++)
+			{
+				sums[i] = 0;
+				if (j < 0 || j >= YRES/CELL)
+					continue;
+				sums[i] = fire[j][i] + (i > 0 ? fire[j][i-1] : 0) + (i < XRES/CELL-1 ? fire[j][i+1] : 0);
+			}
+		};
+		sumRow(-1, rowSums[0]);
+		sumRow(0, rowSums[1]);
+		for (int j=0; j<YRES/CELL; j++)
+		{
+			unsigned short *above = rowSums[j%3], *row = rowSums[(j+1)%3], *below = rowSums[(j+2)%3];
+			sumRow(j+1, below);
+			for (int i=0; i<XRES/CELL; i++)
+			{
+				int c = (7*fire[j][i] + above[i] + row[i] + below[i]) / 16;
+				fire[j][i] = c>4 ? c-4 : 0;
+			}
+		}
+	}
 #endif
 }
 
-float temp[CELL*3][CELL*3];
 float fire_alphaf[CELL*3][CELL*3];
 float glow_alphaf[11][11];
 float blur_alphaf[7][7];
 void Renderer::prepare_alpha(int size, float intensity)
 {
 	//TODO: implement size
-	int x,y,i,j;
+	int x,i;
 	float multiplier = 255.0f*intensity;
 
-	memset(temp, 0, sizeof(temp));
+	// Sum of a gaussian over every pixel of the cell, it is the same across and down
+	float kernel[CELL*3] = {};
 	for (x=0; x<CELL; x++)
-		for (y=0; y<CELL; y++)
-			for (i=-CELL; i<CELL; i++)
-				for (j=-CELL; j<CELL; j++)
-					temp[y+CELL+j][x+CELL+i] += expf(-0.1f*(i*i+j*j));
+		for (i=-CELL; i<CELL; i++)
+			kernel[x+CELL+i] += expf(-0.1f*(i*i));
 	for (x=0; x<CELL*3; x++)
-		for (y=0; y<CELL*3; y++)
-			fire_alpha[y][x] = (int)(multiplier*temp[y][x]/(CELL*CELL));
+		fire_kernel[x] = kernel[x]*sqrtf(multiplier/(CELL*CELL)/256.0f);
 
 #ifdef OGLR
+	int y;
 	memset(fire_alphaf, 0, sizeof(fire_alphaf));
 	for (x=0; x<CELL*3; x++)
 		for (y=0; y<CELL*3; y++)
 		{
-			fire_alphaf[y][x] = intensity*temp[y][x]/((float)(CELL*CELL));
+			fire_alphaf[y][x] = intensity*kernel[y]*kernel[x]/((float)(CELL*CELL));
 		}
 	glEnable(GL_TEXTURE_2D);
 	glBindTexture(GL_TEXTURE_2D, fireAlpha);
@@ -1197,11 +1500,88 @@ void Renderer::prepare_alpha(int size, float intensity)
 }
 
 #ifndef FONTEDITOR
+gcache_item &Renderer::ParticleGraphics(int t, const Particle &part)
+{
+	unsigned int cacheFields = sim->elements[t].GraphicsCacheFields;
+	int fields[7] = {};
+	if (cacheFields & GCACHE_LIFE)
+		fields[0] = part.life;
+	if (cacheFields & GCACHE_CTYPE)
+		fields[1] = part.ctype;
+	if (cacheFields & GCACHE_TMP)
+		fields[2] = part.tmp;
+	if (cacheFields & GCACHE_TMP2)
+		fields[3] = part.tmp2;
+	if (cacheFields & GCACHE_TMP3)
+		fields[4] = part.tmp3;
+	if (cacheFields & GCACHE_TMP4)
+		fields[5] = part.tmp4;
+	if (cacheFields & GCACHE_TEMP)
+		memcpy(&fields[6], &part.temp, sizeof(float));
+	uint64_t hash = 14695981039346656037ULL ^ uint64_t(t);
+	for (auto field : fields)
+		hash = (hash ^ uint32_t(field)) * 1099511628211ULL;
+
+	auto unlink = [this](int index) {
+		auto &entry = particleGraphicsCache[index];
+		(entry.prev >= 0 ? particleGraphicsCache[entry.prev].next : particleGraphicsFirst) = entry.next;
+		(entry.next >= 0 ? particleGraphicsCache[entry.next].prev : particleGraphicsLast) = entry.prev;
+	};
+	int index;
+	auto found = particleGraphicsIndex.find(hash);
+	if (found != particleGraphicsIndex.end())
+	{
+		index = found->second;
+		unlink(index);
+	}
+	else
+	{
+		if (int(particleGraphicsCache.size()) < RENDER_GCACHE_SIZE)
+		{
+			if (particleGraphicsCache.empty())
+			{
+				particleGraphicsCache.reserve(RENDER_GCACHE_SIZE);
+				particleGraphicsIndex.reserve(RENDER_GCACHE_SIZE);
+			}
+			index = int(particleGraphicsCache.size());
+			particleGraphicsCache.emplace_back();
+		}
+		else
+		{
+			index = particleGraphicsLast;
+			unlink(index);
+			particleGraphicsIndex.erase(particleGraphicsCache[index].hash);
+		}
+		particleGraphicsIndex[hash] = index;
+		particleGraphicsCache[index].hash = hash;
+		particleGraphicsCache[index].type = -1;
+	}
+	auto &entry = particleGraphicsCache[index];
+	entry.prev = -1;
+	entry.next = particleGraphicsFirst;
+	(particleGraphicsFirst >= 0 ? particleGraphicsCache[particleGraphicsFirst].prev : particleGraphicsLast) = index;
+	particleGraphicsFirst = index;
+	// A different particle with the same hash takes the entry over
+	if (entry.type != t || !std::equal(fields, fields + 7, entry.fields))
+	{
+		entry.type = t;
+		std::copy(fields, fields + 7, entry.fields);
+		entry.result = gcache_item();
+	}
+	return entry.result;
+}
+
+void Renderer::ClearParticleGraphicsCache()
+{
+	particleGraphicsCache.clear();
+	particleGraphicsIndex.clear();
+	particleGraphicsFirst = particleGraphicsLast = -1;
+}
+
 void Renderer::render_parts()
 {
-	int deca, decr, decg, decb, cola, colr, colg, colb, firea, firer, fireg, fireb, pixel_mode, q, i, t, nx, ny, x, y, caddress;
-	int orbd[4] = {0, 0, 0, 0}, orbl[4] = {0, 0, 0, 0};
-	float gradv, flicker;
+	int deca, decr, decg, decb, cola, colr, colg, colb, firea, firer, fireg, fireb, pixel_mode, q, i, t, nx, ny, caddress;
+	float gradv;
 	Particle * parts;
 	Element *elements;
 	if(!sim)
@@ -1239,13 +1619,573 @@ void Renderer::render_parts()
 			}
 	}
 #endif
-	foundElements = 0;
-	for(i = 0; i<=sim->parts_lastActiveIndex; i++) {
-		if (sim->parts[i].type && sim->parts[i].type >= 0 && sim->parts[i].type < PT_NUM) {
-			t = sim->parts[i].type;
 
-			nx = (int)(sim->parts[i].x+0.5f);
-			ny = (int)(sim->parts[i].y+0.5f);
+	// Draws the parts of a particle selected by modes, with the colours worked out below
+	auto drawRecord = [&](const RenderRecord &record, int modes) {
+		int i = record.i, t = parts[i].type, nx = record.nx, ny = record.ny;
+		int pixel_mode = record.pixel_mode & modes;
+		int cola = record.cola, colr = record.colr, colg = record.colg, colb = record.colb;
+		int x;
+		int orbd[4] = {0, 0, 0, 0}, orbl[4] = {0, 0, 0, 0};
+		float gradv, flicker;
+#ifdef OGLR
+		int firea = record.firea, firer = record.firer, fireg = record.fireg, fireb = record.fireb;
+		float fnx = record.fnx, fny = record.fny;
+#endif
+
+		//Pixel rendering
+		if (pixel_mode & EFFECT_LINES)
+		{
+			if (t==PT_SOAP)
+			{
+				if ((parts[i].ctype&3) == 3 && parts[i].tmp >= 0 && parts[i].tmp < NPART)
+					draw_line(nx, ny, (int)(parts[parts[i].tmp].x+0.5f), (int)(parts[parts[i].tmp].y+0.5f), colr, colg, colb, cola);
+			}
+		}
+		if(pixel_mode & PSPEC_STICKMAN)
+		{
+			int legr, legg, legb;
+			playerst *cplayer;
+			if(t==PT_STKM)
+				cplayer = &sim->player;
+			else if(t==PT_STKM2)
+				cplayer = &sim->player2;
+			else if (t==PT_FIGH && sim->parts[i].tmp >= 0 && sim->parts[i].tmp < MAX_FIGHTERS)
+				cplayer = &sim->fighters[(unsigned char)sim->parts[i].tmp];
+			else
+				return;
+
+			if (mousePos.X>(nx-3) && mousePos.X<(nx+3) && mousePos.Y<(ny+3) && mousePos.Y>(ny-3)) //If mouse is in the head
+			{
+				String hp = String::Build(Format::Width(sim->parts[i].life, 3));
+				drawtext(mousePos.X-8-2*(sim->parts[i].life<100)-2*(sim->parts[i].life<10), mousePos.Y-12, hp, 255, 255, 255, 255);
+			}
+
+			if (findingElement == t)
+			{
+				colr = 255;
+				colg = colb = 0;
+			}
+			else if (colour_mode != COLOUR_HEAT)
+			{
+				if (cplayer->fan)
+				{
+					colr = PIXR(0x8080FF);
+					colg = PIXG(0x8080FF);
+					colb = PIXB(0x8080FF);
+				}
+				else if (cplayer->elem < PT_NUM && cplayer->elem > 0)
+				{
+					colr = PIXR(elements[cplayer->elem].Colour);
+					colg = PIXG(elements[cplayer->elem].Colour);
+					colb = PIXB(elements[cplayer->elem].Colour);
+				}
+				else
+				{
+					colr = 0x80;
+					colg = 0x80;
+					colb = 0xFF;
+				}
+			}
+
+#ifdef OGLR
+			glColor4f(((float)colr)/255.0f, ((float)colg)/255.0f, ((float)colb)/255.0f, 1.0f);
+			glBegin(GL_LINE_STRIP);
+			if(t==PT_FIGH)
+			{
+				glVertex2f(fnx, fny+2);
+				glVertex2f(fnx+2, fny);
+				glVertex2f(fnx, fny-2);
+				glVertex2f(fnx-2, fny);
+				glVertex2f(fnx, fny+2);
+			}
+			else
+			{
+				glVertex2f(fnx-2, fny-2);
+				glVertex2f(fnx+2, fny-2);
+				glVertex2f(fnx+2, fny+2);
+				glVertex2f(fnx-2, fny+2);
+				glVertex2f(fnx-2, fny-2);
+			}
+			glEnd();
+			glBegin(GL_LINES);
+
+			if (colour_mode!=COLOUR_HEAT)
+			{
+				if (t==PT_STKM2)
+					glColor4f(100.0f/255.0f, 100.0f/255.0f, 1.0f, 1.0f);
+				else
+					glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+			}
+
+			glVertex2f(nx, ny+3);
+			glVertex2f(cplayer->legs[0], cplayer->legs[1]);
+
+			glVertex2f(cplayer->legs[0], cplayer->legs[1]);
+			glVertex2f(cplayer->legs[4], cplayer->legs[5]);
+
+			glVertex2f(nx, ny+3);
+			glVertex2f(cplayer->legs[8], cplayer->legs[9]);
+
+			glVertex2f(cplayer->legs[8], cplayer->legs[9]);
+			glVertex2f(cplayer->legs[12], cplayer->legs[13]);
+			glEnd();
+#else
+			if (findingElement && findingElement == t)
+			{
+				legr = 255;
+				legg = legb = 0;
+			}
+			else if (colour_mode==COLOUR_HEAT)
+			{
+				legr = colr;
+				legg = colg;
+				legb = colb;
+			}
+			else if (t==PT_STKM2)
+			{
+				legr = 100;
+				legg = 100;
+				legb = 255;
+			}
+			else
+			{
+				legr = 255;
+				legg = 255;
+				legb = 255;
+			}
+
+			if (findingElement && findingElement != t)
+			{
+				colr /= 10;
+				colg /= 10;
+				colb /= 10;
+				legr /= 10;
+				legg /= 10;
+				legb /= 10;
+			}
+
+			//head
+			if(t==PT_FIGH)
+			{
+				draw_line(nx, ny+2, nx+2, ny, colr, colg, colb, 255);
+				draw_line(nx+2, ny, nx, ny-2, colr, colg, colb, 255);
+				draw_line(nx, ny-2, nx-2, ny, colr, colg, colb, 255);
+				draw_line(nx-2, ny, nx, ny+2, colr, colg, colb, 255);
+			}
+			else
+			{
+				draw_line(nx-2, ny+2, nx+2, ny+2, colr, colg, colb, 255);
+				draw_line(nx-2, ny-2, nx+2, ny-2, colr, colg, colb, 255);
+				draw_line(nx-2, ny-2, nx-2, ny+2, colr, colg, colb, 255);
+				draw_line(nx+2, ny-2, nx+2, ny+2, colr, colg, colb, 255);
+			}
+			//legs
+			draw_line(nx, ny+3, int(cplayer->legs[0]), int(cplayer->legs[1]), legr, legg, legb, 255);
+			draw_line(int(cplayer->legs[0]), int(cplayer->legs[1]), int(cplayer->legs[4]), int(cplayer->legs[5]), legr, legg, legb, 255);
+			draw_line(nx, ny+3, int(cplayer->legs[8]), int(cplayer->legs[9]), legr, legg, legb, 255);
+			draw_line(int(cplayer->legs[8]), int(cplayer->legs[9]), int(cplayer->legs[12]), int(cplayer->legs[13]), legr, legg, legb, 255);
+			if (cplayer->rocketBoots)
+			{
+				for (int leg=0; leg<2; leg++)
+				{
+					int nx = int(cplayer->legs[leg*8+4]), ny = int(cplayer->legs[leg*8+5]);
+					int colr = 255, colg = 0, colb = 255;
+					if (((int)(cplayer->comm)&0x04) == 0x04 || (((int)(cplayer->comm)&0x01) == 0x01 && leg==0) || (((int)(cplayer->comm)&0x02) == 0x02 && leg==1))
+						blendpixel(nx, ny, 0, 255, 0, 255);
+					else
+						blendpixel(nx, ny, 255, 0, 0, 255);
+					blendpixel(nx+1, ny, colr, colg, colb, 223);
+					blendpixel(nx-1, ny, colr, colg, colb, 223);
+					blendpixel(nx, ny+1, colr, colg, colb, 223);
+					blendpixel(nx, ny-1, colr, colg, colb, 223);
+
+					blendpixel(nx+1, ny-1, colr, colg, colb, 112);
+					blendpixel(nx-1, ny-1, colr, colg, colb, 112);
+					blendpixel(nx+1, ny+1, colr, colg, colb, 112);
+					blendpixel(nx-1, ny+1, colr, colg, colb, 112);
+				}
+			}
+#endif
+		}
+#ifdef OGLR
+		// The software renderer draws these in the passes of the compositor below
+		if(pixel_mode & PMODE_FLAT)
+		{
+			flatV[cflatV++] = nx;
+			flatV[cflatV++] = ny;
+			flatC[cflatC++] = ((float)colr)/255.0f;
+			flatC[cflatC++] = ((float)colg)/255.0f;
+			flatC[cflatC++] = ((float)colb)/255.0f;
+			flatC[cflatC++] = 1.0f;
+			cflat++;
+		}
+		if(pixel_mode & PMODE_BLEND)
+		{
+			flatV[cflatV++] = nx;
+			flatV[cflatV++] = ny;
+			flatC[cflatC++] = ((float)colr)/255.0f;
+			flatC[cflatC++] = ((float)colg)/255.0f;
+			flatC[cflatC++] = ((float)colb)/255.0f;
+			flatC[cflatC++] = ((float)cola)/255.0f;
+			cflat++;
+		}
+		if(pixel_mode & PMODE_ADD)
+		{
+			addV[caddV++] = nx;
+			addV[caddV++] = ny;
+			addC[caddC++] = ((float)colr)/255.0f;
+			addC[caddC++] = ((float)colg)/255.0f;
+			addC[caddC++] = ((float)colb)/255.0f;
+			addC[caddC++] = ((float)cola)/255.0f;
+			cadd++;
+		}
+		if(pixel_mode & PMODE_BLOB)
+		{
+			blobV[cblobV++] = nx;
+			blobV[cblobV++] = ny;
+			blobC[cblobC++] = ((float)colr)/255.0f;
+			blobC[cblobC++] = ((float)colg)/255.0f;
+			blobC[cblobC++] = ((float)colb)/255.0f;
+			blobC[cblobC++] = 1.0f;
+			cblob++;
+		}
+		if(pixel_mode & PMODE_GLOW)
+		{
+			glowV[cglowV++] = nx;
+			glowV[cglowV++] = ny;
+			glowC[cglowC++] = ((float)colr)/255.0f;
+			glowC[cglowC++] = ((float)colg)/255.0f;
+			glowC[cglowC++] = ((float)colb)/255.0f;
+			glowC[cglowC++] = 1.0f;
+			cglow++;
+		}
+		if(pixel_mode & PMODE_BLUR)
+		{
+			blurV[cblurV++] = nx;
+			blurV[cblurV++] = ny;
+			blurC[cblurC++] = ((float)colr)/255.0f;
+			blurC[cblurC++] = ((float)colg)/255.0f;
+			blurC[cblurC++] = ((float)colb)/255.0f;
+			blurC[cblurC++] = 1.0f;
+			cblur++;
+		}
+		if(pixel_mode & PMODE_SPARK)
+		{
+			flicker = float(record.sparkFlicker);
+			//Oh god, this is awful
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 0.0f;
+			lineV[clineV++] = fnx-5;
+			lineV[clineV++] = fny;
+			cline++;
+
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 1.0f - ((float)flicker)/30;
+			lineV[clineV++] = fnx;
+			lineV[clineV++] = fny;
+			cline++;
+
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 0.0f;
+			lineV[clineV++] = fnx+5;
+			lineV[clineV++] = fny;
+			cline++;
+
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 0.0f;
+			lineV[clineV++] = fnx;
+			lineV[clineV++] = fny-5;
+			cline++;
+
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 1.0f - ((float)flicker)/30;
+			lineV[clineV++] = fnx;
+			lineV[clineV++] = fny;
+			cline++;
+
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 0.0f;
+			lineV[clineV++] = fnx;
+			lineV[clineV++] = fny+5;
+			cline++;
+		}
+#endif
+		if(pixel_mode & PMODE_FLARE)
+		{
+			flicker = float(record.flareFlicker);
+#ifdef OGLR
+			//Oh god, this is awful
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 0.0f;
+			lineV[clineV++] = fnx-10;
+			lineV[clineV++] = fny;
+			cline++;
+
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 1.0f - ((float)flicker)/40;
+			lineV[clineV++] = fnx;
+			lineV[clineV++] = fny;
+			cline++;
+
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 0.0f;
+			lineV[clineV++] = fnx+10;
+			lineV[clineV++] = fny;
+			cline++;
+
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 0.0f;
+			lineV[clineV++] = fnx;
+			lineV[clineV++] = fny-10;
+			cline++;
+
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 1.0f - ((float)flicker)/30;
+			lineV[clineV++] = fnx;
+			lineV[clineV++] = fny;
+			cline++;
+
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 0.0f;
+			lineV[clineV++] = fnx;
+			lineV[clineV++] = fny+10;
+			cline++;
+#else
+			gradv = flicker + fabs(parts[i].vx)*17 + fabs(sim->parts[i].vy)*17;
+			blendpixel(nx, ny, colr, colg, colb, int((gradv*4)>255?255:(gradv*4)) );
+			blendpixel(nx+1, ny, colr, colg, colb,int( (gradv*2)>255?255:(gradv*2)) );
+			blendpixel(nx-1, ny, colr, colg, colb, int((gradv*2)>255?255:(gradv*2)) );
+			blendpixel(nx, ny+1, colr, colg, colb, int((gradv*2)>255?255:(gradv*2)) );
+			blendpixel(nx, ny-1, colr, colg, colb, int((gradv*2)>255?255:(gradv*2)) );
+			if (gradv>255) gradv=255;
+			blendpixel(nx+1, ny-1, colr, colg, colb, int(gradv));
+			blendpixel(nx-1, ny-1, colr, colg, colb, int(gradv));
+			blendpixel(nx+1, ny+1, colr, colg, colb, int(gradv));
+			blendpixel(nx-1, ny+1, colr, colg, colb, int(gradv));
+			for (x = 1; gradv>0.5; x++) {
+				addpixel(nx+x, ny, colr, colg, colb, int(gradv));
+				addpixel(nx-x, ny, colr, colg, colb, int(gradv));
+				addpixel(nx, ny+x, colr, colg, colb, int(gradv));
+				addpixel(nx, ny-x, colr, colg, colb, int(gradv));
+				gradv = gradv/1.2f;
+			}
+#endif
+		}
+		if(pixel_mode & PMODE_LFLARE)
+		{
+			flicker = float(record.lflareFlicker);
+#ifdef OGLR
+			//Oh god, this is awful
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 0.0f;
+			lineV[clineV++] = fnx-70;
+			lineV[clineV++] = fny;
+			cline++;
+
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 1.0f - ((float)flicker)/30;
+			lineV[clineV++] = fnx;
+			lineV[clineV++] = fny;
+			cline++;
+
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 0.0f;
+			lineV[clineV++] = fnx+70;
+			lineV[clineV++] = fny;
+			cline++;
+
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 0.0f;
+			lineV[clineV++] = fnx;
+			lineV[clineV++] = fny-70;
+			cline++;
+
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 1.0f - ((float)flicker)/50;
+			lineV[clineV++] = fnx;
+			lineV[clineV++] = fny;
+			cline++;
+
+			lineC[clineC++] = ((float)colr)/255.0f;
+			lineC[clineC++] = ((float)colg)/255.0f;
+			lineC[clineC++] = ((float)colb)/255.0f;
+			lineC[clineC++] = 0.0f;
+			lineV[clineV++] = fnx;
+			lineV[clineV++] = fny+70;
+			cline++;
+#else
+			gradv = flicker + fabs(parts[i].vx)*17 + fabs(parts[i].vy)*17;
+			blendpixel(nx, ny, colr, colg, colb, int((gradv*4)>255?255:(gradv*4)) );
+			blendpixel(nx+1, ny, colr, colg, colb, int((gradv*2)>255?255:(gradv*2)) );
+			blendpixel(nx-1, ny, colr, colg, colb, int((gradv*2)>255?255:(gradv*2)) );
+			blendpixel(nx, ny+1, colr, colg, colb, int((gradv*2)>255?255:(gradv*2)) );
+			blendpixel(nx, ny-1, colr, colg, colb, int((gradv*2)>255?255:(gradv*2)) );
+			if (gradv>255) gradv=255;
+			blendpixel(nx+1, ny-1, colr, colg, colb, int(gradv));
+			blendpixel(nx-1, ny-1, colr, colg, colb, int(gradv));
+			blendpixel(nx+1, ny+1, colr, colg, colb, int(gradv));
+			blendpixel(nx-1, ny+1, colr, colg, colb, int(gradv));
+			for (x = 1; gradv>0.5; x++) {
+				addpixel(nx+x, ny, colr, colg, colb, int(gradv));
+				addpixel(nx-x, ny, colr, colg, colb, int(gradv));
+				addpixel(nx, ny+x, colr, colg, colb, int(gradv));
+				addpixel(nx, ny-x, colr, colg, colb, int(gradv));
+				gradv = gradv/1.01f;
+			}
+#endif
+		}
+		if (pixel_mode & EFFECT_GRAVIN)
+		{
+			int nxo = 0;
+			int nyo = 0;
+			int r;
+			float drad = 0.0f;
+			float ddist = 0.0f;
+			sim->orbitalparts_get(parts[i].life, parts[i].ctype, orbd, orbl);
+			for (r = 0; r < 4; r++) {
+				ddist = ((float)orbd[r])/16.0f;
+				drad = (M_PI * ((float)orbl[r]) / 180.0f)*1.41f;
+				nxo = (int)(ddist*cos(drad));
+				nyo = (int)(ddist*sin(drad));
+				if (ny+nyo>0 && ny+nyo<YRES && nx+nxo>0 && nx+nxo<XRES && TYP(sim->pmap[ny+nyo][nx+nxo]) != PT_PRTI)
+					addpixel(nx+nxo, ny+nyo, colr, colg, colb, 255-orbd[r]);
+			}
+		}
+		if (pixel_mode & EFFECT_GRAVOUT)
+		{
+			int nxo = 0;
+			int nyo = 0;
+			int r;
+			float drad = 0.0f;
+			float ddist = 0.0f;
+			sim->orbitalparts_get(parts[i].life, parts[i].ctype, orbd, orbl);
+			for (r = 0; r < 4; r++) {
+				ddist = ((float)orbd[r])/16.0f;
+				drad = (M_PI * ((float)orbl[r]) / 180.0f)*1.41f;
+				nxo = (int)(ddist*cos(drad));
+				nyo = (int)(ddist*sin(drad));
+				if (ny+nyo>0 && ny+nyo<YRES && nx+nxo>0 && nx+nxo<XRES && TYP(sim->pmap[ny+nyo][nx+nxo]) != PT_PRTO)
+					addpixel(nx+nxo, ny+nyo, colr, colg, colb, 255-orbd[r]);
+			}
+		}
+		if (pixel_mode & EFFECT_DBGLINES && !(display_mode&DISPLAY_PERS))
+		{
+			// draw lines connecting wifi/portal channels
+			if (mousePos.X == nx && mousePos.Y == ny && i == ID(sim->pmap[ny][nx]) && debugLines)
+			{
+				int type = parts[i].type, tmp = (int)((parts[i].temp-73.15f)/100+1), othertmp;
+				if (type == PT_PRTI)
+					type = PT_PRTO;
+				else if (type == PT_PRTO)
+					type = PT_PRTI;
+				for (int z = 0; z <= sim->parts_lastActiveIndex; z++)
+				{
+					if (parts[z].type == type)
+					{
+						othertmp = (int)((parts[z].temp-73.15f)/100+1);
+						if (tmp == othertmp)
+							xor_line(nx,ny,(int)(parts[z].x+0.5f),(int)(parts[z].y+0.5f));
+					}
+				}
+			}
+		}
+#ifdef OGLR
+		//Fire effects
+		if(firea && (pixel_mode & FIRE_BLEND))
+		{
+			smokeV[csmokeV++] = nx;
+			smokeV[csmokeV++] = ny;
+			smokeC[csmokeC++] = ((float)firer)/255.0f;
+			smokeC[csmokeC++] = ((float)fireg)/255.0f;
+			smokeC[csmokeC++] = ((float)fireb)/255.0f;
+			smokeC[csmokeC++] = ((float)firea)/255.0f;
+			csmoke++;
+		}
+		if(firea && (pixel_mode & FIRE_ADD))
+		{
+			fireV[cfireV++] = nx;
+			fireV[cfireV++] = ny;
+			fireC[cfireC++] = ((float)firer)/255.0f;
+			fireC[cfireC++] = ((float)fireg)/255.0f;
+			fireC[cfireC++] = ((float)fireb)/255.0f;
+			fireC[cfireC++] = ((float)firea)/255.0f;
+			cfire++;
+		}
+		if(firea && (pixel_mode & FIRE_SPARK))
+		{
+			smokeV[csmokeV++] = nx;
+			smokeV[csmokeV++] = ny;
+			smokeC[csmokeC++] = ((float)firer)/255.0f;
+			smokeC[csmokeC++] = ((float)fireg)/255.0f;
+			smokeC[csmokeC++] = ((float)fireb)/255.0f;
+			smokeC[csmokeC++] = ((float)firea)/255.0f;
+			csmoke++;
+		}
+#endif
+	};
+
+	// With more than one thread, the compositor below draws tiles of vid on separate threads
+	bool tiled = ThreadPool::Ref().ThreadCount() >= 2;
+#ifdef OGLR
+	tiled = false;
+#endif
+	foundElements = 0;
+	renderRecords.clear();
+#ifndef OGLR
+	int tileSize = tiled ? RENDER_TILE_SIZE : std::max(VIDXRES, VIDYRES);
+	int tilesX = (VIDXRES + tileSize - 1) / tileSize;
+	int tilesY = (VIDYRES + tileSize - 1) / tileSize;
+	renderTileBins.resize(tilesX * tilesY);
+	for (auto &bin : renderTileBins)
+	{
+		for (auto &pass : bin.passes)
+			pass.clear();
+		bin.flatOffsets.clear();
+		bin.flatColours.clear();
+	}
+#endif
+	// Simulations that are only drawn (thumbnails, the snapshot of a threaded simulation) don't keep partCoords
+	auto *coords = sim->partCoords.Allocated() ? &sim->PartCoords() : nullptr;
+	for(i = sim->NextActivePart(0); i<=sim->parts_lastActiveIndex; i = sim->NextActivePart(i+1)) {
+		t = coords ? coords->type[i] : sim->parts[i].type;
+		if (t > 0 && t < PT_NUM) {
+			nx = coords ? coords->x[i] : (int)(sim->parts[i].x+0.5f);
+			ny = coords ? coords->y[i] : (int)(sim->parts[i].y+0.5f);
 #ifdef OGLR
 			fnx = sim->parts[i].x;
 			fny = sim->parts[i].y;
@@ -1295,7 +2235,22 @@ void Renderer::render_parts()
 				}
 				else if(!(colour_mode & COLOUR_BASC))
 				{
-					if (!elements[t].Graphics || (*(elements[t].Graphics))(this, &(sim->parts[i]), nx, ny, &pixel_mode, &cola, &colr, &colg, &colb, &firea, &firer, &fireg, &fireb)) //That's a lot of args, a struct might be better
+					gcache_item *particleCache = nullptr;
+					if (elements[t].Graphics && elements[t].GraphicsCacheFields)
+						particleCache = &ParticleGraphics(t, sim->parts[i]);
+					if (particleCache && particleCache->isready)
+					{
+						pixel_mode = particleCache->pixel_mode;
+						cola = particleCache->cola;
+						colr = particleCache->colr;
+						colg = particleCache->colg;
+						colb = particleCache->colb;
+						firea = particleCache->firea;
+						firer = particleCache->firer;
+						fireg = particleCache->fireg;
+						fireb = particleCache->fireb;
+					}
+					else if (!elements[t].Graphics || (*(elements[t].Graphics))(this, &(sim->parts[i]), nx, ny, &pixel_mode, &cola, &colr, &colg, &colb, &firea, &firer, &fireg, &fireb)) //That's a lot of args, a struct might be better
 					{
 						graphicscache[t].isready = 1;
 						graphicscache[t].pixel_mode = pixel_mode;
@@ -1308,6 +2263,19 @@ void Renderer::render_parts()
 						graphicscache[t].fireg = fireg;
 						graphicscache[t].fireb = fireb;
 					}
+					else if (particleCache)
+					{
+						particleCache->isready = 1;
+						particleCache->pixel_mode = pixel_mode;
+						particleCache->cola = cola;
+						particleCache->colr = colr;
+						particleCache->colg = colg;
+						particleCache->colb = colb;
+						particleCache->firea = firea;
+						particleCache->firer = firer;
+						particleCache->fireg = fireg;
+						particleCache->fireb = fireb;
+					}
 				}
 				if((elements[t].Properties & PROP_HOT_GLOW) && sim->parts[i].temp>(elements[t].HighTemperature-800.0f))
 				{
@@ -1402,7 +2370,6 @@ void Renderer::render_parts()
 					if(pixel_mode & (FIREMODE | PMODE_GLOW)) pixel_mode = (pixel_mode & ~(FIREMODE|PMODE_GLOW)) | PMODE_BLUR;
 				}
 
-	#ifndef OGLR
 				//All colours are now set, check ranges
 				if(colr>255) colr = 255;
 				else if(colr<0) colr = 0;
@@ -1421,7 +2388,6 @@ void Renderer::render_parts()
 				else if(fireb<0) fireb = 0;
 				if(firea>255) firea = 255;
 				else if(firea<0) firea = 0;
-	#endif
 
 				if (findingElement)
 				{
@@ -1443,638 +2409,268 @@ void Renderer::render_parts()
 					}
 				}
 
-				//Pixel rendering
-				if (pixel_mode & EFFECT_LINES)
-				{
-					if (t==PT_SOAP)
-					{
-						if ((parts[i].ctype&3) == 3 && parts[i].tmp >= 0 && parts[i].tmp < NPART)
-							draw_line(nx, ny, (int)(parts[parts[i].tmp].x+0.5f), (int)(parts[parts[i].tmp].y+0.5f), colr, colg, colb, cola);
-					}
-				}
-				if(pixel_mode & PSPEC_STICKMAN)
-				{
-					int legr, legg, legb;
-					playerst *cplayer;
-					if(t==PT_STKM)
-						cplayer = &sim->player;
-					else if(t==PT_STKM2)
-						cplayer = &sim->player2;
-					else if (t==PT_FIGH && sim->parts[i].tmp >= 0 && sim->parts[i].tmp < MAX_FIGHTERS)
-						cplayer = &sim->fighters[(unsigned char)sim->parts[i].tmp];
-					else
-						continue;
-
-					if (mousePos.X>(nx-3) && mousePos.X<(nx+3) && mousePos.Y<(ny+3) && mousePos.Y>(ny-3)) //If mouse is in the head
-					{
-						String hp = String::Build(Format::Width(sim->parts[i].life, 3));
-						drawtext(mousePos.X-8-2*(sim->parts[i].life<100)-2*(sim->parts[i].life<10), mousePos.Y-12, hp, 255, 255, 255, 255);
-					}
-
-					if (findingElement == t)
-					{
-						colr = 255;
-						colg = colb = 0;
-					}
-					else if (colour_mode != COLOUR_HEAT)
-					{
-						if (cplayer->fan)
-						{
-							colr = PIXR(0x8080FF);
-							colg = PIXG(0x8080FF);
-							colb = PIXB(0x8080FF);
-						}
-						else if (cplayer->elem < PT_NUM && cplayer->elem > 0)
-						{
-							colr = PIXR(elements[cplayer->elem].Colour);
-							colg = PIXG(elements[cplayer->elem].Colour);
-							colb = PIXB(elements[cplayer->elem].Colour);
-						}
-						else
-						{
-							colr = 0x80;
-							colg = 0x80;
-							colb = 0xFF;
-						}
-					}
-
-#ifdef OGLR
-					glColor4f(((float)colr)/255.0f, ((float)colg)/255.0f, ((float)colb)/255.0f, 1.0f);
-					glBegin(GL_LINE_STRIP);
-					if(t==PT_FIGH)
-					{
-						glVertex2f(fnx, fny+2);
-						glVertex2f(fnx+2, fny);
-						glVertex2f(fnx, fny-2);
-						glVertex2f(fnx-2, fny);
-						glVertex2f(fnx, fny+2);
-					}
-					else
-					{
-						glVertex2f(fnx-2, fny-2);
-						glVertex2f(fnx+2, fny-2);
-						glVertex2f(fnx+2, fny+2);
-						glVertex2f(fnx-2, fny+2);
-						glVertex2f(fnx-2, fny-2);
-					}
-					glEnd();
-					glBegin(GL_LINES);
-
-					if (colour_mode!=COLOUR_HEAT)
-					{
-						if (t==PT_STKM2)
-							glColor4f(100.0f/255.0f, 100.0f/255.0f, 1.0f, 1.0f);
-						else
-							glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-					}
-
-					glVertex2f(nx, ny+3);
-					glVertex2f(cplayer->legs[0], cplayer->legs[1]);
-
-					glVertex2f(cplayer->legs[0], cplayer->legs[1]);
-					glVertex2f(cplayer->legs[4], cplayer->legs[5]);
-
-					glVertex2f(nx, ny+3);
-					glVertex2f(cplayer->legs[8], cplayer->legs[9]);
-
-					glVertex2f(cplayer->legs[8], cplayer->legs[9]);
-					glVertex2f(cplayer->legs[12], cplayer->legs[13]);
-					glEnd();
-#else
-					if (findingElement && findingElement == t)
-					{
-						legr = 255;
-						legg = legb = 0;
-					}
-					else if (colour_mode==COLOUR_HEAT)
-					{
-						legr = colr;
-						legg = colg;
-						legb = colb;
-					}
-					else if (t==PT_STKM2)
-					{
-						legr = 100;
-						legg = 100;
-						legb = 255;
-					}
-					else
-					{
-						legr = 255;
-						legg = 255;
-						legb = 255;
-					}
-
-					if (findingElement && findingElement != t)
-					{
-						colr /= 10;
-						colg /= 10;
-						colb /= 10;
-						legr /= 10;
-						legg /= 10;
-						legb /= 10;
-					}
+				// Stickmen that don't belong to a player or fighter aren't drawn, apart from their lines
+				if ((pixel_mode & PSPEC_STICKMAN) && t!=PT_STKM && t!=PT_STKM2 && !(t==PT_FIGH && parts[i].tmp >= 0 && parts[i].tmp < MAX_FIGHTERS))
+					pixel_mode &= EFFECT_LINES;
 
-					//head
-					if(t==PT_FIGH)
-					{
-						draw_line(nx, ny+2, nx+2, ny, colr, colg, colb, 255);
-						draw_line(nx+2, ny, nx, ny-2, colr, colg, colb, 255);
-						draw_line(nx, ny-2, nx-2, ny, colr, colg, colb, 255);
-						draw_line(nx-2, ny, nx, ny+2, colr, colg, colb, 255);
-					}
-					else
-					{
-						draw_line(nx-2, ny+2, nx+2, ny+2, colr, colg, colb, 255);
-						draw_line(nx-2, ny-2, nx+2, ny-2, colr, colg, colb, 255);
-						draw_line(nx-2, ny-2, nx-2, ny+2, colr, colg, colb, 255);
-						draw_line(nx+2, ny-2, nx+2, ny+2, colr, colg, colb, 255);
-					}
-					//legs
-					draw_line(nx, ny+3, int(cplayer->legs[0]), int(cplayer->legs[1]), legr, legg, legb, 255);
-					draw_line(int(cplayer->legs[0]), int(cplayer->legs[1]), int(cplayer->legs[4]), int(cplayer->legs[5]), legr, legg, legb, 255);
-					draw_line(nx, ny+3, int(cplayer->legs[8]), int(cplayer->legs[9]), legr, legg, legb, 255);
-					draw_line(int(cplayer->legs[8]), int(cplayer->legs[9]), int(cplayer->legs[12]), int(cplayer->legs[13]), legr, legg, legb, 255);
-					if (cplayer->rocketBoots)
-					{
-						for (int leg=0; leg<2; leg++)
-						{
-							int nx = int(cplayer->legs[leg*8+4]), ny = int(cplayer->legs[leg*8+5]);
-							int colr = 255, colg = 0, colb = 255;
-							if (((int)(cplayer->comm)&0x04) == 0x04 || (((int)(cplayer->comm)&0x01) == 0x01 && leg==0) || (((int)(cplayer->comm)&0x02) == 0x02 && leg==1))
-								blendpixel(nx, ny, 0, 255, 0, 255);
-							else
-								blendpixel(nx, ny, 255, 0, 0, 255);
-							blendpixel(nx+1, ny, colr, colg, colb, 223);
-							blendpixel(nx-1, ny, colr, colg, colb, 223);
-							blendpixel(nx, ny+1, colr, colg, colb, 223);
-							blendpixel(nx, ny-1, colr, colg, colb, 223);
-
-							blendpixel(nx+1, ny-1, colr, colg, colb, 112);
-							blendpixel(nx-1, ny-1, colr, colg, colb, 112);
-							blendpixel(nx+1, ny+1, colr, colg, colb, 112);
-							blendpixel(nx-1, ny+1, colr, colg, colb, 112);
-						}
-					}
-#endif
-				}
-				if(pixel_mode & PMODE_FLAT)
-				{
-#ifdef OGLR
-					flatV[cflatV++] = nx;
-					flatV[cflatV++] = ny;
-					flatC[cflatC++] = ((float)colr)/255.0f;
-					flatC[cflatC++] = ((float)colg)/255.0f;
-					flatC[cflatC++] = ((float)colb)/255.0f;
-					flatC[cflatC++] = 1.0f;
-					cflat++;
-#else
-					vid[ny*(VIDXRES)+nx] = PIXRGB(colr,colg,colb);
-#endif
-				}
-				if(pixel_mode & PMODE_BLEND)
+#ifndef OGLR
+				// Plain pixels go straight to the tile they are in, particles need a record only if something else is drawn for them
+				if (pixel_mode & PMODE_FLAT)
 				{
-#ifdef OGLR
-					flatV[cflatV++] = nx;
-					flatV[cflatV++] = ny;
-					flatC[cflatC++] = ((float)colr)/255.0f;
-					flatC[cflatC++] = ((float)colg)/255.0f;
-					flatC[cflatC++] = ((float)colb)/255.0f;
-					flatC[cflatC++] = ((float)cola)/255.0f;
-					cflat++;
-#else
-					blendpixel(nx, ny, colr, colg, colb, cola);
-#endif
+					auto &home = renderTileBins[(ny / tileSize) * tilesX + nx / tileSize];
+					home.flatOffsets.push_back(ny*(VIDXRES)+nx);
+					home.flatColours.push_back(PIXRGB(colr, colg, colb));
 				}
-				if(pixel_mode & PMODE_ADD)
-				{
-#ifdef OGLR
-					addV[caddV++] = nx;
-					addV[caddV++] = ny;
-					addC[caddC++] = ((float)colr)/255.0f;
-					addC[caddC++] = ((float)colg)/255.0f;
-					addC[caddC++] = ((float)colb)/255.0f;
-					addC[caddC++] = ((float)cola)/255.0f;
-					cadd++;
-#else
-					addpixel(nx, ny, colr, colg, colb, cola);
+				if (!(pixel_mode & ~(PMODE_FLAT | OPTIONS)))
+					continue;
 #endif
-				}
-				if(pixel_mode & PMODE_BLOB)
-				{
-#ifdef OGLR
-					blobV[cblobV++] = nx;
-					blobV[cblobV++] = ny;
-					blobC[cblobC++] = ((float)colr)/255.0f;
-					blobC[cblobC++] = ((float)colg)/255.0f;
-					blobC[cblobC++] = ((float)colb)/255.0f;
-					blobC[cblobC++] = 1.0f;
-					cblob++;
-#else
-					vid[ny*(VIDXRES)+nx] = PIXRGB(colr,colg,colb);
 
-					blendpixel(nx+1, ny, colr, colg, colb, 223);
-					blendpixel(nx-1, ny, colr, colg, colb, 223);
-					blendpixel(nx, ny+1, colr, colg, colb, 223);
-					blendpixel(nx, ny-1, colr, colg, colb, 223);
-
-					blendpixel(nx+1, ny-1, colr, colg, colb, 112);
-					blendpixel(nx-1, ny-1, colr, colg, colb, 112);
-					blendpixel(nx+1, ny+1, colr, colg, colb, 112);
-					blendpixel(nx-1, ny+1, colr, colg, colb, 112);
-#endif
-				}
-				if(pixel_mode & PMODE_GLOW)
-				{
-					int cola1 = (5*cola)/255;
-#ifdef OGLR
-					glowV[cglowV++] = nx;
-					glowV[cglowV++] = ny;
-					glowC[cglowC++] = ((float)colr)/255.0f;
-					glowC[cglowC++] = ((float)colg)/255.0f;
-					glowC[cglowC++] = ((float)colb)/255.0f;
-					glowC[cglowC++] = 1.0f;
-					cglow++;
-#else
-					addpixel(nx, ny, colr, colg, colb, (192*cola)/255);
-					addpixel(nx+1, ny, colr, colg, colb, (96*cola)/255);
-					addpixel(nx-1, ny, colr, colg, colb, (96*cola)/255);
-					addpixel(nx, ny+1, colr, colg, colb, (96*cola)/255);
-					addpixel(nx, ny-1, colr, colg, colb, (96*cola)/255);
-
-					for (x = 1; x < 6; x++) {
-						addpixel(nx, ny-x, colr, colg, colb, cola1);
-						addpixel(nx, ny+x, colr, colg, colb, cola1);
-						addpixel(nx-x, ny, colr, colg, colb, cola1);
-						addpixel(nx+x, ny, colr, colg, colb, cola1);
-						for (y = 1; y < 6; y++) {
-							if(x + y > 7)
-								continue;
-							addpixel(nx+x, ny-y, colr, colg, colb, cola1);
-							addpixel(nx-x, ny+y, colr, colg, colb, cola1);
-							addpixel(nx+x, ny+y, colr, colg, colb, cola1);
-							addpixel(nx-x, ny-y, colr, colg, colb, cola1);
-						}
-					}
-#endif
-				}
-				if(pixel_mode & PMODE_BLUR)
-				{
+				RenderRecord record;
+				record.i = i;
+				record.nx = nx;
+				record.ny = ny;
 #ifdef OGLR
-					blurV[cblurV++] = nx;
-					blurV[cblurV++] = ny;
-					blurC[cblurC++] = ((float)colr)/255.0f;
-					blurC[cblurC++] = ((float)colg)/255.0f;
-					blurC[cblurC++] = ((float)colb)/255.0f;
-					blurC[cblurC++] = 1.0f;
-					cblur++;
-#else
-					for (x=-3; x<4; x++)
-					{
-						for (y=-3; y<4; y++)
-						{
-							if (abs(x)+abs(y) <2 && !(abs(x)==2||abs(y)==2))
-								blendpixel(x+nx, y+ny, colr, colg, colb, 30);
-							if (abs(x)+abs(y) <=3 && abs(x)+abs(y))
-								blendpixel(x+nx, y+ny, colr, colg, colb, 20);
-							if (abs(x)+abs(y) == 2)
-								blendpixel(x+nx, y+ny, colr, colg, colb, 10);
-						}
-					}
+				record.fnx = fnx;
+				record.fny = fny;
 #endif
-				}
-				if(pixel_mode & PMODE_SPARK)
-				{
-					flicker = float(random_gen()%20);
+				record.pixel_mode = pixel_mode;
+				record.cola = cola;
+				record.colr = colr;
+				record.colg = colg;
+				record.colb = colb;
+				record.firea = firea;
+				record.firer = firer;
+				record.fireg = fireg;
+				record.fireb = fireb;
+
+				// Flickers are picked here, so that rng is used in the same order however particles are drawn
+				record.sparkFlicker = (pixel_mode & PMODE_SPARK) ? rng()%20 : 0;
+				record.flareFlicker = (pixel_mode & PMODE_FLARE) ? rng()%20 : 0;
+				record.lflareFlicker = (pixel_mode & PMODE_LFLARE) ? rng()%20 : 0;
 #ifdef OGLR
-					//Oh god, this is awful
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 0.0f;
-					lineV[clineV++] = fnx-5;
-					lineV[clineV++] = fny;
-					cline++;
-
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 1.0f - ((float)flicker)/30;
-					lineV[clineV++] = fnx;
-					lineV[clineV++] = fny;
-					cline++;
-
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 0.0f;
-					lineV[clineV++] = fnx+5;
-					lineV[clineV++] = fny;
-					cline++;
-
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 0.0f;
-					lineV[clineV++] = fnx;
-					lineV[clineV++] = fny-5;
-					cline++;
-
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 1.0f - ((float)flicker)/30;
-					lineV[clineV++] = fnx;
-					lineV[clineV++] = fny;
-					cline++;
-
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 0.0f;
-					lineV[clineV++] = fnx;
-					lineV[clineV++] = fny+5;
-					cline++;
-#else
-					gradv = 4*sim->parts[i].life + flicker;
-					for (x = 0; gradv>0.5; x++) {
-						addpixel(nx+x, ny, colr, colg, colb, int(gradv));
-						addpixel(nx-x, ny, colr, colg, colb, int(gradv));
-
-						addpixel(nx, ny+x, colr, colg, colb, int(gradv));
-						addpixel(nx, ny-x, colr, colg, colb, int(gradv));
-						gradv = gradv/1.5f;
-					}
-#endif
-				}
-				if(pixel_mode & PMODE_FLARE)
-				{
-					flicker = float(random_gen()%20);
-#ifdef OGLR
-					//Oh god, this is awful
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 0.0f;
-					lineV[clineV++] = fnx-10;
-					lineV[clineV++] = fny;
-					cline++;
-
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 1.0f - ((float)flicker)/40;
-					lineV[clineV++] = fnx;
-					lineV[clineV++] = fny;
-					cline++;
-
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 0.0f;
-					lineV[clineV++] = fnx+10;
-					lineV[clineV++] = fny;
-					cline++;
-
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 0.0f;
-					lineV[clineV++] = fnx;
-					lineV[clineV++] = fny-10;
-					cline++;
-
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 1.0f - ((float)flicker)/30;
-					lineV[clineV++] = fnx;
-					lineV[clineV++] = fny;
-					cline++;
-
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 0.0f;
-					lineV[clineV++] = fnx;
-					lineV[clineV++] = fny+10;
-					cline++;
-#else
-					gradv = flicker + fabs(parts[i].vx)*17 + fabs(sim->parts[i].vy)*17;
-					blendpixel(nx, ny, colr, colg, colb, int((gradv*4)>255?255:(gradv*4)) );
-					blendpixel(nx+1, ny, colr, colg, colb,int( (gradv*2)>255?255:(gradv*2)) );
-					blendpixel(nx-1, ny, colr, colg, colb, int((gradv*2)>255?255:(gradv*2)) );
-					blendpixel(nx, ny+1, colr, colg, colb, int((gradv*2)>255?255:(gradv*2)) );
-					blendpixel(nx, ny-1, colr, colg, colb, int((gradv*2)>255?255:(gradv*2)) );
-					if (gradv>255) gradv=255;
-					blendpixel(nx+1, ny-1, colr, colg, colb, int(gradv));
-					blendpixel(nx-1, ny-1, colr, colg, colb, int(gradv));
-					blendpixel(nx+1, ny+1, colr, colg, colb, int(gradv));
-					blendpixel(nx-1, ny+1, colr, colg, colb, int(gradv));
-					for (x = 1; gradv>0.5; x++) {
-						addpixel(nx+x, ny, colr, colg, colb, int(gradv));
-						addpixel(nx-x, ny, colr, colg, colb, int(gradv));
-						addpixel(nx, ny+x, colr, colg, colb, int(gradv));
-						addpixel(nx, ny-x, colr, colg, colb, int(gradv));
-						gradv = gradv/1.2f;
-					}
-#endif
-				}
-				if(pixel_mode & PMODE_LFLARE)
-				{
-					flicker = float(random_gen()%20);
-#ifdef OGLR
-					//Oh god, this is awful
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 0.0f;
-					lineV[clineV++] = fnx-70;
-					lineV[clineV++] = fny;
-					cline++;
-
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 1.0f - ((float)flicker)/30;
-					lineV[clineV++] = fnx;
-					lineV[clineV++] = fny;
-					cline++;
-
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 0.0f;
-					lineV[clineV++] = fnx+70;
-					lineV[clineV++] = fny;
-					cline++;
-
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 0.0f;
-					lineV[clineV++] = fnx;
-					lineV[clineV++] = fny-70;
-					cline++;
-
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 1.0f - ((float)flicker)/50;
-					lineV[clineV++] = fnx;
-					lineV[clineV++] = fny;
-					cline++;
-
-					lineC[clineC++] = ((float)colr)/255.0f;
-					lineC[clineC++] = ((float)colg)/255.0f;
-					lineC[clineC++] = ((float)colb)/255.0f;
-					lineC[clineC++] = 0.0f;
-					lineV[clineV++] = fnx;
-					lineV[clineV++] = fny+70;
-					cline++;
-#else
-					gradv = flicker + fabs(parts[i].vx)*17 + fabs(parts[i].vy)*17;
-					blendpixel(nx, ny, colr, colg, colb, int((gradv*4)>255?255:(gradv*4)) );
-					blendpixel(nx+1, ny, colr, colg, colb, int((gradv*2)>255?255:(gradv*2)) );
-					blendpixel(nx-1, ny, colr, colg, colb, int((gradv*2)>255?255:(gradv*2)) );
-					blendpixel(nx, ny+1, colr, colg, colb, int((gradv*2)>255?255:(gradv*2)) );
-					blendpixel(nx, ny-1, colr, colg, colb, int((gradv*2)>255?255:(gradv*2)) );
-					if (gradv>255) gradv=255;
-					blendpixel(nx+1, ny-1, colr, colg, colb, int(gradv));
-					blendpixel(nx-1, ny-1, colr, colg, colb, int(gradv));
-					blendpixel(nx+1, ny+1, colr, colg, colb, int(gradv));
-					blendpixel(nx-1, ny+1, colr, colg, colb, int(gradv));
-					for (x = 1; gradv>0.5; x++) {
-						addpixel(nx+x, ny, colr, colg, colb, int(gradv));
-						addpixel(nx-x, ny, colr, colg, colb, int(gradv));
-						addpixel(nx, ny+x, colr, colg, colb, int(gradv));
-						addpixel(nx, ny-x, colr, colg, colb, int(gradv));
-						gradv = gradv/1.01f;
-					}
+				drawRecord(record, ~0);
+				continue;
 #endif
-				}
-				if (pixel_mode & EFFECT_GRAVIN)
-				{
-					int nxo = 0;
-					int nyo = 0;
-					int r;
-					float drad = 0.0f;
-					float ddist = 0.0f;
-					sim->orbitalparts_get(parts[i].life, parts[i].ctype, orbd, orbl);
-					for (r = 0; r < 4; r++) {
-						ddist = ((float)orbd[r])/16.0f;
-						drad = (M_PI * ((float)orbl[r]) / 180.0f)*1.41f;
-						nxo = (int)(ddist*cos(drad));
-						nyo = (int)(ddist*sin(drad));
-						if (ny+nyo>0 && ny+nyo<YRES && nx+nxo>0 && nx+nxo<XRES && TYP(sim->pmap[ny+nyo][nx+nxo]) != PT_PRTI)
-							addpixel(nx+nxo, ny+nyo, colr, colg, colb, 255-orbd[r]);
-					}
-				}
-				if (pixel_mode & EFFECT_GRAVOUT)
+				if (!tiled)
 				{
-					int nxo = 0;
-					int nyo = 0;
-					int r;
-					float drad = 0.0f;
-					float ddist = 0.0f;
-					sim->orbitalparts_get(parts[i].life, parts[i].ctype, orbd, orbl);
-					for (r = 0; r < 4; r++) {
-						ddist = ((float)orbd[r])/16.0f;
-						drad = (M_PI * ((float)orbl[r]) / 180.0f)*1.41f;
-						nxo = (int)(ddist*cos(drad));
-						nyo = (int)(ddist*sin(drad));
-						if (ny+nyo>0 && ny+nyo<YRES && nx+nxo>0 && nx+nxo<XRES && TYP(sim->pmap[ny+nyo][nx+nxo]) != PT_PRTO)
-							addpixel(nx+nxo, ny+nyo, colr, colg, colb, 255-orbd[r]);
-					}
+					record.x1 = record.x2 = short(nx);
+					record.y1 = record.y2 = short(ny);
+					renderRecords.push_back(record);
+					continue;
 				}
-				if (pixel_mode & EFFECT_DBGLINES && !(display_mode&DISPLAY_PERS))
+
+				// Work out how far from the particle drawing it reaches, so that tiles it doesn't reach can skip it
+				int reach = 0;
+				if (pixel_mode & PMODE_BLOB)
+					reach = std::max(reach, 1);
+				if (pixel_mode & PMODE_BLUR)
+					reach = std::max(reach, 3);
+				if (pixel_mode & PMODE_GLOW)
+					reach = std::max(reach, 5);
+				if (pixel_mode & (EFFECT_GRAVIN | EFFECT_GRAVOUT))
+					reach = std::max(reach, 16);
+				if (pixel_mode & PMODE_SPARK)
+					reach = std::max(reach, RayLength(4*parts[i].life + float(record.sparkFlicker), 1.5f));
+				if (pixel_mode & PMODE_FLARE)
 				{
-					// draw lines connecting wifi/portal channels
-					if (mousePos.X == nx && mousePos.Y == ny && i == ID(sim->pmap[ny][nx]) && debugLines)
-					{
-						int type = parts[i].type, tmp = (int)((parts[i].temp-73.15f)/100+1), othertmp;
-						if (type == PT_PRTI)
-							type = PT_PRTO;
-						else if (type == PT_PRTO)
-							type = PT_PRTI;
-						for (int z = 0; z <= sim->parts_lastActiveIndex; z++)
-						{
-							if (parts[z].type == type)
-							{
-								othertmp = (int)((parts[z].temp-73.15f)/100+1);
-								if (tmp == othertmp)
-									xor_line(nx,ny,(int)(parts[z].x+0.5f),(int)(parts[z].y+0.5f));
-							}
-						}
-					}
+					gradv = float(record.flareFlicker + fabs(parts[i].vx)*17 + fabs(parts[i].vy)*17);
+					reach = std::max(reach, 1 + RayLength(gradv>255 ? 255 : gradv, 1.2f));
 				}
-				//Fire effects
-				if(firea && (pixel_mode & FIRE_BLEND))
+				if (pixel_mode & PMODE_LFLARE)
 				{
-#ifdef OGLR
-					smokeV[csmokeV++] = nx;
-					smokeV[csmokeV++] = ny;
-					smokeC[csmokeC++] = ((float)firer)/255.0f;
-					smokeC[csmokeC++] = ((float)fireg)/255.0f;
-					smokeC[csmokeC++] = ((float)fireb)/255.0f;
-					smokeC[csmokeC++] = ((float)firea)/255.0f;
-					csmoke++;
-#else
-					firea /= 2;
-					fire_r[ny/CELL][nx/CELL] = (firea*firer + (255-firea)*fire_r[ny/CELL][nx/CELL]) >> 8;
-					fire_g[ny/CELL][nx/CELL] = (firea*fireg + (255-firea)*fire_g[ny/CELL][nx/CELL]) >> 8;
-					fire_b[ny/CELL][nx/CELL] = (firea*fireb + (255-firea)*fire_b[ny/CELL][nx/CELL]) >> 8;
-#endif
+					gradv = float(record.lflareFlicker + fabs(parts[i].vx)*17 + fabs(parts[i].vy)*17);
+					reach = std::max(reach, 1 + RayLength(gradv>255 ? 255 : gradv, 1.01f));
 				}
-				if(firea && (pixel_mode & FIRE_ADD))
+				int x1 = nx - reach, y1 = ny - reach, x2 = nx + reach, y2 = ny + reach;
+				if ((pixel_mode & EFFECT_LINES) && t==PT_SOAP && (parts[i].ctype&3) == 3 && parts[i].tmp >= 0 && parts[i].tmp < NPART)
 				{
-#ifdef OGLR
-					fireV[cfireV++] = nx;
-					fireV[cfireV++] = ny;
-					fireC[cfireC++] = ((float)firer)/255.0f;
-					fireC[cfireC++] = ((float)fireg)/255.0f;
-					fireC[cfireC++] = ((float)fireb)/255.0f;
-					fireC[cfireC++] = ((float)firea)/255.0f;
-					cfire++;
-#else
-					firea /= 8;
-					firer = ((firea*firer) >> 8) + fire_r[ny/CELL][nx/CELL];
-					fireg = ((firea*fireg) >> 8) + fire_g[ny/CELL][nx/CELL];
-					fireb = ((firea*fireb) >> 8) + fire_b[ny/CELL][nx/CELL];
-
-					if(firer>255)
-						firer = 255;
-					if(fireg>255)
-						fireg = 255;
-					if(fireb>255)
-						fireb = 255;
-
-					fire_r[ny/CELL][nx/CELL] = firer;
-					fire_g[ny/CELL][nx/CELL] = fireg;
-					fire_b[ny/CELL][nx/CELL] = fireb;
-#endif
+					int ox = (int)(parts[parts[i].tmp].x+0.5f), oy = (int)(parts[parts[i].tmp].y+0.5f);
+					x1 = std::min(x1, ox);
+					y1 = std::min(y1, oy);
+					x2 = std::max(x2, ox);
+					y2 = std::max(y2, oy);
 				}
-				if(firea && (pixel_mode & FIRE_SPARK))
+				// Stickmen draw their health next to the mouse, debug lines go anywhere
+				if ((pixel_mode & PSPEC_STICKMAN) || ((pixel_mode & EFFECT_DBGLINES) && mousePos.X == nx && mousePos.Y == ny))
 				{
-#ifdef OGLR
-					smokeV[csmokeV++] = nx;
-					smokeV[csmokeV++] = ny;
-					smokeC[csmokeC++] = ((float)firer)/255.0f;
-					smokeC[csmokeC++] = ((float)fireg)/255.0f;
-					smokeC[csmokeC++] = ((float)fireb)/255.0f;
-					smokeC[csmokeC++] = ((float)firea)/255.0f;
-					csmoke++;
-#else
-					firea /= 4;
-					fire_r[ny/CELL][nx/CELL] = (firea*firer + (255-firea)*fire_r[ny/CELL][nx/CELL]) >> 8;
-					fire_g[ny/CELL][nx/CELL] = (firea*fireg + (255-firea)*fire_g[ny/CELL][nx/CELL]) >> 8;
-					fire_b[ny/CELL][nx/CELL] = (firea*fireb + (255-firea)*fire_b[ny/CELL][nx/CELL]) >> 8;
-#endif
+					x1 = y1 = 0;
+					x2 = VIDXRES-1;
+					y2 = VIDYRES-1;
 				}
+				record.x1 = short(std::max(x1, 0));
+				record.y1 = short(std::max(y1, 0));
+				record.x2 = short(std::min(x2, VIDXRES-1));
+				record.y2 = short(std::min(y2, VIDYRES-1));
+				renderRecords.push_back(record);
 			}
 		}
 	}
-#ifdef OGLR
+
+#ifndef OGLR
+	// Sort the particles into passes, per tile of vid they reach. Particles stay in the order they
+	// were worked out in within each pass, passes are drawn in the order below.
+	for (int r = 0; r < int(renderRecords.size()); r++)
+	{
+		auto &record = renderRecords[r];
+		int modes = record.pixel_mode;
+		// Single pixels and fire only concern the tile the particle is in, plain ones are already there
+		auto &home = renderTileBins[(record.ny / tileSize) * tilesX + record.nx / tileSize];
+		if (modes & PMODE_BLEND)
+			home.passes[RENDER_PASS_BLEND].push_back(r);
+		if (modes & PMODE_ADD)
+			home.passes[RENDER_PASS_ADD].push_back(r);
+		if (record.firea && (modes & FIREMODE))
+			home.passes[RENDER_PASS_FIRE].push_back(r);
+		if (!(modes & (PMODE_BLOB | PMODE_GLOW | PMODE_BLUR | PMODE_SPARK | RENDER_EFFECT_MODES | RENDER_LINE_MODES)))
+			continue;
+		for (int ty = record.y1 / tileSize; ty <= record.y2 / tileSize; ty++)
+			for (int tx = record.x1 / tileSize; tx <= record.x2 / tileSize; tx++)
+			{
+				auto &bin = renderTileBins[ty * tilesX + tx];
+				if (modes & PMODE_BLOB)
+					bin.passes[RENDER_PASS_BLOB].push_back(r);
+				if (modes & PMODE_GLOW)
+					bin.passes[RENDER_PASS_GLOW].push_back(r);
+				if (modes & PMODE_BLUR)
+					bin.passes[RENDER_PASS_BLUR].push_back(r);
+				if (modes & PMODE_SPARK)
+					bin.passes[RENDER_PASS_SPARK].push_back(r);
+				if (modes & RENDER_EFFECT_MODES)
+					bin.passes[RENDER_PASS_EFFECTS].push_back(r);
+				if (modes & RENDER_LINE_MODES)
+					bin.passes[RENDER_PASS_LINES].push_back(r);
+			}
+	}
+
+	auto &blobStamp = BlobStamp();
+	auto &glowStamp = GlowStamp();
+	auto &blurStamp = BlurStamp();
+	ThreadPool::Ref().ParallelFor(tilesX * tilesY, [&](int tile) {
+		auto &bin = renderTileBins[tile];
+		RenderTile area;
+		area.x1 = (tile % tilesX) * tileSize;
+		area.y1 = (tile / tilesX) * tileSize;
+		area.x2 = std::min(area.x1 + tileSize, VIDXRES);
+		area.y2 = std::min(area.y1 + tileSize, VIDYRES);
+		const RenderTile *&threadTile = currentTile;
+		threadTile = tiled ? &area : nullptr;
+
+		// A stamp is drawn without looking at every pixel if all of it is in the tile
+		auto stampInside = [&area](const RenderRecord &record, int reach) {
+			return area.Contains(record.nx - reach, record.ny - reach) && area.Contains(record.nx + reach, record.ny + reach);
+		};
+
+		for (size_t k = 0; k < bin.flatOffsets.size(); k++)
+			vid[bin.flatOffsets[k]] = bin.flatColours[k];
+		for (int r : bin.passes[RENDER_PASS_BLEND])
+		{
+			auto &record = renderRecords[r];
+			BlendPixel(vid[record.ny*(VIDXRES)+record.nx], record.colr, record.colg, record.colb, record.cola);
+		}
+		for (int r : bin.passes[RENDER_PASS_ADD])
+		{
+			auto &record = renderRecords[r];
+			AddPixel(vid[record.ny*(VIDXRES)+record.nx], record.colr, record.colg, record.colb, record.cola);
+		}
+		for (int r : bin.passes[RENDER_PASS_BLOB])
+		{
+			auto &record = renderRecords[r];
+			pixel *centre = &vid[record.ny*(VIDXRES)+record.nx];
+			bool inside = stampInside(record, 1);
+			if (inside || area.Contains(record.nx, record.ny))
+				*centre = PIXRGB(record.colr, record.colg, record.colb);
+			for (auto &p : blobStamp)
+				if (inside || area.Contains(record.nx+p.dx, record.ny+p.dy))
+					BlendPixel(centre[p.offset], record.colr, record.colg, record.colb, p.weight);
+		}
+		for (int r : bin.passes[RENDER_PASS_GLOW])
+		{
+			auto &record = renderRecords[r];
+			pixel *centre = &vid[record.ny*(VIDXRES)+record.nx];
+			int alpha[3] = { (192*record.cola)/255, (96*record.cola)/255, (5*record.cola)/255 };
+			if (stampInside(record, 5))
+			{
+				for (auto &p : glowStamp)
+					AddPixel(centre[p.offset], record.colr, record.colg, record.colb, alpha[p.weight]);
+				continue;
+			}
+			for (auto &p : glowStamp)
+				if (area.Contains(record.nx+p.dx, record.ny+p.dy))
+					AddPixel(centre[p.offset], record.colr, record.colg, record.colb, alpha[p.weight]);
+		}
+		for (int r : bin.passes[RENDER_PASS_BLUR])
+		{
+			auto &record = renderRecords[r];
+			pixel *centre = &vid[record.ny*(VIDXRES)+record.nx];
+			if (stampInside(record, 3))
+			{
+				for (auto &p : blurStamp)
+					BlendPixel(centre[p.offset], record.colr, record.colg, record.colb, p.weight);
+				continue;
+			}
+			for (auto &p : blurStamp)
+				if (area.Contains(record.nx+p.dx, record.ny+p.dy))
+					BlendPixel(centre[p.offset], record.colr, record.colg, record.colb, p.weight);
+		}
+		for (int r : bin.passes[RENDER_PASS_SPARK])
+		{
+			auto &record = renderRecords[r];
+			int nx = record.nx, ny = record.ny;
+			float gradv = 4*parts[record.i].life + float(record.sparkFlicker);
+			for (int x = 0; gradv>0.5; x++)
+			{
+				int a = int(gradv);
+				if (area.Contains(nx+x, ny))
+					AddPixel(vid[ny*(VIDXRES)+nx+x], record.colr, record.colg, record.colb, a);
+				if (area.Contains(nx-x, ny))
+					AddPixel(vid[ny*(VIDXRES)+nx-x], record.colr, record.colg, record.colb, a);
+				if (area.Contains(nx, ny+x))
+					AddPixel(vid[(ny+x)*(VIDXRES)+nx], record.colr, record.colg, record.colb, a);
+				if (area.Contains(nx, ny-x))
+					AddPixel(vid[(ny-x)*(VIDXRES)+nx], record.colr, record.colg, record.colb, a);
+				gradv = gradv/1.5f;
+			}
+		}
+		for (int r : bin.passes[RENDER_PASS_EFFECTS])
+			drawRecord(renderRecords[r], RENDER_EFFECT_MODES);
+		for (int r : bin.passes[RENDER_PASS_LINES])
+			drawRecord(renderRecords[r], RENDER_LINE_MODES);
+		for (int r : bin.passes[RENDER_PASS_FIRE])
+		{
+			auto &record = renderRecords[r];
+			int firea = record.firea, firer = record.firer, fireg = record.fireg, fireb = record.fireb;
+			unsigned char &cellr = fire_r[record.ny/CELL][record.nx/CELL];
+			unsigned char &cellg = fire_g[record.ny/CELL][record.nx/CELL];
+			unsigned char &cellb = fire_b[record.ny/CELL][record.nx/CELL];
+			if (firea && (record.pixel_mode & FIRE_BLEND))
+			{
+				firea /= 2;
+				cellr = (firea*firer + (255-firea)*cellr) >> 8;
+				cellg = (firea*fireg + (255-firea)*cellg) >> 8;
+				cellb = (firea*fireb + (255-firea)*cellb) >> 8;
+			}
+			if (firea && (record.pixel_mode & FIRE_ADD))
+			{
+				firea /= 8;
+				firer = std::min(((firea*firer) >> 8) + cellr, 255);
+				fireg = std::min(((firea*fireg) >> 8) + cellg, 255);
+				fireb = std::min(((firea*fireb) >> 8) + cellb, 255);
+				cellr = firer;
+				cellg = fireg;
+				cellb = fireb;
+			}
+			if (firea && (record.pixel_mode & FIRE_SPARK))
+			{
+				firea /= 4;
+				cellr = (firea*firer + (255-firea)*cellr) >> 8;
+				cellg = (firea*fireg + (255-firea)*cellg) >> 8;
+				cellb = (firea*fireb + (255-firea)*cellb) >> 8;
+			}
+		}
+
+		threadTile = nullptr;
+	});
+#else
 
 		//Go into array mode
 		glEnableClientState(GL_COLOR_ARRAY);
@@ -2964,3 +3560,4 @@ Renderer::~Renderer()
 #endif
 
 #undef PIXELMETHODS_CLASS
+#undef PIXELMETHODS_CLIPPED
@@ -2,16 +2,20 @@
 #define RENDERER_H
 #include "Config.h"
 
+#include <cstdint>
+#include <unordered_map>
 #include <vector>
 #ifdef OGLR
 #include "OpenGLHeaders.h"
 #endif
 
 #include "Graphics.h"
+#include "common/tpt-rand.h"
 #include "gui/interface/Point.h"
 
 class RenderPreset;
 class Simulation;
+struct Particle;
 
 struct gcache_item
 {
@@ -35,12 +39,73 @@ struct gcache_item
 };
 typedef struct gcache_item gcache_item;
 
+// Graphics result for particles of one type whose Element::GraphicsCacheFields have the same values
+struct ParticleGraphicsEntry
+{
+	uint64_t hash;
+	int type;
+	int fields[7];
+	gcache_item result;
+	// Neighbours in order of last use, most recent first
+	int prev, next;
+};
+
+// How render_parts draws a particle, worked out before any particle is drawn. Kept small, as there
+// can be one for every particle on the screen.
+struct RenderRecord
+{
+	int i;
+	short nx, ny;
+#ifdef OGLR
+	float fnx, fny;
+#endif
+	int pixel_mode;
+	unsigned char cola, colr, colg, colb;
+	unsigned char firea, firer, fireg, fireb;
+	unsigned char sparkFlicker, flareFlicker, lflareFlicker;
+	// Part of vid drawing the particle may change
+	short x1, y1, x2, y2;
+};
+
+// Passes render_parts draws particles in, apart from PMODE_FLAT which is drawn first
+enum RenderPass
+{
+	RENDER_PASS_BLEND,
+	RENDER_PASS_ADD,
+	RENDER_PASS_BLOB,
+	RENDER_PASS_GLOW,
+	RENDER_PASS_BLUR,
+	RENDER_PASS_SPARK,
+	RENDER_PASS_EFFECTS, // flares, orbits and debug lines
+	RENDER_PASS_LINES, // SOAP lines and stickmen
+	RENDER_PASS_FIRE,
+	RENDER_PASS_COUNT
+};
+
+// Particles a tile of vid is drawn from, per pass
+struct RenderTileBin
+{
+	std::vector<int> passes[RENDER_PASS_COUNT];
+	// PMODE_FLAT pixels, stored into vid as they are
+	std::vector<int> flatOffsets;
+	std::vector<pixel> flatColours;
+};
+
 class Renderer
 {
 public:
 	Simulation * sim;
 	Graphics * g;
 	gcache_item *graphicscache;
+	// For elements with GraphicsCacheFields, whose Graphics results are not the same for the whole type.
+	// Holds up to RENDER_GCACHE_SIZE results, the least recently used is dropped to make room.
+	std::vector<ParticleGraphicsEntry> particleGraphicsCache;
+	std::unordered_map<uint64_t, int> particleGraphicsIndex;
+	int particleGraphicsFirst = -1, particleGraphicsLast = -1;
+	std::vector<RenderRecord> renderRecords;
+	std::vector<RenderTileBin> renderTileBins;
+	// Picks the flicker of sparks and flares. One per Renderer, as SaveRenderer draws on several at once.
+	RNG rng;
 
 	std::vector<unsigned int> render_modes;
 	unsigned int render_mode;
@@ -52,7 +117,8 @@ public:
 	unsigned char fire_r[YRES/CELL][XRES/CELL];
 	unsigned char fire_g[YRES/CELL][XRES/CELL];
 	unsigned char fire_b[YRES/CELL][XRES/CELL];
-	unsigned int fire_alpha[CELL*3][CELL*3];
+	// The glow of a fire cell over the 3*CELL square around it, its alpha at (x, y) is fire_kernel[x]*fire_kernel[y]*256
+	float fire_kernel[CELL*3];
 	char * flm_data;
 	char * plasma_data;
 	//
@@ -87,6 +153,9 @@ public:
 	void render_fire();
 	void prepare_alpha(int size, float intensity);
 	void render_parts();
+	// Cached result for a particle of an element with GraphicsCacheFields, isready is 0 if it has to be filled in
+	gcache_item &ParticleGraphics(int t, const Particle &part);
+	void ClearParticleGraphicsCache();
 	void draw_grav_zones();
 	void draw_air();
 	void draw_grav();
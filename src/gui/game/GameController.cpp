@@ -33,6 +33,7 @@
 #include "simulation/ElementClasses.h"
 #include "simulation/Simulation.h"
 #include "simulation/SimulationData.h"
+#include "simulation/SimulationThread.h"
 #include "simulation/Snapshot.h"
 
 #include "gui/dialogues/ErrorMessage.h"
@@ -798,8 +799,11 @@ void GameController::ResetSpark()
 		{
 			if (sim->parts[i].ctype >= 0 && sim->parts[i].ctype < PT_NUM && sim->elements[sim->parts[i].ctype].Enabled)
 			{
+				sim->PartGridChangeType(i, PT_SPRK, sim->parts[i].ctype);
 				sim->parts[i].type = sim->parts[i].ctype;
 				sim->parts[i].ctype = sim->parts[i].life = 0;
+				sim->UpdatePartCoords(i);
+				sim->UpdatePartPmap(i, int(sim->parts[i].x+0.5f), int(sim->parts[i].y+0.5f));
 			}
 			else
 				sim->kill_part(i);
@@ -892,11 +896,14 @@ void GameController::Update()
 		gameView->SetSample(gameModel->GetSimulation()->GetSample(pos.X, pos.Y));
 
 	Simulation * sim = gameModel->GetSimulation();
-	sim->BeforeSim();
-	if (!sim->sys_pause || sim->framerender)
+	if (!SimulationThread::Ref().Running())
 	{
-		sim->UpdateParticles(0, NPART);
-		sim->AfterSim();
+		sim->BeforeSim();
+		if (!sim->sys_pause || sim->framerender)
+		{
+			sim->UpdateParticles(0, NPART);
+			sim->AfterSim();
+		}
 	}
 
 	//if either STKM or STK2 isn't out, reset it's selected element. Defaults to PT_DUST unless right selected is something else
@@ -1207,7 +1214,7 @@ void GameController::OpenLocalSaveWindow(bool asCurrent)
 
 			gameModel->SetSaveFile(&tempSave, gameView->ShiftBehaviour());
 			Platform::MakeDirectory(LOCAL_SAVE_DIR);
-			std::vector<char> saveData = gameSave->Serialise();
+			std::vector<char> saveData = gameSave->Serialise(GameSave::CompressionZlib);
 			if (saveData.size() == 0)
 				new ErrorMessage("Error", "Unable to serialize game data.");
 			else if (!Client::Ref().WriteFile(saveData, gameModel->GetSaveFile()->GetName()))
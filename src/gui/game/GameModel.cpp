@@ -26,6 +26,7 @@
 #include "simulation/Gravity.h"
 #include "simulation/Simulation.h"
 #include "simulation/Snapshot.h"
+#include "simulation/SimulationThread.h"
 #include "simulation/SnapshotDelta.h"
 #include "simulation/ElementClasses.h"
 #include "simulation/ElementGraphics.h"
@@ -116,6 +117,11 @@ GameModel::GameModel():
 		sim->grav->start_grav_async();
 	sim->aheat_enable =  Client::Ref().GetPrefInteger("Simulation.AmbientHeat", 0);
 	sim->pretty_powder =  Client::Ref().GetPrefInteger("Simulation.PrettyPowder", 0);
+	sim->parallelUpdate = Client::Ref().GetPrefBool("Simulation.ParallelUpdate", false);
+	sim->incrementalPmap = Client::Ref().GetPrefBool("Simulation.IncrementalPmap", false);
+	sim->sleepingCells = Client::Ref().GetPrefBool("Simulation.SleepingCells", false);
+	sim->air->scalarUpdate = Client::Ref().GetPrefBool("Simulation.ScalarAir", false);
+	sim->grav->sparseUpdates = Client::Ref().GetPrefBool("Simulation.SparseGravity", false);
 
 	Favorite::Ref().LoadFavoritesFromPrefs();
 
@@ -156,10 +162,20 @@ GameModel::GameModel():
 	includePressure = Client::Ref().GetPrefBool("Simulation.IncludePressure", true);
 
 	ClearSimulation();
+
+	// Draws from a second Simulation that the main thread copies to every frame, which takes about 30MB more memory
+	if (Client::Ref().GetPrefBool("Simulation.Threaded", false))
+	{
+		SimulationThread::Ref().Start(sim, Client::Ref().GetPrefNumber("Simulation.TickRate", 60.0));
+		ren->sim = SimulationThread::Ref().GetSnapshot();
+	}
 }
 
 GameModel::~GameModel()
 {
+	SimulationThread::Ref().Stop();
+	ren->sim = sim;
+
 	//Save to config:
 	Client::Ref().SetPref("Renderer.ColourMode", ren->GetColourMode());
 
@@ -962,6 +978,7 @@ void GameModel::SetSave(SaveInfo * newSave, bool invertIncludePressure)
 		sim->legacy_enable = saveData->legacyEnable;
 		sim->water_equal_test = saveData->waterEEnabled;
 		sim->aheat_enable = saveData->aheatEnable;
+		sim->fastHeat = saveData->fastHeat;
 		if(saveData->gravityEnable)
 			sim->grav->start_grav_async();
 		else
@@ -1026,6 +1043,7 @@ void GameModel::SetSaveFile(SaveFile * newSave, bool invertIncludePressure)
 		sim->legacy_enable = saveData->legacyEnable;
 		sim->water_equal_test = saveData->waterEEnabled;
 		sim->aheat_enable = saveData->aheatEnable;
+		sim->fastHeat = saveData->fastHeat;
 		if(saveData->gravityEnable && !sim->grav->IsEnabled())
 		{
 			sim->grav->start_grav_async();
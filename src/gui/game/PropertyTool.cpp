@@ -281,21 +281,7 @@ void PropertyTool::SetProperty(Simulation *sim, ui::Point position)
 		return;
 	}
 
-	switch (propType)
-	{
-		case StructProperty::Float:
-			*((float*)(((char*)&sim->parts[ID(i)])+propOffset)) = propValue.Float;
-			break;
-		case StructProperty::ParticleType:
-		case StructProperty::Integer:
-			*((int*)(((char*)&sim->parts[ID(i)])+propOffset)) = propValue.Integer;
-			break;
-		case StructProperty::UInteger:
-			*((unsigned int*)(((char*)&sim->parts[ID(i)])+propOffset)) = propValue.UInteger;
-			break;
-		default:
-			break;
-	}
+	sim->SetPartProperty(ID(i), propType, propOffset, propValue);
 }
 
 void PropertyTool::Draw(Simulation *sim, Brush *cBrush, ui::Point position)
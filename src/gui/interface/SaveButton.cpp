@@ -6,6 +6,7 @@
 #include "Mouse.h"
 
 #include "client/Client.h"
+#include "client/ThumbnailCache.h"
 #include "client/ThumbnailRendererTask.h"
 #include "client/SaveFile.h"
 #include "client/SaveInfo.h"
@@ -14,6 +15,12 @@
 
 namespace ui {
 
+// Thumbnails of a given version of a save never change, those of the latest version may
+static ByteString ServerThumbnailKey(SaveInfo *save, ui::Point size)
+{
+	return ThumbnailCache::Key({}, ByteString::Build("server_", save->GetID(), "_", save->GetVersion(), "_", size.X, "x", size.Y));
+}
+
 SaveButton::SaveButton(Point position, Point size) :
 	Component(position, size),
 	file(nullptr),
@@ -120,6 +127,16 @@ SaveButton::~SaveButton()
 void SaveButton::OnResponse(std::unique_ptr<VideoBuffer> Thumbnail)
 {
 	thumbnail = std::move(Thumbnail);
+	if (thumbnail && save && save->GetVersion())
+	{
+		float scaleFactor = (Size.Y-25)/((float)YRES);
+		ui::Point thumbBoxSize = ui::Point(int(XRES*scaleFactor), int(YRES*scaleFactor));
+		// Written to the cache on a worker; nothing comes back from it, so it is left to the queue, which
+		// still stores abandoned thumbnails and deletes the task once it is done
+		auto *storeTask = new ThumbnailRendererTask(ServerThumbnailKey(save, thumbBoxSize), *thumbnail);
+		storeTask->Start();
+		storeTask->Abandon();
+	}
 }
 
 void SaveButton::Tick(float dt)
@@ -140,8 +157,18 @@ void SaveButton::Tick(float dt)
 				}
 				else if (save->GetID())
 				{
-					RequestSetup(save->GetID(), save->GetVersion(), thumbBoxSize.X, thumbBoxSize.Y);
-					RequestStart();
+					// Looking in the cache reads files, so it is left to a worker; the thumbnail is only
+					// downloaded once that has come back empty handed
+					if (save->GetVersion())
+					{
+						thumbnailRenderer = new ThumbnailRendererTask(ServerThumbnailKey(save, thumbBoxSize));
+						thumbnailRenderer->Start();
+					}
+					else
+					{
+						RequestSetup(save->GetID(), save->GetVersion(), thumbBoxSize.X, thumbBoxSize.Y);
+						RequestStart();
+					}
 					triedThumbnail = true;
 				}
 			}
@@ -157,11 +184,21 @@ void SaveButton::Tick(float dt)
 
 		if (thumbnailRenderer)
 		{
+			// Panels only draw the buttons that are on screen, render those first
+			thumbnailRenderer->SetPriority(wantsDraw ? 1 : 0);
+			wantsDraw = false;
 			thumbnailRenderer->Poll();
 			if (thumbnailRenderer->GetDone())
 			{
 				thumbnail = thumbnailRenderer->Finish();
 				thumbnailRenderer = nullptr;
+				if (!thumbnail && save && !save->GetGameSave() && save->GetID())
+				{
+					float scaleFactor = (Size.Y-25)/((float)YRES);
+					ui::Point thumbBoxSize = ui::Point(int(XRES*scaleFactor), int(YRES*scaleFactor));
+					RequestSetup(save->GetID(), save->GetVersion(), thumbBoxSize.X, thumbBoxSize.Y);
+					RequestStart();
+				}
 			}
 		}
 
@@ -20,6 +20,7 @@ public:
 	void SetAmbientHeatSimulation(bool state);
 	void SetNewtonianGravity(bool state);
 	void SetWaterEqualisation(bool state);
+	void SetFastHeat(bool state);
 	void SetGravityMode(int gravityMode);
 	void SetCustomGravityX(float x);
 	void SetCustomGravityY(float y);
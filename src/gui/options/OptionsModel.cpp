@@ -69,6 +69,17 @@ void OptionsModel::SetWaterEqualisation(bool state)
 	notifySettingsChanged();
 }
 
+bool OptionsModel::GetFastHeat()
+{
+	return sim->fastHeat;
+}
+
+void OptionsModel::SetFastHeat(bool state)
+{
+	sim->fastHeat = state;
+	notifySettingsChanged();
+}
+
 int OptionsModel::GetAirMode()
 {
 	return sim->air->airMode;
@@ -106,6 +106,18 @@ OptionsView::OptionsView():
 	tempLabel->Appearance.VerticalAlign = ui::Appearance::AlignMiddle;
 	scrollPanel->AddChild(tempLabel);
 
+	currentY+=16;
+	fastHeat = new ui::Checkbox(ui::Point(8, currentY), ui::Point(1, 16), "Fast heat conduction", "");
+	autowidth(fastHeat);
+	fastHeat->SetActionCallback({ [this] { c->SetFastHeat(fastHeat->GetChecked()); } });
+	scrollPanel->AddChild(fastHeat);
+	currentY+=14;
+	tempLabel = new ui::Label(ui::Point(24, currentY), ui::Point(1, 16), "\bgFaster with large thermal builds on multi-core machines, heat spreads differently");
+	autowidth(tempLabel);
+	tempLabel->Appearance.HorizontalAlign = ui::Appearance::AlignLeft;
+	tempLabel->Appearance.VerticalAlign = ui::Appearance::AlignMiddle;
+	scrollPanel->AddChild(tempLabel);
+
 	currentY+=19;
 	airMode = new ui::DropDown(ui::Point(Size.X-95, currentY), ui::Point(80, 16));
 	scrollPanel->AddChild(airMode);
@@ -493,6 +505,7 @@ void OptionsView::NotifySettingsChanged(OptionsModel * sender)
 	ambientHeatSimulation->SetChecked(sender->GetAmbientHeatSimulation());
 	newtonianGravity->SetChecked(sender->GetNewtonianGravity());
 	waterEqualisation->SetChecked(sender->GetWaterEqualisation());
+	fastHeat->SetChecked(sender->GetFastHeat());
 	airMode->SetOption(sender->GetAirMode());
 	// Initialize air temp and preview only when the options menu is opened, and not when user is actively editing the textbox
 	if (!initializedAirTempPreview)
@@ -22,6 +22,7 @@ class OptionsView: public ui::Window
 	ui::Checkbox * ambientHeatSimulation;
 	ui::Checkbox * newtonianGravity;
 	ui::Checkbox * waterEqualisation;
+	ui::Checkbox * fastHeat;
 	ui::DropDown * airMode;
 	ui::Textbox * ambientAirTemp;
 	ui::Button * ambientAirTempPreview;
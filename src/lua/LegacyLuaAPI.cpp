@@ -22,6 +22,7 @@
 #include "simulation/Gravity.h"
 #include "simulation/Simulation.h"
 #include "simulation/SimulationData.h"
+#include "simulation/SimulationThread.h"
 
 #include "gui/dialogues/ConfirmPrompt.h"
 #include "gui/dialogues/ErrorMessage.h"
@@ -99,11 +100,11 @@ int luacon_partread(lua_State* l)
 	{
 	case CommandInterface::FormatInt:
 	case CommandInterface::FormatElement:
-		tempinteger = *((int*)(((unsigned char*)&luacon_sim->parts[i])+offset));
+		tempinteger = luacon_sim->GetPartProperty<int>(i, offset);
 		lua_pushnumber(l, tempinteger);
 		break;
 	case CommandInterface::FormatFloat:
-		tempfloat = *((float*)(((unsigned char*)&luacon_sim->parts[i])+offset));
+		tempfloat = luacon_sim->GetPartProperty<float>(i, offset);
 		lua_pushnumber(l, tempfloat);
 		break;
 	default:
@@ -129,10 +130,10 @@ int luacon_partwrite(lua_State* l)
 	switch(format)
 	{
 	case CommandInterface::FormatInt:
-		*((int*)(((unsigned char*)&luacon_sim->parts[i])+offset)) = luaL_optinteger(l, 3, 0);
+		luacon_sim->SetPartProperty<int>(i, offset, luaL_optinteger(l, 3, 0));
 		break;
 	case CommandInterface::FormatFloat:
-		*((float*)(((unsigned char*)&luacon_sim->parts[i])+offset)) = luaL_optnumber(l, 3, 0);
+		luacon_sim->SetPartProperty<float>(i, offset, luaL_optnumber(l, 3, 0));
 		break;
 	case CommandInterface::FormatElement:
 		luacon_sim->part_change_type(i, int(luacon_sim->parts[i].x + 0.5f), int(luacon_sim->parts[i].y + 0.5f), luaL_optinteger(l, 3, 0));
@@ -267,6 +268,8 @@ int luacon_elementwrite(lua_State* l)
 	luacon_model->BuildMenus();
 	luacon_sim->init_can_move();
 	std::fill(&luacon_ren->graphicscache[0], &luacon_ren->graphicscache[PT_NUM], gcache_item());
+	luacon_ren->ClearParticleGraphicsCache();
+	SimulationThread::Ref().ElementsChanged();
 
 	return 0;
 }
@@ -632,9 +635,9 @@ int luatpt_set_property(lua_State* l)
 					if (format == CommandInterface::FormatElement)
 						luacon_sim->part_change_type(i, nx, ny, t);
 					else if(format == CommandInterface::FormatFloat)
-						*((float*)(((unsigned char*)&luacon_sim->parts[i])+offset)) = f;
+						luacon_sim->SetPartProperty<float>(i, offset, f);
 					else
-						*((int*)(((unsigned char*)&luacon_sim->parts[i])+offset)) = t;
+						luacon_sim->SetPartProperty<int>(i, offset, t);
 				}
 			}
 		}
@@ -665,9 +668,9 @@ int luatpt_set_property(lua_State* l)
 		if (format == CommandInterface::FormatElement)
 			luacon_sim->part_change_type(i, int(luacon_sim->parts[i].x + 0.5f), int(luacon_sim->parts[i].y + 0.5f), t);
 		else if (format == CommandInterface::FormatFloat)
-			*((float*)(((unsigned char*)&luacon_sim->parts[i])+offset)) = f;
+			luacon_sim->SetPartProperty<float>(i, offset, f);
 		else
-			*((int*)(((unsigned char*)&luacon_sim->parts[i])+offset)) = t;
+			luacon_sim->SetPartProperty<int>(i, offset, t);
 	}
 	return 0;
 }
@@ -830,11 +833,11 @@ int luatpt_get_property(lua_State* l)
 		{
 		case CommandInterface::FormatInt:
 		case CommandInterface::FormatElement:
-			tempinteger = *((int*)(((unsigned char*)&luacon_sim->parts[i])+offset));
+			tempinteger = luacon_sim->GetPartProperty<int>(i, offset);
 			lua_pushnumber(l, tempinteger);
 			break;
 		case CommandInterface::FormatFloat:
-			tempfloat = *((float*)(((unsigned char*)&luacon_sim->parts[i])+offset));
+			tempfloat = luacon_sim->GetPartProperty<float>(i, offset);
 			lua_pushnumber(l, tempfloat);
 			break;
 		default:
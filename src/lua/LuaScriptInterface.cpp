@@ -41,6 +41,7 @@
 #include "simulation/Simulation.h"
 #include "simulation/ToolClasses.h"
 #include "simulation/SaveRenderer.h"
+#include "simulation/SimulationThread.h"
 
 #include "gui/interface/Window.h"
 #include "gui/interface/Engine.h"
@@ -812,6 +813,7 @@ void LuaScriptInterface::initSimulationAPI()
 		{"partProperty", simulation_partProperty},
 		{"partPosition", simulation_partPosition},
 		{"partID", simulation_partID},
+		{"partNearest", simulation_partNearest},
 		{"partKill", simulation_partKill},
 		{"partExists", simulation_partExists},
 		{"pressure", simulation_pressure},
@@ -855,6 +857,7 @@ void LuaScriptInterface::initSimulationAPI()
 		{"airMode", simulation_airMode},
 		{"waterEqualisation", simulation_waterEqualisation},
 		{"waterEqualization", simulation_waterEqualisation},
+		{"fastHeat", simulation_fastHeat},
 		{"ambientAirTemp", simulation_ambientAirTemp},
 		{"elementCount", simulation_elementCount},
 		{"can_move", simulation_canMove},
@@ -1080,6 +1083,25 @@ int LuaScriptInterface::simulation_partID(lua_State * l)
 	return 1;
 }
 
+int LuaScriptInterface::simulation_partNearest(lua_State * l)
+{
+	int x = luaL_checkinteger(l, 1);
+	int y = luaL_checkinteger(l, 2);
+	int element = luaL_checkinteger(l, 3);
+	if (element <= 0 || element >= PT_NUM || !luacon_sim->elements[element].Enabled)
+		return luaL_error(l, "Invalid element ID (%d)", element);
+
+	auto *parts = luacon_sim->parts;
+	int i = luacon_sim->PartGrid(element).Nearest(parts, x, y, [parts, element](int candidate) {
+		return parts[candidate].type == element;
+	});
+	if (i < 0)
+		lua_pushnil(l);
+	else
+		lua_pushinteger(l, i);
+	return 1;
+}
+
 int LuaScriptInterface::simulation_partPosition(lua_State * l)
 {
 	int particleID = lua_tointeger(l, 1);
@@ -1098,8 +1120,12 @@ int LuaScriptInterface::simulation_partPosition(lua_State * l)
 
 	if(argCount == 3)
 	{
+		int oldX = int(luacon_sim->parts[particleID].x+0.5f), oldY = int(luacon_sim->parts[particleID].y+0.5f);
 		luacon_sim->parts[particleID].x = lua_tonumber(l, 2);
 		luacon_sim->parts[particleID].y = lua_tonumber(l, 3);
+		luacon_sim->PartGridMove(particleID);
+		luacon_sim->UpdatePartCoords(particleID);
+		luacon_sim->UpdatePartPmap(particleID, oldX, oldY);
 		return 0;
 	}
 	else
@@ -1160,7 +1186,7 @@ int LuaScriptInterface::simulation_partProperty(lua_State * l)
 	}
 
 	//Calculate memory address of property
-	intptr_t propertyAddress = (intptr_t)(((unsigned char*)&luacon_sim->parts[particleID]) + prop->Offset);
+	intptr_t propertyAddress = (intptr_t)luacon_sim->PartPropertyAddress(particleID, prop->Offset);
 
 	if(argCount == 3)
 	{
@@ -1170,7 +1196,14 @@ int LuaScriptInterface::simulation_partProperty(lua_State * l)
 		}
 		else
 		{
+			int oldX = int(luacon_sim->parts[particleID].x+0.5f), oldY = int(luacon_sim->parts[particleID].y+0.5f);
 			LuaSetProperty(l, *prop, propertyAddress, 3);
+			luacon_sim->UpdatePartCoords(particleID);
+			if (prop->Offset == offsetof(Particle, x) || prop->Offset == offsetof(Particle, y))
+			{
+				luacon_sim->PartGridMove(particleID);
+				luacon_sim->UpdatePartPmap(particleID, oldX, oldY);
+			}
 		}
 		return 0;
 	}
@@ -2032,6 +2065,18 @@ int LuaScriptInterface::simulation_waterEqualisation(lua_State * l)
 	return 0;
 }
 
+int LuaScriptInterface::simulation_fastHeat(lua_State * l)
+{
+	int acount = lua_gettop(l);
+	if (acount == 0)
+	{
+		lua_pushboolean(l, luacon_sim->fastHeat);
+		return 1;
+	}
+	luacon_sim->fastHeat = lua_toboolean(l, 1);
+	return 0;
+}
+
 int LuaScriptInterface::simulation_ambientAirTemp(lua_State * l)
 {
 	int acount = lua_gettop(l);
@@ -2734,6 +2779,13 @@ void LuaScriptInterface::initElementsAPI()
 	SETCONST(l, FLAG_SKIPMOVE);
 	SETCONST(l, FLAG_MOVABLE);
 	SETCONST(l, FLAG_PHOTDECO);
+	SETCONST(l, GCACHE_LIFE);
+	SETCONST(l, GCACHE_CTYPE);
+	SETCONST(l, GCACHE_TMP);
+	SETCONST(l, GCACHE_TMP2);
+	SETCONST(l, GCACHE_TMP3);
+	SETCONST(l, GCACHE_TMP4);
+	SETCONST(l, GCACHE_TEMP);
 	lua_pushinteger(l, 0);
 	lua_setfield(l, -2, "ST_NONE");
 	lua_pushinteger(l, 0);
@@ -2918,7 +2970,9 @@ int LuaScriptInterface::elements_loadDefault(lua_State * l)
 	}
 	luacon_ci->custom_init_can_move();
 	std::fill(luacon_ren->graphicscache, luacon_ren->graphicscache+PT_NUM, gcache_item());
+	luacon_ren->ClearParticleGraphicsCache();
 	SaveRenderer::Ref().Flush(0, PT_NUM);
+	SimulationThread::Ref().ElementsChanged();
 	return 0;
 }
 
@@ -2991,6 +3045,7 @@ int LuaScriptInterface::elements_allocate(lua_State * l)
 		}
 		luacon_model->BuildMenus();
 		luacon_ci->custom_init_can_move();
+		SimulationThread::Ref().ElementsChanged();
 	}
 
 	lua_pushinteger(l, newID);
@@ -3281,7 +3336,9 @@ int LuaScriptInterface::elements_element(lua_State * l)
 		luacon_model->BuildMenus();
 		luacon_ci->custom_init_can_move();
 		luacon_ren->graphicscache[id].isready = 0;
+		luacon_ren->ClearParticleGraphicsCache();
 		SaveRenderer::Ref().Flush(id, id + 1);
+		SimulationThread::Ref().ElementsChanged();
 
 		return 0;
 	}
@@ -3386,7 +3443,9 @@ int LuaScriptInterface::elements_property(lua_State * l)
 			luacon_model->BuildMenus();
 			luacon_ci->custom_init_can_move();
 			luacon_ren->graphicscache[id].isready = 0;
+			luacon_ren->ClearParticleGraphicsCache();
 			SaveRenderer::Ref().Flush(id, id + 1);
+			SimulationThread::Ref().ElementsChanged();
 		}
 		else if (propertyName == "Update")
 		{
@@ -3429,7 +3488,9 @@ int LuaScriptInterface::elements_property(lua_State * l)
 				luacon_sim->elements[id].Graphics = GetElements()[id].Graphics;
 			}
 			luacon_ren->graphicscache[id].isready = 0;
+			luacon_ren->ClearParticleGraphicsCache();
 			SaveRenderer::Ref().Flush(id, id + 1);
+			SimulationThread::Ref().ElementsChanged();
 		}
 		else if (propertyName == "Create")
 		{
@@ -3534,6 +3595,7 @@ int LuaScriptInterface::elements_free(lua_State * l)
 
 	luacon_sim->elements[id].Enabled = false;
 	luacon_model->BuildMenus();
+	SimulationThread::Ref().ElementsChanged();
 
 	lua_getglobal(l, "elements");
 	lua_pushnil(l);
@@ -62,6 +62,7 @@ class LuaScriptInterface: public CommandInterface
 	static int simulation_partProperty(lua_State * l);
 	static int simulation_partPosition(lua_State * l);
 	static int simulation_partID(lua_State * l);
+	static int simulation_partNearest(lua_State * l);
 	static int simulation_partKill(lua_State * l);
 	static int simulation_partExists(lua_State * l);
 	static int simulation_pressure(lua_State * l);
@@ -104,6 +105,7 @@ class LuaScriptInterface: public CommandInterface
 	static int simulation_customGravity(lua_State * l);
 	static int simulation_airMode(lua_State * l);
 	static int simulation_waterEqualisation(lua_State * l);
+	static int simulation_fastHeat(lua_State * l);
 	static int simulation_ambientAirTemp(lua_State * l);
 	static int simulation_elementCount(lua_State * l);
 	static int simulation_canMove(lua_State * l);
@@ -259,7 +259,6 @@ AnyType TPTScriptInterface::tptS_set(std::deque<String> * words)
 	AnyType value = eval(words);
 
 	Simulation * sim = m->GetSimulation();
-	unsigned char * partsBlock = (unsigned char*)&sim->parts[0];
 
 	int returnValue = 0;
 
@@ -326,10 +325,10 @@ AnyType TPTScriptInterface::tptS_set(std::deque<String> * words)
 		switch(propertyFormat)
 		{
 		case FormatInt:
-			*((int*)(partsBlock+(partIndex*sizeof(Particle))+propertyOffset)) = newValue;
+			sim->SetPartProperty<int>(partIndex, propertyOffset, newValue);
 			break;
 		case FormatFloat:
-			*((float*)(partsBlock+(partIndex*sizeof(Particle))+propertyOffset)) = newValuef;
+			sim->SetPartProperty<float>(partIndex, propertyOffset, newValuef);
 			break;
 		case FormatElement:
 			sim->part_change_type(partIndex, int(sim->parts[partIndex].x + 0.5f), int(sim->parts[partIndex].y + 0.5f), newValue);
@@ -349,7 +348,7 @@ AnyType TPTScriptInterface::tptS_set(std::deque<String> * words)
 					if(sim->parts[j].type)
 					{
 						returnValue++;
-						*((int*)(partsBlock+(j*sizeof(Particle))+propertyOffset)) = newValue;
+						sim->SetPartProperty<int>(j, propertyOffset, newValue);
 					}
 			}
 			break;
@@ -359,7 +358,7 @@ AnyType TPTScriptInterface::tptS_set(std::deque<String> * words)
 					if(sim->parts[j].type)
 					{
 						returnValue++;
-						*((float*)(partsBlock+(j*sizeof(Particle))+propertyOffset)) = newValuef;
+						sim->SetPartProperty<float>(j, propertyOffset, newValuef);
 					}
 			}
 			break;
@@ -397,7 +396,7 @@ AnyType TPTScriptInterface::tptS_set(std::deque<String> * words)
 					if (sim->parts[j].type == type)
 					{
 						returnValue++;
-						*((int*)(partsBlock+(j*sizeof(Particle))+propertyOffset)) = newValue;
+						sim->SetPartProperty<int>(j, propertyOffset, newValue);
 					}
 			}
 			break;
@@ -407,7 +406,7 @@ AnyType TPTScriptInterface::tptS_set(std::deque<String> * words)
 					if (sim->parts[j].type == type)
 					{
 						returnValue++;
-						*((float*)(partsBlock+(j*sizeof(Particle))+propertyOffset)) = newValuef;
+						sim->SetPartProperty<float>(j, propertyOffset, newValuef);
 					}
 			}
 			break;
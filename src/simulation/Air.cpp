@@ -2,10 +2,22 @@
 
 #include <cmath>
 #include <algorithm>
+#include <cstring>
 
 #include "Simulation.h"
 #include "ElementClasses.h"
 #include "common/tpt-rand.h"
+#include "common/ThreadPool.h"
+
+#ifdef X86_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// Rows of the velocity and pressure update handed to each thread pool job
+	constexpr int AIR_ROWS_PER_JOB = 8;
+}
 
 /*float kernel[9];
 
@@ -132,14 +144,201 @@ void Air::update_airh(void)
 	memcpy(hv, ohv, sizeof(hv));
 }
 
-void Air::update_air(void)
+// Weighted average of the velocity and pressure around a cell, where cells that block air count as the centre one
+void Air::BlurCell(int y, int x, float &dx, float &dy, float &dp)
 {
-	int x = 0, y = 0, i = 0, j = 0;
-	float dp = 0.0f, dx = 0.0f, dy = 0.0f, f = 0.0f, tx = 0.0f, ty = 0.0f;
+	int i, j;
+	float f;
+	dx = 0.0f;
+	dy = 0.0f;
+	dp = 0.0f;
+	for (j=-1; j<2; j++)
+		for (i=-1; i<2; i++)
+			if (y+j>0 && y+j<YRES/CELL-1 &&
+			        x+i>0 && x+i<XRES/CELL-1 &&
+			        !bmap_blockair[y+j][x+i])
+			{
+				f = kernel[i+1+(j+1)*3];
+				dx += vx[y+j][x+i]*f;
+				dy += vy[y+j][x+i]*f;
+				dp += pv[y+j][x+i]*f;
+			}
+			else
+			{
+				f = kernel[i+1+(j+1)*3];
+				dx += vx[y][x]*f;
+				dy += vy[y][x]*f;
+				dp += pv[y][x]*f;
+			}
+}
+
+#ifdef X86_SSE2
+// BlurCell for the four cells starting at x, which must all be at least two cells away from the edges.
+// Does the same operations in the same order as BlurCell, so the results are equivalent up to rounding; they are
+// only bit-identical if the compiler doesn't reorder BlurCell, which release builds with -ffast-math allow it to.
+void Air::BlurCellsSse2(int y, int x, float *dx, float *dy, float *dp)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128 centreX = _mm_loadu_ps(&vx[y][x]);
+	__m128 centreY = _mm_loadu_ps(&vy[y][x]);
+	__m128 centreP = _mm_loadu_ps(&pv[y][x]);
+	__m128 sumX = _mm_setzero_ps();
+	__m128 sumY = _mm_setzero_ps();
+	__m128 sumP = _mm_setzero_ps();
+	for (int j=-1; j<2; j++)
+		for (int i=-1; i<2; i++)
+		{
+			int blockAir;
+			memcpy(&blockAir, &bmap_blockair[y+j][x+i], sizeof(blockAir));
+			__m128i blocked = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(blockAir), zero), zero);
+			__m128 useCentre = _mm_castsi128_ps(_mm_cmpgt_epi32(blocked, zero));
+			__m128 f = _mm_set1_ps(kernel[i+1+(j+1)*3]);
+			__m128 valueX = _mm_or_ps(_mm_and_ps(useCentre, centreX), _mm_andnot_ps(useCentre, _mm_loadu_ps(&vx[y+j][x+i])));
+			__m128 valueY = _mm_or_ps(_mm_and_ps(useCentre, centreY), _mm_andnot_ps(useCentre, _mm_loadu_ps(&vy[y+j][x+i])));
+			__m128 valueP = _mm_or_ps(_mm_and_ps(useCentre, centreP), _mm_andnot_ps(useCentre, _mm_loadu_ps(&pv[y+j][x+i])));
+			sumX = _mm_add_ps(sumX, _mm_mul_ps(valueX, f));
+			sumY = _mm_add_ps(sumY, _mm_mul_ps(valueY, f));
+			sumP = _mm_add_ps(sumP, _mm_mul_ps(valueP, f));
+		}
+	_mm_storeu_ps(dx, sumX);
+	_mm_storeu_ps(dy, sumY);
+	_mm_storeu_ps(dp, sumP);
+}
+#endif
+
+// Advects the blurred velocity and pressure of a cell and stores the result in ovx, ovy and opv
+void Air::AdvectCell(int y, int x, float dx, float dy, float dp)
+{
+	int i, j;
+	float tx, ty;
 	const float advDistanceMult = 0.7f;
 	float stepX, stepY;
 	int stepLimit, step;
 
+	tx = x - dx*advDistanceMult;
+	ty = y - dy*advDistanceMult;
+	if ((dx*advDistanceMult>1.0f || dy*advDistanceMult>1.0f) && (tx>=2 && tx<XRES/CELL-2 && ty>=2 && ty<YRES/CELL-2))
+	{
+		// Trying to take velocity from far away, check whether there is an intervening wall. Step from current position to desired source location, looking for walls, with either the x or y step size being 1 cell
+		if (std::abs(dx)>std::abs(dy))
+		{
+			stepX = (dx<0.0f) ? 1.f : -1.f;
+			stepY = -dy/fabsf(dx);
+			stepLimit = (int)(fabsf(dx*advDistanceMult));
+		}
+		else
+		{
+			stepY = (dy<0.0f) ? 1.f : -1.f;
+			stepX = -dx/fabsf(dy);
+			stepLimit = (int)(fabsf(dy*advDistanceMult));
+		}
+		tx = float(x);
+		ty = float(y);
+		for (step=0; step<stepLimit; ++step)
+		{
+			tx += stepX;
+			ty += stepY;
+			if (bmap_blockair[(int)(ty+0.5f)][(int)(tx+0.5f)])
+			{
+				tx -= stepX;
+				ty -= stepY;
+				break;
+			}
+		}
+		if (step==stepLimit)
+		{
+			// No wall found
+			tx = x - dx*advDistanceMult;
+			ty = y - dy*advDistanceMult;
+		}
+	}
+	i = (int)tx;
+	j = (int)ty;
+	tx -= i;
+	ty -= j;
+	if (!bmap_blockair[y][x] && i>=2 && i<=XRES/CELL-3 &&
+	        j>=2 && j<=YRES/CELL-3)
+	{
+		dx *= 1.0f - AIR_VADV;
+		dy *= 1.0f - AIR_VADV;
+
+		dx += AIR_VADV*(1.0f-tx)*(1.0f-ty)*vx[j][i];
+		dy += AIR_VADV*(1.0f-tx)*(1.0f-ty)*vy[j][i];
+
+		dx += AIR_VADV*tx*(1.0f-ty)*vx[j][i+1];
+		dy += AIR_VADV*tx*(1.0f-ty)*vy[j][i+1];
+
+		dx += AIR_VADV*(1.0f-tx)*ty*vx[j+1][i];
+		dy += AIR_VADV*(1.0f-tx)*ty*vy[j+1][i];
+
+		dx += AIR_VADV*tx*ty*vx[j+1][i+1];
+		dy += AIR_VADV*tx*ty*vy[j+1][i+1];
+	}
+
+	if (bmap[y][x] == WL_FAN)
+	{
+		dx += fvx[y][x];
+		dy += fvy[y][x];
+	}
+	// pressure/velocity caps
+	if (dp > 256.0f) dp = 256.0f;
+	if (dp < -256.0f) dp = -256.0f;
+	if (dx > 256.0f) dx = 256.0f;
+	if (dx < -256.0f) dx = -256.0f;
+	if (dy > 256.0f) dy = 256.0f;
+	if (dy < -256.0f) dy = -256.0f;
+
+
+	switch (airMode)
+	{
+	default:
+	case 0:  //Default
+		break;
+	case 1:  //0 Pressure
+		dp = 0.0f;
+		break;
+	case 2:  //0 Velocity
+		dx = 0.0f;
+		dy = 0.0f;
+		break;
+	case 3: //0 Air
+		dx = 0.0f;
+		dy = 0.0f;
+		dp = 0.0f;
+		break;
+	case 4: //No Update
+		break;
+	}
+
+	ovx[y][x] = dx;
+	ovy[y][x] = dy;
+	opv[y][x] = dp;
+}
+
+void Air::UpdateAirRow(int y, bool simd)
+{
+	float dx[XRES/CELL], dy[XRES/CELL], dp[XRES/CELL];
+	int x = 0;
+#ifdef X86_SSE2
+	if (simd && y>=2 && y<YRES/CELL-2)
+	{
+		for (; x<2; x++)
+			BlurCell(y, x, dx[x], dy[x], dp[x]);
+		for (; x+4<=XRES/CELL-2; x+=4)
+			BlurCellsSse2(y, x, &dx[x], &dy[x], &dp[x]);
+	}
+#endif
+	for (; x<XRES/CELL; x++)
+		BlurCell(y, x, dx[x], dy[x], dp[x]);
+	for (x=0; x<XRES/CELL; x++)
+		AdvectCell(y, x, dx[x], dy[x], dp[x]);
+}
+
+void Air::update_air(void)
+{
+	int x = 0, y = 0, i = 0, j = 0;
+	float dp = 0.0f, dx = 0.0f, dy = 0.0f;
+
 	if (airMode != 4) { //airMode 4 is no air/pressure update
 
 		for (i=0; i<YRES/CELL; i++) //reduces pressure/velocity on the edges every frame
@@ -215,130 +414,19 @@ void Air::update_air(void)
 					vy[y][x] = 0;
 			}
 
-		for (y=0; y<YRES/CELL; y++) //update velocity and pressure
-			for (x=0; x<XRES/CELL; x++)
-			{
-				dx = 0.0f;
-				dy = 0.0f;
-				dp = 0.0f;
-				for (j=-1; j<2; j++)
-					for (i=-1; i<2; i++)
-						if (y+j>0 && y+j<YRES/CELL-1 &&
-						        x+i>0 && x+i<XRES/CELL-1 &&
-						        !bmap_blockair[y+j][x+i])
-						{
-							f = kernel[i+1+(j+1)*3];
-							dx += vx[y+j][x+i]*f;
-							dy += vy[y+j][x+i]*f;
-							dp += pv[y+j][x+i]*f;
-						}
-						else
-						{
-							f = kernel[i+1+(j+1)*3];
-							dx += vx[y][x]*f;
-							dy += vy[y][x]*f;
-							dp += pv[y][x]*f;
-						}
-
-				tx = x - dx*advDistanceMult;
-				ty = y - dy*advDistanceMult;
-				if ((dx*advDistanceMult>1.0f || dy*advDistanceMult>1.0f) && (tx>=2 && tx<XRES/CELL-2 && ty>=2 && ty<YRES/CELL-2))
-				{
-					// Trying to take velocity from far away, check whether there is an intervening wall. Step from current position to desired source location, looking for walls, with either the x or y step size being 1 cell
-					if (std::abs(dx)>std::abs(dy))
-					{
-						stepX = (dx<0.0f) ? 1.f : -1.f;
-						stepY = -dy/fabsf(dx);
-						stepLimit = (int)(fabsf(dx*advDistanceMult));
-					}
-					else
-					{
-						stepY = (dy<0.0f) ? 1.f : -1.f;
-						stepX = -dx/fabsf(dy);
-						stepLimit = (int)(fabsf(dy*advDistanceMult));
-					}
-					tx = float(x);
-					ty = float(y);
-					for (step=0; step<stepLimit; ++step)
-					{
-						tx += stepX;
-						ty += stepY;
-						if (bmap_blockair[(int)(ty+0.5f)][(int)(tx+0.5f)])
-						{
-							tx -= stepX;
-							ty -= stepY;
-							break;
-						}
-					}
-					if (step==stepLimit)
-					{
-						// No wall found
-						tx = x - dx*advDistanceMult;
-						ty = y - dy*advDistanceMult;
-					}
-				}
-				i = (int)tx;
-				j = (int)ty;
-				tx -= i;
-				ty -= j;
-				if (!bmap_blockair[y][x] && i>=2 && i<=XRES/CELL-3 &&
-				        j>=2 && j<=YRES/CELL-3)
-				{
-					dx *= 1.0f - AIR_VADV;
-					dy *= 1.0f - AIR_VADV;
-
-					dx += AIR_VADV*(1.0f-tx)*(1.0f-ty)*vx[j][i];
-					dy += AIR_VADV*(1.0f-tx)*(1.0f-ty)*vy[j][i];
-
-					dx += AIR_VADV*tx*(1.0f-ty)*vx[j][i+1];
-					dy += AIR_VADV*tx*(1.0f-ty)*vy[j][i+1];
-
-					dx += AIR_VADV*(1.0f-tx)*ty*vx[j+1][i];
-					dy += AIR_VADV*(1.0f-tx)*ty*vy[j+1][i];
-
-					dx += AIR_VADV*tx*ty*vx[j+1][i+1];
-					dy += AIR_VADV*tx*ty*vy[j+1][i+1];
-				}
-
-				if (bmap[y][x] == WL_FAN)
-				{
-					dx += fvx[y][x];
-					dy += fvy[y][x];
-				}
-				// pressure/velocity caps
-				if (dp > 256.0f) dp = 256.0f;
-				if (dp < -256.0f) dp = -256.0f;
-				if (dx > 256.0f) dx = 256.0f;
-				if (dx < -256.0f) dx = -256.0f;
-				if (dy > 256.0f) dy = 256.0f;
-				if (dy < -256.0f) dy = -256.0f;
-
-
-				switch (airMode)
-				{
-				default:
-				case 0:  //Default
-					break;
-				case 1:  //0 Pressure
-					dp = 0.0f;
-					break;
-				case 2:  //0 Velocity
-					dx = 0.0f;
-					dy = 0.0f;
-					break;
-				case 3: //0 Air
-					dx = 0.0f;
-					dy = 0.0f;
-					dp = 0.0f;
-					break;
-				case 4: //No Update
-					break;
-				}
-
-				ovx[y][x] = dx;
-				ovy[y][x] = dy;
-				opv[y][x] = dp;
-			}
+		if (scalarUpdate)
+		{
+			for (y=0; y<YRES/CELL; y++) //update velocity and pressure
+				UpdateAirRow(y, false);
+		}
+		else
+		{
+			// Rows only read vx, vy and pv, and only write their own row of ovx, ovy and opv
+			ThreadPool::Ref().ParallelFor((YRES/CELL + AIR_ROWS_PER_JOB - 1) / AIR_ROWS_PER_JOB, [this](int job) {
+				for (int y = job * AIR_ROWS_PER_JOB; y < std::min((job + 1) * AIR_ROWS_PER_JOB, YRES/CELL); y++)
+					UpdateAirRow(y, true);
+			});
+		}
 		memcpy(vx, ovx, sizeof(vx));
 		memcpy(vy, ovy, sizeof(vy));
 		memcpy(pv, opv, sizeof(pv));
@@ -390,7 +478,8 @@ void Air::RecalculateBlockAirMaps()
 Air::Air(Simulation & simulation):
 	sim(simulation),
 	airMode(0),
-	ambientAirTemp(R_TEMP + 273.15f)
+	ambientAirTemp(R_TEMP + 273.15f),
+	scalarUpdate(false)
 {
 	//Simulation should do this.
 	make_kernel();
@@ -10,6 +10,9 @@ public:
 	Simulation & sim;
 	int airMode;
 	float ambientAirTemp;
+	// Update velocity and pressure one row at a time on the calling thread, without SIMD.
+	// The results are equivalent up to rounding either way, this is for checking that they still are.
+	bool scalarUpdate;
 	//Arrays from the simulation
 	unsigned char (*bmap)[XRES/CELL];
 	unsigned char (*emap)[XRES/CELL];
@@ -30,6 +33,12 @@ public:
 	void make_kernel(void);
 	void update_airh(void);
 	void update_air(void);
+	void UpdateAirRow(int y, bool simd);
+	void BlurCell(int y, int x, float &dx, float &dy, float &dp);
+#ifdef X86_SSE2
+	void BlurCellsSse2(int y, int x, float *dx, float *dy, float *dp);
+#endif
+	void AdvectCell(int y, int x, float dx, float dy, float dp);
 	void Clear();
 	void ClearAirH();
 	void Invert();
@@ -88,7 +88,8 @@ std::vector<StructProperty> const &Element::GetProperties()
 		{ "LowTemperature",            StructProperty::Float,    offsetof(Element, LowTemperature           ) },
 		{ "LowTemperatureTransition",  StructProperty::TransitionType,  offsetof(Element, LowTemperatureTransition ) },
 		{ "HighTemperature",           StructProperty::Float,    offsetof(Element, HighTemperature          ) },
-		{ "HighTemperatureTransition", StructProperty::TransitionType,  offsetof(Element, HighTemperatureTransition) }
+		{ "HighTemperatureTransition", StructProperty::TransitionType,  offsetof(Element, HighTemperatureTransition) },
+		{ "GraphicsCacheFields",       StructProperty::UInteger, offsetof(Element, GraphicsCacheFields      ) }
 	};
 	return properties;
 }
@@ -52,9 +52,14 @@ public:
 
 	int (*Update) (UPDATE_FUNC_ARGS);
 	int (*Graphics) (GRAPHICS_FUNC_ARGS);
+	// GCACHE_ flags of the particle properties Graphics depends on, if it depends on nothing else (not the position,
+	// neighbours or random numbers). If set, Graphics is only called once for every combination of their values.
+	unsigned int GraphicsCacheFields = 0;
 
 	void (*Create)(ELEMENT_CREATE_FUNC_ARGS) = nullptr;
 	bool (*CreateAllowed)(ELEMENT_CREATE_ALLOWED_FUNC_ARGS) = nullptr;
+	// Also called from the worker threads of Simulation::UpdateParticlesInStripes, one call at a time, so it should
+	// only touch state that the Update functions of types without a ChangeType handler don't read
 	void (*ChangeType)(ELEMENT_CHANGETYPE_FUNC_ARGS) = nullptr;
 
 	bool (*CtypeDraw) (CTYPEDRAW_FUNC_ARGS);
@@ -32,6 +32,15 @@
 #define PROP_NOAMBHEAT		0x40000  //2^18 Don't transfer or receive heat from ambient heat.
 #define PROP_NOCTYPEDRAW	0x100000 // 2^20 When this element is drawn upon with, do not set ctype (like BCLN for CLNE)
 
+// Particle properties an element's Graphics function depends on, see Element::GraphicsCacheFields
+#define GCACHE_LIFE		0x01
+#define GCACHE_CTYPE	0x02
+#define GCACHE_TMP		0x04
+#define GCACHE_TMP2		0x08
+#define GCACHE_TMP3		0x10
+#define GCACHE_TMP4		0x20
+#define GCACHE_TEMP		0x40
+
 #define FLAG_STAGNANT	0x1
 #define FLAG_SKIPMOVE  0x2 // skip movement for one frame, only implemented for PHOT
 //#define FLAG_WATEREQUAL 0x4 //if a liquid was already checked during equalization
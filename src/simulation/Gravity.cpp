@@ -1,7 +1,11 @@
 #include "Gravity.h"
 
+#include <algorithm>
 #include <cmath>
+#include <complex>
+#include <cstring>
 #include <iostream>
+#include <vector>
 #include <sys/types.h>
 
 #include "CoordStack.h"
@@ -9,6 +13,14 @@
 #include "Simulation.h"
 #include "SimulationData.h"
 
+namespace
+{
+	// Sparse updates add the field of each changed cell to the whole map, which is only
+	// cheaper than a full FFT update if few cells changed
+	constexpr int GRAV_SPARSE_MAX_CELLS = 64;
+	// Full updates after this many sparse ones, so that rounding errors don't add up
+	constexpr int GRAV_SPARSE_MAX_UPDATES = 60;
+}
 
 Gravity::Gravity()
 {
@@ -29,9 +41,11 @@ Gravity::Gravity()
 Gravity::~Gravity()
 {
 	stop_grav_async();
-#ifdef GRAVFFT
 	grav_fft_cleanup();
-#endif
+	delete[] th_pointgravx;
+	delete[] th_pointgravy;
+	delete[] th_fieldx;
+	delete[] th_fieldy;
 
 	delete[] th_ogravmap;
 	delete[] th_gravmap;
@@ -152,16 +166,10 @@ void Gravity::gravity_update_async()
 			{
 				if (th_gravchanged && !ignoreNextResult)
 				{
-#if !defined(GRAVFFT) && defined(GRAV_DIFF)
-					memcpy(gravy, th_gravy, (XRES/CELL)*(YRES/CELL)*sizeof(float));
-					memcpy(gravx, th_gravx, (XRES/CELL)*(YRES/CELL)*sizeof(float));
-					memcpy(gravp, th_gravp, (XRES/CELL)*(YRES/CELL)*sizeof(float));
-#else
 					// Copy thread gravity maps into this one
 					std::swap(gravy, th_gravy);
 					std::swap(gravx, th_gravx);
 					std::swap(gravp, th_gravp);
-#endif
 				}
 				ignoreNextResult = false;
 
@@ -175,7 +183,16 @@ void Gravity::gravity_update_async()
 
 	if (signal_grav)
 	{
-		gravcv.notify_one();
+		if (gravthread.joinable())
+		{
+			gravcv.notify_one();
+		}
+		else
+		{
+			// Synchronous mode, do what the gravity thread would have done
+			update_grav();
+			grav_ready = 1;
+		}
 	}
 	unsigned int size = (XRES / CELL) * (YRES / CELL);
 	membwand(gravy, gravmask, size * sizeof(float), size * sizeof(unsigned));
@@ -183,10 +200,8 @@ void Gravity::gravity_update_async()
 	std::fill(&gravmap[0], &gravmap[size], 0.0f);
 }
 
-void Gravity::update_grav_async()
+void Gravity::reset_thread_maps()
 {
-	int done = 0;
-	int thread_done = 0;
 	unsigned int size = (XRES / CELL) * (YRES / CELL);
 	std::fill(&th_ogravmap[0], &th_ogravmap[size], 0.0f);
 	std::fill(&th_gravmap[0], &th_gravmap[size], 0.0f);
@@ -194,10 +209,16 @@ void Gravity::update_grav_async()
 	std::fill(&th_gravx[0], &th_gravx[size], 0.0f);
 	std::fill(&th_gravp[0], &th_gravp[size], 0.0f);
 
-#ifdef GRAVFFT
 	if (!grav_fft_status)
 		grav_fft_init();
-#endif
+	th_fieldvalid = false;
+}
+
+void Gravity::update_grav_async()
+{
+	int done = 0;
+	int thread_done = 0;
+	reset_thread_maps();
 
 	std::unique_lock<std::mutex> l(gravmutex);
 	while (!thread_done)
@@ -227,7 +248,16 @@ void Gravity::start_grav_async()
 
 	gravthread_done = 0;
 	grav_ready = 0;
-	gravthread = std::thread([this]() { update_grav_async(); }); //Start asynchronous gravity simulation
+	if (synchronous)
+	{
+		reset_thread_maps();
+		update_grav();
+		grav_ready = 1;
+	}
+	else
+	{
+		gravthread = std::thread([this]() { update_grav_async(); }); //Start asynchronous gravity simulation
+	}
 	enabled = true;
 
 	unsigned int size = (XRES / CELL) * (YRES / CELL);
@@ -241,12 +271,15 @@ void Gravity::stop_grav_async()
 {
 	if (enabled)
 	{
+		if (gravthread.joinable())
 		{
-			std::lock_guard<std::mutex> g(gravmutex);
-			gravthread_done = 1;
+			{
+				std::lock_guard<std::mutex> g(gravmutex);
+				gravthread_done = 1;
+			}
+			gravcv.notify_one();
+			gravthread.join();
 		}
-		gravcv.notify_one();
-		gravthread.join();
 		enabled = false;
 	}
 	// Clear the grav velocities
@@ -258,125 +291,495 @@ void Gravity::stop_grav_async()
 }
 
 #ifdef GRAVFFT
-void Gravity::update_grav()
+void Gravity::grav_fft_solve()
 {
 	int xblock2 = XRES/CELL*2, yblock2 = YRES/CELL*2;
 	int fft_tsize = (xblock2/2+1)*yblock2;
 	float mr, mc, pr, pc, gr, gc;
-	if (memcmp(th_ogravmap, th_gravmap, sizeof(float)*(XRES/CELL)*(YRES/CELL)) != 0)
+	//copy gravmap into padded gravmap array
+	for (int y = 0; y < YRES / CELL; y++)
 	{
-		th_gravchanged = 1;
+		for (int x = 0; x < XRES / CELL; x++)
+		{
+			th_gravmapbig[(y+YRES/CELL)*xblock2+XRES/CELL+x] = th_gravmap[y*(XRES/CELL)+x];
+		}
+	}
+	//transform gravmap
+	fftwf_execute(plan_gravmap);
+	//do convolution (multiply the complex numbers)
+	for (int i = 0; i < fft_tsize; i++)
+	{
+		mr = th_gravmapbigt[i][0];
+		mc = th_gravmapbigt[i][1];
+		pr = th_ptgravxt[i][0];
+		pc = th_ptgravxt[i][1];
+		gr = mr*pr-mc*pc;
+		gc = mr*pc+mc*pr;
+		th_gravxbigt[i][0] = gr;
+		th_gravxbigt[i][1] = gc;
+		pr = th_ptgravyt[i][0];
+		pc = th_ptgravyt[i][1];
+		gr = mr*pr-mc*pc;
+		gc = mr*pc+mc*pr;
+		th_gravybigt[i][0] = gr;
+		th_gravybigt[i][1] = gc;
+	}
+	//inverse transform, and copy from padded arrays into normal velocity maps
+	fftwf_execute(plan_gravx_inverse);
+	fftwf_execute(plan_gravy_inverse);
+	for (int y = 0; y < YRES / CELL; y++)
+	{
+		for (int x = 0; x < XRES / CELL; x++)
+		{
+			th_gravx[y*(XRES/CELL)+x] = th_gravxbig[y*xblock2+x];
+			th_gravy[y*(XRES/CELL)+x] = th_gravybig[y*xblock2+x];
+			th_gravp[y*(XRES/CELL)+x] = sqrtf(pow(th_gravxbig[y*xblock2+x],2)+pow(th_gravybig[y*xblock2+x],2));
+		}
+	}
+}
 
-		membwand(th_gravmap, gravmask, (XRES/CELL)*(YRES/CELL)*sizeof(float), (XRES/CELL)*(YRES/CELL)*sizeof(unsigned));
-		//copy gravmap into padded gravmap array
-		for (int y = 0; y < YRES / CELL; y++)
+#else
+// Built-in replacement for fftw, used when the game is built without it
+
+namespace
+{
+	using Complex = std::complex<float>;
+
+	// std::complex multiplication checks for infinities and NaNs, which is slow and not needed here
+	inline Complex Multiply(Complex a, Complex b)
+	{
+		return Complex(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+	}
+
+	// Unnormalized mixed radix complex FFT, for sizes that are products of small primes
+	class ComplexFft
+	{
+		int size;
+		// Radix of each stage, followed by the size of the transforms that stage combines
+		std::vector<int> factors;
+		// exp(-2 pi i k / size)
+		std::vector<Complex> twiddles;
+		std::vector<Complex> scratch;
+
+		void Work(Complex *out, const Complex *in, int fstride, int inStride, int stage);
+		void Butterfly2(Complex *out, int fstride, int m);
+		void Butterfly4(Complex *out, int fstride, int m);
+		void ButterflyGeneric(Complex *out, int fstride, int m, int p);
+
+	public:
+		ComplexFft(int size);
+
+		// out[k] = sum of in[n*inStride]*exp(-2 pi i n k / size), out must not overlap in
+		void Forward(const Complex *in, int inStride, Complex *out)
+		{
+			Work(out, in, 1, inStride, 0);
+		}
+	};
+
+	ComplexFft::ComplexFft(int size) :
+		size(size),
+		twiddles(size)
+	{
+		for (int k = 0; k < size; k++)
+		{
+			double phase = -2.0 * M_PI * k / size;
+			twiddles[k] = Complex(float(cos(phase)), float(sin(phase)));
+		}
+		int n = size, p = 4;
+		int maxRadix = 1;
+		while (n > 1)
 		{
-			for (int x = 0; x < XRES / CELL; x++)
+			while (n % p)
 			{
-				th_gravmapbig[(y+YRES/CELL)*xblock2+XRES/CELL+x] = th_gravmap[y*(XRES/CELL)+x];
+				if (p == 4)
+					p = 2;
+				else if (p == 2)
+					p = 3;
+				else
+					p += 2;
 			}
+			n /= p;
+			factors.push_back(p);
+			factors.push_back(n);
+			maxRadix = std::max(maxRadix, p);
+		}
+		scratch.resize(maxRadix);
+	}
+
+	void ComplexFft::Work(Complex *out, const Complex *in, int fstride, int inStride, int stage)
+	{
+		int p = factors[stage];
+		int m = factors[stage + 1];
+		Complex *outEnd = out + p * m;
+		if (m == 1)
+		{
+			for (Complex *o = out; o != outEnd; o++, in += fstride * inStride)
+				*o = *in;
+		}
+		else
+		{
+			for (Complex *o = out; o != outEnd; o += m, in += fstride * inStride)
+				Work(o, in, fstride * p, inStride, stage + 2);
+		}
+		switch (p)
+		{
+		case 2:
+			Butterfly2(out, fstride, m);
+			break;
+
+		case 4:
+			Butterfly4(out, fstride, m);
+			break;
+
+		default:
+			ButterflyGeneric(out, fstride, m, p);
+			break;
+		}
+	}
+
+	void ComplexFft::Butterfly2(Complex *out, int fstride, int m)
+	{
+		for (int k = 0; k < m; k++)
+		{
+			Complex t = Multiply(out[m + k], twiddles[k * fstride]);
+			out[m + k] = out[k] - t;
+			out[k] += t;
 		}
-		//transform gravmap
-		fftwf_execute(plan_gravmap);
-		//do convolution (multiply the complex numbers)
-		for (int i = 0; i < fft_tsize; i++)
-		{
-			mr = th_gravmapbigt[i][0];
-			mc = th_gravmapbigt[i][1];
-			pr = th_ptgravxt[i][0];
-			pc = th_ptgravxt[i][1];
-			gr = mr*pr-mc*pc;
-			gc = mr*pc+mc*pr;
-			th_gravxbigt[i][0] = gr;
-			th_gravxbigt[i][1] = gc;
-			pr = th_ptgravyt[i][0];
-			pc = th_ptgravyt[i][1];
-			gr = mr*pr-mc*pc;
-			gc = mr*pc+mc*pr;
-			th_gravybigt[i][0] = gr;
-			th_gravybigt[i][1] = gc;
+	}
+
+	void ComplexFft::Butterfly4(Complex *out, int fstride, int m)
+	{
+		for (int k = 0; k < m; k++)
+		{
+			Complex s0 = Multiply(out[k + m], twiddles[k * fstride]);
+			Complex s1 = Multiply(out[k + 2 * m], twiddles[2 * k * fstride]);
+			Complex s2 = Multiply(out[k + 3 * m], twiddles[3 * k * fstride]);
+			Complex s5 = out[k] - s1;
+			out[k] += s1;
+			Complex s3 = s0 + s2;
+			Complex s4 = s0 - s2;
+			out[k + 2 * m] = out[k] - s3;
+			out[k] += s3;
+			out[k + m] = Complex(s5.real() + s4.imag(), s5.imag() - s4.real());
+			out[k + 3 * m] = Complex(s5.real() - s4.imag(), s5.imag() + s4.real());
 		}
-		//inverse transform, and copy from padded arrays into normal velocity maps
-		fftwf_execute(plan_gravx_inverse);
-		fftwf_execute(plan_gravy_inverse);
-		for (int y = 0; y < YRES / CELL; y++)
+	}
+
+	void ComplexFft::ButterflyGeneric(Complex *out, int fstride, int m, int p)
+	{
+		for (int u = 0; u < m; u++)
 		{
-			for (int x = 0; x < XRES / CELL; x++)
+			for (int q = 0; q < p; q++)
+				scratch[q] = out[u + q * m];
+			for (int q = 0; q < p; q++)
 			{
-				th_gravx[y*(XRES/CELL)+x] = th_gravxbig[y*xblock2+x];
-				th_gravy[y*(XRES/CELL)+x] = th_gravybig[y*xblock2+x];
-				th_gravp[y*(XRES/CELL)+x] = sqrtf(pow(th_gravxbig[y*xblock2+x],2)+pow(th_gravybig[y*xblock2+x],2));
+				int k = u + q * m;
+				int twiddle = 0;
+				Complex sum = scratch[0];
+				for (int r = 1; r < p; r++)
+				{
+					twiddle += fstride * k;
+					if (twiddle >= size)
+						twiddle -= size;
+					sum += Multiply(scratch[r], twiddles[twiddle]);
+				}
+				out[k] = sum;
 			}
 		}
 	}
-	else
+
+	// Smallest even size with no prime factors above 5 that a cyclic convolution of length cells
+	// can be done in without wrapping around
+	int PaddedSize(int cells)
 	{
-		th_gravchanged = 0;
+		for (int size = 2 * cells - 1; ; size++)
+		{
+			int n = size;
+			for (int p : { 2, 3, 5 })
+				while (!(n % p))
+					n /= p;
+			if (n == 1 && !(size % 2))
+				return size;
+		}
 	}
+}
 
-	// Copy th_ogravmap into th_gravmap (doesn't matter what th_ogravmap is afterwards)
-	std::swap(th_gravmap, th_ogravmap);
+// Convolves the gravity map with the field of a point mass, with 2D real FFTs. Rows are transformed
+// with a complex FFT of half their length, then the (width/2+1) columns of the result with a
+// complex FFT of their full length. Like fftw, no transform is normalized, the kernel is scaled instead.
+class GravityFft
+{
+	int cellsX, cellsY;
+	int width, height, spectrumWidth;
+	ComplexFft rowFft, columnFft;
+	// exp(-2 pi i k / width) for k up to width/2, for splitting the transform of a row into that of its even and odd cells
+	std::vector<Complex> rowTwiddles;
+	std::vector<Complex> kernelX, kernelY;
+	std::vector<Complex> spectrum, spectrumX, spectrumY;
+	std::vector<Complex> bufferIn, bufferOut;
+	std::vector<float> realOut;
+
+	void Forward(const float *in, int inWidth, int inRows, Complex *out);
+	void Inverse(Complex *in, int outWidth, int outRows, float *out);
+
+public:
+	GravityFft(int cellsX, int cellsY);
+	void Convolve(const float *mass, float *gravx, float *gravy, float *gravp);
+};
+
+GravityFft::GravityFft(int cellsX, int cellsY) :
+	cellsX(cellsX),
+	cellsY(cellsY),
+	width(PaddedSize(cellsX)),
+	height(PaddedSize(cellsY)),
+	spectrumWidth(width / 2 + 1),
+	rowFft(width / 2),
+	columnFft(height),
+	rowTwiddles(width / 2 + 1),
+	kernelX(spectrumWidth * height),
+	kernelY(spectrumWidth * height),
+	spectrum(spectrumWidth * height),
+	spectrumX(spectrumWidth * height),
+	spectrumY(spectrumWidth * height),
+	bufferIn(std::max(width / 2, height)),
+	bufferOut(std::max(width / 2, height)),
+	realOut(width * height)
+{
+	for (int k = 0; k <= width / 2; k++)
+	{
+		double phase = -2.0 * M_PI * k / width;
+		rowTwiddles[k] = Complex(float(cos(phase)), float(sin(phase)));
+	}
+
+	//calculate velocity map caused by a point mass, at every offset from it that fits in the map
+	std::vector<float> pointX(width * height, 0.0f), pointY(width * height, 0.0f);
+	double scaleFactor = -double(M_GRAV) / (width * height);
+	for (int y = -(cellsY - 1); y < cellsY; y++)
+	{
+		for (int x = -(cellsX - 1); x < cellsX; x++)
+		{
+			if (!x && !y)
+				continue;
+			double distance = sqrt(double(x * x + y * y));
+			int i = ((y + height) % height) * width + (x + width) % width;
+			pointX[i] = float(scaleFactor * x / (distance * distance * distance));
+			pointY[i] = float(scaleFactor * y / (distance * distance * distance));
+		}
+	}
+	Forward(&pointX[0], width, height, &kernelX[0]);
+	Forward(&pointY[0], width, height, &kernelY[0]);
 }
 
-#else
-// gravity without fast Fourier transforms
+// Transforms a map of inRows rows of inWidth cells, padded with zeros to width by height
+void GravityFft::Forward(const float *in, int inWidth, int inRows, Complex *out)
+{
+	int half = width / 2;
+	for (int y = 0; y < inRows; y++)
+	{
+		const float *row = &in[y * inWidth];
+		for (int n = 0; n < half; n++)
+		{
+			float even = 2 * n < inWidth ? row[2 * n] : 0.0f;
+			float odd = 2 * n + 1 < inWidth ? row[2 * n + 1] : 0.0f;
+			bufferIn[n] = Complex(even, odd);
+		}
+		rowFft.Forward(&bufferIn[0], 1, &bufferOut[0]);
+		Complex *rowOut = &out[y * spectrumWidth];
+		for (int k = 0; k <= half; k++)
+		{
+			Complex z = bufferOut[k % half];
+			Complex zc = std::conj(bufferOut[(half - k) % half]);
+			Complex even = (z + zc) * 0.5f;
+			Complex odd = Complex(z.imag() - zc.imag(), zc.real() - z.real()) * 0.5f;
+			rowOut[k] = even + Multiply(rowTwiddles[k], odd);
+		}
+	}
+	std::fill(&out[inRows * spectrumWidth], &out[height * spectrumWidth], Complex(0.0f, 0.0f));
+	for (int x = 0; x < spectrumWidth; x++)
+	{
+		columnFft.Forward(&out[x], spectrumWidth, &bufferOut[0]);
+		for (int y = 0; y < height; y++)
+			out[y * spectrumWidth + x] = bufferOut[y];
+	}
+}
 
-void Gravity::update_grav(void)
+// Inverse of Forward, overwrites in and only produces the top left outWidth by outRows cells
+void GravityFft::Inverse(Complex *in, int outWidth, int outRows, float *out)
 {
-	int x, y, i, j;
-	float val, distance;
-	th_gravchanged = 0;
-#ifndef GRAV_DIFF
-	//Find any changed cells
-	for (i=0; i<YRES/CELL; i++)
-	{
-		if(changed)
-			break;
-		for (j=0; j<XRES/CELL; j++)
+	int half = width / 2;
+	// The inverse transform is the conjugate of the forward transform of the conjugate
+	for (int x = 0; x < spectrumWidth; x++)
+	{
+		for (int y = 0; y < height; y++)
+			bufferIn[y] = std::conj(in[y * spectrumWidth + x]);
+		columnFft.Forward(&bufferIn[0], 1, &bufferOut[0]);
+		for (int y = 0; y < height; y++)
+			in[y * spectrumWidth + x] = std::conj(bufferOut[y]);
+	}
+	for (int y = 0; y < outRows; y++)
+	{
+		Complex *rowIn = &in[y * spectrumWidth];
+		for (int k = 0; k < half; k++)
 		{
-			if(th_ogravmap[i*(XRES/CELL)+j]!=th_gravmap[i*(XRES/CELL)+j]){
-				changed = 1;
-				break;
-			}
+			Complex a = rowIn[k];
+			Complex b = std::conj(rowIn[half - k]);
+			Complex even = a + b;
+			Complex odd = Multiply(a - b, std::conj(rowTwiddles[k]));
+			bufferIn[k] = std::conj(even + Complex(-odd.imag(), odd.real()));
+		}
+		rowFft.Forward(&bufferIn[0], 1, &bufferOut[0]);
+		float *row = &out[y * outWidth];
+		for (int n = 0; n < half && 2 * n < outWidth; n++)
+		{
+			row[2 * n] = bufferOut[n].real();
+			if (2 * n + 1 < outWidth)
+				row[2 * n + 1] = -bufferOut[n].imag();
 		}
 	}
-	if(!changed)
-		goto fin;
-	memset(th_gravy, 0, (XRES/CELL)*(YRES/CELL)*sizeof(float));
-	memset(th_gravx, 0, (XRES/CELL)*(YRES/CELL)*sizeof(float));
+}
+
+void GravityFft::Convolve(const float *mass, float *gravx, float *gravy, float *gravp)
+{
+	int size = cellsX * cellsY;
+	Forward(mass, cellsX, cellsY, &spectrum[0]);
+	//do convolution (multiply the complex numbers)
+	for (int i = 0; i < spectrumWidth * height; i++)
+	{
+		spectrumX[i] = Multiply(spectrum[i], kernelX[i]);
+		spectrumY[i] = Multiply(spectrum[i], kernelY[i]);
+	}
+	Inverse(&spectrumX[0], cellsX, cellsY, gravx);
+	Inverse(&spectrumY[0], cellsX, cellsY, gravy);
+	for (int i = 0; i < size; i++)
+		gravp[i] = sqrtf(gravx[i] * gravx[i] + gravy[i] * gravy[i]);
+}
+
+void Gravity::grav_fft_init()
+{
+	if (grav_fft_status) return;
+	th_fft = new GravityFft(XRES / CELL, YRES / CELL);
+	grav_fft_status = true;
+}
+
+void Gravity::grav_fft_cleanup()
+{
+	if (!grav_fft_status) return;
+	delete th_fft;
+	th_fft = nullptr;
+	grav_fft_status = false;
+}
+
+void Gravity::grav_fft_solve()
+{
+	th_fft->Convolve(th_gravmap, th_gravx, th_gravy, th_gravp);
+}
 #endif
-	th_gravchanged = 1;
-	membwand(th_gravmap, gravmask, (XRES/CELL)*(YRES/CELL)*sizeof(float), (XRES/CELL)*(YRES/CELL)*sizeof(unsigned));
-	for (i = 0; i < YRES / CELL; i++) {
-		for (j = 0; j < XRES / CELL; j++) {
-#ifdef GRAV_DIFF
-			if (th_ogravmap[i*(XRES/CELL)+j] != th_gravmap[i*(XRES/CELL)+j])
+
+void Gravity::grav_sparse_init()
+{
+	int xblock = XRES/CELL, yblock = YRES/CELL;
+	int pointWidth = 2*xblock-1, pointHeight = 2*yblock-1;
+	th_pointgravx = new float[pointWidth * pointHeight];
+	th_pointgravy = new float[pointWidth * pointHeight];
+	th_fieldx = new float[xblock * yblock];
+	th_fieldy = new float[xblock * yblock];
+	//calculate velocity map caused by a point mass, at every offset from it that fits in the map
+	for (int y = -(yblock-1); y < yblock; y++)
+	{
+		for (int x = -(xblock-1); x < xblock; x++)
+		{
+			int i = (y+yblock-1)*pointWidth + x+xblock-1;
+			if (!x && !y)
 			{
-#else
-			if (th_gravmap[i*(XRES/CELL)+j] > 0.0001f || th_gravmap[i*(XRES/CELL)+j]<-0.0001f) //Only calculate with populated or changed cells.
+				th_pointgravx[i] = 0.0f;
+				th_pointgravy[i] = 0.0f;
+				continue;
+			}
+			double distance = sqrt(double(x*x + y*y));
+			th_pointgravx[i] = float(-M_GRAV * x / (distance*distance*distance));
+			th_pointgravy[i] = float(-M_GRAV * y / (distance*distance*distance));
+		}
+	}
+}
+
+// Adds the field of the change in mass of each cell to the result of the last update, if few enough cells changed.
+// Returns false if a full update is needed instead.
+bool Gravity::update_grav_sparse()
+{
+	int xblock = XRES/CELL, yblock = YRES/CELL;
+	int pointWidth = 2*xblock-1;
+	int changedCells[GRAV_SPARSE_MAX_CELLS];
+	int changed = 0;
+	if (!th_fieldvalid || th_fieldupdates >= GRAV_SPARSE_MAX_UPDATES)
+		return false;
+	for (int i = 0; i < xblock*yblock; i++)
+	{
+		if (th_gravmap[i] != th_ogravmap[i])
+		{
+			if (changed == GRAV_SPARSE_MAX_CELLS)
+				return false;
+			changedCells[changed++] = i;
+		}
+	}
+	for (int c = 0; c < changed; c++)
+	{
+		int i = changedCells[c];
+		int cx = i % xblock, cy = i / xblock;
+		float delta = th_gravmap[i] - th_ogravmap[i];
+		for (int y = 0; y < yblock; y++)
+		{
+			// Field of the cell at every x in this row, which is contiguous in the point mass maps
+			const float *pointx = &th_pointgravx[(y-cy+yblock-1)*pointWidth + xblock-1-cx];
+			const float *pointy = &th_pointgravy[(y-cy+yblock-1)*pointWidth + xblock-1-cx];
+			float *fieldx = &th_fieldx[y*xblock];
+			float *fieldy = &th_fieldy[y*xblock];
+			for (int x = 0; x < xblock; x++)
 			{
-#endif
-				for (y = 0; y < YRES / CELL; y++) {
-					for (x = 0; x < XRES / CELL; x++) {
-						if (x == j && y == i)//Ensure it doesn't calculate with itself
-							continue;
-						distance = sqrt(pow(j - x, 2.0f) + pow(i - y, 2.0f));
-#ifdef GRAV_DIFF
-						val = th_gravmap[i*(XRES/CELL)+j] - th_ogravmap[i*(XRES/CELL)+j];
-#else
-						val = th_gravmap[i*(XRES/CELL)+j];
-#endif
-						th_gravx[y*(XRES/CELL)+x] += M_GRAV * val * (j - x) / pow(distance, 3.0f);
-						th_gravy[y*(XRES/CELL)+x] += M_GRAV * val * (i - y) / pow(distance, 3.0f);
-						th_gravp[y*(XRES/CELL)+x] += M_GRAV * val / pow(distance, 2.0f);
-					}
-				}
+				fieldx[x] += delta * pointx[x];
+				fieldy[x] += delta * pointy[x];
 			}
 		}
 	}
-	memcpy(th_ogravmap, th_gravmap, (XRES/CELL)*(YRES/CELL)*sizeof(float));
+	th_fieldupdates++;
+	memcpy(th_gravx, th_fieldx, xblock*yblock*sizeof(float));
+	memcpy(th_gravy, th_fieldy, xblock*yblock*sizeof(float));
+	for (int i = 0; i < xblock*yblock; i++)
+		th_gravp[i] = sqrtf(th_gravx[i]*th_gravx[i] + th_gravy[i]*th_gravy[i]);
+	return true;
+}
+
+void Gravity::update_grav()
+{
+	if (memcmp(th_ogravmap, th_gravmap, sizeof(float)*(XRES/CELL)*(YRES/CELL)) != 0)
+	{
+		th_gravchanged = 1;
+
+		membwand(th_gravmap, gravmask, (XRES/CELL)*(YRES/CELL)*sizeof(float), (XRES/CELL)*(YRES/CELL)*sizeof(unsigned));
+		if (!sparseUpdates)
+		{
+			th_fieldvalid = false;
+			grav_fft_solve();
+		}
+		else if (!update_grav_sparse())
+		{
+			grav_fft_solve();
+			// th_gravx and th_gravy are handed to the main thread, keep a copy to add to
+			if (!th_pointgravx)
+				grav_sparse_init();
+			memcpy(th_fieldx, th_gravx, (XRES/CELL)*(YRES/CELL)*sizeof(float));
+			memcpy(th_fieldy, th_gravy, (XRES/CELL)*(YRES/CELL)*sizeof(float));
+			th_fieldvalid = true;
+			th_fieldupdates = 0;
+		}
+	}
+	else
+	{
+		th_gravchanged = 0;
+	}
+
+	// Copy th_ogravmap into th_gravmap (doesn't matter what th_ogravmap is afterwards)
+	std::swap(th_gravmap, th_ogravmap);
 }
-#endif
 
 
 
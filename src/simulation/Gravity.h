@@ -11,6 +11,9 @@
 #endif
 
 class Simulation;
+#ifndef GRAVFFT
+class GravityFft;
+#endif
 
 class Gravity
 {
@@ -44,6 +47,9 @@ private:
 
 	fftwf_complex *th_ptgravxt, *th_ptgravyt, *th_gravmapbigt, *th_gravxbigt, *th_gravybigt;
 	fftwf_plan plan_gravmap, plan_gravx_inverse, plan_gravy_inverse;
+#else
+	bool grav_fft_status = false;
+	GravityFft *th_fft = nullptr;
 #endif
 
 	struct mask_el {
@@ -56,14 +62,24 @@ private:
 	bool grav_mask_r(int x, int y, char checkmap[YRES/CELL][XRES/CELL], char shape[YRES/CELL][XRES/CELL]);
 	void mask_free(mask_el *c_mask_el);
 
+	// Field of a point mass at every offset from it that fits in the map, for sparse updates
+	float *th_pointgravx = nullptr;
+	float *th_pointgravy = nullptr;
+	// Copy of the last th_gravx and th_gravy, which sparse updates add to
+	float *th_fieldx = nullptr;
+	float *th_fieldy = nullptr;
+	bool th_fieldvalid = false;
+	int th_fieldupdates = 0;
+
+	void reset_thread_maps();
+	void grav_sparse_init();
+	bool update_grav_sparse();
 	void update_grav();
 	void update_grav_async();
 
-
-#ifdef GRAVFFT
 	void grav_fft_init();
 	void grav_fft_cleanup();
-#endif
+	void grav_fft_solve();
 
 public:
 	//Maps to be used by the main thread
@@ -75,6 +91,14 @@ public:
 
 	unsigned char (*bmap)[XRES/CELL];
 
+	// Run the solver on the calling thread in gravity_update_async instead of on its own thread,
+	// so that results are reproducible. Only takes effect when gravity is started.
+	bool synchronous = false;
+
+	// When few cells change mass, add the field of the changes to the last result instead of
+	// recalculating all of it. Results differ from full updates by rounding errors.
+	bool sparseUpdates = false;
+
 	bool IsEnabled() { return enabled; }
 
 	void Clear();
@@ -0,0 +1,225 @@
+#include "HeatField.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Simulation.h"
+#include "ElementClasses.h"
+#include "Misc.h"
+#include "common/ThreadPool.h"
+
+#ifdef X86_SSE2
+#include <emmintrin.h>
+#endif
+
+// fastHeat is saved with the save, so the field has to give the same temperatures with and without SIMD and on
+// every platform. Release builds let the compiler reorder and fuse floating point operations, which would leave
+// that up to the compiler, so it may not do that here.
+#if defined(__clang__)
+# pragma clang fp reassociate(off) contract(off)
+#elif defined(__GNUC__)
+# pragma GCC optimize("no-associative-math", "fp-contract=off")
+#elif defined(_MSC_VER)
+# pragma float_control(precise, on)
+# pragma fp_contract(off)
+#endif
+
+namespace
+{
+	// Rows of the field handed to each thread pool job
+	constexpr int HEAT_ROWS_PER_JOB = 16;
+	// A particle that conducts averages its temperature with its eight neighbours, so heat that can flow
+	// freely between two pixels moves by a ninth of the difference each tick
+	constexpr float HEAT_FLOW = 1.0f / 9.0f;
+}
+
+HeatField::HeatField(Simulation & sim) :
+	sim(sim),
+	updatedTick(-1),
+	scalarUpdate(false)
+{
+	// Only the inside of the simulation area is ever filled in, everything outside it conducts nothing
+	std::fill(&conducts[0][0], &conducts[0][0] + YRES * XRES, 0.0f);
+	std::fill(&temp[0][0], &temp[0][0] + YRES * XRES, 0.0f);
+	std::fill(&conduct[0][0], &conduct[0][0] + YRES * XRES, 0.0f);
+	std::fill(&conductTemp[0][0], &conductTemp[0][0] + YRES * XRES, 0.0f);
+	std::fill(&group[0][0], &group[0][0] + YRES * XRES, 0);
+	std::fill(&ids[0][0], &ids[0][0] + YRES * XRES, -1);
+	std::fill(rowStart, rowStart + YRES, 0);
+	std::fill(rowEnd, rowEnd + YRES, 0);
+	std::fill(rowGroups, rowGroups + YRES, false);
+}
+
+void HeatField::GatherRow(int y)
+{
+	// Clear what was filled in last time
+	for (int x = rowStart[y]; x < rowEnd[y]; x++)
+	{
+		conducts[y][x] = 0.0f;
+		temp[y][x] = 0.0f;
+		conduct[y][x] = 0.0f;
+		conductTemp[y][x] = 0.0f;
+		group[y][x] = 0;
+		ids[y][x] = -1;
+	}
+	int start = XRES, end = 0;
+	bool groups = false;
+	for (int x = CELL; x < XRES - CELL; x++)
+	{
+		int r = sim.pmap[y][x];
+		if (!r)
+			continue;
+		int i = ID(r), t = TYP(r);
+		float c = typeConduct[t];
+		if (c <= 0.0f)
+			continue;
+		auto &part = sim.parts[i];
+		// Skip entries left behind by particles that have since moved or changed
+		if (part.type != t || int(part.x + 0.5f) != x || int(part.y + 0.5f) != y)
+			continue;
+		if (t == PT_GEL)
+		{
+			c = std::min(sim.elements[t].HeatConduct * part.tmp*2.55f / 250.0f, 1.0f);
+			if (c <= 0.0f)
+				continue;
+		}
+		else if (t == PT_HSWC && part.life != 10)
+			continue;
+		if (sim.bmap[y/CELL][x/CELL] == WL_STASIS && sim.emap[y/CELL][x/CELL] < 8)
+			continue;
+		conducts[y][x] = 1.0f;
+		temp[y][x] = part.temp;
+		conduct[y][x] = c;
+		conductTemp[y][x] = c * part.temp;
+		if (t == PT_FILT)
+			group[y][x] = 1;
+		else if (t == PT_BRAY || t == PT_BIZR || t == PT_BIZRG || (t == PT_HSWC && part.tmp == 1))
+			group[y][x] = 2;
+		groups |= group[y][x] != 0;
+		ids[y][x] = i;
+		start = std::min(start, x);
+		end = x + 1;
+	}
+	rowStart[y] = short(std::min(start, end));
+	rowEnd[y] = short(end);
+	rowGroups[y] = groups;
+}
+
+// Heat flows between two neighbours if both conduct, at the average of their chances of conducting, unless
+// one is FILT and the other something FILT doesn't exchange heat with
+float HeatField::ConductCell(int y, int x)
+{
+	float t = temp[y][x], c = conduct[y][x];
+	float flow = 0.0f;
+	for (int j = -1; j < 2; j++)
+		for (int i = -1; i < 2; i++)
+		{
+			float cn = conduct[y+j][x+i];
+			if ((i || j) && cn > 0.0f && group[y][x] * group[y+j][x+i] != 2)
+				flow += (c + cn) * 0.5f * (temp[y+j][x+i] - t);
+		}
+	return t + flow * HEAT_FLOW;
+}
+
+// Without the FILT exceptions, the flow into a pixel from its neighbours (c + cn) / 2 * (tn - t) adds up to
+// (c * (sum of tn - n * t) + (sum of cn * tn - sum of cn * t)) / 2, so only sums over 3x3 boxes are needed.
+// The centre pixel's own terms in those sums cancel out. Pixels in a group are done by ConductCell instead.
+void HeatField::ConductRow(int y, bool simd)
+{
+	int start = rowStart[y], end = rowEnd[y];
+	if (start >= end)
+		return;
+	// Sums over the column of three pixels centred on each x, then over three of those
+	float columnConducts[XRES], columnTemp[XRES], columnConduct[XRES], columnConductTemp[XRES];
+	float result[XRES];
+	int x = start - 1;
+#ifdef X86_SSE2
+	if (simd)
+	{
+		for (; x + 4 <= end + 1; x += 4)
+		{
+			_mm_storeu_ps(&columnConducts[x], _mm_add_ps(_mm_add_ps(_mm_loadu_ps(&conducts[y-1][x]), _mm_loadu_ps(&conducts[y][x])), _mm_loadu_ps(&conducts[y+1][x])));
+			_mm_storeu_ps(&columnTemp[x], _mm_add_ps(_mm_add_ps(_mm_loadu_ps(&temp[y-1][x]), _mm_loadu_ps(&temp[y][x])), _mm_loadu_ps(&temp[y+1][x])));
+			_mm_storeu_ps(&columnConduct[x], _mm_add_ps(_mm_add_ps(_mm_loadu_ps(&conduct[y-1][x]), _mm_loadu_ps(&conduct[y][x])), _mm_loadu_ps(&conduct[y+1][x])));
+			_mm_storeu_ps(&columnConductTemp[x], _mm_add_ps(_mm_add_ps(_mm_loadu_ps(&conductTemp[y-1][x]), _mm_loadu_ps(&conductTemp[y][x])), _mm_loadu_ps(&conductTemp[y+1][x])));
+		}
+	}
+#endif
+	for (; x < end + 1; x++)
+	{
+		columnConducts[x] = conducts[y-1][x] + conducts[y][x] + conducts[y+1][x];
+		columnTemp[x] = temp[y-1][x] + temp[y][x] + temp[y+1][x];
+		columnConduct[x] = conduct[y-1][x] + conduct[y][x] + conduct[y+1][x];
+		columnConductTemp[x] = conductTemp[y-1][x] + conductTemp[y][x] + conductTemp[y+1][x];
+	}
+	x = start;
+#ifdef X86_SSE2
+	if (simd)
+	{
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 flowRate = _mm_set1_ps(HEAT_FLOW);
+		for (; x + 4 <= end; x += 4)
+		{
+			__m128 boxConducts = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(&columnConducts[x-1]), _mm_loadu_ps(&columnConducts[x])), _mm_loadu_ps(&columnConducts[x+1]));
+			__m128 boxTemp = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(&columnTemp[x-1]), _mm_loadu_ps(&columnTemp[x])), _mm_loadu_ps(&columnTemp[x+1]));
+			__m128 boxConduct = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(&columnConduct[x-1]), _mm_loadu_ps(&columnConduct[x])), _mm_loadu_ps(&columnConduct[x+1]));
+			__m128 boxConductTemp = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(&columnConductTemp[x-1]), _mm_loadu_ps(&columnConductTemp[x])), _mm_loadu_ps(&columnConductTemp[x+1]));
+			__m128 t = _mm_loadu_ps(&temp[y][x]);
+			__m128 c = _mm_loadu_ps(&conduct[y][x]);
+			__m128 flow = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(c, _mm_sub_ps(boxTemp, _mm_mul_ps(boxConducts, t))), _mm_sub_ps(boxConductTemp, _mm_mul_ps(boxConduct, t))), half);
+			_mm_storeu_ps(&result[x], _mm_add_ps(t, _mm_mul_ps(flow, flowRate)));
+		}
+	}
+#endif
+	for (; x < end; x++)
+	{
+		float boxConducts = columnConducts[x-1] + columnConducts[x] + columnConducts[x+1];
+		float boxTemp = columnTemp[x-1] + columnTemp[x] + columnTemp[x+1];
+		float boxConduct = columnConduct[x-1] + columnConduct[x] + columnConduct[x+1];
+		float boxConductTemp = columnConductTemp[x-1] + columnConductTemp[x] + columnConductTemp[x+1];
+		float t = temp[y][x], c = conduct[y][x];
+		float flow = (c * (boxTemp - boxConducts * t) + (boxConductTemp - boxConduct * t)) * 0.5f;
+		result[x] = t + flow * HEAT_FLOW;
+	}
+	for (x = start; x < end; x++)
+	{
+		if (ids[y][x] < 0)
+			continue;
+		if (rowGroups[y] && group[y][x])
+			result[x] = ConductCell(y, x);
+		// Leave particles whose temperature didn't change alone, there are usually a lot of them
+		if (result[x] != temp[y][x])
+			sim.parts[ids[y][x]].temp = restrict_flt(result[x], MIN_TEMP, MAX_TEMP);
+	}
+}
+
+void HeatField::Update()
+{
+	updatedTick = sim.currentTick;
+	for (int t = 0; t < PT_NUM; t++)
+		typeConduct[t] = t && sim.elements[t].Enabled ? std::min(sim.elements[t].HeatConduct / 250.0f, 1.0f) : 0.0f;
+	if (scalarUpdate)
+	{
+		for (int y = CELL; y < YRES - CELL; y++)
+			GatherRow(y);
+		for (int y = CELL; y < YRES - CELL; y++)
+			ConductRow(y, false);
+		return;
+	}
+	// Gathering only writes its own rows of the field; conducting only reads the field and writes the
+	// temperatures of the particles in its own rows, each of which is in the field only once
+	const int jobs = (YRES - 2*CELL + HEAT_ROWS_PER_JOB - 1) / HEAT_ROWS_PER_JOB;
+	ThreadPool::Ref().ParallelFor(jobs, [this](int job) {
+		for (int y = CELL + job * HEAT_ROWS_PER_JOB; y < std::min(CELL + (job + 1) * HEAT_ROWS_PER_JOB, YRES - CELL); y++)
+			GatherRow(y);
+	});
+	ThreadPool::Ref().ParallelFor(jobs, [this](int job) {
+		for (int y = CELL + job * HEAT_ROWS_PER_JOB; y < std::min(CELL + (job + 1) * HEAT_ROWS_PER_JOB, YRES - CELL); y++)
+			ConductRow(y, true);
+	});
+}
+
+bool HeatField::Conducted(int i, int x, int y) const
+{
+	return updatedTick == sim.currentTick && ids[y][x] == i;
+}
@@ -0,0 +1,45 @@
+#ifndef HEATFIELD_H
+#define HEATFIELD_H
+#include "Config.h"
+#include "ElementDefs.h"
+
+class Simulation;
+
+// Heat conduction between neighbouring particles done for the whole simulation at once, on a grid of the
+// temperatures and conductivities of the particles in pmap, instead of by each particle averaging its
+// temperature with its neighbours' when RNG says so. Used when Simulation::fastHeat is set.
+class HeatField
+{
+	Simulation & sim;
+	// Tick the field was last updated in; particles only skip their own conduction in that tick
+	int updatedTick;
+	// Per pixel, as of the start of the tick, for the particle in pmap if it conducts heat (all 0 otherwise):
+	// 1, its temperature, the chance that it would conduct in a tick, and the last two multiplied
+	float conducts[YRES][XRES];
+	float temp[YRES][XRES];
+	float conduct[YRES][XRES];
+	float conductTemp[YRES][XRES];
+	// 1 for FILT, 2 for what FILT doesn't exchange heat with, 0 for everything else
+	unsigned char group[YRES][XRES];
+	int ids[YRES][XRES];
+	// Range of x in each row with particles that conduct, and whether any of them is in a group
+	short rowStart[YRES], rowEnd[YRES];
+	bool rowGroups[YRES];
+	// Chance that a particle of each type conducts heat in a tick
+	float typeConduct[PT_NUM];
+
+	void GatherRow(int y);
+	void ConductRow(int y, bool simd);
+	float ConductCell(int y, int x);
+
+public:
+	// Conduct on one thread without SIMD, for checking that the results are still the same either way
+	bool scalarUpdate;
+
+	HeatField(Simulation & sim);
+	void Update();
+	// Whether heat for particle i at x, y was already conducted this tick
+	bool Conducted(int i, int x, int y) const;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#include "OccupiedPixels.h"
+#include <algorithm>
+#include <cstring>
+
+#include "common/tpt-bits.h"
+
+void OccupiedPixels::Build(const int (*pmap)[XRES], const int (*photons)[XRES])
+{
+	memset(rows, 0, sizeof(rows));
+	memset(columns, 0, sizeof(columns));
+	memset(diagonals, 0, sizeof(diagonals));
+	memset(antiDiagonals, 0, sizeof(antiDiagonals));
+	valid = true;
+	for (int y = 0; y < YRES; y++)
+	{
+		for (int x = 0; x < XRES; x++)
+		{
+			if (pmap[y][x] || photons[y][x])
+				Mark(x, y);
+		}
+	}
+}
+
+// Distance from pos to the first set bit in direction dir, looking at no more than limit bits
+int OccupiedPixels::Scan(const uint64_t *line, int pos, int dir, int limit)
+{
+	int k = 0;
+	while (k < limit)
+	{
+		int p = pos + dir * k;
+		uint64_t word = line[p / 64];
+		int bit = p % 64;
+		if (dir > 0)
+		{
+			word >>= bit;
+			if (word)
+				return std::min(k + CountTrailingZeros(word), limit);
+			k += 64 - bit;
+		}
+		else
+		{
+			word <<= 63 - bit;
+			if (word)
+				return std::min(k + CountLeadingZeros(word), limit);
+			k += bit + 1;
+		}
+	}
+	return limit;
+}
+
+int OccupiedPixels::Steps(int x, int y, int dx, int dy) const
+{
+	if (x < 0 || y < 0 || x >= XRES || y >= YRES)
+		return 0;
+	// Steps left before the ray leaves the screen
+	int limit = XRES + YRES;
+	if (dx)
+		limit = std::min(limit, dx > 0 ? XRES - x : x + 1);
+	if (dy)
+		limit = std::min(limit, dy > 0 ? YRES - y : y + 1);
+	if (!dy)
+		return Scan(rows[y], x, dx, limit);
+	if (!dx)
+		return Scan(columns[x], y, dy, limit);
+	if (dx == dy)
+		return Scan(diagonals[x - y + YRES - 1], y, dy, limit);
+	return Scan(antiDiagonals[x + y], y, dy, limit);
+}
@@ -0,0 +1,51 @@
+#ifndef OCCUPIEDPIXELS_H_
+#define OCCUPIEDPIXELS_H_
+#include "Config.h"
+#include <cstdint>
+
+// Pixels that may have something in pmap or photons, as bits along every row, column and diagonal, so that
+// a ray can jump to the next pixel that isn't empty instead of looking at each one; see
+// Simulation::StepsToOccupied. Bits are set as particles are put somewhere and only cleared when the map is
+// built again, so a set bit doesn't guarantee that the pixel is occupied, but a clear one means it is empty.
+class OccupiedPixels
+{
+	static const int WORDS_X = (XRES + 63) / 64;
+	static const int WORDS_Y = (YRES + 63) / 64;
+	static const int DIAGONALS = XRES + YRES - 1;
+
+	// Rows are indexed by x, everything else by y; a diagonal going down and right is number x - y + YRES - 1,
+	// one going down and left is number x + y
+	uint64_t rows[YRES][WORDS_X];
+	uint64_t columns[XRES][WORDS_Y];
+	uint64_t diagonals[DIAGONALS][WORDS_Y];
+	uint64_t antiDiagonals[DIAGONALS][WORDS_Y];
+
+	static void Set(uint64_t *line, int pos)
+	{
+		line[pos / 64] |= uint64_t(1) << (pos % 64);
+	}
+
+	static int Scan(const uint64_t *line, int pos, int dir, int limit);
+
+public:
+	// Cleared by Simulation::RecalcFreeParticles and while stripes are updated, built again on the next query
+	bool valid = false;
+
+	void Build(const int (*pmap)[XRES], const int (*photons)[XRES]);
+
+	void Mark(int x, int y)
+	{
+		if (!valid)
+			return;
+		Set(rows[y], x);
+		Set(columns[x], y);
+		Set(diagonals[x - y + YRES - 1], y);
+		Set(antiDiagonals[x + y], y);
+	}
+
+	// Number of steps of dx, dy (each -1, 0 or 1, not both 0) from x, y to the first pixel that may be
+	// occupied or is out of bounds; 0 if x, y itself is
+	int Steps(int x, int y, int dx, int dy) const;
+};
+
+#endif /* OCCUPIEDPIXELS_H_ */
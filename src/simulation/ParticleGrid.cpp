@@ -0,0 +1,53 @@
+#include "ParticleGrid.h"
+
+ParticleGrid::ParticleGrid() :
+	bucketOf(NPART, -1)
+{
+}
+
+void ParticleGrid::Clear()
+{
+	for (auto &row : buckets)
+	{
+		for (auto &bucket : row)
+		{
+			for (auto i : bucket)
+			{
+				bucketOf[i] = -1;
+			}
+			bucket.clear();
+		}
+	}
+	valid = false;
+}
+
+void ParticleGrid::Add(const Particle *parts, int i)
+{
+	Remove(i);
+	int bx = BucketX(int(parts[i].x));
+	int by = BucketY(int(parts[i].y));
+	buckets[by][bx].push_back(i);
+	bucketOf[i] = short(by * BUCKETS_X + bx);
+}
+
+void ParticleGrid::Remove(int i)
+{
+	if (bucketOf[i] < 0)
+		return;
+	auto &bucket = buckets[bucketOf[i] / BUCKETS_X][bucketOf[i] % BUCKETS_X];
+	auto it = std::find(bucket.begin(), bucket.end(), i);
+	*it = bucket.back();
+	bucket.pop_back();
+	bucketOf[i] = -1;
+}
+
+void ParticleGrid::Move(const Particle *parts, int i)
+{
+	if (bucketOf[i] < 0)
+		return;
+	int bx = BucketX(int(parts[i].x));
+	int by = BucketY(int(parts[i].y));
+	if (bucketOf[i] == by * BUCKETS_X + bx)
+		return;
+	Add(parts, i);
+}
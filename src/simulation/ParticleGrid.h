@@ -0,0 +1,105 @@
+#ifndef PARTICLEGRID_H_
+#define PARTICLEGRID_H_
+#include "Config.h"
+#include "Particle.h"
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+// Particles of one type sorted into square buckets by position, so that the one nearest to a point can be found
+// without going through every particle; see Simulation::PartGrid. Particles that move have to be put in the
+// bucket for where they are now with Move, or Nearest may miss them for ones further away.
+class ParticleGrid
+{
+	static constexpr int BUCKET_SIZE = 16;
+	static constexpr int BUCKETS_X = (XRES + BUCKET_SIZE - 1) / BUCKET_SIZE;
+	static constexpr int BUCKETS_Y = (YRES + BUCKET_SIZE - 1) / BUCKET_SIZE;
+
+	std::vector<int> buckets[BUCKETS_Y][BUCKETS_X];
+	// Bucket each particle is in, as y * BUCKETS_X + x, -1 if it is in none
+	std::vector<short> bucketOf;
+
+	static int BucketX(int x)
+	{
+		return std::min(std::max(x / BUCKET_SIZE, 0), BUCKETS_X - 1);
+	}
+
+	static int BucketY(int y)
+	{
+		return std::min(std::max(y / BUCKET_SIZE, 0), BUCKETS_Y - 1);
+	}
+
+public:
+	// Cleared by Simulation::RecalcFreeParticles, built again on the next query
+	bool valid = false;
+
+	ParticleGrid();
+	void Clear();
+	void Add(const Particle *parts, int i);
+	void Remove(int i);
+	// Puts particle i in the bucket for where it is now, if it is in the grid at all
+	void Move(const Particle *parts, int i);
+
+	// Particle nearest to x, y by the distance between truncated positions along both axes, and the one with
+	// the lowest index out of the nearest ones, that accept(i) returns true for; -1 if there is none
+	template<class Accept>
+	int Nearest(const Particle *parts, int x, int y, Accept accept) const
+	{
+		int centreX = BucketX(x), centreY = BucketY(y);
+		int foundI = -1, foundDistance = 0;
+		auto visit = [&](int bx, int by) {
+			if (bx < 0 || by < 0 || bx >= BUCKETS_X || by >= BUCKETS_Y)
+				return;
+			for (auto i : buckets[by][bx])
+			{
+				if (!accept(i))
+					continue;
+				int distance = std::abs(int(parts[i].x) - x) + std::abs(int(parts[i].y) - y);
+				if (foundI < 0 || distance < foundDistance || (distance == foundDistance && i < foundI))
+				{
+					foundDistance = distance;
+					foundI = i;
+				}
+			}
+		};
+		for (int ring = 0; ring < std::max(BUCKETS_X, BUCKETS_Y); ring++)
+		{
+			// Everything in this ring of buckets around the one x, y is in is at least this far away
+			if (foundI >= 0 && (ring - 1) * BUCKET_SIZE + 1 > foundDistance)
+				break;
+			for (int bx = centreX - ring; bx <= centreX + ring; bx++)
+			{
+				visit(bx, centreY - ring);
+				if (ring)
+					visit(bx, centreY + ring);
+			}
+			for (int by = centreY - ring + 1; by <= centreY + ring - 1; by++)
+			{
+				visit(centreX - ring, by);
+				visit(centreX + ring, by);
+			}
+		}
+		return foundI;
+	}
+
+	// Number of particles that accept(i) returns true for
+	template<class Accept>
+	int Count(const Particle *parts, Accept accept) const
+	{
+		int count = 0;
+		for (auto &row : buckets)
+		{
+			for (auto &bucket : row)
+			{
+				for (auto i : bucket)
+				{
+					if (accept(i))
+						count++;
+				}
+			}
+		}
+		return count;
+	}
+};
+
+#endif /* PARTICLEGRID_H_ */
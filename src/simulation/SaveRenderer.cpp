@@ -1,47 +1,116 @@
 #include "SaveRenderer.h"
 
+#include <algorithm>
+#include <thread>
+
 #include "client/GameSave.h"
 
+#include "common/tpt-rand.h"
+
 #include "graphics/Graphics.h"
 #include "graphics/Renderer.h"
 
 #include "Simulation.h"
 
-SaveRenderer::SaveRenderer(){
-	g = new Graphics();
-	sim = new Simulation();
-	ren = new Renderer(g, sim);
-	ren->decorations_enable = true;
-	ren->blackDecorations = true;
+namespace
+{
+	// Every slot has a Simulation of its own, which is not small, so the pool stops growing here even on
+	// machines with more cores than this
+	constexpr int SAVERENDERER_MAX_SLOTS = 8;
+}
 
+struct SaveRenderer::Slot
+{
+	Graphics * g;
+	Simulation * sim;
+	Renderer * ren;
+	// Renders on different threads would otherwise all draw from the shared generator
+	RNG rng;
 #if defined(OGLR) || defined(OGLI)
-	glEnable(GL_TEXTURE_2D);
-	glGenTextures(1, &fboTex);
-	glBindTexture(GL_TEXTURE_2D, fboTex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, XRES, YRES, 0, GL_RGBA, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
-
-	//FBO
-	glGenFramebuffers(1, &fbo);
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
-	glEnable(GL_BLEND);
-	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fboTex, 0);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); // Reset framebuffer binding
-	glDisable(GL_TEXTURE_2D);
+	GLuint fboTex, fbo;
 #endif
+
+	Slot()
+	{
+		g = new Graphics();
+		sim = new Simulation();
+		ren = new Renderer(g, sim);
+		ren->decorations_enable = true;
+		ren->blackDecorations = true;
+
+#if defined(OGLR) || defined(OGLI)
+		glEnable(GL_TEXTURE_2D);
+		glGenTextures(1, &fboTex);
+		glBindTexture(GL_TEXTURE_2D, fboTex);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, XRES, YRES, 0, GL_RGBA, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+
+		//FBO
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+		glEnable(GL_BLEND);
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fboTex, 0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); // Reset framebuffer binding
+		glDisable(GL_TEXTURE_2D);
+#endif
+	}
+};
+
+SaveRenderer::SaveRenderer()
+{
+#if defined(OGLR) || defined(OGLI)
+	// There is only the one GL context
+	maxSlots = 1;
+#else
+	maxSlots = std::max(1, std::min(int(std::thread::hardware_concurrency()), SAVERENDERER_MAX_SLOTS));
+#endif
+}
+
+SaveRenderer::Slot *SaveRenderer::AcquireSlot()
+{
+	std::unique_lock<std::mutex> l(poolMutex);
+	if (freeSlots.empty() && int(slots.size()) < maxSlots)
+	{
+		slots.push_back(std::make_unique<Slot>());
+		return slots.back().get();
+	}
+	slotFreed.wait(l, [this]() { return !freeSlots.empty(); });
+	auto *slot = freeSlots.back();
+	freeSlots.pop_back();
+	return slot;
+}
+
+void SaveRenderer::ReleaseSlot(Slot *slot)
+{
+	{
+		std::lock_guard<std::mutex> g(poolMutex);
+		freeSlots.push_back(slot);
+	}
+	slotFreed.notify_all();
 }
 
 void SaveRenderer::Flush(int begin, int end)
 {
-	std::lock_guard<std::mutex> gx(renderMutex);
-	std::fill(ren->graphicscache + begin, ren->graphicscache + end, gcache_item());
+	// Wait for renders in progress, and keep new ones from starting by holding on to poolMutex
+	std::unique_lock<std::mutex> l(poolMutex);
+	slotFreed.wait(l, [this]() { return freeSlots.size() == slots.size(); });
+	for (auto &slot : slots)
+	{
+		std::fill(slot->ren->graphicscache + begin, slot->ren->graphicscache + end, gcache_item());
+		slot->ren->ClearParticleGraphicsCache();
+	}
 }
 
 VideoBuffer * SaveRenderer::Render(GameSave * save, bool decorations, bool fire, Renderer *renderModeSource)
 {
-	std::lock_guard<std::mutex> gx(renderMutex);
+	auto *slot = AcquireSlot();
+	auto *g = slot->g;
+	auto *sim = slot->sim;
+	auto *ren = slot->ren;
+	auto *previousRng = &RNG::Ref();
+	RNG::SetThreadGenerator(&slot->rng);
 
 	ren->ResetModes();
 	if (renderModeSource)
@@ -58,9 +127,14 @@ VideoBuffer * SaveRenderer::Render(GameSave * save, bool decorations, bool fire,
 	bool doCollapse = save->Collapsed();
 
 	g->Clear();
-	sim->clear_sim();
+	bool loadFailed;
+	{
+		std::lock_guard<std::mutex> l(loadMutex);
+		sim->clear_sim();
+		loadFailed = sim->Load(save, true);
+	}
 
-	if(!sim->Load(save, true))
+	if(!loadFailed)
 	{
 		ren->decorations_enable = true;
 		ren->blackDecorations = !decorations;
@@ -69,7 +143,7 @@ VideoBuffer * SaveRenderer::Render(GameSave * save, bool decorations, bool fire,
 		unsigned char * texData = NULL;
 
 		glTranslated(0, MENUSIZE, 0);
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, slot->fbo);
 		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT);
 
@@ -100,7 +174,7 @@ VideoBuffer * SaveRenderer::Render(GameSave * save, bool decorations, bool fire,
 		glTranslated(0, -MENUSIZE, 0);
 
 		glEnable( GL_TEXTURE_2D );
-		glBindTexture(GL_TEXTURE_2D, fboTex);
+		glBindTexture(GL_TEXTURE_2D, slot->fboTex);
 
 		pData = new pixel[XRES*YRES];
 		texData = new unsigned char[(XRES*YRES)*PIXELSIZE];
@@ -162,6 +236,8 @@ VideoBuffer * SaveRenderer::Render(GameSave * save, bool decorations, bool fire,
 	if(doCollapse)
 		save->Collapse();
 
+	RNG::SetThreadGenerator(previousRng);
+	ReleaseSlot(slot);
 	return tempThumb;
 }
 
@@ -5,7 +5,10 @@
 #include "graphics/OpenGLHeaders.h"
 #endif
 #include "common/Singleton.h"
+#include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 class GameSave;
 class VideoBuffer;
@@ -13,22 +16,33 @@ class Graphics;
 class Simulation;
 class Renderer;
 
+// Renders saves into thumbnails. Holds a pool of Graphics/Simulation/Renderer sets, one per core at
+// most and created as they are needed, so that several threads can render at the same time.
 class SaveRenderer: public Singleton<SaveRenderer> {
-	Graphics * g;
-	Simulation * sim;
-	Renderer * ren;
-	std::mutex renderMutex;
+	struct Slot;
+	std::vector<std::unique_ptr<Slot>> slots;
+	std::vector<Slot *> freeSlots;
+	int maxSlots;
+	std::mutex poolMutex;
+	std::condition_variable slotFreed;
+	// Loading a save still writes globals (the air block map randomness, PPIP state, the BSON error handler),
+	// so only rendering runs on several slots at once
+	std::mutex loadMutex;
+
+	Slot *AcquireSlot();
+	void ReleaseSlot(Slot *slot);
+
 public:
 	SaveRenderer();
 	VideoBuffer * Render(GameSave * save, bool decorations = true, bool fire = true, Renderer *renderModeSource = nullptr);
 	VideoBuffer * Render(unsigned char * saveData, int saveDataSize, bool decorations = true, bool fire = true);
 	void Flush(int begin, int end);
+	// How many renders can run at once
+	int SlotCount() const
+	{
+		return maxSlots;
+	}
 	virtual ~SaveRenderer();
-
-private:
-#if defined(OGLR) || defined(OGLI)
-	GLuint fboTex, fbo;
-#endif
 };
 
 #endif /* SAVERENDERER_H_ */
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <cmath>
 #include <set>
+#include <chrono>
 #ifdef _MSC_VER
 #include <intrin.h>
 #else
@@ -14,6 +15,7 @@
 #include "CoordStack.h"
 #include "ElementClasses.h"
 #include "Gravity.h"
+#include "HeatField.h"
 #include "Sample.h"
 #include "Snapshot.h"
 
@@ -26,10 +28,12 @@
 #include "graphics/Renderer.h"
 
 #include "client/GameSave.h"
+#include "common/tpt-bits.h"
 #include "common/tpt-compat.h"
 #include "common/tpt-minmax.h"
 #include "common/tpt-rand.h"
 #include "common/tpt-thread-local.h"
+#include "common/ThreadPool.h"
 #include "gui/game/Brush.h"
 
 #ifdef LUACONSOLE
@@ -43,6 +47,123 @@ extern int Element_LOLZ_lolz[XRES/9][YRES/9];
 extern int Element_LOVE_RuleTable[9][9];
 extern int Element_LOVE_love[XRES/9][YRES/9];
 
+namespace
+{
+	// Adds the lifetime of the object to one of the fields of Simulation::phaseTimes, if profiling is enabled
+	class PhaseTimer
+	{
+		uint64_t *accumulator;
+		std::chrono::steady_clock::time_point start;
+
+	public:
+		PhaseTimer(SimulationPhaseTimes *times, uint64_t SimulationPhaseTimes::*phase) :
+			accumulator(times ? &(times->*phase) : nullptr)
+		{
+			if (accumulator)
+				start = std::chrono::steady_clock::now();
+		}
+
+		~PhaseTimer()
+		{
+			if (accumulator)
+				*accumulator += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		}
+	};
+
+	// Held while changing the free list and element counts, which all stripes share, see Simulation::UpdateParticlesInStripes.
+	// Element ChangeType handlers are only called with it held, so the state they keep outside the particle (player,
+	// fighters, etrd_life0_count, the partners of SOAP) is only changed by one stripe at a time; it belongs to types
+	// with a ChangeType handler, which are never updated on a stripe, so stripes don't read it either.
+	class StripeLock
+	{
+		std::unique_lock<std::recursive_mutex> lock;
+
+	public:
+		StripeLock(Simulation &sim) :
+			lock(sim.stripeMutex, std::defer_lock)
+		{
+			if (sim.stripePhase)
+				lock.lock();
+		}
+	};
+
+	// The stripe being updated on this thread, if any
+	THREAD_LOCAL(ParticleStripe *, currentStripe);
+
+	// Size of the runs of the free list that stripes take their slots from, see Simulation::take_free_part
+	const int STRIPE_FREE_SLOTS = 512;
+
+	// Height of the bands UpdateParticlesInStripes splits the simulation into, a multiple of CELL
+	const int STRIPE_HEIGHT = 64;
+	// How far past its own rows the update of a stripe may read or write; stripes that are updated
+	// at the same time are a stripe apart, so this may be at most half a stripe
+	const int STRIPE_MARGIN = STRIPE_HEIGHT / 2;
+
+	// Size of the area GOL wraps around in, and of the rows of Simulation::golLive
+	const int GOL_WIDTH = XRES - 2 * CELL;
+	const int GOL_HEIGHT = YRES - 2 * CELL;
+	const int GOL_WORDS = (GOL_WIDTH + 63) / 64;
+
+	// Use a threshold, since some particle stacking can be normal (e.g. BIZR + FILT)
+	const unsigned int STACKING_THRESHOLD = 5;
+
+	// With incrementalPmap, how many ticks may pass between rebuilds of pmap and photons
+	const int PMAP_REBUILD_INTERVAL = 30;
+
+	// With sleepingCells, how long an area and its neighbours have to stay unchanged before it goes to sleep,
+	// and the changes that are small enough not to count
+	const int CELL_SLEEP_TICKS = 60;
+	const float CELL_HEAT_EPSILON = 0.01f;
+	const float CELL_AIR_EPSILON = 0.001f;
+
+	// Builtin update functions that only touch particles, air and pressure within two pixels of the
+	// particle, so they can run on a stripe. They may create, kill and change the type of particles.
+	bool IsStripeLocalUpdate(int t)
+	{
+		switch (t)
+		{
+		case PT_WATR:
+		case PT_SLTW:
+		case PT_DSTW:
+		case PT_WTRV:
+		case PT_ICEI:
+		case PT_SNOW:
+		case PT_FIRE:
+		case PT_PLSM:
+		case PT_LAVA:
+		case PT_BMTL:
+		case PT_BRMT:
+		case PT_ACID:
+		case PT_GLAS:
+		case PT_WOOD:
+		case PT_COAL:
+		case PT_BCOL:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// Builtin update functions of solids that only act on what the particle and its surroundings within CELL
+	// pixels are like, and not by chance, so they have nothing to do in an area that has stopped changing.
+	// Ones that act by chance (BMTL breaking, IRON rusting, TUNG melting, ...) would stop doing that once asleep.
+	bool IsSleepableUpdate(int t)
+	{
+		switch (t)
+		{
+		case PT_GLAS:
+		case PT_RIME:
+		case PT_SWCH:
+		case PT_HSWC:
+		case PT_CRMC:
+		case PT_INVIS:
+			return true;
+		default:
+			return false;
+		}
+	}
+}
+
 int Simulation::Load(const GameSave * save, bool includePressure)
 {
 	return Load(save, includePressure, 0, 0);
@@ -315,6 +436,7 @@ int Simulation::Load(const GameSave * originalSave, bool includePressure, int fu
 	parts_lastActiveIndex = NPART-1;
 	force_stacking_check = true;
 	Element_PPIP_ppip_changed = 1;
+	partCoords.valid = false;
 	RecalcFreeParticles(false);
 
 	// fix SOAP links using soapList, a map of old particle ID -> new particle ID
@@ -554,6 +676,7 @@ void Simulation::SaveSimOptions(GameSave * gameSave)
 	gameSave->waterEEnabled = water_equal_test;
 	gameSave->gravityEnable = grav->IsEnabled();
 	gameSave->aheatEnable = aheat_enable;
+	gameSave->fastHeat = fastHeat;
 }
 
 std::unique_ptr<Snapshot> Simulation::CreateSnapshot()
@@ -614,6 +737,7 @@ void Simulation::Restore(const Snapshot &snap)
 	player2 = snap.stickmen[snap.stickmen.size() - 2];
 	signs = snap.signs;
 	parts_lastActiveIndex = NPART - 1;
+	partCoords.valid = false;
 	air->RecalculateBlockAirMaps();
 	RecalcFreeParticles(false);
 	gravWallChanged = true;
@@ -665,6 +789,25 @@ CoordStack& Simulation::getCoordStackSingleton()
 	return cs;
 }
 
+void Simulation::SetPartProperty(int i, StructProperty::PropertyType type, intptr_t offset, PropertyValue value)
+{
+	switch (type)
+	{
+	case StructProperty::Float:
+		SetPartProperty<float>(i, offset, value.Float);
+		break;
+	case StructProperty::ParticleType:
+	case StructProperty::Integer:
+		SetPartProperty<int>(i, offset, value.Integer);
+		break;
+	case StructProperty::UInteger:
+		SetPartProperty<unsigned int>(i, offset, value.UInteger);
+		break;
+	default:
+		break;
+	}
+}
+
 int Simulation::flood_prop(int x, int y, size_t propoffset, PropertyValue propvalue, StructProperty::PropertyType proptype)
 {
 	int i, x1, x2, dy = 1;
@@ -678,6 +821,8 @@ int Simulation::flood_prop(int x, int y, size_t propoffset, PropertyValue propva
 	char * bitmap = (char*)malloc(XRES*YRES); //Bitmap for checking
 	if (!bitmap) return -1;
 	memset(bitmap, 0, XRES*YRES);
+	// Written once the fill is done, as writing type, x or y moves the particles around in pmap
+	std::vector<int> filled;
 	try
 	{
 		CoordStack& cs = getCoordStackSingleton();
@@ -707,23 +852,7 @@ int Simulation::flood_prop(int x, int y, size_t propoffset, PropertyValue propva
 					i = photons[y][x];
 				if (!i)
 					continue;
-				switch (proptype) {
-					case StructProperty::Float:
-						*((float*)(((char*)&parts[ID(i)])+propoffset)) = propvalue.Float;
-						break;
-
-					case StructProperty::ParticleType:
-					case StructProperty::Integer:
-						*((int*)(((char*)&parts[ID(i)])+propoffset)) = propvalue.Integer;
-						break;
-
-					case StructProperty::UInteger:
-						*((unsigned int*)(((char*)&parts[ID(i)])+propoffset)) = propvalue.UInteger;
-						break;
-
-					default:
-						break;
-				}
+				filled.push_back(ID(i));
 				bitmap[(y*XRES)+x] = 1;
 				did_something = 1;
 			}
@@ -744,6 +873,8 @@ int Simulation::flood_prop(int x, int y, size_t propoffset, PropertyValue propva
 		return -1;
 	}
 	free(bitmap);
+	for (auto id : filled)
+		SetPartProperty(id, proptype, propoffset, propvalue);
 	return did_something;
 }
 
@@ -943,9 +1074,11 @@ bool Simulation::flood_water(int x, int y, int i)
 					int oldx = (int)(parts[i].x + 0.5f);
 					int oldy = (int)(parts[i].y + 0.5f);
 					pmap[y - 1][x] = pmap[oldy][oldx];
+					occupiedPixels.Mark(x, y - 1);
 					pmap[oldy][oldx] = 0;
 					parts[i].x = float(x);
 					parts[i].y = float(y - 1);
+					PartGridMove(i);
 					return true;
 				}
 
@@ -2152,6 +2285,14 @@ void Simulation::set_emap(int x, int y)
 {
 	int x1, x2;
 
+	// The fill can reach any row, leave it until the stripes are done
+	if (stripePhase)
+	{
+		ParticleStripe *stripe = currentStripe;
+		stripe->emapUpdates.push_back({ x, y });
+		return;
+	}
+
 	if (!is_wire_off(x, y))
 		return;
 
@@ -2279,12 +2420,27 @@ void Simulation::clear_sim(void)
 	parts[NPART-1].life = -1;
 	pfree = 0;
 	parts_lastActiveIndex = 0;
+	memset(activeParts, 0, sizeof(activeParts));
+	typePartsValid = false;
+	// Slots RecalcFreeParticles goes through without their having been handed out have to read as empty
+	std::fill(partCoords.type.begin(), partCoords.type.end(), 0);
+	partCoords.valid = false;
+	memset(cellIdleTicks, 0, sizeof(cellIdleTicks));
+	memset(cellLastState, 0, sizeof(cellLastState));
+	memset(sleepTemp, 0, sizeof(sleepTemp));
 	memset(pmap, 0, sizeof(pmap));
 	memset(fvx, 0, sizeof(fvx));
 	memset(fvy, 0, sizeof(fvy));
 	memset(photons, 0, sizeof(photons));
 	memset(wireless, 0, sizeof(wireless));
 	memset(gol, 0, sizeof(gol));
+	memset(golLive, 0, sizeof(golLive));
+	for (auto &grid : partGrids)
+	{
+		if (grid)
+			grid->valid = false;
+	}
+	occupiedPixels.valid = false;
 	memset(portalp, 0, sizeof(portalp));
 	memset(fighters, 0, sizeof(fighters));
 	std::fill(elementCount, elementCount+PT_NUM, 0);
@@ -2618,7 +2774,9 @@ int Simulation::try_move(int i, int x, int y, int nx, int ny)
 				if (!portalp[parts[ID(r)].tmp][count][nnx].type)
 				{
 					portalp[parts[ID(r)].tmp][count][nnx] = parts[i];
+					PartGridChangeType(i, parts[i].type, PT_NONE);
 					parts[i].type=PT_NONE;
+					UpdatePartPmap(i, x, y);
 					break;
 				}
 		}
@@ -2852,14 +3010,18 @@ int Simulation::try_move(int i, int x, int y, int nx, int ny)
 			if (s)
 			{
 				pmap[ny][nx] = (s&~PMAPMASK)|parts[ID(s)].type;
+				occupiedPixels.Mark(nx, ny);
 				parts[ID(s)].x = float(nx);
 				parts[ID(s)].y = float(ny);
+				PartGridMove(ID(s));
 			}
 			else
 				pmap[ny][nx] = 0;
 			parts[ri].x = float(x);
 			parts[ri].y = float(y);
+			PartGridMove(ri);
 			pmap[y][x] = PMAP(ri, parts[ri].type);
+			occupiedPixels.Mark(x, y);
 			return 1;
 		}
 
@@ -2867,12 +3029,16 @@ int Simulation::try_move(int i, int x, int y, int nx, int ny)
 			pmap[ny][nx] = 0;
 		parts[ri].x += float(x - nx);
 		parts[ri].y += float(y - ny);
+		PartGridMove(ri);
 		int rx = int(parts[ri].x + 0.5f);
 		int ry = int(parts[ri].y + 0.5f);
 		// This check will never fail unless the pmap array has already been corrupted via another bug
 		// In that case, r's position is inaccurate (not actually at nx/ny) and rx/ry may be out of bounds
 		if (InBounds(rx, ry))
+		{
 			pmap[ry][rx] = PMAP(ri, parts[ri].type);
+			occupiedPixels.Mark(rx, ry);
+		}
 	}
 	return 1;
 }
@@ -2908,6 +3074,7 @@ int Simulation::do_move(int i, int x, int y, float nxf, float nyf)
 		int t = parts[i].type;
 		parts[i].x = nxf;
 		parts[i].y = nyf;
+		PartGridMove(i);
 		if (ny!=y || nx!=x)
 		{
 			if (ID(pmap[y][x]) == i)
@@ -2924,6 +3091,7 @@ int Simulation::do_move(int i, int x, int y, float nxf, float nyf)
 				photons[ny][nx] = PMAP(i, t);
 			else if (t)
 				pmap[ny][nx] = PMAP(i, t);
+			occupiedPixels.Mark(nx, ny);
 		}
 	}
 	return result;
@@ -3099,7 +3267,8 @@ void Simulation::kill_part(int i)//kills particle number i
 {
 	if (i < 0 || i >= NPART)
 		return;
-	
+	StripeLock stripeLock(*this);
+
 	int x = (int)(parts[i].x + 0.5f);
 	int y = (int)(parts[i].y + 0.5f);
 
@@ -3108,6 +3277,7 @@ void Simulation::kill_part(int i)//kills particle number i
 	{
 		(*(elements[t].ChangeType))(this, i, x, y, t, PT_NONE);
 	}
+	PartGridChangeType(i, t, PT_NONE);
 
 	if (x >= 0 && y >= 0 && x < XRES && y < YRES)
 	{
@@ -3124,6 +3294,14 @@ void Simulation::kill_part(int i)//kills particle number i
 	elementCount[t]--;
 
 	parts[i].type = PT_NONE;
+	UpdatePartCoords(i);
+	// Stripes must not hand out the slot again while they are running, it may still be in a list of particles to update
+	if (stripePhase)
+	{
+		ParticleStripe *stripe = currentStripe;
+		stripe->freed.push_back(i);
+		return;
+	}
 	parts[i].life = pfree;
 	pfree = i;
 }
@@ -3134,11 +3312,13 @@ bool Simulation::part_change_type(int i, int x, int y, int t)
 {
 	if (x<0 || y<0 || x>=XRES || y>=YRES || i>=NPART || t<0 || t>=PT_NUM || !parts[i].type)
 		return false;
+	StripeLock stripeLock(*this);
 	if (!elements[t].Enabled || t == PT_NONE)
 	{
 		kill_part(i);
 		return true;
 	}
+	InvalidateTypeParts();
 	if (elements[t].CreateAllowed)
 	{
 		if (!(*(elements[t].CreateAllowed))(this, i, x, y, t))
@@ -3154,22 +3334,197 @@ bool Simulation::part_change_type(int i, int x, int y, int t)
 		elementCount[parts[i].type]--;
 	elementCount[t]++;
 
+	int oldType = parts[i].type;
 	parts[i].type = t;
+	PartGridChangeType(i, oldType, t);
+	UpdatePartCoords(i);
 	if (elements[t].Properties & TYPE_ENERGY)
 	{
 		photons[y][x] = PMAP(i, t);
+		occupiedPixels.Mark(x, y);
 		if (ID(pmap[y][x]) == i)
 			pmap[y][x] = 0;
 	}
 	else
 	{
 		pmap[y][x] = PMAP(i, t);
+		occupiedPixels.Mark(x, y);
 		if (ID(photons[y][x]) == i)
 			photons[y][x] = 0;
 	}
 	return false;
 }
 
+// Takes an unused particle slot off the free list, returns -1 if there is none
+int Simulation::take_free_part()
+{
+	if (stripePhase)
+	{
+		// Stripe s takes the runs s, s + stripeCount, s + 2*stripeCount, ... of the free list, so which particle
+		// gets which slot doesn't depend on how the threads are scheduled or how many slots other stripes need.
+		// The free list is only unlinked as far as it is needed, into stripeFreeList; StripeLock is held here.
+		ParticleStripe *stripe = currentStripe;
+		while (true)
+		{
+			size_t run = (stripe->freeSlotsTaken / STRIPE_FREE_SLOTS) * stripes.size() + stripe->y0 / STRIPE_HEIGHT;
+			size_t pos = run * STRIPE_FREE_SLOTS + stripe->freeSlotsTaken % STRIPE_FREE_SLOTS;
+			while (stripeFreeList.size() <= pos && pfree != -1)
+			{
+				stripeFreeList.push_back(pfree);
+				stripeFreeTaken.push_back(false);
+				pfree = parts[pfree].life;
+			}
+			if (pos >= stripeFreeList.size())
+				break;
+			stripe->freeSlotsTaken++;
+			// Skip slots that a stripe which ran out of its own took
+			if (!stripeFreeTaken[pos])
+			{
+				stripeFreeTaken[pos] = true;
+				return stripeFreeList[pos];
+			}
+		}
+		// The free list is all unlinked and this stripe's runs are past its end, but the runs of other stripes may
+		// still have slots. Taking those makes slot allocation depend on timing, but only when the list runs short.
+		while (stripeFreeScan < stripeFreeList.size() && stripeFreeTaken[stripeFreeScan])
+			stripeFreeScan++;
+		if (stripeFreeScan == stripeFreeList.size())
+			return -1;
+		stripeFreeTaken[stripeFreeScan] = true;
+		return stripeFreeList[stripeFreeScan];
+	}
+	if (pfree == -1)
+		return -1;
+	int i = pfree;
+	pfree = parts[i].life;
+	return i;
+}
+
+// UpdateParticles clears typePartsValid before the stripe phase, which never sets it again, so stripes leave
+// it alone rather than all writing it at once
+void Simulation::InvalidateTypeParts()
+{
+	if (!stripePhase)
+		typePartsValid = false;
+}
+
+void Simulation::MarkPartActive(int i)
+{
+	activeParts[i / 32] |= 1U << (i % 32);
+	if (i > parts_lastActiveIndex)
+		parts_lastActiveIndex = i;
+}
+
+// Returns the first slot at or after i that may hold a live particle, or NPART if there is none
+int Simulation::NextActivePart(int i) const
+{
+	if (i >= NPART)
+		return NPART;
+	int word = i / 32;
+	uint32_t bits = activeParts[word] & (~0U << (i % 32));
+	while (!bits)
+	{
+		if (++word >= (NPART + 31) / 32)
+			return NPART;
+		bits = activeParts[word];
+	}
+	return word * 32 + __builtin_ctz(bits);
+}
+
+// Particles of type t in index order. Entries may since have been killed or changed type, so callers
+// must check parts[i].type. If the lists from RecalcFreeParticles are out of date, the list for t
+// is collected again, which invalidates earlier references to it.
+const std::vector<int> &Simulation::PartsOfType(int t)
+{
+	if (!typePartsValid)
+	{
+		typeParts[t].clear();
+		for (int i = NextActivePart(0); i <= parts_lastActiveIndex; i = NextActivePart(i + 1))
+		{
+			if (parts[i].type == t)
+				typeParts[t].push_back(i);
+		}
+	}
+	return typeParts[t];
+}
+
+// Grid of the particles of type t, built the first time it is asked for after RecalcFreeParticles. Particles
+// created, killed or changed to or from type t are added or taken out as that happens.
+ParticleGrid &Simulation::PartGrid(int t)
+{
+	auto &grid = partGrids[t];
+	if (!grid)
+		grid = std::make_unique<ParticleGrid>();
+	if (!grid->valid)
+	{
+		grid->Clear();
+		for (int i = NextActivePart(0); i <= parts_lastActiveIndex; i = NextActivePart(i + 1))
+		{
+			if (parts[i].type == t)
+				grid->Add(parts, i);
+		}
+		grid->valid = true;
+	}
+	return *grid;
+}
+
+void Simulation::PartGridChangeType(int i, int from, int to)
+{
+	if (from != to && partGrids[from] && partGrids[from]->valid)
+		partGrids[from]->Remove(i);
+	if (partGrids[to] && partGrids[to]->valid)
+		partGrids[to]->Add(parts, i);
+}
+
+// Moves the pmap or photons entry of particle i from oldX, oldY to where the particle is now, with its current type,
+// after its position or type was written directly. Without incrementalPmap, pmap is rebuilt before it is next
+// relied on anyway, and leaving it alone keeps the rest of the tick seeing what it always has.
+void Simulation::UpdatePartPmap(int i, int oldX, int oldY)
+{
+	if (!incrementalPmap)
+		return;
+	if (InBounds(oldX, oldY))
+	{
+		if (ID(pmap[oldY][oldX]) == i)
+			pmap[oldY][oldX] = 0;
+		if (ID(photons[oldY][oldX]) == i)
+			photons[oldY][oldX] = 0;
+	}
+	int t = parts[i].type;
+	int x = (int)(parts[i].x+0.5f), y = (int)(parts[i].y+0.5f);
+	if (!t || !InBounds(x, y))
+		return;
+	if (elements[t].Properties & TYPE_ENERGY)
+		photons[y][x] = PMAP(i, t);
+	else
+		pmap[y][x] = PMAP(i, t);
+	occupiedPixels.Mark(x, y);
+}
+
+// Number of steps of dx, dy from x, y before reaching a pixel that may have something in pmap or photons,
+// or leaving the screen, so that rays can skip empty pixels. Built the first time it is asked for after
+// RecalcFreeParticles; pixels that particles are created in or moved to are marked as that happens.
+int Simulation::StepsToOccupied(int x, int y, int dx, int dy)
+{
+	if (!occupiedPixels.valid)
+		occupiedPixels.Build(pmap, photons);
+	return occupiedPixels.Steps(x, y, dx, dy);
+}
+
+// The types and rounded positions of the particles up to parts_lastActiveIndex, copied from parts the first time
+// they are asked for since particles last moved, unless RecalcFreeParticles has already done that
+const ParticleCoords &Simulation::PartCoords()
+{
+	if (!partCoords.valid)
+	{
+		partCoords.Allocate();
+		for (int i = NextActivePart(0); i <= parts_lastActiveIndex; i = NextActivePart(i + 1))
+			partCoords.Set(i, parts[i]);
+		partCoords.valid = true;
+	}
+	return partCoords;
+}
+
 //the function for creating a particle, use p=-1 for creating a new particle, -2 is from a brush, or a particle number to replace a particle.
 //tv = Type (PMAPBITS bits) + Var (32-PMAPBITS bits), var is usually 0
 int Simulation::create_part(int p, int x, int y, int t, int v)
@@ -3178,6 +3533,8 @@ int Simulation::create_part(int p, int x, int y, int t, int v)
 
 	if (x<0 || y<0 || x>=XRES || y>=YRES || t<=0 || t>=PT_NUM || !elements[t].Enabled)
 		return -1;
+	StripeLock stripeLock(*this);
+	InvalidateTypeParts();
 
 	if (t == PT_SPRK && !(p == -2 && elements[TYP(pmap[y][x])].CtypeDraw))
 	{
@@ -3195,9 +3552,11 @@ int Simulation::create_part(int p, int x, int y, int t, int v)
 			FloodINST(x, y);
 			return index;
 		}
+		PartGridChangeType(index, parts[index].type, PT_SPRK);
 		parts[index].type = PT_SPRK;
 		parts[index].life = 4;
 		parts[index].ctype = type;
+		UpdatePartCoords(index);
 		pmap[y][x] = (pmap[y][x]&~PMAPMASK) | PT_SPRK;
 		if (parts[index].temp+10.0f < 673.0f && !legacy_enable && (type==PT_METL || type == PT_BMTL || type == PT_BRMT || type == PT_PSCN || type == PT_NSCN || type == PT_ETRD || type == PT_NBLE || type == PT_IRON))
 			parts[index].temp = parts[index].temp+10.0f;
@@ -3237,24 +3596,21 @@ int Simulation::create_part(int p, int x, int y, int t, int v)
 		{
 			return -1;
 		}
-		if (pfree == -1)
+		i = take_free_part();
+		if (i == -1)
 			return -1;
-		i = pfree;
-		pfree = parts[i].life;
 	}
 	else if (p == -2)//creating from brush
 	{
-		if (pfree == -1)
+		i = take_free_part();
+		if (i == -1)
 			return -1;
-		i = pfree;
-		pfree = parts[i].life;
 	}
 	else if (p == -3)//skip pmap checks, e.g. for sing explosion
 	{
-		if (pfree == -1)
+		i = take_free_part();
+		if (i == -1)
 			return -1;
-		i = pfree;
-		pfree = parts[i].life;
 	}
 	else
 	{
@@ -3275,7 +3631,7 @@ int Simulation::create_part(int p, int x, int y, int t, int v)
 		i = p;
 	}
 
-	if (i>parts_lastActiveIndex) parts_lastActiveIndex = i;
+	MarkPartActive(i);
 
 	parts[i] = elements[t].DefaultProperties;
 	parts[i].type = t;
@@ -3287,6 +3643,7 @@ int Simulation::create_part(int p, int x, int y, int t, int v)
 		photons[y][x] = PMAP(i, t);
 	else if (t!=PT_STKM && t!=PT_STKM2 && t!=PT_FIGH)
 		pmap[y][x] = PMAP(i, t);
+	occupiedPixels.Mark(x, y);
 
 	//Fancy dust effects for powder types
 	if((elements[t].Properties & TYPE_PART) && pretty_powder)
@@ -3307,6 +3664,8 @@ int Simulation::create_part(int p, int x, int y, int t, int v)
 
 	if (elements[t].ChangeType)
 		(*(elements[t].ChangeType))(this, i, x, y, oldType, t);
+	PartGridChangeType(i, oldType, t);
+	UpdatePartCoords(i);
 
 	elementCount[t]++;
 	return i;
@@ -3375,7 +3734,7 @@ void Simulation::create_gain_photon(int pp)//photons from PHOT going through GLO
 		return;
 
 	pfree = parts[i].life;
-	if (i>parts_lastActiveIndex) parts_lastActiveIndex = i;
+	MarkPartActive(i);
 
 	parts[i].type = PT_PHOT;
 	parts[i].life = 680;
@@ -3388,6 +3747,8 @@ void Simulation::create_gain_photon(int pp)//photons from PHOT going through GLO
 	parts[i].tmp3 = 0;
 	parts[i].tmp4 = 0;
 	photons[ny][nx] = PMAP(i, PT_PHOT);
+	occupiedPixels.Mark(nx, ny);
+	PartGridChangeType(i, PT_NONE, PT_PHOT);
 
 	temp_bin = (int)((parts[i].temp-273.0f)*0.25f);
 	if (temp_bin < 0) temp_bin = 0;
@@ -3413,7 +3774,7 @@ void Simulation::create_cherenkov_photon(int pp)//photons from NEUT going throug
 		return;
 
 	pfree = parts[i].life;
-	if (i>parts_lastActiveIndex) parts_lastActiveIndex = i;
+	MarkPartActive(i);
 
 	lr = RNG::Ref().between(0, 1);
 
@@ -3427,6 +3788,8 @@ void Simulation::create_cherenkov_photon(int pp)//photons from NEUT going throug
 	parts[i].tmp3 = 0;
 	parts[i].tmp4 = 0;
 	photons[ny][nx] = PMAP(i, PT_PHOT);
+	occupiedPixels.Mark(nx, ny);
+	PartGridChangeType(i, PT_NONE, PT_PHOT);
 
 	if (lr) {
 		parts[i].vx = parts[pp].vx - 2.5f*parts[pp].vy;
@@ -3458,11 +3821,28 @@ void Simulation::delete_part(int x, int y)//calls kill_part with the particle lo
 
 void Simulation::UpdateParticles(int start, int end)
 {
-	int i, j, x, y, t, nx, ny, r, surround_space, s, rt, nt;
-	float mv, dx, dy, nrx, nry, dp, ctemph, ctempl, gravtot;
-	int fin_x, fin_y, clear_x, clear_y, stagnant;
-	float fin_xf, fin_yf, clear_xf, clear_yf;
-	float nn, ct1, ct2, swappage;
+	//the main particle loop function, goes over all particles.
+	typePartsValid = false;
+	partCoords.Allocate();
+	partCoords.valid = false;
+	if (start == 0 && end >= NPART-1 && CanUpdateParticlesInStripes())
+		UpdateParticlesInStripes();
+	else
+	{
+		for (int i = NextActivePart(start); i <= end && i <= parts_lastActiveIndex; i = NextActivePart(i + 1))
+			if (parts[i].type)
+				UpdateParticle(i, nullptr);
+	}
+
+	//'f' was pressed (single frame)
+	if (framerender)
+		framerender--;
+}
+
+void Simulation::UpdateParticle(int i, ParticleStripe *stripe)
+{
+	int j, x, y, t, nx, ny, r, surround_space, s, rt, nt;
+	float ctemph, ctempl, gravtot, swappage;
 	float pt = R_TEMP;
 	float c_heat = 0.0f;
 	int h_count = 0;
@@ -3470,1158 +3850,1368 @@ void Simulation::UpdateParticles(int start, int end)
 	int surround_hconduct[8];
 	bool transitionOccurred;
 
-	//the main particle loop function, goes over all particles.
-	for (i = start; i <= end && i <= parts_lastActiveIndex; i++)
-		if (parts[i].type)
-		{
-			t = parts[i].type;
 
-			x = (int)(parts[i].x+0.5f);
-			y = (int)(parts[i].y+0.5f);
+	t = parts[i].type;
 
-			// Kill a particle off screen
-			if (x<CELL || y<CELL || x>=XRES-CELL || y>=YRES-CELL)
-			{
-				kill_part(i);
-				continue;
-			}
+	x = (int)(parts[i].x+0.5f);
+	y = (int)(parts[i].y+0.5f);
 
-			// Kill a particle in a wall where it isn't supposed to go
-			if (bmap[y/CELL][x/CELL] &&
-			   (bmap[y/CELL][x/CELL]==WL_WALL ||
-			    bmap[y/CELL][x/CELL]==WL_WALLELEC ||
-			    bmap[y/CELL][x/CELL]==WL_ALLOWAIR ||
-			    (bmap[y/CELL][x/CELL]==WL_DESTROYALL) ||
-			    (bmap[y/CELL][x/CELL]==WL_ALLOWLIQUID && !(elements[t].Properties&TYPE_LIQUID)) ||
-			    (bmap[y/CELL][x/CELL]==WL_ALLOWPOWDER && !(elements[t].Properties&TYPE_PART)) ||
-			    (bmap[y/CELL][x/CELL]==WL_ALLOWGAS && !(elements[t].Properties&TYPE_GAS)) || //&& elements[t].Falldown!=0 && parts[i].type!=PT_FIRE && parts[i].type!=PT_SMKE && parts[i].type!=PT_CFLM) ||
-			            (bmap[y/CELL][x/CELL]==WL_ALLOWENERGY && !(elements[t].Properties&TYPE_ENERGY)) ||
-			    (bmap[y/CELL][x/CELL]==WL_EWALL && !emap[y/CELL][x/CELL])) && (t!=PT_STKM) && (t!=PT_STKM2) && (t!=PT_FIGH))
-			{
-				kill_part(i);
-				continue;
-			}
+	// Kill a particle off screen
+	if (x<CELL || y<CELL || x>=XRES-CELL || y>=YRES-CELL)
+	{
+		kill_part(i);
+		return;
+	}
 
-			// Make sure that STASIS'd particles don't tick.
-			if (bmap[y/CELL][x/CELL] == WL_STASIS && emap[y/CELL][x/CELL]<8) {
-				continue;
-			}
+	// Kill a particle in a wall where it isn't supposed to go
+	if (bmap[y/CELL][x/CELL] &&
+	   (bmap[y/CELL][x/CELL]==WL_WALL ||
+	    bmap[y/CELL][x/CELL]==WL_WALLELEC ||
+	    bmap[y/CELL][x/CELL]==WL_ALLOWAIR ||
+	    (bmap[y/CELL][x/CELL]==WL_DESTROYALL) ||
+	    (bmap[y/CELL][x/CELL]==WL_ALLOWLIQUID && !(elements[t].Properties&TYPE_LIQUID)) ||
+	    (bmap[y/CELL][x/CELL]==WL_ALLOWPOWDER && !(elements[t].Properties&TYPE_PART)) ||
+	    (bmap[y/CELL][x/CELL]==WL_ALLOWGAS && !(elements[t].Properties&TYPE_GAS)) || //&& elements[t].Falldown!=0 && parts[i].type!=PT_FIRE && parts[i].type!=PT_SMKE && parts[i].type!=PT_CFLM) ||
+	            (bmap[y/CELL][x/CELL]==WL_ALLOWENERGY && !(elements[t].Properties&TYPE_ENERGY)) ||
+	    (bmap[y/CELL][x/CELL]==WL_EWALL && !emap[y/CELL][x/CELL])) && (t!=PT_STKM) && (t!=PT_STKM2) && (t!=PT_FIGH))
+	{
+		kill_part(i);
+		return;
+	}
 
-			if (bmap[y/CELL][x/CELL]==WL_DETECT && emap[y/CELL][x/CELL]<8)
-				set_emap(x/CELL, y/CELL);
+	// Make sure that STASIS'd particles don't tick.
+	if (bmap[y/CELL][x/CELL] == WL_STASIS && emap[y/CELL][x/CELL]<8) {
+		return;
+	}
 
-			//adding to velocity from the particle's velocity
-			vx[y/CELL][x/CELL] = vx[y/CELL][x/CELL]*elements[t].AirLoss + elements[t].AirDrag*parts[i].vx;
-			vy[y/CELL][x/CELL] = vy[y/CELL][x/CELL]*elements[t].AirLoss + elements[t].AirDrag*parts[i].vy;
+	if (bmap[y/CELL][x/CELL]==WL_DETECT && emap[y/CELL][x/CELL]<8)
+		set_emap(x/CELL, y/CELL);
 
-			if (elements[t].HotAir)
-			{
-				if (t==PT_GAS||t==PT_NBLE)
-				{
-					if (pv[y/CELL][x/CELL]<3.5f)
-						pv[y/CELL][x/CELL] += elements[t].HotAir*(3.5f-pv[y/CELL][x/CELL]);
-					if (y+CELL<YRES && pv[y/CELL+1][x/CELL]<3.5f)
-						pv[y/CELL+1][x/CELL] += elements[t].HotAir*(3.5f-pv[y/CELL+1][x/CELL]);
-					if (x+CELL<XRES)
-					{
-						if (pv[y/CELL][x/CELL+1]<3.5f)
-							pv[y/CELL][x/CELL+1] += elements[t].HotAir*(3.5f-pv[y/CELL][x/CELL+1]);
-						if (y+CELL<YRES && pv[y/CELL+1][x/CELL+1]<3.5f)
-							pv[y/CELL+1][x/CELL+1] += elements[t].HotAir*(3.5f-pv[y/CELL+1][x/CELL+1]);
-					}
-				}
-				else//add the hotair variable to the pressure map, like black hole, or white hole.
-				{
-					pv[y/CELL][x/CELL] += elements[t].HotAir;
-					if (y+CELL<YRES)
-						pv[y/CELL+1][x/CELL] += elements[t].HotAir;
-					if (x+CELL<XRES)
-					{
-						pv[y/CELL][x/CELL+1] += elements[t].HotAir;
-						if (y+CELL<YRES)
-							pv[y/CELL+1][x/CELL+1] += elements[t].HotAir;
-					}
-				}
-			}
+	if (sleepingCells && canSleep[t] && cellIdleTicks[y/CELL][x/CELL] >= CELL_SLEEP_TICKS)
+		return;
 
-			float pGravX = 0, pGravY = 0;
-			if (!(elements[t].Properties & TYPE_SOLID) && (elements[t].Gravity || elements[t].NewtonianGravity))
+	//adding to velocity from the particle's velocity
+	vx[y/CELL][x/CELL] = vx[y/CELL][x/CELL]*elements[t].AirLoss + elements[t].AirDrag*parts[i].vx;
+	vy[y/CELL][x/CELL] = vy[y/CELL][x/CELL]*elements[t].AirLoss + elements[t].AirDrag*parts[i].vy;
+
+	if (elements[t].HotAir)
+	{
+		if (t==PT_GAS||t==PT_NBLE)
+		{
+			if (pv[y/CELL][x/CELL]<3.5f)
+				pv[y/CELL][x/CELL] += elements[t].HotAir*(3.5f-pv[y/CELL][x/CELL]);
+			if (y+CELL<YRES && pv[y/CELL+1][x/CELL]<3.5f)
+				pv[y/CELL+1][x/CELL] += elements[t].HotAir*(3.5f-pv[y/CELL+1][x/CELL]);
+			if (x+CELL<XRES)
 			{
-				GetGravityField(x, y, elements[t].Gravity, elements[t].NewtonianGravity, pGravX, pGravY);
+				if (pv[y/CELL][x/CELL+1]<3.5f)
+					pv[y/CELL][x/CELL+1] += elements[t].HotAir*(3.5f-pv[y/CELL][x/CELL+1]);
+				if (y+CELL<YRES && pv[y/CELL+1][x/CELL+1]<3.5f)
+					pv[y/CELL+1][x/CELL+1] += elements[t].HotAir*(3.5f-pv[y/CELL+1][x/CELL+1]);
 			}
-
-			//velocity updates for the particle
-			if (t != PT_SPNG || !(parts[i].flags&FLAG_MOVABLE))
+		}
+		else//add the hotair variable to the pressure map, like black hole, or white hole.
+		{
+			pv[y/CELL][x/CELL] += elements[t].HotAir;
+			if (y+CELL<YRES)
+				pv[y/CELL+1][x/CELL] += elements[t].HotAir;
+			if (x+CELL<XRES)
 			{
-				parts[i].vx *= elements[t].Loss;
-				parts[i].vy *= elements[t].Loss;
+				pv[y/CELL][x/CELL+1] += elements[t].HotAir;
+				if (y+CELL<YRES)
+					pv[y/CELL+1][x/CELL+1] += elements[t].HotAir;
 			}
-			//particle gets velocity from the vx and vy maps
-			parts[i].vx += elements[t].Advection*vx[y/CELL][x/CELL] + pGravX;
-			parts[i].vy += elements[t].Advection*vy[y/CELL][x/CELL] + pGravY;
+		}
+	}
+
+	float pGravX = 0, pGravY = 0;
+	if (!(elements[t].Properties & TYPE_SOLID) && (elements[t].Gravity || elements[t].NewtonianGravity))
+	{
+		GetGravityField(x, y, elements[t].Gravity, elements[t].NewtonianGravity, pGravX, pGravY);
+	}
 
+	//velocity updates for the particle
+	if (t != PT_SPNG || !(parts[i].flags&FLAG_MOVABLE))
+	{
+		parts[i].vx *= elements[t].Loss;
+		parts[i].vy *= elements[t].Loss;
+	}
+	//particle gets velocity from the vx and vy maps
+	parts[i].vx += elements[t].Advection*vx[y/CELL][x/CELL] + pGravX;
+	parts[i].vy += elements[t].Advection*vy[y/CELL][x/CELL] + pGravY;
 
-			if (elements[t].Diffusion)//the random diffusion that gasses have
-			{
+
+	if (elements[t].Diffusion)//the random diffusion that gasses have
+	{
 #ifdef REALISTIC
-				//The magic number controls diffusion speed
-				parts[i].vx += 0.05*sqrtf(parts[i].temp)*elements[t].Diffusion*(2.0f*RNG::Ref().uniform01()-1.0f);
-				parts[i].vy += 0.05*sqrtf(parts[i].temp)*elements[t].Diffusion*(2.0f*RNG::Ref().uniform01()-1.0f);
+		//The magic number controls diffusion speed
+		parts[i].vx += 0.05*sqrtf(parts[i].temp)*elements[t].Diffusion*(2.0f*RNG::Ref().uniform01()-1.0f);
+		parts[i].vy += 0.05*sqrtf(parts[i].temp)*elements[t].Diffusion*(2.0f*RNG::Ref().uniform01()-1.0f);
 #else
-				parts[i].vx += elements[t].Diffusion*(2.0f*RNG::Ref().uniform01()-1.0f);
-				parts[i].vy += elements[t].Diffusion*(2.0f*RNG::Ref().uniform01()-1.0f);
+		parts[i].vx += elements[t].Diffusion*(2.0f*RNG::Ref().uniform01()-1.0f);
+		parts[i].vy += elements[t].Diffusion*(2.0f*RNG::Ref().uniform01()-1.0f);
 #endif
-			}
+	}
 
-			transitionOccurred = false;
+	transitionOccurred = false;
 
-			j = surround_space = nt = 0;//if nt is greater than 1 after this, then there is a particle around the current particle, that is NOT the current particle's type, for water movement.
-			for (nx=-1; nx<2; nx++)
-				for (ny=-1; ny<2; ny++) {
-					if (nx||ny) {
-						surround[j] = r = pmap[y+ny][x+nx];
-						j++;
-						surround_space += (!TYP(r)); // count empty space
-						nt += (TYP(r)!=t); // count empty space and particles of different type
-					}
-				}
+	j = surround_space = nt = 0;//if nt is greater than 1 after this, then there is a particle around the current particle, that is NOT the current particle's type, for water movement.
+	for (nx=-1; nx<2; nx++)
+		for (ny=-1; ny<2; ny++) {
+			if (nx||ny) {
+				surround[j] = r = pmap[y+ny][x+nx];
+				j++;
+				surround_space += (!TYP(r)); // count empty space
+				nt += (TYP(r)!=t); // count empty space and particles of different type
+			}
+		}
 
-			float gel_scale = 1.0f;
-			if (t==PT_GEL)
-				gel_scale = parts[i].tmp*2.55f;
+	float gel_scale = 1.0f;
+	if (t==PT_GEL)
+		gel_scale = parts[i].tmp*2.55f;
 
-			if (!legacy_enable)
-			{
-				if ((elements[t].Properties&TYPE_LIQUID) && (t!=PT_GEL || gel_scale > (1 + RNG::Ref().between(0, 254))))
-				{
-					float convGravX, convGravY;
-					GetGravityField(x, y, -2.0f, -2.0f, convGravX, convGravY);
-					auto offsetX = int(std::round(convGravX + x));
-					auto offsetY = int(std::round(convGravY + y));
-					if ((offsetX != x || offsetY != y) && offsetX >= 0 && offsetX < XRES && offsetY >= 0 && offsetY < YRES) {//some heat convection for liquids
-						r = pmap[offsetY][offsetX];
-						if (!(!r || parts[i].type != TYP(r))) {
-							if (parts[i].temp>parts[ID(r)].temp) {
-								swappage = parts[i].temp;
-								parts[i].temp = parts[ID(r)].temp;
-								parts[ID(r)].temp = swappage;
-							}
-						}
+	if (!legacy_enable)
+	{
+		if ((elements[t].Properties&TYPE_LIQUID) && (t!=PT_GEL || gel_scale > (1 + RNG::Ref().between(0, 254))))
+		{
+			float convGravX, convGravY;
+			GetGravityField(x, y, -2.0f, -2.0f, convGravX, convGravY);
+			auto offsetX = int(std::round(convGravX + x));
+			auto offsetY = int(std::round(convGravY + y));
+			if ((offsetX != x || offsetY != y) && offsetX >= 0 && offsetX < XRES && offsetY >= 0 && offsetY < YRES) {//some heat convection for liquids
+				r = pmap[offsetY][offsetX];
+				if (!(!r || parts[i].type != TYP(r))) {
+					if (parts[i].temp>parts[ID(r)].temp) {
+						swappage = parts[i].temp;
+						parts[i].temp = parts[ID(r)].temp;
+						parts[ID(r)].temp = swappage;
 					}
 				}
+			}
+		}
 
-				//heat transfer code
-				h_count = 0;
+		//heat transfer code
+		h_count = 0;
 #ifdef REALISTIC
-				if (t&&(t!=PT_HSWC||parts[i].life==10)&&(elements[t].HeatConduct*gel_scale))
+		if (t&&(t!=PT_HSWC||parts[i].life==10)&&(elements[t].HeatConduct*gel_scale))
 #else
-				if (t && (t!=PT_HSWC||parts[i].life==10) && RNG::Ref().chance(int(elements[t].HeatConduct*gel_scale), 250))
+		if (t && (t!=PT_HSWC||parts[i].life==10) && RNG::Ref().chance(int(elements[t].HeatConduct*gel_scale), 250))
 #endif
-				{
-					if (aheat_enable && !(elements[t].Properties&PROP_NOAMBHEAT))
-					{
+		{
+			if (aheat_enable && !(elements[t].Properties&PROP_NOAMBHEAT))
+			{
 #ifdef REALISTIC
-						c_heat = parts[i].temp*96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight) + hv[y/CELL][x/CELL]*100*(pv[y/CELL][x/CELL]+273.15f)/256;
-						float c_Cm = 96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight)  + 100*(pv[y/CELL][x/CELL]+273.15f)/256;
-						pt = c_heat/c_Cm;
-						pt = restrict_flt(pt, -MAX_TEMP+MIN_TEMP, MAX_TEMP-MIN_TEMP);
-						parts[i].temp = pt;
-						//Pressure increase from heat (temporary)
-						pv[y/CELL][x/CELL] += (pt-hv[y/CELL][x/CELL])*0.004;
-						hv[y/CELL][x/CELL] = pt;
+				c_heat = parts[i].temp*96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight) + hv[y/CELL][x/CELL]*100*(pv[y/CELL][x/CELL]+273.15f)/256;
+				float c_Cm = 96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight)  + 100*(pv[y/CELL][x/CELL]+273.15f)/256;
+				pt = c_heat/c_Cm;
+				pt = restrict_flt(pt, -MAX_TEMP+MIN_TEMP, MAX_TEMP-MIN_TEMP);
+				parts[i].temp = pt;
+				//Pressure increase from heat (temporary)
+				pv[y/CELL][x/CELL] += (pt-hv[y/CELL][x/CELL])*0.004;
+				hv[y/CELL][x/CELL] = pt;
 #else
-						c_heat = (hv[y/CELL][x/CELL]-parts[i].temp)*0.04;
-						c_heat = restrict_flt(c_heat, -MAX_TEMP+MIN_TEMP, MAX_TEMP-MIN_TEMP);
-						parts[i].temp += c_heat;
-						hv[y/CELL][x/CELL] -= c_heat;
+				c_heat = (hv[y/CELL][x/CELL]-parts[i].temp)*0.04;
+				c_heat = restrict_flt(c_heat, -MAX_TEMP+MIN_TEMP, MAX_TEMP-MIN_TEMP);
+				parts[i].temp += c_heat;
+				hv[y/CELL][x/CELL] -= c_heat;
 #endif
-					}
-					c_heat = 0.0f;
+			}
+			c_heat = 0.0f;
 #ifdef REALISTIC
-					float c_Cm = 0.0f;
+			float c_Cm = 0.0f;
 #endif
-					for (j=0; j<8; j++)
-					{
-						surround_hconduct[j] = i;
-						r = surround[j];
-						if (!r)
-							continue;
-						rt = TYP(r);
-						if (rt && elements[rt].HeatConduct && (rt!=PT_HSWC||parts[ID(r)].life==10)
-						        && (t!=PT_FILT||(rt!=PT_BRAY&&rt!=PT_BIZR&&rt!=PT_BIZRG))
-						        && (rt!=PT_FILT||(t!=PT_BRAY&&t!=PT_PHOT&&t!=PT_BIZR&&t!=PT_BIZRG))
-						        && (t!=PT_ELEC||rt!=PT_DEUT)
-						        && (t!=PT_DEUT||rt!=PT_ELEC)
-						        && (t!=PT_HSWC || rt!=PT_FILT || parts[i].tmp != 1)
-						        && (t!=PT_FILT || rt!=PT_HSWC || parts[ID(r)].tmp != 1))
-						{
-							surround_hconduct[j] = ID(r);
+			// Heat between this and its neighbours was already conducted by the heat field
+			bool fieldConducted = fastHeat && heatField && heatField->Conducted(i, x, y);
+			for (j=0; j<8; j++)
+			{
+				surround_hconduct[j] = i;
+				r = surround[j];
+				if (!r || fieldConducted)
+					continue;
+				rt = TYP(r);
+				if (rt && elements[rt].HeatConduct && (rt!=PT_HSWC||parts[ID(r)].life==10)
+				        && (t!=PT_FILT||(rt!=PT_BRAY&&rt!=PT_BIZR&&rt!=PT_BIZRG))
+				        && (rt!=PT_FILT||(t!=PT_BRAY&&t!=PT_PHOT&&t!=PT_BIZR&&t!=PT_BIZRG))
+				        && (t!=PT_ELEC||rt!=PT_DEUT)
+				        && (t!=PT_DEUT||rt!=PT_ELEC)
+				        && (t!=PT_HSWC || rt!=PT_FILT || parts[i].tmp != 1)
+				        && (t!=PT_FILT || rt!=PT_HSWC || parts[ID(r)].tmp != 1))
+				{
+					surround_hconduct[j] = ID(r);
 #ifdef REALISTIC
-							if (rt==PT_GEL)
-								gel_scale = parts[ID(r)].tmp*2.55f;
-							else gel_scale = 1.0f;
+					if (rt==PT_GEL)
+						gel_scale = parts[ID(r)].tmp*2.55f;
+					else gel_scale = 1.0f;
 
-							c_heat += parts[ID(r)].temp*96.645/elements[rt].HeatConduct*gel_scale*fabs(elements[rt].Weight);
-							c_Cm += 96.645/elements[rt].HeatConduct*gel_scale*fabs(elements[rt].Weight);
+					c_heat += parts[ID(r)].temp*96.645/elements[rt].HeatConduct*gel_scale*fabs(elements[rt].Weight);
+					c_Cm += 96.645/elements[rt].HeatConduct*gel_scale*fabs(elements[rt].Weight);
 #else
-							c_heat += parts[ID(r)].temp;
+					c_heat += parts[ID(r)].temp;
 #endif
-							h_count++;
-						}
-					}
+					h_count++;
+				}
+			}
 #ifdef REALISTIC
-					if (t==PT_GEL)
-						gel_scale = parts[i].tmp*2.55f;
-					else gel_scale = 1.0f;
+			if (t==PT_GEL)
+				gel_scale = parts[i].tmp*2.55f;
+			else gel_scale = 1.0f;
 
-					if (t == PT_PHOT)
-						pt = (c_heat+parts[i].temp*96.645)/(c_Cm+96.645);
-					else
-						pt = (c_heat+parts[i].temp*96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight))/(c_Cm+96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight));
+			if (t == PT_PHOT)
+				pt = (c_heat+parts[i].temp*96.645)/(c_Cm+96.645);
+			else
+				pt = (c_heat+parts[i].temp*96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight))/(c_Cm+96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight));
 
-					c_heat += parts[i].temp*96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight);
-					c_Cm += 96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight);
-					parts[i].temp = restrict_flt(pt, MIN_TEMP, MAX_TEMP);
+			c_heat += parts[i].temp*96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight);
+			c_Cm += 96.645/elements[t].HeatConduct*gel_scale*fabs(elements[t].Weight);
+			parts[i].temp = restrict_flt(pt, MIN_TEMP, MAX_TEMP);
 #else
-					pt = (c_heat+parts[i].temp)/(h_count+1);
-					pt = parts[i].temp = restrict_flt(pt, MIN_TEMP, MAX_TEMP);
-					for (j=0; j<8; j++)
-					{
-						parts[surround_hconduct[j]].temp = pt;
-					}
+			pt = (c_heat+parts[i].temp)/(h_count+1);
+			pt = parts[i].temp = restrict_flt(pt, MIN_TEMP, MAX_TEMP);
+			for (j=0; j<8; j++)
+			{
+				parts[surround_hconduct[j]].temp = pt;
+			}
 #endif
 
-					ctemph = ctempl = pt;
-					// change boiling point with pressure
-					if (((elements[t].Properties&TYPE_LIQUID) && IsElementOrNone(elements[t].HighTemperatureTransition) && (elements[elements[t].HighTemperatureTransition].Properties&TYPE_GAS))
-					        || t==PT_LNTG || t==PT_SLTW)
-						ctemph -= 2.0f*pv[y/CELL][x/CELL];
-					else if (((elements[t].Properties&TYPE_GAS) && IsElementOrNone(elements[t].LowTemperatureTransition) && (elements[elements[t].LowTemperatureTransition].Properties&TYPE_LIQUID))
-					         || t==PT_WTRV)
-						ctempl -= 2.0f*pv[y/CELL][x/CELL];
-					s = 1;
-
-					//A fix for ice with ctype = 0
-					if ((t==PT_ICEI || t==PT_SNOW) && (!IsElement(parts[i].ctype) || parts[i].ctype==PT_ICEI || parts[i].ctype==PT_SNOW))
-						parts[i].ctype = PT_WATR;
-
-					if (elements[t].HighTemperatureTransition>-1 && ctemph>=elements[t].HighTemperature)
-					{
-						// particle type change due to high temperature
-#ifdef REALISTIC
-						float dbt = ctempl - pt;
-						if (elements[t].HighTemperatureTransition != PT_NUM)
-						{
-							if (platent[t] <= (c_heat - (elements[t].HighTemperature - dbt)*c_Cm))
-							{
-								pt = (c_heat - platent[t])/c_Cm;
-								t = elements[t].HighTemperatureTransition;
-							}
-							else
-							{
-								parts[i].temp = restrict_flt(elements[t].HighTemperature - dbt, MIN_TEMP, MAX_TEMP);
-								s = 0;
-							}
-						}
-#else
-						if (elements[t].HighTemperatureTransition != PT_NUM)
-							t = elements[t].HighTemperatureTransition;
-#endif
-						else if (t == PT_ICEI || t == PT_SNOW)
-						{
-							if (parts[i].ctype > 0 && parts[i].ctype < PT_NUM && parts[i].ctype != t)
-							{
-								if (elements[parts[i].ctype].LowTemperatureTransition==PT_ICEI || elements[parts[i].ctype].LowTemperatureTransition==PT_SNOW)
-								{
-									if (pt<elements[parts[i].ctype].LowTemperature)
-										s = 0;
-								}
-								else if (pt<273.15f)
-									s = 0;
+			ctemph = ctempl = pt;
+			// change boiling point with pressure
+			if (((elements[t].Properties&TYPE_LIQUID) && IsElementOrNone(elements[t].HighTemperatureTransition) && (elements[elements[t].HighTemperatureTransition].Properties&TYPE_GAS))
+			        || t==PT_LNTG || t==PT_SLTW)
+				ctemph -= 2.0f*pv[y/CELL][x/CELL];
+			else if (((elements[t].Properties&TYPE_GAS) && IsElementOrNone(elements[t].LowTemperatureTransition) && (elements[elements[t].LowTemperatureTransition].Properties&TYPE_LIQUID))
+			         || t==PT_WTRV)
+				ctempl -= 2.0f*pv[y/CELL][x/CELL];
+			s = 1;
 
-								if (s)
-								{
+			//A fix for ice with ctype = 0
+			if ((t==PT_ICEI || t==PT_SNOW) && (!IsElement(parts[i].ctype) || parts[i].ctype==PT_ICEI || parts[i].ctype==PT_SNOW))
+				parts[i].ctype = PT_WATR;
+
+			if (elements[t].HighTemperatureTransition>-1 && ctemph>=elements[t].HighTemperature)
+			{
+				// particle type change due to high temperature
 #ifdef REALISTIC
-									//One ice table value for all it's kinds
-									if (platent[t] <= (c_heat - (elements[parts[i].ctype].LowTemperature - dbt)*c_Cm))
-									{
-										pt = (c_heat - platent[t])/c_Cm;
-										t = parts[i].ctype;
-										parts[i].ctype = PT_NONE;
-										parts[i].life = 0;
-									}
-									else
-									{
-										parts[i].temp = restrict_flt(elements[parts[i].ctype].LowTemperature - dbt, MIN_TEMP, MAX_TEMP);
-										s = 0;
-									}
+				float dbt = ctempl - pt;
+				if (elements[t].HighTemperatureTransition != PT_NUM)
+				{
+					if (platent[t] <= (c_heat - (elements[t].HighTemperature - dbt)*c_Cm))
+					{
+						pt = (c_heat - platent[t])/c_Cm;
+						t = elements[t].HighTemperatureTransition;
+					}
+					else
+					{
+						parts[i].temp = restrict_flt(elements[t].HighTemperature - dbt, MIN_TEMP, MAX_TEMP);
+						s = 0;
+					}
+				}
 #else
-									t = parts[i].ctype;
-									parts[i].ctype = PT_NONE;
-									parts[i].life = 0;
+				if (elements[t].HighTemperatureTransition != PT_NUM)
+					t = elements[t].HighTemperatureTransition;
 #endif
-								}
-							}
-							else
+				else if (t == PT_ICEI || t == PT_SNOW)
+				{
+					if (parts[i].ctype > 0 && parts[i].ctype < PT_NUM && parts[i].ctype != t)
+					{
+						if (elements[parts[i].ctype].LowTemperatureTransition==PT_ICEI || elements[parts[i].ctype].LowTemperatureTransition==PT_SNOW)
+						{
+							if (pt<elements[parts[i].ctype].LowTemperature)
 								s = 0;
 						}
-						else if (t == PT_SLTW)
+						else if (pt<273.15f)
+							s = 0;
+
+						if (s)
 						{
 #ifdef REALISTIC
-							if (platent[t] <= (c_heat - (elements[t].HighTemperature - dbt)*c_Cm))
+							//One ice table value for all it's kinds
+							if (platent[t] <= (c_heat - (elements[parts[i].ctype].LowTemperature - dbt)*c_Cm))
 							{
 								pt = (c_heat - platent[t])/c_Cm;
-
-								t = RNG::Ref().chance(1, 4) ? PT_SALT : PT_WTRV;
+								t = parts[i].ctype;
+								parts[i].ctype = PT_NONE;
+								parts[i].life = 0;
 							}
 							else
 							{
-								parts[i].temp = restrict_flt(elements[t].HighTemperature - dbt, MIN_TEMP, MAX_TEMP);
+								parts[i].temp = restrict_flt(elements[parts[i].ctype].LowTemperature - dbt, MIN_TEMP, MAX_TEMP);
 								s = 0;
 							}
 #else
-							t = RNG::Ref().chance(1, 4) ? PT_SALT : PT_WTRV;
+							t = parts[i].ctype;
+							parts[i].ctype = PT_NONE;
+							parts[i].life = 0;
 #endif
 						}
-						else if (t == PT_BRMT)
-						{
-							if (parts[i].ctype == PT_TUNG)
-							{
-								if (ctemph < elements[parts[i].ctype].HighTemperature)
-									s = 0;
-								else
-								{
-									t = PT_LAVA;
-									parts[i].type = PT_TUNG;
-								}
-							}
-							else if (ctemph >= elements[t].HighTemperature)
-								t = PT_LAVA;
-							else
-								s = 0;
-						}
-						else if (t == PT_CRMC)
-						{
-							float pres = std::max((pv[y/CELL][x/CELL]+pv[(y-2)/CELL][x/CELL]+pv[(y+2)/CELL][x/CELL]+pv[y/CELL][(x-2)/CELL]+pv[y/CELL][(x+2)/CELL])*2.0f, 0.0f);
-							if (ctemph < pres+elements[PT_CRMC].HighTemperature)
-								s = 0;
-							else
-								t = PT_LAVA;
-						}
-						else
-							s = 0;
 					}
-					else if (elements[t].LowTemperatureTransition > -1 && ctempl<elements[t].LowTemperature)
-					{
-						// particle type change due to low temperature
+					else
+						s = 0;
+				}
+				else if (t == PT_SLTW)
+				{
 #ifdef REALISTIC
-						float dbt = ctempl - pt;
-						if (elements[t].LowTemperatureTransition != PT_NUM)
-						{
-							if (platent[elements[t].LowTemperatureTransition] >= (c_heat - (elements[t].LowTemperature - dbt)*c_Cm))
-							{
-								pt = (c_heat + platent[elements[t].LowTemperatureTransition])/c_Cm;
-								t = elements[t].LowTemperatureTransition;
-							}
-							else
-							{
-								parts[i].temp = restrict_flt(elements[t].LowTemperature - dbt, MIN_TEMP, MAX_TEMP);
-								s = 0;
-							}
-						}
+					if (platent[t] <= (c_heat - (elements[t].HighTemperature - dbt)*c_Cm))
+					{
+						pt = (c_heat - platent[t])/c_Cm;
+
+						t = RNG::Ref().chance(1, 4) ? PT_SALT : PT_WTRV;
+					}
+					else
+					{
+						parts[i].temp = restrict_flt(elements[t].HighTemperature - dbt, MIN_TEMP, MAX_TEMP);
+						s = 0;
+					}
 #else
-						if (elements[t].LowTemperatureTransition != PT_NUM)
-							t = elements[t].LowTemperatureTransition;
+					t = RNG::Ref().chance(1, 4) ? PT_SALT : PT_WTRV;
 #endif
-						else if (t == PT_WTRV)
-						{
-							t = (pt < 273.0f) ? PT_RIME : PT_DSTW;
-						}
-						else if (t == PT_LAVA)
+				}
+				else if (t == PT_BRMT)
+				{
+					if (parts[i].ctype == PT_TUNG)
+					{
+						if (ctemph < elements[parts[i].ctype].HighTemperature)
+							s = 0;
+						else
 						{
-							if (parts[i].ctype > 0 && parts[i].ctype < PT_NUM && parts[i].ctype != PT_LAVA && elements[parts[i].ctype].Enabled)
-							{
-								if (parts[i].ctype == PT_THRM && pt >= elements[PT_BMTL].HighTemperature)
-									s = 0;
-								else if ((parts[i].ctype == PT_VIBR || parts[i].ctype == PT_BVBR) && pt >= 273.15f)
-									s = 0;
-								else if (parts[i].ctype == PT_TUNG)
-								{
-									// TUNG does its own melting in its update function, so HighTemperatureTransition is not LAVA so it won't be handled by the code for HighTemperatureTransition==PT_LAVA below
-									// However, the threshold is stored in HighTemperature to allow it to be changed from Lua
-									if (pt >= elements[parts[i].ctype].HighTemperature)
-										s = 0;
-								}
-								else if (parts[i].ctype == PT_CRMC)
-								{
-									float pres = std::max((pv[y/CELL][x/CELL]+pv[(y-2)/CELL][x/CELL]+pv[(y+2)/CELL][x/CELL]+pv[y/CELL][(x-2)/CELL]+pv[y/CELL][(x+2)/CELL])*2.0f, 0.0f);
-									if (ctemph >= pres+elements[PT_CRMC].HighTemperature)
-										s = 0;
-								}
-								else if (elements[parts[i].ctype].HighTemperatureTransition == PT_LAVA || parts[i].ctype == PT_HEAC)
-								{
-									if (pt >= elements[parts[i].ctype].HighTemperature)
-										s = 0;
-								}
-								else if (pt>=973.0f)
-									s = 0; // freezing point for lava with any other (not listed in ptransitions as turning into lava) ctype
-								if (s)
-								{
-									t = parts[i].ctype;
-									parts[i].ctype = PT_NONE;
-									if (t == PT_THRM)
-									{
-										parts[i].tmp = 0;
-										t = PT_BMTL;
-									}
-									if (t == PT_PLUT)
-									{
-										parts[i].tmp = 0;
-										t = PT_LAVA;
-									}
-								}
-							}
-							else if (pt<973.0f)
-								t = PT_STNE;
-							else
-								s = 0;
+							t = PT_LAVA;
+							parts[i].type = PT_TUNG;
 						}
-						else
-							s = 0;
 					}
+					else if (ctemph >= elements[t].HighTemperature)
+						t = PT_LAVA;
 					else
 						s = 0;
+				}
+				else if (t == PT_CRMC)
+				{
+					float pres = std::max((pv[y/CELL][x/CELL]+pv[(y-2)/CELL][x/CELL]+pv[(y+2)/CELL][x/CELL]+pv[y/CELL][(x-2)/CELL]+pv[y/CELL][(x+2)/CELL])*2.0f, 0.0f);
+					if (ctemph < pres+elements[PT_CRMC].HighTemperature)
+						s = 0;
+					else
+						t = PT_LAVA;
+				}
+				else
+					s = 0;
+			}
+			else if (elements[t].LowTemperatureTransition > -1 && ctempl<elements[t].LowTemperature)
+			{
+				// particle type change due to low temperature
 #ifdef REALISTIC
-					pt = restrict_flt(pt, MIN_TEMP, MAX_TEMP);
-					for (j=0; j<8; j++)
+				float dbt = ctempl - pt;
+				if (elements[t].LowTemperatureTransition != PT_NUM)
+				{
+					if (platent[elements[t].LowTemperatureTransition] >= (c_heat - (elements[t].LowTemperature - dbt)*c_Cm))
 					{
-						parts[surround_hconduct[j]].temp = pt;
+						pt = (c_heat + platent[elements[t].LowTemperatureTransition])/c_Cm;
+						t = elements[t].LowTemperatureTransition;
 					}
+					else
+					{
+						parts[i].temp = restrict_flt(elements[t].LowTemperature - dbt, MIN_TEMP, MAX_TEMP);
+						s = 0;
+					}
+				}
+#else
+				if (elements[t].LowTemperatureTransition != PT_NUM)
+					t = elements[t].LowTemperatureTransition;
 #endif
-					if (s) // particle type change occurred
+				else if (t == PT_WTRV)
+				{
+					t = (pt < 273.0f) ? PT_RIME : PT_DSTW;
+				}
+				else if (t == PT_LAVA)
+				{
+					if (parts[i].ctype > 0 && parts[i].ctype < PT_NUM && parts[i].ctype != PT_LAVA && elements[parts[i].ctype].Enabled)
 					{
-						if (t==PT_ICEI || t==PT_LAVA || t==PT_SNOW)
-							parts[i].ctype = parts[i].type;
-						if (!(t==PT_ICEI && parts[i].ctype==PT_FRZW))
-							parts[i].life = 0;
-						if (t == PT_FIRE)
-						{
-							//hackish, if tmp isn't 0 the FIRE might turn into DSTW later
-							//idealy transitions should use create_part(i) but some elements rely on properties staying constant
-							//and I don't feel like checking each one right now
-							parts[i].tmp = 0;
-						}
-						if ((elements[t].Properties&TYPE_GAS) && !(elements[parts[i].type].Properties&TYPE_GAS))
-							pv[y/CELL][x/CELL] += 0.50f;
-
-						if (t == PT_NONE)
+						if (parts[i].ctype == PT_THRM && pt >= elements[PT_BMTL].HighTemperature)
+							s = 0;
+						else if ((parts[i].ctype == PT_VIBR || parts[i].ctype == PT_BVBR) && pt >= 273.15f)
+							s = 0;
+						else if (parts[i].ctype == PT_TUNG)
 						{
-							kill_part(i);
-							goto killed;
+							// TUNG does its own melting in its update function, so HighTemperatureTransition is not LAVA so it won't be handled by the code for HighTemperatureTransition==PT_LAVA below
+							// However, the threshold is stored in HighTemperature to allow it to be changed from Lua
+							if (pt >= elements[parts[i].ctype].HighTemperature)
+								s = 0;
 						}
-						// part_change_type could refuse to change the type and kill the particle
-						// for example, changing type to STKM but one already exists
-						// we need to account for that to not cause simulation corruption issues
-						if (part_change_type(i,x,y,t))
-							goto killed;
-
-						if (t==PT_FIRE || t==PT_PLSM || t==PT_CFLM)
-							parts[i].life = RNG::Ref().between(120, 169);
-						if (t == PT_LAVA)
+						else if (parts[i].ctype == PT_CRMC)
 						{
-							if (parts[i].ctype == PT_BRMT) parts[i].ctype = PT_BMTL;
-							else if (parts[i].ctype == PT_SAND) parts[i].ctype = PT_GLAS;
-							else if (parts[i].ctype == PT_BGLA) parts[i].ctype = PT_GLAS;
-							else if (parts[i].ctype == PT_PQRT) parts[i].ctype = PT_QRTZ;
-							else if (parts[i].ctype == PT_LITH && parts[i].tmp2 > 3) parts[i].ctype = PT_GLAS;
-							parts[i].life = RNG::Ref().between(240, 359);
+							float pres = std::max((pv[y/CELL][x/CELL]+pv[(y-2)/CELL][x/CELL]+pv[(y+2)/CELL][x/CELL]+pv[y/CELL][(x-2)/CELL]+pv[y/CELL][(x+2)/CELL])*2.0f, 0.0f);
+							if (ctemph >= pres+elements[PT_CRMC].HighTemperature)
+								s = 0;
 						}
-						transitionOccurred = true;
-					}
-
-					pt = parts[i].temp = restrict_flt(parts[i].temp, MIN_TEMP, MAX_TEMP);
-					if (t == PT_LAVA)
-					{
-						parts[i].life = int(restrict_flt((parts[i].temp-700)/7, 0, 400));
-						if (parts[i].ctype==PT_THRM&&parts[i].tmp>0)
+						else if (elements[parts[i].ctype].HighTemperatureTransition == PT_LAVA || parts[i].ctype == PT_HEAC)
 						{
-							parts[i].tmp--;
-							parts[i].temp = 3500;
+							if (pt >= elements[parts[i].ctype].HighTemperature)
+								s = 0;
 						}
-						if (parts[i].ctype==PT_PLUT&&parts[i].tmp>0)
+						else if (pt>=973.0f)
+							s = 0; // freezing point for lava with any other (not listed in ptransitions as turning into lava) ctype
+						if (s)
 						{
-							parts[i].tmp--;
-							parts[i].temp = MAX_TEMP;
+							t = parts[i].ctype;
+							parts[i].ctype = PT_NONE;
+							if (t == PT_THRM)
+							{
+								parts[i].tmp = 0;
+								t = PT_BMTL;
+							}
+							if (t == PT_PLUT)
+							{
+								parts[i].tmp = 0;
+								t = PT_LAVA;
+							}
 						}
 					}
+					else if (pt<973.0f)
+						t = PT_STNE;
+					else
+						s = 0;
 				}
 				else
-				{
-					if (!(air->bmap_blockairh[y/CELL][x/CELL]&0x8))
-						air->bmap_blockairh[y/CELL][x/CELL]++;
-					parts[i].temp = restrict_flt(parts[i].temp, MIN_TEMP, MAX_TEMP);
-				}
+					s = 0;
 			}
-
-			if (t==PT_LIFE)
-			{
-				parts[i].temp = restrict_flt(parts[i].temp-50.0f, MIN_TEMP, MAX_TEMP);
-			}
-			if (t==PT_WIRE)
+			else
+				s = 0;
+#ifdef REALISTIC
+			pt = restrict_flt(pt, MIN_TEMP, MAX_TEMP);
+			for (j=0; j<8; j++)
 			{
-				//wire_placed = 1;
+				parts[surround_hconduct[j]].temp = pt;
 			}
-			//spark updates from walls
-			if ((elements[t].Properties&PROP_CONDUCTS) || t==PT_SPRK)
+#endif
+			if (s) // particle type change occurred
 			{
-				nx = x % CELL;
-				if (nx == 0)
-					nx = x/CELL - 1;
-				else if (nx == CELL-1)
-					nx = x/CELL + 1;
-				else
-					nx = x/CELL;
-				ny = y % CELL;
-				if (ny == 0)
-					ny = y/CELL - 1;
-				else if (ny == CELL-1)
-					ny = y/CELL + 1;
-				else
-					ny = y/CELL;
-				if (nx>=0 && ny>=0 && nx<XRES/CELL && ny<YRES/CELL)
+				if (t==PT_ICEI || t==PT_LAVA || t==PT_SNOW)
+					parts[i].ctype = parts[i].type;
+				if (!(t==PT_ICEI && parts[i].ctype==PT_FRZW))
+					parts[i].life = 0;
+				if (t == PT_FIRE)
 				{
-					if (t!=PT_SPRK)
-					{
-						if (emap[ny][nx]==12 && !parts[i].life && bmap[ny][nx] != WL_STASIS)
-						{
-							part_change_type(i,x,y,PT_SPRK);
-							parts[i].life = 4;
-							parts[i].ctype = t;
-							t = PT_SPRK;
-						}
-					}
-					else if (bmap[ny][nx]==WL_DETECT || bmap[ny][nx]==WL_EWALL || bmap[ny][nx]==WL_ALLOWLIQUID || bmap[ny][nx]==WL_WALLELEC || bmap[ny][nx]==WL_ALLOWALLELEC || bmap[ny][nx]==WL_EHOLE)
-						set_emap(nx, ny);
-				}
-			}
-
-			//the basic explosion, from the .explosive variable
-			if ((elements[t].Explosive&2) && pv[y/CELL][x/CELL]>2.5f)
-			{
-				parts[i].life = RNG::Ref().between(180, 259);
-				parts[i].temp = restrict_flt(elements[PT_FIRE].DefaultProperties.temp + (elements[t].Flammable/2), MIN_TEMP, MAX_TEMP);
-				t = PT_FIRE;
-				part_change_type(i,x,y,t);
-				pv[y/CELL][x/CELL] += 0.25f * CFDS;
-			}
-
-
-			s = 1;
-			gravtot = fabs(gravy[(y/CELL)*(XRES/CELL)+(x/CELL)])+fabs(gravx[(y/CELL)*(XRES/CELL)+(x/CELL)]);
-			if (elements[t].HighPressureTransition>-1 && pv[y/CELL][x/CELL]>elements[t].HighPressure) {
-				// particle type change due to high pressure
-				if (elements[t].HighPressureTransition!=PT_NUM)
-					t = elements[t].HighPressureTransition;
-				else if (t==PT_BMTL) {
-					if (pv[y/CELL][x/CELL]>2.5f)
-						t = PT_BRMT;
-					else if (pv[y/CELL][x/CELL]>1.0f && parts[i].tmp==1)
-						t = PT_BRMT;
-					else s = 0;
-				}
-				else s = 0;
-			} else if (elements[t].LowPressureTransition>-1 && pv[y/CELL][x/CELL]<elements[t].LowPressure && gravtot<=(elements[t].LowPressure/4.0f)) {
-				// particle type change due to low pressure
-				if (elements[t].LowPressureTransition!=PT_NUM)
-					t = elements[t].LowPressureTransition;
-				else s = 0;
-			} else if (elements[t].HighPressureTransition>-1 && gravtot>(elements[t].HighPressure/4.0f)) {
-				// particle type change due to high gravity
-				if (elements[t].HighPressureTransition!=PT_NUM)
-					t = elements[t].HighPressureTransition;
-				else if (t==PT_BMTL) {
-					if (gravtot>0.625f)
-						t = PT_BRMT;
-					else if (gravtot>0.25f && parts[i].tmp==1)
-						t = PT_BRMT;
-					else s = 0;
+					//hackish, if tmp isn't 0 the FIRE might turn into DSTW later
+					//idealy transitions should use create_part(i) but some elements rely on properties staying constant
+					//and I don't feel like checking each one right now
+					parts[i].tmp = 0;
 				}
-				else s = 0;
-			} else s = 0;
+				if ((elements[t].Properties&TYPE_GAS) && !(elements[parts[i].type].Properties&TYPE_GAS))
+					pv[y/CELL][x/CELL] += 0.50f;
 
-			// particle type change occurred
-			if (s)
-			{
 				if (t == PT_NONE)
 				{
 					kill_part(i);
 					goto killed;
 				}
-				parts[i].life = 0;
 				// part_change_type could refuse to change the type and kill the particle
 				// for example, changing type to STKM but one already exists
 				// we need to account for that to not cause simulation corruption issues
 				if (part_change_type(i,x,y,t))
 					goto killed;
-				if (t == PT_FIRE)
+
+				if (t==PT_FIRE || t==PT_PLSM || t==PT_CFLM)
 					parts[i].life = RNG::Ref().between(120, 169);
+				if (t == PT_LAVA)
+				{
+					if (parts[i].ctype == PT_BRMT) parts[i].ctype = PT_BMTL;
+					else if (parts[i].ctype == PT_SAND) parts[i].ctype = PT_GLAS;
+					else if (parts[i].ctype == PT_BGLA) parts[i].ctype = PT_GLAS;
+					else if (parts[i].ctype == PT_PQRT) parts[i].ctype = PT_QRTZ;
+					else if (parts[i].ctype == PT_LITH && parts[i].tmp2 > 3) parts[i].ctype = PT_GLAS;
+					parts[i].life = RNG::Ref().between(240, 359);
+				}
 				transitionOccurred = true;
 			}
 
-			//call the particle update function, if there is one
-			if (elements[t].Update)
+			pt = parts[i].temp = restrict_flt(parts[i].temp, MIN_TEMP, MAX_TEMP);
+			if (t == PT_LAVA)
 			{
-				if ((*(elements[t].Update))(this, i, x, y, surround_space, nt, parts, pmap))
-					continue;
-				x = (int)(parts[i].x+0.5f);
-				y = (int)(parts[i].y+0.5f);
+				parts[i].life = int(restrict_flt((parts[i].temp-700)/7, 0, 400));
+				if (parts[i].ctype==PT_THRM&&parts[i].tmp>0)
+				{
+					parts[i].tmp--;
+					parts[i].temp = 3500;
+				}
+				if (parts[i].ctype==PT_PLUT&&parts[i].tmp>0)
+				{
+					parts[i].tmp--;
+					parts[i].temp = MAX_TEMP;
+				}
 			}
+		}
+		else
+		{
+			if (!(air->bmap_blockairh[y/CELL][x/CELL]&0x8))
+				air->bmap_blockairh[y/CELL][x/CELL]++;
+			parts[i].temp = restrict_flt(parts[i].temp, MIN_TEMP, MAX_TEMP);
+		}
+	}
+
+	if (t==PT_LIFE)
+	{
+		parts[i].temp = restrict_flt(parts[i].temp-50.0f, MIN_TEMP, MAX_TEMP);
+	}
+	if (t==PT_WIRE)
+	{
+		//wire_placed = 1;
+	}
+	//spark updates from walls
+	if ((elements[t].Properties&PROP_CONDUCTS) || t==PT_SPRK)
+	{
+		nx = x % CELL;
+		if (nx == 0)
+			nx = x/CELL - 1;
+		else if (nx == CELL-1)
+			nx = x/CELL + 1;
+		else
+			nx = x/CELL;
+		ny = y % CELL;
+		if (ny == 0)
+			ny = y/CELL - 1;
+		else if (ny == CELL-1)
+			ny = y/CELL + 1;
+		else
+			ny = y/CELL;
+		if (nx>=0 && ny>=0 && nx<XRES/CELL && ny<YRES/CELL)
+		{
+			if (t!=PT_SPRK)
+			{
+				if (emap[ny][nx]==12 && !parts[i].life && bmap[ny][nx] != WL_STASIS)
+				{
+					part_change_type(i,x,y,PT_SPRK);
+					parts[i].life = 4;
+					parts[i].ctype = t;
+					t = PT_SPRK;
+				}
+			}
+			else if (bmap[ny][nx]==WL_DETECT || bmap[ny][nx]==WL_EWALL || bmap[ny][nx]==WL_ALLOWLIQUID || bmap[ny][nx]==WL_WALLELEC || bmap[ny][nx]==WL_ALLOWALLELEC || bmap[ny][nx]==WL_EHOLE)
+				set_emap(nx, ny);
+		}
+	}
+
+	//the basic explosion, from the .explosive variable
+	if ((elements[t].Explosive&2) && pv[y/CELL][x/CELL]>2.5f)
+	{
+		parts[i].life = RNG::Ref().between(180, 259);
+		parts[i].temp = restrict_flt(elements[PT_FIRE].DefaultProperties.temp + (elements[t].Flammable/2), MIN_TEMP, MAX_TEMP);
+		t = PT_FIRE;
+		part_change_type(i,x,y,t);
+		pv[y/CELL][x/CELL] += 0.25f * CFDS;
+	}
 
-			if(legacy_enable)//if heat sim is off
-				Element::legacyUpdate(this, i,x,y,surround_space,nt, parts, pmap);
+
+	s = 1;
+	gravtot = fabs(gravy[(y/CELL)*(XRES/CELL)+(x/CELL)])+fabs(gravx[(y/CELL)*(XRES/CELL)+(x/CELL)]);
+	if (elements[t].HighPressureTransition>-1 && pv[y/CELL][x/CELL]>elements[t].HighPressure) {
+		// particle type change due to high pressure
+		if (elements[t].HighPressureTransition!=PT_NUM)
+			t = elements[t].HighPressureTransition;
+		else if (t==PT_BMTL) {
+			if (pv[y/CELL][x/CELL]>2.5f)
+				t = PT_BRMT;
+			else if (pv[y/CELL][x/CELL]>1.0f && parts[i].tmp==1)
+				t = PT_BRMT;
+			else s = 0;
+		}
+		else s = 0;
+	} else if (elements[t].LowPressureTransition>-1 && pv[y/CELL][x/CELL]<elements[t].LowPressure && gravtot<=(elements[t].LowPressure/4.0f)) {
+		// particle type change due to low pressure
+		if (elements[t].LowPressureTransition!=PT_NUM)
+			t = elements[t].LowPressureTransition;
+		else s = 0;
+	} else if (elements[t].HighPressureTransition>-1 && gravtot>(elements[t].HighPressure/4.0f)) {
+		// particle type change due to high gravity
+		if (elements[t].HighPressureTransition!=PT_NUM)
+			t = elements[t].HighPressureTransition;
+		else if (t==PT_BMTL) {
+			if (gravtot>0.625f)
+				t = PT_BRMT;
+			else if (gravtot>0.25f && parts[i].tmp==1)
+				t = PT_BRMT;
+			else s = 0;
+		}
+		else s = 0;
+	} else s = 0;
+
+	// particle type change occurred
+	if (s)
+	{
+		if (t == PT_NONE)
+		{
+			kill_part(i);
+			goto killed;
+		}
+		parts[i].life = 0;
+		// part_change_type could refuse to change the type and kill the particle
+		// for example, changing type to STKM but one already exists
+		// we need to account for that to not cause simulation corruption issues
+		if (part_change_type(i,x,y,t))
+			goto killed;
+		if (t == PT_FIRE)
+			parts[i].life = RNG::Ref().between(120, 169);
+		transitionOccurred = true;
+	}
+
+	//call the particle update function, if there is one
+	if (elements[t].Update)
+	{
+		// The particle may have changed into something whose update reaches further than the stripe allows
+		if (stripe && !stripeLocalType[t])
+		{
+			stripe->unfinished.push_back({ i, t, x, y, nt, surround_space, pGravX, pGravY, transitionOccurred, true });
+			return;
+		}
+		if ((*(elements[t].Update))(this, i, x, y, surround_space, nt, parts, pmap))
+			return;
+		x = (int)(parts[i].x+0.5f);
+		y = (int)(parts[i].y+0.5f);
+	}
+
+	if(legacy_enable)//if heat sim is off
+		Element::legacyUpdate(this, i,x,y,surround_space,nt, parts, pmap);
 
 killed:
-			if (parts[i].type == PT_NONE)//if its dead, skip to next particle
-				continue;
+	if (parts[i].type == PT_NONE)//if its dead, skip to next particle
+		return;
 
-			if (transitionOccurred)
-				continue;
+	if (transitionOccurred)
+		return;
 
-			if (!parts[i].vx&&!parts[i].vy)//if its not moving, skip to next particle, movement code it next
-				continue;
+	if (!parts[i].vx&&!parts[i].vy)//if its not moving, skip to next particle, movement code it next
+		return;
+
+	// Moves that could reach beyond the rows this stripe may touch are done in the serial pass
+	if (stripe && !CanMoveInStripe(*stripe, i, t, y, pGravX, pGravY))
+	{
+		stripe->unfinished.push_back({ i, t, x, y, nt, surround_space, pGravX, pGravY, transitionOccurred, false });
+		return;
+	}
+
+	MoveParticle(i, t, x, y, nt, surround_space, pGravX, pGravY);
+}
 
-			mv = fmaxf(fabsf(parts[i].vx), fabsf(parts[i].vy));
-			if (mv < ISTP)
+void Simulation::MoveParticle(int i, int t, int x, int y, int nt, int surround_space, float pGravX, float pGravY)
+{
+	int j, nx, ny, r, s, rt;
+	float mv, dx, dy, nrx, nry, dp;
+	int fin_x, fin_y, clear_x, clear_y, stagnant;
+	float fin_xf, fin_yf, clear_xf, clear_yf;
+	float nn, ct1, ct2, swappage;
+
+
+	mv = fmaxf(fabsf(parts[i].vx), fabsf(parts[i].vy));
+	if (mv < ISTP)
+	{
+		clear_x = x;
+		clear_y = y;
+		clear_xf = parts[i].x;
+		clear_yf = parts[i].y;
+		fin_xf = clear_xf + parts[i].vx;
+		fin_yf = clear_yf + parts[i].vy;
+		fin_x = (int)(fin_xf+0.5f);
+		fin_y = (int)(fin_yf+0.5f);
+	}
+	else
+	{
+		if (mv > SIM_MAXVELOCITY)
+		{
+			parts[i].vx *= SIM_MAXVELOCITY/mv;
+			parts[i].vy *= SIM_MAXVELOCITY/mv;
+			mv = SIM_MAXVELOCITY;
+		}
+		// interpolate to see if there is anything in the way
+		dx = parts[i].vx*ISTP/mv;
+		dy = parts[i].vy*ISTP/mv;
+		fin_xf = parts[i].x;
+		fin_yf = parts[i].y;
+		fin_x = (int)(fin_xf+0.5f);
+		fin_y = (int)(fin_yf+0.5f);
+		bool closedEholeStart = this->InBounds(fin_x, fin_y) && (bmap[fin_y/CELL][fin_x/CELL] == WL_EHOLE && !emap[fin_y/CELL][fin_x/CELL]);
+		while (1)
+		{
+			mv -= ISTP;
+			fin_xf += dx;
+			fin_yf += dy;
+			fin_x = (int)(fin_xf+0.5f);
+			fin_y = (int)(fin_yf+0.5f);
+			if (edgeMode == 2)
 			{
-				clear_x = x;
-				clear_y = y;
-				clear_xf = parts[i].x;
-				clear_yf = parts[i].y;
-				fin_xf = clear_xf + parts[i].vx;
-				fin_yf = clear_yf + parts[i].vy;
+				bool x_ok = (fin_xf >= CELL-.5f && fin_xf < XRES-CELL-.5f);
+				bool y_ok = (fin_yf >= CELL-.5f && fin_yf < YRES-CELL-.5f);
+				if (!x_ok)
+					fin_xf = remainder_p(fin_xf-CELL+.5f, XRES-CELL*2.0f)+CELL-.5f;
+				if (!y_ok)
+					fin_yf = remainder_p(fin_yf-CELL+.5f, YRES-CELL*2.0f)+CELL-.5f;
 				fin_x = (int)(fin_xf+0.5f);
 				fin_y = (int)(fin_yf+0.5f);
 			}
-			else
+			if (mv <= 0.0f)
 			{
-				if (mv > SIM_MAXVELOCITY)
+				// nothing found
+				fin_xf = parts[i].x + parts[i].vx;
+				fin_yf = parts[i].y + parts[i].vy;
+				if (edgeMode == 2)
 				{
-					parts[i].vx *= SIM_MAXVELOCITY/mv;
-					parts[i].vy *= SIM_MAXVELOCITY/mv;
-					mv = SIM_MAXVELOCITY;
+					bool x_ok = (fin_xf >= CELL-.5f && fin_xf < XRES-CELL-.5f);
+					bool y_ok = (fin_yf >= CELL-.5f && fin_yf < YRES-CELL-.5f);
+					if (!x_ok)
+						fin_xf = remainder_p(fin_xf-CELL+.5f, XRES-CELL*2.0f)+CELL-.5f;
+					if (!y_ok)
+						fin_yf = remainder_p(fin_yf-CELL+.5f, YRES-CELL*2.0f)+CELL-.5f;
 				}
-				// interpolate to see if there is anything in the way
-				dx = parts[i].vx*ISTP/mv;
-				dy = parts[i].vy*ISTP/mv;
-				fin_xf = parts[i].x;
-				fin_yf = parts[i].y;
 				fin_x = (int)(fin_xf+0.5f);
 				fin_y = (int)(fin_yf+0.5f);
-				bool closedEholeStart = this->InBounds(fin_x, fin_y) && (bmap[fin_y/CELL][fin_x/CELL] == WL_EHOLE && !emap[fin_y/CELL][fin_x/CELL]);
-				while (1)
-				{
-					mv -= ISTP;
-					fin_xf += dx;
-					fin_yf += dy;
-					fin_x = (int)(fin_xf+0.5f);
-					fin_y = (int)(fin_yf+0.5f);
-					if (edgeMode == 2)
-					{
-						bool x_ok = (fin_xf >= CELL-.5f && fin_xf < XRES-CELL-.5f);
-						bool y_ok = (fin_yf >= CELL-.5f && fin_yf < YRES-CELL-.5f);
-						if (!x_ok)
-							fin_xf = remainder_p(fin_xf-CELL+.5f, XRES-CELL*2.0f)+CELL-.5f;
-						if (!y_ok)
-							fin_yf = remainder_p(fin_yf-CELL+.5f, YRES-CELL*2.0f)+CELL-.5f;
-						fin_x = (int)(fin_xf+0.5f);
-						fin_y = (int)(fin_yf+0.5f);
-					}
-					if (mv <= 0.0f)
-					{
-						// nothing found
-						fin_xf = parts[i].x + parts[i].vx;
-						fin_yf = parts[i].y + parts[i].vy;
-						if (edgeMode == 2)
-						{
-							bool x_ok = (fin_xf >= CELL-.5f && fin_xf < XRES-CELL-.5f);
-							bool y_ok = (fin_yf >= CELL-.5f && fin_yf < YRES-CELL-.5f);
-							if (!x_ok)
-								fin_xf = remainder_p(fin_xf-CELL+.5f, XRES-CELL*2.0f)+CELL-.5f;
-							if (!y_ok)
-								fin_yf = remainder_p(fin_yf-CELL+.5f, YRES-CELL*2.0f)+CELL-.5f;
-						}
-						fin_x = (int)(fin_xf+0.5f);
-						fin_y = (int)(fin_yf+0.5f);
-						clear_xf = fin_xf-dx;
-						clear_yf = fin_yf-dy;
-						clear_x = (int)(clear_xf+0.5f);
-						clear_y = (int)(clear_yf+0.5f);
-						break;
-					}
-					//block if particle can't move (0), or some special cases where it returns 1 (can_move = 3 but returns 1 meaning particle will be eaten)
-					//also photons are still blocked (slowed down) by any particle (even ones it can move through), and absorb wall also blocks particles
-					int eval = eval_move(t, fin_x, fin_y, NULL);
-					if (!eval || (can_move[t][TYP(pmap[fin_y][fin_x])] == 3 && eval == 1) || (t == PT_PHOT && pmap[fin_y][fin_x]) || bmap[fin_y/CELL][fin_x/CELL]==WL_DESTROYALL || closedEholeStart!=(bmap[fin_y/CELL][fin_x/CELL] == WL_EHOLE && !emap[fin_y/CELL][fin_x/CELL]))
-					{
-						// found an obstacle
-						clear_xf = fin_xf-dx;
-						clear_yf = fin_yf-dy;
-						clear_x = (int)(clear_xf+0.5f);
-						clear_y = (int)(clear_yf+0.5f);
-						break;
-					}
-					if (bmap[fin_y/CELL][fin_x/CELL]==WL_DETECT && emap[fin_y/CELL][fin_x/CELL]<8)
-						set_emap(fin_x/CELL, fin_y/CELL);
-				}
+				clear_xf = fin_xf-dx;
+				clear_yf = fin_yf-dy;
+				clear_x = (int)(clear_xf+0.5f);
+				clear_y = (int)(clear_yf+0.5f);
+				break;
+			}
+			//block if particle can't move (0), or some special cases where it returns 1 (can_move = 3 but returns 1 meaning particle will be eaten)
+			//also photons are still blocked (slowed down) by any particle (even ones it can move through), and absorb wall also blocks particles
+			int eval = eval_move(t, fin_x, fin_y, NULL);
+			if (!eval || (can_move[t][TYP(pmap[fin_y][fin_x])] == 3 && eval == 1) || (t == PT_PHOT && pmap[fin_y][fin_x]) || bmap[fin_y/CELL][fin_x/CELL]==WL_DESTROYALL || closedEholeStart!=(bmap[fin_y/CELL][fin_x/CELL] == WL_EHOLE && !emap[fin_y/CELL][fin_x/CELL]))
+			{
+				// found an obstacle
+				clear_xf = fin_xf-dx;
+				clear_yf = fin_yf-dy;
+				clear_x = (int)(clear_xf+0.5f);
+				clear_y = (int)(clear_yf+0.5f);
+				break;
 			}
+			if (bmap[fin_y/CELL][fin_x/CELL]==WL_DETECT && emap[fin_y/CELL][fin_x/CELL]<8)
+				set_emap(fin_x/CELL, fin_y/CELL);
+		}
+	}
 
-			stagnant = parts[i].flags & FLAG_STAGNANT;
-			parts[i].flags &= ~FLAG_STAGNANT;
+	stagnant = parts[i].flags & FLAG_STAGNANT;
+	parts[i].flags &= ~FLAG_STAGNANT;
 
-			if (t==PT_STKM || t==PT_STKM2 || t==PT_FIGH)
+	if (t==PT_STKM || t==PT_STKM2 || t==PT_FIGH)
+	{
+		//head movement, let head pass through anything
+		parts[i].x += parts[i].vx;
+		parts[i].y += parts[i].vy;
+		int nx = (int)((float)parts[i].x+0.5f);
+		int ny = (int)((float)parts[i].y+0.5f);
+		if (edgeMode == 2)
+		{
+			bool x_ok = (nx >= CELL && nx < XRES-CELL);
+			bool y_ok = (ny >= CELL && ny < YRES-CELL);
+			int oldnx = nx, oldny = ny;
+			if (!x_ok)
 			{
-				//head movement, let head pass through anything
-				parts[i].x += parts[i].vx;
-				parts[i].y += parts[i].vy;
-				int nx = (int)((float)parts[i].x+0.5f);
-				int ny = (int)((float)parts[i].y+0.5f);
-				if (edgeMode == 2)
-				{
-					bool x_ok = (nx >= CELL && nx < XRES-CELL);
-					bool y_ok = (ny >= CELL && ny < YRES-CELL);
-					int oldnx = nx, oldny = ny;
-					if (!x_ok)
-					{
-						parts[i].x = remainder_p(parts[i].x-CELL+.5f, XRES-CELL*2.0f)+CELL-.5f;
-						nx = (int)((float)parts[i].x+0.5f);
-					}
-					if (!y_ok)
-					{
-						parts[i].y = remainder_p(parts[i].y-CELL+.5f, YRES-CELL*2.0f)+CELL-.5f;
-						ny = (int)((float)parts[i].y+0.5f);
-					}
+				parts[i].x = remainder_p(parts[i].x-CELL+.5f, XRES-CELL*2.0f)+CELL-.5f;
+				nx = (int)((float)parts[i].x+0.5f);
+			}
+			if (!y_ok)
+			{
+				parts[i].y = remainder_p(parts[i].y-CELL+.5f, YRES-CELL*2.0f)+CELL-.5f;
+				ny = (int)((float)parts[i].y+0.5f);
+			}
 
-					if (!x_ok || !y_ok) //when moving from left to right stickmen might be able to fall through solid things, fix with "eval_move(t, nx+diffx, ny+diffy, NULL)" but then they die instead
-					{
-						//adjust stickmen legs
-						playerst* stickman = NULL;
-						int t = parts[i].type;
-						if (t == PT_STKM)
-							stickman = &player;
-						else if (t == PT_STKM2)
-							stickman = &player2;
-						else if (t == PT_FIGH && parts[i].tmp >= 0 && parts[i].tmp < MAX_FIGHTERS)
-							stickman = &fighters[parts[i].tmp];
-
-						if (stickman)
-							for (int i = 0; i < 16; i+=2)
-							{
-								stickman->legs[i] += (nx-oldnx);
-								stickman->legs[i+1] += (ny-oldny);
-								stickman->accs[i/2] *= .95f;
-							}
-						parts[i].vy *= .95f;
-						parts[i].vx *= .95f;
-					}
-				}
-				if (ny!=y || nx!=x)
-				{
-					if (ID(pmap[y][x]) == i)
-						pmap[y][x] = 0;
-					else if (ID(photons[y][x]) == i)
-						photons[y][x] = 0;
-					if (nx<CELL || nx>=XRES-CELL || ny<CELL || ny>=YRES-CELL)
+			if (!x_ok || !y_ok) //when moving from left to right stickmen might be able to fall through solid things, fix with "eval_move(t, nx+diffx, ny+diffy, NULL)" but then they die instead
+			{
+				//adjust stickmen legs
+				playerst* stickman = NULL;
+				int t = parts[i].type;
+				if (t == PT_STKM)
+					stickman = &player;
+				else if (t == PT_STKM2)
+					stickman = &player2;
+				else if (t == PT_FIGH && parts[i].tmp >= 0 && parts[i].tmp < MAX_FIGHTERS)
+					stickman = &fighters[parts[i].tmp];
+
+				if (stickman)
+					for (int i = 0; i < 16; i+=2)
 					{
-						kill_part(i);
-						continue;
+						stickman->legs[i] += (nx-oldnx);
+						stickman->legs[i+1] += (ny-oldny);
+						stickman->accs[i/2] *= .95f;
 					}
-					if (elements[t].Properties & TYPE_ENERGY)
-						photons[ny][nx] = PMAP(i, t);
-					else if (t)
-						pmap[ny][nx] = PMAP(i, t);
-				}
+				parts[i].vy *= .95f;
+				parts[i].vx *= .95f;
 			}
-			else if (elements[t].Properties & TYPE_ENERGY)
+		}
+		PartGridMove(i);
+		if (ny!=y || nx!=x)
+		{
+			if (ID(pmap[y][x]) == i)
+				pmap[y][x] = 0;
+			else if (ID(photons[y][x]) == i)
+				photons[y][x] = 0;
+			if (nx<CELL || nx>=XRES-CELL || ny<CELL || ny>=YRES-CELL)
 			{
-				if (t == PT_PHOT)
-				{
-					if (parts[i].flags&FLAG_SKIPMOVE)
-					{
-						parts[i].flags &= ~FLAG_SKIPMOVE;
-						continue;
-					}
-
-					if (eval_move(PT_PHOT, fin_x, fin_y, NULL))
-					{
-						int rt = TYP(pmap[fin_y][fin_x]);
-						int lt = TYP(pmap[y][x]);
-						int rt_glas = (rt == PT_GLAS) || (rt == PT_BGLA);
-						int lt_glas = (lt == PT_GLAS) || (lt == PT_BGLA);
-						if ((rt_glas && !lt_glas) || (lt_glas && !rt_glas))
-						{
-							if (!get_normal_interp(REFRACT|t, parts[i].x, parts[i].y, parts[i].vx, parts[i].vy, &nrx, &nry)) {
-								kill_part(i);
-								continue;
-							}
+				kill_part(i);
+				return;
+			}
+			if (elements[t].Properties & TYPE_ENERGY)
+				photons[ny][nx] = PMAP(i, t);
+			else if (t)
+				pmap[ny][nx] = PMAP(i, t);
+			occupiedPixels.Mark(nx, ny);
+		}
+	}
+	else if (elements[t].Properties & TYPE_ENERGY)
+	{
+		if (t == PT_PHOT)
+		{
+			if (parts[i].flags&FLAG_SKIPMOVE)
+			{
+				parts[i].flags &= ~FLAG_SKIPMOVE;
+				return;
+			}
 
-							r = get_wavelength_bin(&parts[i].ctype);
-							if (r == -1 || !(parts[i].ctype&0x3FFFFFFF))
-							{
-								kill_part(i);
-								continue;
-							}
-							nn = GLASS_IOR - GLASS_DISP*(r-30)/30.0f;
-							nn *= nn;
-							nrx = -nrx;
-							nry = -nry;
-							if (rt_glas && !lt_glas)
-								nn = 1.0f/nn;
-							ct1 = parts[i].vx*nrx + parts[i].vy*nry;
-							ct2 = 1.0f - (nn*nn)*(1.0f-(ct1*ct1));
-							if (ct2 < 0.0f) {
-								// total internal reflection
-								parts[i].vx -= 2.0f*ct1*nrx;
-								parts[i].vy -= 2.0f*ct1*nry;
-								fin_xf = parts[i].x;
-								fin_yf = parts[i].y;
-								fin_x = x;
-								fin_y = y;
-							} else {
-								// refraction
-								ct2 = sqrtf(ct2);
-								ct2 = ct2 - nn*ct1;
-								parts[i].vx = nn*parts[i].vx + ct2*nrx;
-								parts[i].vy = nn*parts[i].vy + ct2*nry;
-							}
-						}
-					}
-				}
-				if (stagnant)//FLAG_STAGNANT set, was reflected on previous frame
-				{
-					// cast coords as int then back to float for compatibility with existing saves
-					if (!do_move(i, x, y, (float)fin_x, (float)fin_y) && parts[i].type) {
-						kill_part(i);
-						continue;
-					}
-				}
-				else if (!do_move(i, x, y, fin_xf, fin_yf))
+			if (eval_move(PT_PHOT, fin_x, fin_y, NULL))
+			{
+				int rt = TYP(pmap[fin_y][fin_x]);
+				int lt = TYP(pmap[y][x]);
+				int rt_glas = (rt == PT_GLAS) || (rt == PT_BGLA);
+				int lt_glas = (lt == PT_GLAS) || (lt == PT_BGLA);
+				if ((rt_glas && !lt_glas) || (lt_glas && !rt_glas))
 				{
-					if (parts[i].type == PT_NONE)
-						continue;
-					// reflection
-					parts[i].flags |= FLAG_STAGNANT;
-					if (t==PT_NEUT && RNG::Ref().chance(1, 10))
-					{
+					if (!get_normal_interp(REFRACT|t, parts[i].x, parts[i].y, parts[i].vx, parts[i].vy, &nrx, &nry)) {
 						kill_part(i);
-						continue;
+						return;
 					}
-					r = pmap[fin_y][fin_x];
 
-					if ((TYP(r)==PT_PIPE || TYP(r) == PT_PPIP) && !TYP(parts[ID(r)].ctype))
+					r = get_wavelength_bin(&parts[i].ctype);
+					if (r == -1 || !(parts[i].ctype&0x3FFFFFFF))
 					{
-						parts[ID(r)].ctype =  parts[i].type;
-						parts[ID(r)].temp = parts[i].temp;
-						parts[ID(r)].tmp2 = parts[i].life;
-						parts[ID(r)].tmp3 = parts[i].tmp;
-						parts[ID(r)].tmp4 = parts[i].ctype;
 						kill_part(i);
-						continue;
+						return;
 					}
-
-					if (t == PT_PHOT)
-					{
-						auto mask = elements[TYP(r)].PhotonReflectWavelengths;
-						if (TYP(r) == PT_LITH)
-						{
-							int wl_bin = parts[ID(r)].ctype / 4;
-							if (wl_bin < 0) wl_bin = 0;
-							if (wl_bin > 25) wl_bin = 25;
-							mask = (0x1F << wl_bin);
-						}
-						parts[i].ctype &= mask;
-					}
-
-					if (get_normal_interp(t, parts[i].x, parts[i].y, parts[i].vx, parts[i].vy, &nrx, &nry))
-					{
-						if (TYP(r) == PT_CRMC)
-						{
-							float r = RNG::Ref().between(-50, 50) * 0.01f, rx, ry, anrx, anry;
-							r = r * r * r;
-							rx = cosf(r); ry = sinf(r);
-							anrx = rx * nrx + ry * nry;
-							anry = rx * nry - ry * nrx;
-							dp = anrx*parts[i].vx + anry*parts[i].vy;
-							parts[i].vx -= 2.0f*dp*anrx;
-							parts[i].vy -= 2.0f*dp*anry;
-						}
-						else
-						{
-							dp = nrx*parts[i].vx + nry*parts[i].vy;
-							parts[i].vx -= 2.0f*dp*nrx;
-							parts[i].vy -= 2.0f*dp*nry;
-						}
-						// leave the actual movement until next frame so that reflection of fast particles and refraction happen correctly
-					}
-					else
-					{
-						if (t!=PT_NEUT)
-							kill_part(i);
-						continue;
-					}
-					if (!(parts[i].ctype&0x3FFFFFFF) && t == PT_PHOT)
-					{
-						kill_part(i);
-						continue;
+					nn = GLASS_IOR - GLASS_DISP*(r-30)/30.0f;
+					nn *= nn;
+					nrx = -nrx;
+					nry = -nry;
+					if (rt_glas && !lt_glas)
+						nn = 1.0f/nn;
+					ct1 = parts[i].vx*nrx + parts[i].vy*nry;
+					ct2 = 1.0f - (nn*nn)*(1.0f-(ct1*ct1));
+					if (ct2 < 0.0f) {
+						// total internal reflection
+						parts[i].vx -= 2.0f*ct1*nrx;
+						parts[i].vy -= 2.0f*ct1*nry;
+						fin_xf = parts[i].x;
+						fin_yf = parts[i].y;
+						fin_x = x;
+						fin_y = y;
+					} else {
+						// refraction
+						ct2 = sqrtf(ct2);
+						ct2 = ct2 - nn*ct1;
+						parts[i].vx = nn*parts[i].vx + ct2*nrx;
+						parts[i].vy = nn*parts[i].vy + ct2*nry;
 					}
 				}
 			}
-			else if (elements[t].Falldown==0)
+		}
+		if (stagnant)//FLAG_STAGNANT set, was reflected on previous frame
+		{
+			// cast coords as int then back to float for compatibility with existing saves
+			if (!do_move(i, x, y, (float)fin_x, (float)fin_y) && parts[i].type) {
+				kill_part(i);
+				return;
+			}
+		}
+		else if (!do_move(i, x, y, fin_xf, fin_yf))
+		{
+			if (parts[i].type == PT_NONE)
+				return;
+			// reflection
+			parts[i].flags |= FLAG_STAGNANT;
+			if (t==PT_NEUT && RNG::Ref().chance(1, 10))
+			{
+				kill_part(i);
+				return;
+			}
+			r = pmap[fin_y][fin_x];
+
+			if ((TYP(r)==PT_PIPE || TYP(r) == PT_PPIP) && !TYP(parts[ID(r)].ctype))
 			{
-				// gasses and solids (but not powders)
-				if (!do_move(i, x, y, fin_xf, fin_yf))
+				parts[ID(r)].ctype =  parts[i].type;
+				parts[ID(r)].temp = parts[i].temp;
+				parts[ID(r)].tmp2 = parts[i].life;
+				parts[ID(r)].tmp3 = parts[i].tmp;
+				parts[ID(r)].tmp4 = parts[i].ctype;
+				kill_part(i);
+				return;
+			}
+
+			if (t == PT_PHOT)
+			{
+				auto mask = elements[TYP(r)].PhotonReflectWavelengths;
+				if (TYP(r) == PT_LITH)
 				{
-					if (parts[i].type == PT_NONE)
-						continue;
-					// can't move there, so bounce off
-					// TODO
-					// TODO: Work out what previous TODO was for
-					if (fin_x>x+ISTP) fin_x=x+ISTP;
-					if (fin_x<x-ISTP) fin_x=x-ISTP;
-					if (fin_y>y+ISTP) fin_y=y+ISTP;
-					if (fin_y<y-ISTP) fin_y=y-ISTP;
-					if (do_move(i, x, y, 0.25f+(float)(2*x-fin_x), 0.25f+fin_y))
-					{
-						parts[i].vx *= elements[t].Collision;
-					}
-					else if (do_move(i, x, y, 0.25f+fin_x, 0.25f+(float)(2*y-fin_y)))
-					{
-						parts[i].vy *= elements[t].Collision;
-					}
-					else
-					{
-						parts[i].vx *= elements[t].Collision;
-						parts[i].vy *= elements[t].Collision;
-					}
+					int wl_bin = parts[ID(r)].ctype / 4;
+					if (wl_bin < 0) wl_bin = 0;
+					if (wl_bin > 25) wl_bin = 25;
+					mask = (0x1F << wl_bin);
 				}
+				parts[i].ctype &= mask;
 			}
-			else
+
+			if (get_normal_interp(t, parts[i].x, parts[i].y, parts[i].vx, parts[i].vy, &nrx, &nry))
 			{
-				// Checking stagnant is cool, but then it doesn't update when you change it later.
-				if (water_equal_test && elements[t].Falldown == 2 && RNG::Ref().chance(1, 200))
+				if (TYP(r) == PT_CRMC)
 				{
-					if (flood_water(x, y, i))
-						goto movedone;
+					float r = RNG::Ref().between(-50, 50) * 0.01f, rx, ry, anrx, anry;
+					r = r * r * r;
+					rx = cosf(r); ry = sinf(r);
+					anrx = rx * nrx + ry * nry;
+					anry = rx * nry - ry * nrx;
+					dp = anrx*parts[i].vx + anry*parts[i].vy;
+					parts[i].vx -= 2.0f*dp*anrx;
+					parts[i].vy -= 2.0f*dp*anry;
 				}
-				// liquids and powders
-				if (!do_move(i, x, y, fin_xf, fin_yf))
+				else
 				{
-					if (parts[i].type == PT_NONE)
-						continue;
-					if (fin_x!=x && do_move(i, x, y, fin_xf, clear_yf))
+					dp = nrx*parts[i].vx + nry*parts[i].vy;
+					parts[i].vx -= 2.0f*dp*nrx;
+					parts[i].vy -= 2.0f*dp*nry;
+				}
+				// leave the actual movement until next frame so that reflection of fast particles and refraction happen correctly
+			}
+			else
+			{
+				if (t!=PT_NEUT)
+					kill_part(i);
+				return;
+			}
+			if (!(parts[i].ctype&0x3FFFFFFF) && t == PT_PHOT)
+			{
+				kill_part(i);
+				return;
+			}
+		}
+	}
+	else if (elements[t].Falldown==0)
+	{
+		// gasses and solids (but not powders)
+		if (!do_move(i, x, y, fin_xf, fin_yf))
+		{
+			if (parts[i].type == PT_NONE)
+				return;
+			// can't move there, so bounce off
+			// TODO
+			// TODO: Work out what previous TODO was for
+			if (fin_x>x+ISTP) fin_x=x+ISTP;
+			if (fin_x<x-ISTP) fin_x=x-ISTP;
+			if (fin_y>y+ISTP) fin_y=y+ISTP;
+			if (fin_y<y-ISTP) fin_y=y-ISTP;
+			if (do_move(i, x, y, 0.25f+(float)(2*x-fin_x), 0.25f+fin_y))
+			{
+				parts[i].vx *= elements[t].Collision;
+			}
+			else if (do_move(i, x, y, 0.25f+fin_x, 0.25f+(float)(2*y-fin_y)))
+			{
+				parts[i].vy *= elements[t].Collision;
+			}
+			else
+			{
+				parts[i].vx *= elements[t].Collision;
+				parts[i].vy *= elements[t].Collision;
+			}
+		}
+	}
+	else
+	{
+		// Checking stagnant is cool, but then it doesn't update when you change it later.
+		if (water_equal_test && elements[t].Falldown == 2 && RNG::Ref().chance(1, 200))
+		{
+			if (flood_water(x, y, i))
+				return;
+		}
+		// liquids and powders
+		if (!do_move(i, x, y, fin_xf, fin_yf))
+		{
+			if (parts[i].type == PT_NONE)
+				return;
+			if (fin_x!=x && do_move(i, x, y, fin_xf, clear_yf))
+			{
+				parts[i].vx *= elements[t].Collision;
+				parts[i].vy *= elements[t].Collision;
+			}
+			else if (fin_y!=y && do_move(i, x, y, clear_xf, fin_yf))
+			{
+				parts[i].vx *= elements[t].Collision;
+				parts[i].vy *= elements[t].Collision;
+			}
+			else
+			{
+				s = 1;
+				r = RNG::Ref().between(0, 1) * 2 - 1;// position search direction (left/right first)
+				if ((clear_x!=x || clear_y!=y || nt || surround_space) &&
+					(fabsf(parts[i].vx)>0.01f || fabsf(parts[i].vy)>0.01f))
+				{
+					// allow diagonal movement if target position is blocked
+					// but no point trying this if particle is stuck in a block of identical particles
+					dx = parts[i].vx - parts[i].vy*r;
+					dy = parts[i].vy + parts[i].vx*r;
+
+					mv = std::max(fabsf(dx), fabsf(dy));
+					dx /= mv;
+					dy /= mv;
+					if (do_move(i, x, y, clear_xf+dx, clear_yf+dy))
 					{
 						parts[i].vx *= elements[t].Collision;
 						parts[i].vy *= elements[t].Collision;
+						return;
 					}
-					else if (fin_y!=y && do_move(i, x, y, clear_xf, fin_yf))
+					swappage = dx;
+					dx = dy*r;
+					dy = -swappage*r;
+					if (do_move(i, x, y, clear_xf+dx, clear_yf+dy))
 					{
 						parts[i].vx *= elements[t].Collision;
 						parts[i].vy *= elements[t].Collision;
+						return;
 					}
+				}
+				if (elements[t].Falldown>1 && !grav->IsEnabled() && gravityMode==0 && parts[i].vy>fabsf(parts[i].vx))
+				{
+					s = 0;
+					// stagnant is true if FLAG_STAGNANT was set for this particle in previous frame
+					if (!stagnant || nt) //nt is if there is an something else besides the current particle type, around the particle
+						rt = 30;//slight less water lag, although it changes how it moves a lot
 					else
+						rt = 10;
+
+					if (t==PT_GEL)
+						rt = int(parts[i].tmp*0.20f+5.0f);
+
+					for (j=clear_x+r; j>=0 && j>=clear_x-rt && j<clear_x+rt && j<XRES; j+=r)
 					{
-						s = 1;
-						r = RNG::Ref().between(0, 1) * 2 - 1;// position search direction (left/right first)
-						if ((clear_x!=x || clear_y!=y || nt || surround_space) &&
-							(fabsf(parts[i].vx)>0.01f || fabsf(parts[i].vy)>0.01f))
+						if ((TYP(pmap[fin_y][j])!=t || bmap[fin_y/CELL][j/CELL])
+							&& (s=do_move(i, x, y, (float)j, fin_yf)))
 						{
-							// allow diagonal movement if target position is blocked
-							// but no point trying this if particle is stuck in a block of identical particles
-							dx = parts[i].vx - parts[i].vy*r;
-							dy = parts[i].vy + parts[i].vx*r;
-
-							mv = std::max(fabsf(dx), fabsf(dy));
-							dx /= mv;
-							dy /= mv;
-							if (do_move(i, x, y, clear_xf+dx, clear_yf+dy))
-							{
-								parts[i].vx *= elements[t].Collision;
-								parts[i].vy *= elements[t].Collision;
-								goto movedone;
-							}
-							swappage = dx;
-							dx = dy*r;
-							dy = -swappage*r;
-							if (do_move(i, x, y, clear_xf+dx, clear_yf+dy))
-							{
-								parts[i].vx *= elements[t].Collision;
-								parts[i].vy *= elements[t].Collision;
-								goto movedone;
-							}
+							nx = (int)(parts[i].x+0.5f);
+							ny = (int)(parts[i].y+0.5f);
+							break;
 						}
-						if (elements[t].Falldown>1 && !grav->IsEnabled() && gravityMode==0 && parts[i].vy>fabsf(parts[i].vx))
+						if (fin_y!=clear_y && (TYP(pmap[clear_y][j])!=t || bmap[clear_y/CELL][j/CELL])
+							&& (s=do_move(i, x, y, (float)j, clear_yf)))
 						{
-							s = 0;
-							// stagnant is true if FLAG_STAGNANT was set for this particle in previous frame
-							if (!stagnant || nt) //nt is if there is an something else besides the current particle type, around the particle
-								rt = 30;//slight less water lag, although it changes how it moves a lot
-							else
-								rt = 10;
-
-							if (t==PT_GEL)
-								rt = int(parts[i].tmp*0.20f+5.0f);
-
-							for (j=clear_x+r; j>=0 && j>=clear_x-rt && j<clear_x+rt && j<XRES; j+=r)
-							{
-								if ((TYP(pmap[fin_y][j])!=t || bmap[fin_y/CELL][j/CELL])
-									&& (s=do_move(i, x, y, (float)j, fin_yf)))
-								{
-									nx = (int)(parts[i].x+0.5f);
-									ny = (int)(parts[i].y+0.5f);
-									break;
-								}
-								if (fin_y!=clear_y && (TYP(pmap[clear_y][j])!=t || bmap[clear_y/CELL][j/CELL])
-									&& (s=do_move(i, x, y, (float)j, clear_yf)))
-								{
-									nx = (int)(parts[i].x+0.5f);
-									ny = (int)(parts[i].y+0.5f);
-									break;
-								}
-								if (TYP(pmap[clear_y][j])!=t || (bmap[clear_y/CELL][j/CELL] && bmap[clear_y/CELL][j/CELL]!=WL_STREAM))
-									break;
-							}
+							nx = (int)(parts[i].x+0.5f);
+							ny = (int)(parts[i].y+0.5f);
+							break;
+						}
+						if (TYP(pmap[clear_y][j])!=t || (bmap[clear_y/CELL][j/CELL] && bmap[clear_y/CELL][j/CELL]!=WL_STREAM))
+							break;
+					}
 
-							r = (parts[i].vy>0) ? 1 : -1;
+					r = (parts[i].vy>0) ? 1 : -1;
 
-							if (s==1)
-								for (j=ny+r; j>=0 && j<YRES && j>=ny-rt && j<ny+rt; j+=r)
-								{
-									if ((TYP(pmap[j][nx])!=t || bmap[j/CELL][nx/CELL]) && do_move(i, nx, ny, (float)nx, (float)j))
-										break;
-									if (TYP(pmap[j][nx])!=t || (bmap[j/CELL][nx/CELL] && bmap[j/CELL][nx/CELL]!=WL_STREAM))
-										break;
-								}
-							else if (s==-1) {} // particle is out of bounds
-							else if ((clear_x!=x||clear_y!=y) && do_move(i, x, y, clear_xf, clear_yf)) {}
-							else parts[i].flags |= FLAG_STAGNANT;
-							parts[i].vx *= elements[t].Collision;
-							parts[i].vy *= elements[t].Collision;
+					if (s==1)
+						for (j=ny+r; j>=0 && j<YRES && j>=ny-rt && j<ny+rt; j+=r)
+						{
+							if ((TYP(pmap[j][nx])!=t || bmap[j/CELL][nx/CELL]) && do_move(i, nx, ny, (float)nx, (float)j))
+								break;
+							if (TYP(pmap[j][nx])!=t || (bmap[j/CELL][nx/CELL] && bmap[j/CELL][nx/CELL]!=WL_STREAM))
+								break;
 						}
-						else if (elements[t].Falldown>1 && fabsf(pGravX*parts[i].vx+pGravY*parts[i].vy)>fabsf(pGravY*parts[i].vx-pGravX*parts[i].vy))
+					else if (s==-1) {} // particle is out of bounds
+					else if ((clear_x!=x||clear_y!=y) && do_move(i, x, y, clear_xf, clear_yf)) {}
+					else parts[i].flags |= FLAG_STAGNANT;
+					parts[i].vx *= elements[t].Collision;
+					parts[i].vy *= elements[t].Collision;
+				}
+				else if (elements[t].Falldown>1 && fabsf(pGravX*parts[i].vx+pGravY*parts[i].vy)>fabsf(pGravY*parts[i].vx-pGravX*parts[i].vy))
+				{
+					float nxf, nyf, prev_pGravX, prev_pGravY, ptGrav = elements[t].Gravity;
+					s = 0;
+					// stagnant is true if FLAG_STAGNANT was set for this particle in previous frame
+					// nt is if there is something else besides the current particle type around the particle
+					// 30 gives slightly less water lag, although it changes how it moves a lot
+					rt = (!stagnant || nt) ? 30 : 10;
+
+					// clear_xf, clear_yf is the last known position that the particle should almost certainly be able to move to
+					nxf = clear_xf;
+					nyf = clear_yf;
+					nx = clear_x;
+					ny = clear_y;
+					// Look for spaces to move horizontally (perpendicular to gravity direction), keep going until a space is found or the number of positions examined = rt
+					for (j=0;j<rt;j++)
+					{
+						// Calculate overall gravity direction
+						GetGravityField(nx, ny, ptGrav, 1.0f, pGravX, pGravY);
+						// Scale gravity vector so that the largest component is 1 pixel
+						mv = std::max(fabsf(pGravX), fabsf(pGravY));
+						if (mv<0.0001f) break;
+						pGravX /= mv;
+						pGravY /= mv;
+						// Move 1 pixel perpendicularly to gravity
+						// r is +1/-1, to try moving left or right at random
+						if (j)
 						{
-							float nxf, nyf, prev_pGravX, prev_pGravY, ptGrav = elements[t].Gravity;
-							s = 0;
-							// stagnant is true if FLAG_STAGNANT was set for this particle in previous frame
-							// nt is if there is something else besides the current particle type around the particle
-							// 30 gives slightly less water lag, although it changes how it moves a lot
-							rt = (!stagnant || nt) ? 30 : 10;
-
-							// clear_xf, clear_yf is the last known position that the particle should almost certainly be able to move to
-							nxf = clear_xf;
-							nyf = clear_yf;
-							nx = clear_x;
-							ny = clear_y;
-							// Look for spaces to move horizontally (perpendicular to gravity direction), keep going until a space is found or the number of positions examined = rt
-							for (j=0;j<rt;j++)
-							{
-								// Calculate overall gravity direction
-								GetGravityField(nx, ny, ptGrav, 1.0f, pGravX, pGravY);
-								// Scale gravity vector so that the largest component is 1 pixel
-								mv = std::max(fabsf(pGravX), fabsf(pGravY));
-								if (mv<0.0001f) break;
-								pGravX /= mv;
-								pGravY /= mv;
-								// Move 1 pixel perpendicularly to gravity
-								// r is +1/-1, to try moving left or right at random
-								if (j)
-								{
-									// Not quite the gravity direction
-									// Gravity direction + last change in gravity direction
-									// This makes liquid movement a bit less frothy, particularly for balls of liquid in radial gravity. With radial gravity, instead of just moving along a tangent, the attempted movement will follow the curvature a bit better.
-									nxf += r*(pGravY*2.0f-prev_pGravY);
-									nyf += -r*(pGravX*2.0f-prev_pGravX);
-								}
-								else
-								{
-									nxf += r*pGravY;
-									nyf += -r*pGravX;
-								}
-								prev_pGravX = pGravX;
-								prev_pGravY = pGravY;
-								// Check whether movement is allowed
-								nx = (int)(nxf+0.5f);
-								ny = (int)(nyf+0.5f);
-								if (nx<0 || ny<0 || nx>=XRES || ny >=YRES)
-									break;
-								if (TYP(pmap[ny][nx])!=t || bmap[ny/CELL][nx/CELL])
-								{
-									s = do_move(i, x, y, nxf, nyf);
-									if (s)
-									{
-										// Movement was successful
-										nx = (int)(parts[i].x+0.5f);
-										ny = (int)(parts[i].y+0.5f);
-										break;
-									}
-									// A particle of a different type, or a wall, was found. Stop trying to move any further horizontally unless the wall should be completely invisible to particles.
-									if (TYP(pmap[ny][nx])!=t || bmap[ny/CELL][nx/CELL]!=WL_STREAM)
-										break;
-								}
-							}
-							if (s==1)
+							// Not quite the gravity direction
+							// Gravity direction + last change in gravity direction
+							// This makes liquid movement a bit less frothy, particularly for balls of liquid in radial gravity. With radial gravity, instead of just moving along a tangent, the attempted movement will follow the curvature a bit better.
+							nxf += r*(pGravY*2.0f-prev_pGravY);
+							nyf += -r*(pGravX*2.0f-prev_pGravX);
+						}
+						else
+						{
+							nxf += r*pGravY;
+							nyf += -r*pGravX;
+						}
+						prev_pGravX = pGravX;
+						prev_pGravY = pGravY;
+						// Check whether movement is allowed
+						nx = (int)(nxf+0.5f);
+						ny = (int)(nyf+0.5f);
+						if (nx<0 || ny<0 || nx>=XRES || ny >=YRES)
+							break;
+						if (TYP(pmap[ny][nx])!=t || bmap[ny/CELL][nx/CELL])
+						{
+							s = do_move(i, x, y, nxf, nyf);
+							if (s)
 							{
-								// The particle managed to move horizontally, now try to move vertically (parallel to gravity direction)
-								// Keep going until the particle is blocked (by something that isn't the same element) or the number of positions examined = rt
-								clear_x = nx;
-								clear_y = ny;
-								for (j=0;j<rt;j++)
-								{
-									// Calculate overall gravity direction
-									GetGravityField(nx, ny, ptGrav, 1.0f, pGravX, pGravY);
-									// Scale gravity vector so that the largest component is 1 pixel
-									mv = std::max(fabsf(pGravX), fabsf(pGravY));
-									if (mv<0.0001f) break;
-									pGravX /= mv;
-									pGravY /= mv;
-									// Move 1 pixel in the direction of gravity
-									nxf += pGravX;
-									nyf += pGravY;
-									nx = (int)(nxf+0.5f);
-									ny = (int)(nyf+0.5f);
-									if (nx<0 || ny<0 || nx>=XRES || ny>=YRES)
-										break;
-									// If the space is anything except the same element (a wall, empty space, or occupied by a particle of a different element), try to move into it
-									if (TYP(pmap[ny][nx])!=t || bmap[ny/CELL][nx/CELL])
-									{
-										s = do_move(i, clear_x, clear_y, nxf, nyf);
-										if (s || TYP(pmap[ny][nx])!=t || bmap[ny/CELL][nx/CELL]!=WL_STREAM)
-											break; // found the edge of the liquid and movement into it succeeded, so stop moving down
-									}
-								}
+								// Movement was successful
+								nx = (int)(parts[i].x+0.5f);
+								ny = (int)(parts[i].y+0.5f);
+								break;
 							}
-							else if (s==-1) {} // particle is out of bounds
-							else if ((clear_x!=x||clear_y!=y) && do_move(i, x, y, clear_xf, clear_yf)) {} // try moving to the last clear position
-							else parts[i].flags |= FLAG_STAGNANT;
-							parts[i].vx *= elements[t].Collision;
-							parts[i].vy *= elements[t].Collision;
+							// A particle of a different type, or a wall, was found. Stop trying to move any further horizontally unless the wall should be completely invisible to particles.
+							if (TYP(pmap[ny][nx])!=t || bmap[ny/CELL][nx/CELL]!=WL_STREAM)
+								break;
 						}
-						else
+					}
+					if (s==1)
+					{
+						// The particle managed to move horizontally, now try to move vertically (parallel to gravity direction)
+						// Keep going until the particle is blocked (by something that isn't the same element) or the number of positions examined = rt
+						clear_x = nx;
+						clear_y = ny;
+						for (j=0;j<rt;j++)
 						{
-							// if interpolation was done, try moving to last clear position
-							if ((clear_x!=x||clear_y!=y) && do_move(i, x, y, clear_xf, clear_yf)) {}
-							else parts[i].flags |= FLAG_STAGNANT;
-							parts[i].vx *= elements[t].Collision;
-							parts[i].vy *= elements[t].Collision;
+							// Calculate overall gravity direction
+							GetGravityField(nx, ny, ptGrav, 1.0f, pGravX, pGravY);
+							// Scale gravity vector so that the largest component is 1 pixel
+							mv = std::max(fabsf(pGravX), fabsf(pGravY));
+							if (mv<0.0001f) break;
+							pGravX /= mv;
+							pGravY /= mv;
+							// Move 1 pixel in the direction of gravity
+							nxf += pGravX;
+							nyf += pGravY;
+							nx = (int)(nxf+0.5f);
+							ny = (int)(nyf+0.5f);
+							if (nx<0 || ny<0 || nx>=XRES || ny>=YRES)
+								break;
+							// If the space is anything except the same element (a wall, empty space, or occupied by a particle of a different element), try to move into it
+							if (TYP(pmap[ny][nx])!=t || bmap[ny/CELL][nx/CELL])
+							{
+								s = do_move(i, clear_x, clear_y, nxf, nyf);
+								if (s || TYP(pmap[ny][nx])!=t || bmap[ny/CELL][nx/CELL]!=WL_STREAM)
+									break; // found the edge of the liquid and movement into it succeeded, so stop moving down
+							}
 						}
 					}
+					else if (s==-1) {} // particle is out of bounds
+					else if ((clear_x!=x||clear_y!=y) && do_move(i, x, y, clear_xf, clear_yf)) {} // try moving to the last clear position
+					else parts[i].flags |= FLAG_STAGNANT;
+					parts[i].vx *= elements[t].Collision;
+					parts[i].vy *= elements[t].Collision;
+				}
+				else
+				{
+					// if interpolation was done, try moving to last clear position
+					if ((clear_x!=x||clear_y!=y) && do_move(i, x, y, clear_xf, clear_yf)) {}
+					else parts[i].flags |= FLAG_STAGNANT;
+					parts[i].vx *= elements[t].Collision;
+					parts[i].vy *= elements[t].Collision;
 				}
 			}
-movedone:
+		}
+	}
+}
+
+bool Simulation::CanUpdateParticlesInStripes()
+{
+	if (!parallelUpdate || deterministicUpdate || legacy_enable || edgeMode == 2 || ThreadPool::Ref().ThreadCount() < 2)
+		return false;
+
+	// Liquids exchange heat with the particle twice the gravity vector away, which has to stay well within the margin
+	float maxGravity = 0.0f;
+	if (gravityMode == 0 || gravityMode == 2)
+		maxGravity = 1.0f;
+	else if (gravityMode == 3)
+		maxGravity = std::max(fabsf(customGravityX), fabsf(customGravityY));
+	if (grav->IsEnabled())
+	{
+		float maxNewtonian = 0.0f;
+		for (int c = 0; c < (YRES/CELL)*(XRES/CELL); c++)
+			maxNewtonian = std::max(maxNewtonian, std::max(fabsf(gravx[c]), fabsf(gravy[c])));
+		maxGravity += maxNewtonian;
+	}
+	if (2.0f*maxGravity + 1.0f > 2*CELL)
+		return false;
+
+	// Lua update functions and elements with global side effects (stickmen, ETRD, ...) are left to the serial pass
+	for (int t = 0; t < PT_NUM; t++)
+	{
+		stripeLocalType[t] = elements[t].Enabled && !(elements[t].Properties & TYPE_ENERGY) && !elements[t].ChangeType &&
+			(!elements[t].Update || (IsStripeLocalUpdate(t) && elements[t].Update == GetElements()[t].Update));
+	}
+	return true;
+}
+
+// Splits the simulation into bands of rows. Even bands are updated concurrently, then odd ones; a band only
+// reads and writes within STRIPE_MARGIN rows of itself, so bands updated at the same time never touch the same
+// particles. Particles that can't keep to that are updated (or finished) serially afterwards.
+void Simulation::UpdateParticlesInStripes()
+{
+	int stripeCount = (YRES + STRIPE_HEIGHT - 1) / STRIPE_HEIGHT;
+	stripes.resize(stripeCount);
+	for (int s = 0; s < stripeCount; s++)
+	{
+		auto &stripe = stripes[s];
+		stripe.y0 = s*STRIPE_HEIGHT;
+		stripe.y1 = std::min(stripe.y0 + STRIPE_HEIGHT, YRES);
+		stripe.particles.clear();
+		stripe.displaced.clear();
+		stripe.unfinished.clear();
+		stripe.freed.clear();
+		stripe.emapUpdates.clear();
+		stripe.freeSlotsTaken = 0;
+	}
+	stripeFreeList.clear();
+	stripeFreeTaken.clear();
+	stripeFreeScan = 0;
+	// Every particle updated on a stripe gets its own random stream, derived from this and its index,
+	// so the outcome doesn't depend on the number of threads or the order in which stripes finish
+	stripeSeed = uint64_t(RNG::Ref()()) << 32;
+	stripeSeed |= RNG::Ref()();
+	stripeSerialParticles.clear();
+	for (int i = NextActivePart(0); i <= parts_lastActiveIndex; i = NextActivePart(i + 1))
+	{
+		int t = parts[i].type;
+		if (!t)
+			continue;
+		int y = (int)(parts[i].y+0.5f);
+		if (stripeLocalType[t] && y >= 0 && y < YRES)
+			stripes[y/STRIPE_HEIGHT].particles.push_back(i);
+		else
+			stripeSerialParticles.push_back(i);
+	}
+
+	// Stripes would mark pixels and move particles in grids from several threads at once, so leave those to be
+	// built again afterwards
+	occupiedPixels.valid = false;
+	for (auto &grid : partGrids)
+	{
+		if (grid)
+			grid->valid = false;
+	}
+	stripePhase = true;
+	for (int parity = 0; parity < 2; parity++)
+	{
+		ThreadPool::Ref().ParallelFor((stripeCount + 1 - parity) / 2, [this, parity](int index) {
+			UpdateStripe(stripes[index*2 + parity]);
+		});
+	}
+	stripePhase = false;
+
+	// Give back the slots the stripes didn't take in reverse, so the free list is in its original order again
+	for (size_t pos = stripeFreeList.size(); pos > 0; pos--)
+	{
+		if (!stripeFreeTaken[pos - 1])
+		{
+			int i = stripeFreeList[pos - 1];
+			parts[i].life = pfree;
+			pfree = i;
+		}
+	}
+
+	for (auto &stripe : stripes)
+		for (auto &emapUpdate : stripe.emapUpdates)
+			set_emap(emapUpdate.first, emapUpdate.second);
+	for (auto &stripe : stripes)
+		for (auto &unfinished : stripe.unfinished)
+			FinishParticleUpdate(unfinished);
+	for (auto &stripe : stripes)
+		stripeSerialParticles.insert(stripeSerialParticles.end(), stripe.displaced.begin(), stripe.displaced.end());
+	std::sort(stripeSerialParticles.begin(), stripeSerialParticles.end());
+	for (auto i : stripeSerialParticles)
+		if (parts[i].type)
+			UpdateParticle(i, nullptr);
+
+	for (auto &stripe : stripes)
+	{
+		for (auto i : stripe.freed)
+		{
+			parts[i].life = pfree;
+			pfree = i;
+		}
+	}
+}
+
+void Simulation::UpdateStripe(ParticleStripe &stripe)
+{
+	ParticleStripe *&threadStripe = currentStripe;
+	threadStripe = &stripe;
+	RNG::SetThreadGenerator(&stripe.rng);
+	for (auto i : stripe.particles)
+	{
+		int t = parts[i].type;
+		if (!t)
+			continue;
+		int y = (int)(parts[i].y+0.5f);
+		if (y < stripe.y0 || y >= stripe.y1 || !stripeLocalType[t])
+		{
+			stripe.displaced.push_back(i);
 			continue;
 		}
+		stripe.rng.seed(stripeSeed, uint64_t(i));
+		UpdateParticle(i, &stripe);
+	}
+	RNG::SetThreadGenerator(nullptr);
+	threadStripe = nullptr;
+}
 
-	//'f' was pressed (single frame)
-	if (framerender)
-		framerender--;
+// Whether every row MoveParticle could read or write for this particle is within reach of the stripe
+bool Simulation::CanMoveInStripe(const ParticleStripe &stripe, int i, int t, int y, float pGravX, float pGravY)
+{
+	float vx = parts[i].vx, vy = parts[i].vy;
+	int up = int(std::min(fabsf(vy), SIM_MAXVELOCITY)) + 2;
+	int down = up;
+	if (elements[t].Falldown > 1)
+	{
+		// flood_water can put the particle anywhere on the surface of the liquid
+		if (water_equal_test && elements[t].Falldown == 2)
+			return false;
+		int rt = 30;
+		if (t == PT_GEL)
+			rt = std::max(rt, int(parts[i].tmp*0.20f+5.0f));
+		// Same branches as the liquid movement in MoveParticle, erring on the side of the wider search
+		if (!grav->IsEnabled() && gravityMode == 0 && vy > fabsf(vx)*1.001f)
+			down += rt + 1;
+		else if (fabsf(pGravX*vx+pGravY*vy) >= 0.999f*fabsf(pGravY*vx-pGravX*vy))
+		{
+			up += 4*rt;
+			down += 4*rt;
+		}
+	}
+	return y - up >= stripe.y0 - STRIPE_MARGIN && y + down < stripe.y1 + STRIPE_MARGIN;
+}
+
+void Simulation::FinishParticleUpdate(const ParticleStripe::Unfinished &unfinished)
+{
+	int i = unfinished.i, t = unfinished.t;
+	int x = unfinished.x, y = unfinished.y;
+	// Something updated earlier in the serial pass may have moved or changed the particle already
+	if (parts[i].type != t || (int)(parts[i].x+0.5f) != x || (int)(parts[i].y+0.5f) != y)
+		return;
+	if (unfinished.update)
+	{
+		if ((*(elements[t].Update))(this, i, x, y, unfinished.surround_space, unfinished.nt, parts, pmap))
+			return;
+		x = (int)(parts[i].x+0.5f);
+		y = (int)(parts[i].y+0.5f);
+		if (parts[i].type == PT_NONE || unfinished.transitionOccurred || (!parts[i].vx && !parts[i].vy))
+			return;
+	}
+	MoveParticle(i, t, x, y, unfinished.nt, unfinished.surround_space, unfinished.pGravX, unfinished.pGravY);
 }
 
 int Simulation::GetParticleType(ByteString type)
@@ -4645,39 +5235,91 @@ int Simulation::GetParticleType(ByteString type)
 	return -1;
 }
 
-void Simulation::RecalcFreeParticles(bool do_life_dec)
+void Simulation::RecalcFreeParticles(bool do_life_dec, bool fullRebuild)
 {
 	int x, y, t;
 	int lastPartUsed = 0;
 	int lastPartUnused = -1;
 
-	memset(pmap, 0, sizeof(pmap));
-	memset(pmap_count, 0, sizeof(pmap_count));
-	memset(photons, 0, sizeof(photons));
+	if (fullRebuild)
+	{
+		memset(pmap, 0, sizeof(pmap));
+		memset(pmap_count, 0, sizeof(pmap_count));
+		stackedCells.clear();
+		memset(photons, 0, sizeof(photons));
+		// Set again below for the particles that survive
+		memset(activeParts, 0, sizeof(activeParts));
+	}
+	for (auto &list : typeParts)
+		list.clear();
+	for (auto &grid : partGrids)
+	{
+		if (grid)
+			grid->valid = false;
+	}
+	occupiedPixels.valid = false;
+	if (sleepingCells)
+		memset(cellState, 0, sizeof(cellState));
 
 	NUM_PARTS = 0;
+	// Types and positions come from partCoords if nothing has moved since it was last brought up to date,
+	// otherwise they are copied there on the way, for SimulateGoL and Renderer::render_parts. Simulations that
+	// are never updated don't have partCoords and read parts.
+	bool keepCoords = partCoords.Allocated();
+	bool coordsValid = partCoords.valid;
+	partCoords.valid = keepCoords;
 	//the particle loop that resets the pmap/photon maps every frame, to update them.
-	for (int i = 0; i <= parts_lastActiveIndex; i++)
+	//When rebuilding, this visits empty slots too, to put them back on the free list in index order.
+	//Otherwise empty slots are skipped, kill_part has already put them on the free list.
+	for (int i = fullRebuild ? 0 : NextActivePart(0); i <= parts_lastActiveIndex; i = fullRebuild ? i + 1 : NextActivePart(i + 1))
 	{
-		if (parts[i].type)
+		if (keepCoords)
+		{
+			if (!coordsValid)
+				partCoords.Set(i, parts[i]);
+			t = partCoords.type[i];
+			x = partCoords.x[i];
+			y = partCoords.y[i];
+		}
+		else
 		{
 			t = parts[i].type;
 			x = (int)(parts[i].x+0.5f);
 			y = (int)(parts[i].y+0.5f);
+		}
+		if (t)
+		{
 			bool inBounds = false;
 			if (x>=0 && y>=0 && x<XRES && y<YRES)
 			{
-				if (elements[t].Properties & TYPE_ENERGY)
-					photons[y][x] = PMAP(i, t);
-				else
+				if (fullRebuild)
+				{
+					if (elements[t].Properties & TYPE_ENERGY)
+						photons[y][x] = PMAP(i, t);
+					else
+					{
+						// Particles are sometimes allowed to go inside INVS and FILT
+						// To make particles collide correctly when inside these elements, these elements must not overwrite an existing pmap entry from particles inside them
+						if (!pmap[y][x] || (t!=PT_INVIS && t!= PT_FILT))
+							pmap[y][x] = PMAP(i, t);
+						// (there are a few exceptions, including energy particles - currently no limit on stacking those)
+						if (t!=PT_THDR && t!=PT_EMBR && t!=PT_FIGH && t!=PT_PLSM)
+						{
+							if (++pmap_count[y][x] == STACKING_THRESHOLD + 1)
+								stackedCells.push_back(y * XRES + x);
+						}
+					}
+				}
+				if (sleepingCells)
 				{
-					// Particles are sometimes allowed to go inside INVS and FILT
-					// To make particles collide correctly when inside these elements, these elements must not overwrite an existing pmap entry from particles inside them
-					if (!pmap[y][x] || (t!=PT_INVIS && t!= PT_FILT))
-						pmap[y][x] = PMAP(i, t);
-					// (there are a few exceptions, including energy particles - currently no limit on stacking those)
-					if (t!=PT_THDR && t!=PT_EMBR && t!=PT_FIGH && t!=PT_PLSM)
-						pmap_count[y][x]++;
+					auto &cell = cellState[y/CELL][x/CELL];
+					cell.signature += (uint32_t(i) * 2654435761U) ^ (uint32_t(t) << 23) ^ (uint32_t(parts[i].ctype) * 40503U) ^ (uint32_t(parts[i].tmp) * 9973U) ^
+					                  (uint32_t(parts[i].life) * 31337U) ^ (uint32_t(parts[i].tmp2) * 65599U) ^ uint32_t(x * 3 + y);
+					if (std::abs(parts[i].temp - sleepTemp[i]) > CELL_HEAT_EPSILON)
+					{
+						cell.heatChanged = true;
+						sleepTemp[i] = parts[i].temp;
+					}
 				}
 				inBounds = true;
 			}
@@ -4696,8 +5338,9 @@ void Simulation::RecalcFreeParticles(bool do_life_dec)
 					continue;
 				}
 
+				// Properties first, so that particles of types without these don't have to be read at all
 				unsigned int elem_properties = elements[t].Properties;
-				if (parts[i].life>0 && (elem_properties&PROP_LIFE_DEC) && !(inBounds && bmap[y/CELL][x/CELL] == WL_STASIS && emap[y/CELL][x/CELL]<8))
+				if ((elem_properties&PROP_LIFE_DEC) && parts[i].life>0 && !(inBounds && bmap[y/CELL][x/CELL] == WL_STASIS && emap[y/CELL][x/CELL]<8))
 				{
 					// automatically decrease life
 					parts[i].life--;
@@ -4708,13 +5351,19 @@ void Simulation::RecalcFreeParticles(bool do_life_dec)
 						continue;
 					}
 				}
-				else if (parts[i].life<=0 && (elem_properties&PROP_LIFE_KILL) && !(inBounds && bmap[y/CELL][x/CELL] == WL_STASIS && emap[y/CELL][x/CELL]<8))
+				else if ((elem_properties&PROP_LIFE_KILL) && parts[i].life<=0 && !(inBounds && bmap[y/CELL][x/CELL] == WL_STASIS && emap[y/CELL][x/CELL]<8))
 				{
 					// kill if no life
 					kill_part(i);
 					continue;
 				}
 			}
+			activeParts[i / 32] |= 1U << (i % 32);
+			typeParts[t].push_back(i);
+		}
+		else if (!fullRebuild)
+		{
+			activeParts[i / 32] &= ~(1U << (i % 32));
 		}
 		else
 		{
@@ -4723,23 +5372,164 @@ void Simulation::RecalcFreeParticles(bool do_life_dec)
 			lastPartUnused = i;
 		}
 	}
-	if (lastPartUnused == -1)
-	{
-		pfree = (parts_lastActiveIndex>=(NPART-1)) ? -1 : parts_lastActiveIndex+1;
-	}
-	else
+	if (fullRebuild)
 	{
-		parts[lastPartUnused].life = (parts_lastActiveIndex>=(NPART-1)) ? -1 : parts_lastActiveIndex+1;
+		if (lastPartUnused == -1)
+		{
+			pfree = (parts_lastActiveIndex>=(NPART-1)) ? -1 : parts_lastActiveIndex+1;
+		}
+		else
+		{
+			parts[lastPartUnused].life = (parts_lastActiveIndex>=(NPART-1)) ? -1 : parts_lastActiveIndex+1;
+		}
+		// Only lowered along with relinking the free list, the slots past it have to form an ascending chain
+		parts_lastActiveIndex = lastPartUsed;
 	}
-	parts_lastActiveIndex = lastPartUsed;
+	typePartsValid = true;
 	if (elementRecount)
 		elementRecount = false;
 }
 
-void Simulation::SimulateGoL()
+// The same generation as SimulateGoL, for when every LIFE that takes part in it follows the same rule, which
+// is what a soup drawn with one brush looks like. Neighbours are then counted 64 cells at a time on golLive
+// instead of being collected in the lists in gol, which only have to settle which rule a new cell follows.
+// Rows with no live cells near them are skipped. Returns false without changing anything if the rules are mixed.
+bool Simulation::SimulateGoLSingleRule()
 {
-	CGOL = 0;
-	for (int i = 0; i <= parts_lastActiveIndex; ++i)
+	auto &lifeParts = PartsOfType(PT_LIFE);
+	auto &coords = PartCoords();
+	unsigned int golnum = 0;
+	int minRow = GOL_HEIGHT, maxRow = -1;
+	for (auto i : lifeParts)
+	{
+		if (coords.type[i] != PT_LIFE)
+		{
+			continue;
+		}
+		auto x = coords.x[i];
+		auto y = coords.y[i];
+		if (x < CELL || y < CELL || x >= XRES - CELL || y >= YRES - CELL)
+		{
+			continue;
+		}
+		auto &part = parts[i];
+		unsigned int partGolnum = part.ctype;
+		unsigned int ruleset = partGolnum;
+		if (partGolnum < NGOL)
+		{
+			ruleset = builtinGol[partGolnum].ruleset;
+			partGolnum += 1;
+		}
+		if (part.tmp2 != int((ruleset >> 17) & 0xF) + 1)
+		{
+			continue;
+		}
+		// * A cell is only counted once here, and the lists would take more than one rule into account.
+		//   Which neighbour new cells take their colours from is looked up through pmap too.
+		if ((golnum && partGolnum != golnum) || partGolnum > 0x001FFFFFU || pmap[y][x] != PMAP(i, PT_LIFE))
+		{
+			for (int row = minRow; row <= maxRow; ++row)
+			{
+				std::fill(golLive[row], golLive[row] + GOL_WORDS, 0);
+			}
+			return false;
+		}
+		golnum = partGolnum;
+		int gx = x - CELL, gy = y - CELL;
+		golLive[gy][gx / 64] |= uint64_t(1) << (gx % 64);
+		minRow = std::min(minRow, gy);
+		maxRow = std::max(maxRow, gy);
+	}
+
+	auto inStasis = [this](int x, int y) {
+		return bmap[y / CELL][x / CELL] == WL_STASIS && emap[y / CELL][x / CELL] < 8;
+	};
+
+	// * Count the eight neighbours of 64 cells at once, into a 4-bit number per cell spread over four
+	//   words. Only rows next to live cells can have any, which may be on the other side of the wraparound.
+	bool wrapRows = maxRow >= 0 && (minRow == 0 || maxRow == GOL_HEIGHT - 1);
+	int firstRow = wrapRows ? 0 : minRow - 1;
+	int lastRow = wrapRows ? GOL_HEIGHT - 1 : maxRow + 1;
+	std::vector<uint64_t> counts(maxRow >= 0 ? (lastRow - firstRow + 1) * GOL_WORDS * 4 : 0);
+	auto shiftRow = [](const uint64_t *row, uint64_t *east, uint64_t *west) {
+		// * Bits of east and west are set if the cell to the east or west of the same bit in row is
+		//   live, wrapping around at the ends of the row.
+		for (int w = 0; w < GOL_WORDS; ++w)
+		{
+			east[w] = (row[w] >> 1) | (w + 1 < GOL_WORDS ? row[w + 1] << 63 : 0);
+			west[w] = (row[w] << 1) | (w ? row[w - 1] >> 63 : 0);
+		}
+		east[(GOL_WIDTH - 1) / 64] |= (row[0] & 1) << ((GOL_WIDTH - 1) % 64);
+		west[0] |= (row[(GOL_WIDTH - 1) / 64] >> ((GOL_WIDTH - 1) % 64)) & 1;
+		if (GOL_WIDTH % 64)
+		{
+			east[GOL_WORDS - 1] &= (uint64_t(1) << (GOL_WIDTH % 64)) - 1;
+			west[GOL_WORDS - 1] &= (uint64_t(1) << (GOL_WIDTH % 64)) - 1;
+		}
+	};
+	for (int gy = firstRow; maxRow >= 0 && gy <= lastRow; ++gy)
+	{
+		const uint64_t *rows[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			rows[k] = golLive[(gy + k - 1 + GOL_HEIGHT) % GOL_HEIGHT];
+		}
+		uint64_t any = 0;
+		for (int w = 0; w < GOL_WORDS; ++w)
+		{
+			any |= rows[0][w] | rows[1][w] | rows[2][w];
+		}
+		if (!any)
+		{
+			continue;
+		}
+		uint64_t east[3][GOL_WORDS], west[3][GOL_WORDS];
+		for (int k = 0; k < 3; ++k)
+		{
+			shiftRow(rows[k], east[k], west[k]);
+		}
+		uint64_t *count = &counts[(gy - firstRow) * GOL_WORDS * 4];
+		for (int w = 0; w < GOL_WORDS; ++w)
+		{
+			uint64_t neighbour[8] = {
+				west[0][w], rows[0][w], east[0][w],
+				west[1][w],             east[1][w],
+				west[2][w], rows[2][w], east[2][w],
+			};
+			uint64_t count0 = 0, count1 = 0, count2 = 0, count3 = 0;
+			for (auto bits : neighbour)
+			{
+				uint64_t carry0 = count0 & bits;
+				count0 ^= bits;
+				uint64_t carry1 = count1 & carry0;
+				count1 ^= carry0;
+				uint64_t carry2 = count2 & carry1;
+				count2 ^= carry1;
+				count3 |= carry2;
+			}
+			count[w * 4] = count0;
+			count[w * 4 + 1] = count1;
+			count[w * 4 + 2] = count2;
+			count[w * 4 + 3] = count3;
+		}
+	}
+	auto countNeighbours = [&counts, firstRow, lastRow, maxRow](int gx, int gy) {
+		if (maxRow < 0 || gy < firstRow || gy > lastRow)
+		{
+			return 0U;
+		}
+		const uint64_t *count = &counts[((gy - firstRow) * GOL_WORDS + gx / 64) * 4];
+		unsigned int neighbours = 0;
+		for (int b = 0; b < 4; ++b)
+		{
+			neighbours |= ((count[b] >> (gx % 64)) & 1) << b;
+		}
+		return neighbours;
+	};
+
+	// * Dying cells count down, live ones that do not survive start the death sequence.
+	std::vector<int> deadPositions;
+	for (auto i : lifeParts)
 	{
 		auto &part = parts[i];
 		if (part.type != PT_LIFE)
@@ -4752,6 +5542,131 @@ void Simulation::SimulateGoL()
 		{
 			continue;
 		}
+		unsigned int ruleset = part.ctype;
+		if (ruleset < NGOL)
+		{
+			ruleset = builtinGol[ruleset].ruleset;
+		}
+		bool stasis = inStasis(x, y);
+		if (part.tmp2 != int((ruleset >> 17) & 0xF) + 1 && !stasis)
+		{
+			part.tmp2 -= 1;
+		}
+		if (pmap[y][x] != PMAP(i, PT_LIFE))
+		{
+			continue;
+		}
+		if (!stasis && part.tmp2 == int(ruleset >> 17) + 1 && !((ruleset >> countNeighbours(x - CELL, y - CELL)) & 1))
+		{
+			part.tmp2 -= 1;
+		}
+		if (part.tmp2 <= 0)
+		{
+			deadPositions.push_back(y * XRES + x);
+		}
+	}
+
+	// * New cells, visited from the top so that they are created in the same order as in SimulateGoL.
+	if (maxRow >= 0)
+	{
+		unsigned int ruleset = golnum;
+		unsigned int golnumToCreate = golnum;
+		if (golnum - 1 < NGOL)
+		{
+			ruleset = builtinGol[golnum - 1].ruleset;
+			golnumToCreate = golnum - 1;
+		}
+		unsigned int births = (ruleset >> 8) & 0x1FE;
+		for (int gy = firstRow; gy <= lastRow; ++gy)
+		{
+			const uint64_t *count = &counts[(gy - firstRow) * GOL_WORDS * 4];
+			for (int w = 0; w < GOL_WORDS; ++w)
+			{
+				uint64_t born = 0;
+				for (int n = 1; n <= 8; ++n)
+				{
+					if ((births >> n) & 1)
+					{
+						born |= ((n & 1) ? count[w * 4] : ~count[w * 4]) & ((n & 2) ? count[w * 4 + 1] : ~count[w * 4 + 1]) &
+						        ((n & 4) ? count[w * 4 + 2] : ~count[w * 4 + 2]) & ((n & 8) ? count[w * 4 + 3] : ~count[w * 4 + 3]);
+					}
+				}
+				born &= ~golLive[gy][w];
+				while (born)
+				{
+					int gx = w * 64 + CountTrailingZeros(born);
+					born &= born - 1;
+					int x = gx + CELL, y = gy + CELL;
+					if (pmap[y][x] || inStasis(x, y))
+					{
+						continue;
+					}
+					// * 0x200000: No need to look for colours, they'll be set later anyway.
+					int i = create_part(-1, x, y, PT_LIFE, golnumToCreate | 0x200000);
+					if (i >= 0)
+					{
+						// * Take the colours of the first neighbour SimulateGoL would have come across,
+						//   which is the live one with the lowest index.
+						int sample = -1;
+						for (int yy = -1; yy <= 1; ++yy)
+						{
+							for (int xx = -1; xx <= 1; ++xx)
+							{
+								int ax = (gx + xx + GOL_WIDTH) % GOL_WIDTH;
+								int ay = (gy + yy + GOL_HEIGHT) % GOL_HEIGHT;
+								if ((xx || yy) && (golLive[ay][ax / 64] >> (ax % 64)) & 1)
+								{
+									int r = ID(pmap[ay + CELL][ax + CELL]);
+									if (sample < 0 || r < sample)
+									{
+										sample = r;
+									}
+								}
+							}
+						}
+						parts[i].dcolour = parts[sample].dcolour;
+						parts[i].tmp = parts[sample].tmp;
+					}
+				}
+			}
+		}
+		for (int row = minRow; row <= maxRow; ++row)
+		{
+			std::fill(golLive[row], golLive[row] + GOL_WORDS, 0);
+		}
+	}
+
+	// * Dead cells go in the order SimulateGoL would have removed them in, which decides which slots
+	//   new particles get.
+	std::sort(deadPositions.begin(), deadPositions.end());
+	for (auto position : deadPositions)
+	{
+		kill_part(ID(pmap[position / XRES][position % XRES]));
+	}
+	return true;
+}
+
+void Simulation::SimulateGoL()
+{
+	CGOL = 0;
+	if (SimulateGoLSingleRule())
+	{
+		return;
+	}
+	auto &coords = PartCoords();
+	for (auto i : PartsOfType(PT_LIFE))
+	{
+		if (coords.type[i] != PT_LIFE)
+		{
+			continue;
+		}
+		auto x = coords.x[i];
+		auto y = coords.y[i];
+		if (x < CELL || y < CELL || x >= XRES - CELL || y >= YRES - CELL)
+		{
+			continue;
+		}
+		auto &part = parts[i];
 		unsigned int golnum = part.ctype;
 		unsigned int ruleset = golnum;
 		if (golnum < NGOL)
@@ -4912,38 +5827,81 @@ void Simulation::SimulateGoL()
 	}
 }
 
+// Wakes areas where anything changed since the last tick, along with their neighbours, and lets the others
+// get closer to falling asleep. Sleeping areas skip the particles that would only react to a change.
+void Simulation::UpdateSleepingCells()
+{
+	for (int t = 0; t < PT_NUM; t++)
+	{
+		// Whether a particle is worth updating is decided by whether anything changed last tick, so anything that
+		// can be left alone in an area where nothing changes may sleep. Conductors too: electric walls only spark
+		// them when emap in the area changes, which wakes it. Lua update functions may depend on anything.
+		auto &element = elements[t];
+		canSleep[t] = element.Enabled && (element.Properties & TYPE_SOLID) && !(element.Properties & TYPE_ENERGY) && !element.HotAir &&
+		              (!element.Update || (IsSleepableUpdate(t) && element.Update == GetElements()[t].Update));
+	}
+	bool changed[YRES/CELL][XRES/CELL];
+	for (int y = 0; y < YRES/CELL; y++)
+	{
+		for (int x = 0; x < XRES/CELL; x++)
+		{
+			auto &cell = cellState[y][x];
+			auto &last = cellLastState[y][x];
+			cell.pressure = pv[y][x];
+			cell.ambientHeat = hv[y][x];
+			cell.emap = emap[y][x];
+			changed[y][x] = cell.signature != last.signature || cell.heatChanged || cell.emap != last.emap ||
+			                std::abs(cell.pressure - last.pressure) > CELL_AIR_EPSILON ||
+			                std::abs(vx[y][x]) > CELL_AIR_EPSILON || std::abs(vy[y][x]) > CELL_AIR_EPSILON ||
+			                (aheat_enable && std::abs(cell.ambientHeat - last.ambientHeat) > CELL_HEAT_EPSILON);
+			last = cell;
+		}
+	}
+	for (int y = 0; y < YRES/CELL; y++)
+	{
+		for (int x = 0; x < XRES/CELL; x++)
+		{
+			bool wake = false;
+			for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, YRES/CELL - 1) && !wake; ny++)
+				for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, XRES/CELL - 1) && !wake; nx++)
+					wake = changed[ny][nx];
+			if (wake)
+				cellIdleTicks[y][x] = 0;
+			else if (cellIdleTicks[y][x] < CELL_SLEEP_TICKS)
+				cellIdleTicks[y][x]++;
+		}
+	}
+}
+
 void Simulation::CheckStacking()
 {
 	bool excessive_stacking_found = false;
 	force_stacking_check = false;
-	for (int y = 0; y < YRES; y++)
-	{
-		for (int x = 0; x < XRES; x++)
+	// Visited in the same order as the rows of pmap_count, which decides what the random numbers are used for
+	std::sort(stackedCells.begin(), stackedCells.end());
+	for (auto cell : stackedCells)
+	{
+		int x = cell % XRES;
+		int y = cell / XRES;
+		// Setting pmap_count[y][x] > NPART means BHOL will form in that spot
+		if (bmap[y/CELL][x/CELL]==WL_EHOLE)
 		{
-			// Use a threshold, since some particle stacking can be normal (e.g. BIZR + FILT)
-			// Setting pmap_count[y][x] > NPART means BHOL will form in that spot
-			if (pmap_count[y][x]>5)
+			// Allow more stacking in E-hole
+			if (pmap_count[y][x]>1500)
 			{
-				if (bmap[y/CELL][x/CELL]==WL_EHOLE)
-				{
-					// Allow more stacking in E-hole
-					if (pmap_count[y][x]>1500)
-					{
-						pmap_count[y][x] = pmap_count[y][x] + NPART;
-						excessive_stacking_found = 1;
-					}
-				}
-				else if (pmap_count[y][x]>1500 || (unsigned int)RNG::Ref().between(0, 1599) <= (pmap_count[y][x]+100))
-				{
-					pmap_count[y][x] = pmap_count[y][x] + NPART;
-					excessive_stacking_found = true;
-				}
+				pmap_count[y][x] = pmap_count[y][x] + NPART;
+				excessive_stacking_found = 1;
 			}
 		}
+		else if (pmap_count[y][x]>1500 || (unsigned int)RNG::Ref().between(0, 1599) <= (pmap_count[y][x]+100))
+		{
+			pmap_count[y][x] = pmap_count[y][x] + NPART;
+			excessive_stacking_found = true;
+		}
 	}
 	if (excessive_stacking_found)
 	{
-		for (int i = 0; i <= parts_lastActiveIndex; i++)
+		for (int i = NextActivePart(0); i <= parts_lastActiveIndex; i = NextActivePart(i + 1))
 		{
 			if (parts[i].type)
 			{
@@ -4978,13 +5936,17 @@ void Simulation::BeforeSim()
 {
 	if (!sys_pause||framerender)
 	{
-		air->update_air();
+		{
+			PhaseTimer timer(phaseTimes, &SimulationPhaseTimes::air);
+			air->update_air();
 
-		if(aheat_enable)
-			air->update_airh();
+			if(aheat_enable)
+				air->update_airh();
+		}
 
 		if(grav->IsEnabled())
 		{
+			PhaseTimer timer(phaseTimes, &SimulationPhaseTimes::gravity);
 			grav->gravity_update_async();
 
 			//Get updated buffer pointers for gravity
@@ -5015,8 +5977,22 @@ void Simulation::BeforeSim()
 		gravWallChanged = false;
 	}
 
+	// Decided before RecalcFreeParticles, which counts stacked particles for it
+	bool checkStacking = false;
+	if (!sys_pause || framerender)
+		checkStacking = force_stacking_check || RNG::Ref().chance(1, 10);
+
 	if (debug_currentParticle == 0)
-		RecalcFreeParticles(true);
+	{
+		PhaseTimer timer(phaseTimes, &SimulationPhaseTimes::recalcFreeParticles);
+		// Even when pmap is kept up to date incrementally, it's rebuilt when stacking is about to be checked,
+		// while paused, so that tools see exact maps, and every so often to get rid of stale entries and
+		// slots that fell off the free list
+		bool fullRebuild = !incrementalPmap || checkStacking || (sys_pause && !framerender) || !(currentTick % PMAP_REBUILD_INTERVAL);
+		RecalcFreeParticles(true, fullRebuild);
+		if (sleepingCells && (!sys_pause || framerender))
+			UpdateSleepingCells();
+	}
 
 	if (!sys_pause || framerender)
 	{
@@ -5034,7 +6010,7 @@ void Simulation::BeforeSim()
 		}
 
 		// check for stacking and create BHOL if found
-		if (force_stacking_check || RNG::Ref().chance(1, 10))
+		if (checkStacking)
 		{
 			CheckStacking();
 		}
@@ -5128,7 +6104,7 @@ void Simulation::BeforeSim()
 		// update PPIP tmp?
 		if (Element_PPIP_ppip_changed)
 		{
-			for (int i = 0; i <= parts_lastActiveIndex; i++)
+			for (auto i : PartsOfType(PT_PPIP))
 			{
 				if (parts[i].type==PT_PPIP)
 				{
@@ -5143,9 +6119,18 @@ void Simulation::BeforeSim()
 		// GSPEED is frames per generation
 		if (elementCount[PT_LIFE]>0 && ++CGOL>=GSPEED)
 		{
+			PhaseTimer timer(phaseTimes, &SimulationPhaseTimes::gol);
 			SimulateGoL();
 		}
 
+#ifndef REALISTIC
+		if (fastHeat && !legacy_enable)
+		{
+			PhaseTimer timer(phaseTimes, &SimulationPhaseTimes::heat);
+			GetHeatField().Update();
+		}
+#endif
+
 		// wifi channel reseting
 		if (ISWIRE > 0)
 		{
@@ -5178,16 +6163,25 @@ void Simulation::AfterSim()
 	}
 }
 
+HeatField &Simulation::GetHeatField()
+{
+	if (!heatField)
+		heatField = new HeatField(*this);
+	return *heatField;
+}
+
 Simulation::~Simulation()
 {
 	delete grav;
 	delete air;
+	delete heatField;
 }
 
 Simulation::Simulation():
 	replaceModeSelected(0),
 	replaceModeFlags(0),
 	debug_currentParticle(0),
+	typePartsValid(false),
 	ISWIRE(0),
 	force_stacking_check(false),
 	emp_decor(0),
@@ -5205,11 +6199,18 @@ Simulation::Simulation():
 	legacy_enable(0),
 	aheat_enable(0),
 	water_equal_test(0),
+	fastHeat(false),
 	sys_pause(0),
 	framerender(0),
 	pretty_powder(0),
 	sandcolour_frame(0),
-	deco_space(0)
+	deco_space(0),
+	phaseTimes(nullptr),
+	parallelUpdate(false),
+	deterministicUpdate(false),
+	incrementalPmap(false),
+	sleepingCells(false),
+	stripePhase(false)
 {
 	int tportal_rx[] = {-1, 0, 1, 1, 1, 0,-1,-1};
 	int tportal_ry[] = {-1,-1,-1, 0, 1, 1, 1, 0};
@@ -5244,6 +6245,9 @@ Simulation::Simulation():
 	pv = air->pv;
 	hv = air->hv;
 
+	// Created by GetHeatField when fastHeat is first used
+	heatField = nullptr;
+
 	msections = LoadMenus();
 	wtypes = LoadWalls();
 	platent = LoadLatent();
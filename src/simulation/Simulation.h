@@ -4,9 +4,11 @@
 
 #include <cstring>
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <array>
 #include <memory>
+#include <mutex>
 
 #include "Particle.h"
 #include "Stickman.h"
@@ -16,6 +18,9 @@
 #include "BuiltinGOL.h"
 #include "MenuSection.h"
 #include "CoordStack.h"
+#include "OccupiedPixels.h"
+#include "ParticleGrid.h"
+#include "common/tpt-rand.h"
 
 #include "Element.h"
 
@@ -32,14 +37,97 @@ class Simulation;
 class Renderer;
 class Gravity;
 class Air;
+class HeatField;
 class GameSave;
 
+// Nanoseconds spent in the phases of BeforeSim, accumulated across ticks; see Simulation::phaseTimes
+struct SimulationPhaseTimes
+{
+	uint64_t air = 0;
+	uint64_t gravity = 0;
+	uint64_t recalcFreeParticles = 0;
+	uint64_t gol = 0;
+	uint64_t heat = 0;
+};
+
+// What RecalcFreeParticles saw of the particles in one CELL-sized area; see Simulation::sleepingCells
+struct CellState
+{
+	uint32_t signature; // changes when particles come, go or change type, ctype, life, tmp or tmp2
+	bool heatChanged; // some particle's temperature moved away from where it was when last counted as a change
+	float pressure;
+	float ambientHeat;
+	unsigned char emap;
+};
+
+// A copy of the types and rounded positions of the particles, in arrays of their own, for the loops over every
+// particle that need little else (RecalcFreeParticles, SimulateGoL, Renderer::render_parts) and would otherwise
+// pull in all of each Particle to read them; see Simulation::PartCoords. parts stays the only real store of these,
+// this is a cache. Only simulations that are updated allocate it, not the ones that are only loaded and drawn.
+struct ParticleCoords
+{
+	std::vector<int> type;
+	std::vector<int> x;
+	std::vector<int> y;
+	// Cleared when particles start moving at the start of UpdateParticles, and by anything that rewrites parts
+	// wholesale; while set, changes made through create_part, kill_part, part_change_type and SetPartProperty
+	// are copied here, other code that changes the type or position of a particle calls UpdatePartCoords
+	bool valid = false;
+
+	bool Allocated() const
+	{
+		return !type.empty();
+	}
+
+	void Allocate()
+	{
+		if (!Allocated())
+		{
+			type.resize(NPART, 0);
+			x.resize(NPART, 0);
+			y.resize(NPART, 0);
+		}
+	}
+
+	void Set(int i, const Particle &part)
+	{
+		type[i] = part.type;
+		x[i] = (int)(part.x+0.5f);
+		y[i] = (int)(part.y+0.5f);
+	}
+};
+
+// A band of rows whose particles are updated on a worker thread; see Simulation::UpdateParticlesInStripes
+struct ParticleStripe
+{
+	// A particle whose update was interrupted on the stripe, to be finished in the serial pass
+	struct Unfinished
+	{
+		int i, t, x, y, nt, surround_space;
+		float pGravX, pGravY;
+		bool transitionOccurred;
+		bool update; // the update function still has to be called, otherwise only the movement is left
+	};
+
+	int y0, y1;
+	std::vector<int> particles; // in index order, binned by position at the start of the tick
+	std::vector<int> displaced; // pushed out of the stripe or changed type before their turn
+	std::vector<Unfinished> unfinished;
+	size_t freeSlotsTaken; // how far into its runs of the free list this stripe is, see Simulation::take_free_part
+	std::vector<int> freed; // returned to the free list once all stripes are done
+	std::vector<std::pair<int, int>> emapUpdates; // set_emap calls, done once all stripes are done
+	// Reseeded for every particle from Simulation::stripeSeed and the particle index
+	RNG rng;
+};
+
 class Simulation
 {
 public:
 
 	Gravity * grav;
 	Air * air;
+	// Only there once fastHeat has been used, see GetHeatField
+	HeatField * heatField;
 
 	std::vector<sign> signs;
 	std::array<Element, PT_NUM> elements;
@@ -56,6 +144,18 @@ public:
 	char can_move[PT_NUM][PT_NUM];
 	int debug_currentParticle;
 	int parts_lastActiveIndex;
+	// Bit i%32 of activeParts[i/32] is set for every slot that may hold a live particle. Bits are set
+	// when a slot is handed out and cleared again by RecalcFreeParticles, so a set bit does not
+	// guarantee that parts[i].type is nonzero. Loops over live particles use NextActivePart to
+	// skip runs of empty slots without touching them.
+	uint32_t activeParts[(NPART + 31) / 32];
+	// Particles of each type in index order, as collected by RecalcFreeParticles. Only valid until
+	// particles are created, change type or get updated, see PartsOfType.
+	std::vector<int> typeParts[PT_NUM];
+	bool typePartsValid;
+	// Grids of the particles of the types that were looked for with PartGrid, the others are null
+	std::unique_ptr<ParticleGrid> partGrids[PT_NUM];
+	ParticleCoords partCoords;
 	int pfree;
 	int NUM_PARTS;
 	bool elementRecount;
@@ -82,6 +182,9 @@ public:
 	int CGOL;
 	int GSPEED;
 	unsigned int gol[YRES][XRES][5];
+	// One bit per cell of the area GOL wraps around in (the simulation area without its outermost CELL),
+	// set for LIFE that takes part in the next generation; see SimulateGoLSingleRule. Left all clear.
+	uint64_t golLive[YRES - 2 * CELL][(XRES - 2 * CELL + 63) / 64];
 	//Air sim
 	float (*vx)[XRES/CELL];
 	float (*vy)[XRES/CELL];
@@ -102,6 +205,11 @@ public:
 	int pmap[YRES][XRES];
 	int photons[YRES][XRES];
 	unsigned int pmap_count[YRES][XRES];
+	// Cells that pmap_count put over the stacking threshold, as y*XRES+x, so that CheckStacking only has to look at those
+	std::vector<int> stackedCells;
+	// Pixels that may be occupied in pmap or photons, for StepsToOccupied; anything that puts a particle in
+	// either of them marks it here
+	OccupiedPixels occupiedPixels;
 	//Simulation Settings
 	int edgeMode;
 	int gravityMode;
@@ -110,12 +218,49 @@ public:
 	int legacy_enable;
 	int aheat_enable;
 	int water_equal_test;
+	// Conduct heat between particles with HeatField instead of letting each particle average its temperature with
+	// its neighbours' by chance; saved with the save, off keeps the original behaviour exactly. Only faster with
+	// several threads to spread the field over: on one core it is a little slower than conducting per particle
+	bool fastHeat;
 	int sys_pause;
 	int framerender;
 	int pretty_powder;
 	int sandcolour;
 	int sandcolour_frame;
 	int deco_space;
+	// Only set when profiling (e.g. by the bench tool), null otherwise
+	SimulationPhaseTimes *phaseTimes;
+	// Update particles on several threads where possible; the outcome differs from the serial order, but not with the number of threads
+	bool parallelUpdate;
+	// Keep the serial particle order even if parallelUpdate is set, e.g. for replays that must come out the same
+	bool deterministicUpdate;
+	// Rely on pmap and photons being kept up to date as particles are created, moved and killed, and only
+	// rebuild them from scratch now and then; stacked particles may go unseen until the next rebuild.
+	// Code that writes the type or position of a particle directly, rather than through create_part,
+	// part_change_type, try_move/do_move or SetPartProperty, has to call UpdatePartPmap afterwards, or
+	// pmap stays wrong for up to PMAP_REBUILD_INTERVAL ticks
+	bool incrementalPmap;
+	// Skip particles that only ever react to their surroundings in CELL-sized areas where nothing has
+	// happened for a while; heat conduction too slow to move any one particle by CELL_HEAT_EPSILON within
+	// CELL_SLEEP_TICKS stops until something wakes them
+	bool sleepingCells;
+	bool canSleep[PT_NUM];
+	unsigned char cellIdleTicks[YRES/CELL][XRES/CELL];
+	CellState cellState[YRES/CELL][XRES/CELL];
+	CellState cellLastState[YRES/CELL][XRES/CELL];
+	float sleepTemp[NPART]; // temperature of each particle when it last counted as a change
+	//Parallel particle update
+	std::vector<ParticleStripe> stripes;
+	std::vector<int> stripeSerialParticles;
+	// The start of the free list, unlinked while stripes take slots from it, which of its slots are taken,
+	// and how far into it all slots are taken
+	std::vector<int> stripeFreeList;
+	std::vector<bool> stripeFreeTaken;
+	size_t stripeFreeScan;
+	bool stripeLocalType[PT_NUM];
+	uint64_t stripeSeed;
+	bool stripePhase;
+	std::recursive_mutex stripeMutex;
 
 	int Load(const GameSave * save, bool includePressure);
 	int Load(const GameSave * save, bool includePressure, int x, int y);
@@ -123,6 +268,9 @@ public:
 	GameSave * Save(bool includePressure, int x1, int y1, int x2, int y2);
 	void SaveSimOptions(GameSave * gameSave);
 	SimulationSample GetSample(int x, int y);
+	// The heat field is several megabytes and most simulations (snapshots, thumbnail renderers) never conduct
+	// heat with it, so it is only created when first needed
+	HeatField &GetHeatField();
 
 	std::unique_ptr<Snapshot> CreateSnapshot();
 	void Restore(const Snapshot &snap);
@@ -155,6 +303,55 @@ public:
 	//int InCurrentBrush(int i, int j, int rx, int ry);
 	//int get_brush_flags();
 	int create_part(int p, int x, int y, int t, int v = -1);
+	int take_free_part();
+	void MarkPartActive(int i);
+	void InvalidateTypeParts();
+	int NextActivePart(int i) const;
+	const std::vector<int> &PartsOfType(int t);
+	ParticleGrid &PartGrid(int t);
+	void PartGridChangeType(int i, int from, int to);
+	// Call after moving particle i other than by creating it, so that PartGrid looks for it where it is now
+	void PartGridMove(int i)
+	{
+		auto &grid = partGrids[parts[i].type];
+		if (grid && grid->valid)
+			grid->Move(parts, i);
+	}
+	void UpdatePartPmap(int i, int oldX, int oldY);
+	int StepsToOccupied(int x, int y, int dx, int dy);
+	const ParticleCoords &PartCoords();
+	void UpdatePartCoords(int i)
+	{
+		if (partCoords.valid)
+			partCoords.Set(i, parts[i]);
+	}
+
+	// Fields of particle i by the offsets in Particle::GetProperties, for code that refers to fields by property
+	// (Lua, the console, the property tool, flood_prop). Keyed on the particle rather than handing out a Particle,
+	// so that fields can be kept apart from parts: writes keep partCoords up to date. Code that writes through
+	// PartPropertyAddress has to call UpdatePartCoords itself, and PartGridMove and UpdatePartPmap too if it wrote x or y.
+	void *PartPropertyAddress(int i, intptr_t offset)
+	{
+		return reinterpret_cast<unsigned char *>(&parts[i]) + offset;
+	}
+	template<class Value>
+	Value GetPartProperty(int i, intptr_t offset)
+	{
+		return *static_cast<Value *>(PartPropertyAddress(i, offset));
+	}
+	template<class Value>
+	void SetPartProperty(int i, intptr_t offset, Value value)
+	{
+		int oldType = parts[i].type, oldX = (int)(parts[i].x+0.5f), oldY = (int)(parts[i].y+0.5f);
+		*static_cast<Value *>(PartPropertyAddress(i, offset)) = value;
+		UpdatePartCoords(i);
+		if (offset == offsetof(Particle, type) || offset == offsetof(Particle, x) || offset == offsetof(Particle, y))
+		{
+			PartGridChangeType(i, oldType, parts[i].type);
+			UpdatePartPmap(i, oldX, oldY);
+		}
+	}
+	void SetPartProperty(int i, StructProperty::PropertyType type, intptr_t offset, PropertyValue value);
 	void delete_part(int x, int y);
 	void get_sign_pos(int i, int *x0, int *y0, int *w, int *h);
 	int is_wire(int x, int y);
@@ -163,9 +360,18 @@ public:
 	int parts_avg(int ci, int ni, int t);
 	void create_arc(int sx, int sy, int dx, int dy, int midpoints, int variance, int type, int flags);
 	void UpdateParticles(int start, int end);
+	void UpdateParticle(int i, ParticleStripe *stripe);
+	void MoveParticle(int i, int t, int x, int y, int nt, int surround_space, float pGravX, float pGravY);
+	bool CanUpdateParticlesInStripes();
+	void UpdateParticlesInStripes();
+	void UpdateStripe(ParticleStripe &stripe);
+	bool CanMoveInStripe(const ParticleStripe &stripe, int i, int t, int y, float pGravX, float pGravY);
+	void FinishParticleUpdate(const ParticleStripe::Unfinished &unfinished);
 	void SimulateGoL();
-	void RecalcFreeParticles(bool do_life_dec);
+	bool SimulateGoLSingleRule();
+	void RecalcFreeParticles(bool do_life_dec, bool fullRebuild = true);
 	void CheckStacking();
+	void UpdateSleepingCells();
 	void BeforeSim();
 	void AfterSim();
 	void rotate_area(int area_x, int area_y, int area_w, int area_h, int invert);
@@ -0,0 +1,171 @@
+#include "SimulationThread.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "Air.h"
+#include "ElementClasses.h"
+#include "Gravity.h"
+#include "Simulation.h"
+
+SimulationThread::SimulationThread() :
+	mainLock(simMutex, std::defer_lock),
+	mainWaiting(false),
+	stopping(false)
+{
+}
+
+SimulationThread::~SimulationThread()
+{
+	Stop();
+}
+
+void SimulationThread::Start(Simulation *newSim, float newTickRate)
+{
+	Stop();
+	sim = newSim;
+	tickRate = newTickRate;
+	if (!snapshot)
+		snapshot = std::make_unique<Simulation>();
+	snapshotLastActiveIndex = NPART - 1;
+	elementsChanged = true;
+	CopySnapshot();
+	stopping = false;
+	thread = std::thread([this]() { Run(); });
+}
+
+void SimulationThread::Stop()
+{
+	if (!Running())
+		return;
+	stopping = true;
+	// The thread may be waiting for the main thread to let go of the simulation
+	if (lockDepth)
+		mainLock.unlock();
+	mainDone.notify_one();
+	thread.join();
+	if (lockDepth)
+		mainLock.lock();
+	sim = nullptr;
+}
+
+void SimulationThread::Lock()
+{
+	if (!lockDepth++)
+	{
+		mainWaiting = true;
+		mainLock.lock();
+		mainWaiting = false;
+	}
+}
+
+void SimulationThread::Unlock()
+{
+	if (!--lockDepth)
+	{
+		mainLock.unlock();
+		mainDone.notify_one();
+	}
+}
+
+void SimulationThread::Run()
+{
+	using Clock = std::chrono::steady_clock;
+	auto nextTick = Clock::now();
+	while (!stopping)
+	{
+		bool stepped;
+		{
+			std::unique_lock<std::mutex> l(simMutex);
+			// Let the main thread in first if it is waiting, otherwise this thread could take the lock
+			// again and again before it gets a chance
+			mainDone.wait(l, [this]() { return !mainWaiting || stopping; });
+			if (stopping)
+				break;
+			stepped = !sim->sys_pause || sim->framerender;
+			sim->BeforeSim();
+			if (stepped)
+			{
+				sim->UpdateParticles(0, NPART);
+				sim->AfterSim();
+			}
+		}
+		// While paused, only keep up the per-frame upkeep of BeforeSim, at no more than 60 times a second
+		float rate = stepped ? tickRate : (tickRate > 0 ? std::min(tickRate, 60.0f) : 60.0f);
+		if (rate > 0)
+		{
+			auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(1.0f / rate));
+			auto now = Clock::now();
+			nextTick = std::max(nextTick + period, now - period);
+			std::this_thread::sleep_until(nextTick);
+		}
+		else
+		{
+			nextTick = Clock::now();
+		}
+	}
+}
+
+Simulation *SimulationThread::TakeSnapshot()
+{
+	if (!Running())
+		return nullptr;
+	CopySnapshot();
+	return snapshot.get();
+}
+
+void SimulationThread::CopySnapshot()
+{
+	auto &to = *snapshot;
+	auto &from = *sim;
+	if (elementsChanged)
+	{
+		to.elements = from.elements;
+		elementsChanged = false;
+	}
+	to.currentTick = from.currentTick;
+	std::copy(from.parts, from.parts + from.parts_lastActiveIndex + 1, to.parts);
+	for (int i = from.parts_lastActiveIndex + 1; i <= snapshotLastActiveIndex; i++)
+		to.parts[i].type = 0;
+	to.parts_lastActiveIndex = snapshotLastActiveIndex = from.parts_lastActiveIndex;
+	to.partCoords.valid = false;
+	std::copy(std::begin(from.activeParts), std::end(from.activeParts), to.activeParts);
+	std::copy(&from.pmap[0][0], &from.pmap[0][0] + YRES*XRES, &to.pmap[0][0]);
+	std::copy(&from.photons[0][0], &from.photons[0][0] + YRES*XRES, &to.photons[0][0]);
+	std::copy(&from.bmap[0][0], &from.bmap[0][0] + (YRES/CELL)*(XRES/CELL), &to.bmap[0][0]);
+	std::copy(&from.emap[0][0], &from.emap[0][0] + (YRES/CELL)*(XRES/CELL), &to.emap[0][0]);
+	std::copy(&from.pv[0][0], &from.pv[0][0] + (YRES/CELL)*(XRES/CELL), &to.pv[0][0]);
+	std::copy(&from.hv[0][0], &from.hv[0][0] + (YRES/CELL)*(XRES/CELL), &to.hv[0][0]);
+	std::copy(&from.vx[0][0], &from.vx[0][0] + (YRES/CELL)*(XRES/CELL), &to.vx[0][0]);
+	std::copy(&from.vy[0][0], &from.vy[0][0] + (YRES/CELL)*(XRES/CELL), &to.vy[0][0]);
+	std::copy(from.gravx, from.gravx + (YRES/CELL)*(XRES/CELL), to.gravx);
+	std::copy(from.gravy, from.gravy + (YRES/CELL)*(XRES/CELL), to.gravy);
+	std::copy(from.gravp, from.gravp + (YRES/CELL)*(XRES/CELL), to.gravp);
+	std::copy(from.gravmap, from.gravmap + (YRES/CELL)*(XRES/CELL), to.gravmap);
+	std::copy(from.grav->gravmask, from.grav->gravmask + (YRES/CELL)*(XRES/CELL), to.grav->gravmask);
+	to.signs = from.signs;
+	to.player = from.player;
+	to.player2 = from.player2;
+	std::copy(std::begin(from.fighters), std::end(from.fighters), to.fighters);
+	to.fighcount = from.fighcount;
+	to.emp_decor = from.emp_decor;
+	to.aheat_enable = from.aheat_enable;
+	to.sys_pause = from.sys_pause;
+}
+
+bool SimulationThread::DrawNeedsLock() const
+{
+	if (!Running())
+		return true;
+	auto &builtinElements = GetElements();
+	for (int t = 0; t < PT_NUM; t++)
+	{
+		// Lua is the only thing that replaces element functions
+		auto &element = sim->elements[t];
+		auto &builtin = builtinElements[t];
+		if (element.Update != builtin.Update || element.Graphics != builtin.Graphics || element.Create != builtin.Create ||
+		    element.CreateAllowed != builtin.CreateAllowed || element.ChangeType != builtin.ChangeType || element.CtypeDraw != builtin.CtypeDraw)
+			return true;
+	}
+	return false;
+}
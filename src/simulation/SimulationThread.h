@@ -0,0 +1,70 @@
+#ifndef SIMULATIONTHREAD_H_
+#define SIMULATIONTHREAD_H_
+#include "Config.h"
+#include "common/Singleton.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+class Simulation;
+
+// Runs the simulation on a thread of its own at a set number of ticks per second, or as fast as it
+// can, so that it is not held back by drawing. The main thread holds Lock() whenever it may touch the
+// simulation, that is, while it handles input and ticks the interface, and draws from a copy taken
+// with TakeSnapshot() at the end of that. Ticks that happen between two drawn frames are never drawn.
+class SimulationThread : public Singleton<SimulationThread>
+{
+	Simulation *sim = nullptr;
+	std::unique_ptr<Simulation> snapshot;
+	int snapshotLastActiveIndex = -1;
+	bool elementsChanged = true;
+	float tickRate = 0;
+	std::thread thread;
+	std::mutex simMutex;
+	std::unique_lock<std::mutex> mainLock;
+	int lockDepth = 0;
+	std::atomic<bool> mainWaiting;
+	std::atomic<bool> stopping;
+	std::condition_variable mainDone;
+
+	void Run();
+	void CopySnapshot();
+
+public:
+	SimulationThread();
+	~SimulationThread();
+
+	// tickRate is in ticks per second, 0 for no limit. Call from the main thread.
+	void Start(Simulation *newSim, float newTickRate);
+	void Stop();
+	bool Running() const
+	{
+		return thread.joinable();
+	}
+
+	// Keeps the simulation thread out until the matching Unlock. Main thread only, may be nested.
+	void Lock();
+	void Unlock();
+
+	// Copies what Renderer reads from the simulation into a Simulation of its own, and returns that. Call
+	// with Lock() held. Returns nullptr if the thread is not running.
+	Simulation *TakeSnapshot();
+	// Element properties are only copied to the snapshot again after this has been called. Call with Lock() held
+	// whenever anything changes elements, as for SaveRenderer::Flush.
+	void ElementsChanged()
+	{
+		elementsChanged = true;
+	}
+	// The Simulation TakeSnapshot copies to, for Renderer to draw from. Valid once the thread has been started.
+	Simulation *GetSnapshot()
+	{
+		return snapshot.get();
+	}
+	// Lua element functions may be called on the simulation thread, and a Lua state can only be used by one
+	// thread at a time. As drawing can call into Lua too, it has to be done with Lock() held if there are any.
+	bool DrawNeedsLock() const;
+};
+
+#endif /* SIMULATIONTHREAD_H_ */
@@ -119,6 +119,18 @@ static int update(UPDATE_FUNC_ARGS)
 							yCopyTo = yCurrent + yStep*copySpaces;
 							break;
 						}
+
+						// Empty pixels only count towards the length unless they are what ends the line, so jump
+						// to just before the next pixel that may have something in it, stopping short of the length
+						if ((localCopyLength || ctype) && !pmap[yCurrent][xCurrent] && !sim->photons[yCurrent][xCurrent])
+						{
+							int skip = sim->StepsToOccupied(xCurrent + xStep, yCurrent + yStep, xStep, yStep);
+							if (partsRemaining > 0)
+								skip = std::min(skip, partsRemaining - 1);
+							xCurrent += xStep * skip;
+							yCurrent += yStep * skip;
+							partsRemaining -= skip;
+						}
 					}
 
 					// now, actually copy the particles
@@ -151,7 +163,19 @@ static int update(UPDATE_FUNC_ARGS)
 						else if (type)
 							p = sim->create_part(-1, xCopyTo, yCopyTo, type);
 						else
+						{
+							// Nothing to copy, and nothing to overwrite either, until the next pixel that may have something in it
+							if (!overwrite)
+							{
+								int skip = std::min(sim->StepsToOccupied(xCurrent + xStep, yCurrent + yStep, xStep, yStep), partsRemaining - 1);
+								xCurrent += xStep * skip;
+								yCurrent += yStep * skip;
+								xCopyTo += xStep * skip;
+								yCopyTo += yStep * skip;
+								partsRemaining -= skip;
+							}
 							continue;
+						}
 
 						// if new particle was created successfully
 						if (p >= 0)
@@ -134,44 +134,25 @@ int Element_ETRD_nearestSparkablePart(Simulation *sim, int targetId)
 				}
 			}
 		}
-		// If neighbor search didn't find a suitable particle, search all particles
+		// If neighbor search didn't find a suitable particle, search all of them
 		if (foundI < 0)
 		{
-			for (int i = 0; i <= sim->parts_lastActiveIndex; i++)
-			{
-				if (parts[i].type == PT_ETRD && !parts[i].life)
-				{
-					ui::Point checkPos = ui::Point(int(parts[i].x)-targetPos.X, int(parts[i].y)-targetPos.Y);
-					int checkDistance = std::abs(checkPos.X) + std::abs(checkPos.Y);
-					if (checkDistance < foundDistance && i != targetId)
-					{
-						foundDistance = checkDistance;
-						foundI = i;
-					}
-				}
-			}
+			foundI = sim->PartGrid(PT_ETRD).Nearest(parts, targetPos.X, targetPos.Y, [parts, targetId](int i) {
+				return parts[i].type == PT_ETRD && !parts[i].life && i != targetId;
+			});
 		}
 	}
 	else
 	{
 		// Recalculate countLife0, and search for the closest suitable particle
-		int countLife0 = 0;
-		for (int i = 0; i <= sim->parts_lastActiveIndex; i++)
-		{
-			if (parts[i].type == PT_ETRD && !parts[i].life)
-			{
-				countLife0++;
-				ui::Point checkPos = ui::Point(int(parts[i].x)-targetPos.X, int(parts[i].y)-targetPos.Y);
-				int checkDistance = std::abs(checkPos.X) + std::abs(checkPos.Y);
-				if (checkDistance < foundDistance && i != targetId)
-				{
-					foundDistance = checkDistance;
-					foundI = i;
-				}
-			}
-		}
-		sim->etrd_life0_count = countLife0;
+		auto &grid = sim->PartGrid(PT_ETRD);
+		sim->etrd_life0_count = grid.Count(parts, [parts](int i) {
+			return parts[i].type == PT_ETRD && !parts[i].life;
+		});
 		sim->etrd_count_valid = true;
+		foundI = grid.Nearest(parts, targetPos.X, targetPos.Y, [parts, targetId](int i) {
+			return parts[i].type == PT_ETRD && !parts[i].life && i != targetId;
+		});
 	}
 	return foundI;
 }
@@ -119,7 +119,13 @@ static int update(UPDATE_FUNC_ARGS)
 					if (!rr && !ignoreEnergy)
 						rr = sim->photons[yCurrent][xCurrent];
 					if (!rr)
+					{
+						// Jump to just before the next pixel that may have something in it
+						int skip = sim->StepsToOccupied(xCurrent + xStep, yCurrent + yStep, xStep, yStep);
+						xCurrent += xStep * skip;
+						yCurrent += yStep * skip;
 						continue;
+					}
 
 					// If ctype isn't set (no type restriction), or ctype matches what we found
 					// Can use .tmp2 flag to invert this
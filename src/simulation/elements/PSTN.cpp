@@ -307,7 +307,9 @@ static int MoveStack(Simulation * sim, int stackX, int stackY, int directionX, i
 				sim->pmap[srcY][srcX] = 0;
 				sim->parts[jP].x = float(destX);
 				sim->parts[jP].y = float(destY);
+				sim->PartGridMove(jP);
 				sim->pmap[destY][destX] = PMAP(jP, sim->parts[jP].type);
+				sim->occupiedPixels.Mark(destX, destY);
 			}
 			return amount;
 		}
@@ -330,7 +332,9 @@ static int MoveStack(Simulation * sim, int stackX, int stackY, int directionX, i
 				sim->pmap[srcY][srcX] = 0;
 				sim->parts[jP].x = float(destX);
 				sim->parts[jP].y = float(destY);
+				sim->PartGridMove(jP);
 				sim->pmap[destY][destX] = PMAP(jP, sim->parts[jP].type);
+				sim->occupiedPixels.Mark(destX, destY);
 			}
 			return possibleMovement;
 		}
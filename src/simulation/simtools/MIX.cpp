@@ -48,6 +48,10 @@ static int perform(Simulation * sim, Particle * cpart, int x, int y, int brushX,
 	sim->pmap[newY][newX] = thisPart;
 	sim->parts[ID(thisPart)].x = float(newX);
 	sim->parts[ID(thisPart)].y = float(newY);
+	sim->UpdatePartCoords(ID(thatPart));
+	sim->UpdatePartCoords(ID(thisPart));
+	sim->PartGridMove(ID(thatPart));
+	sim->PartGridMove(ID(thisPart));
 
 	return 1;
 }
@@ -11,7 +11,7 @@ class AbandonableTask : public Task
 	
 public:
 	void Finish();
-	void Abandon();
+	virtual void Abandon();
 	AbandonableTask();
 	virtual ~AbandonableTask();
 